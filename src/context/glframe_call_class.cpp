@@ -0,0 +1,84 @@
+/**************************************************************************
+ *
+ * Copyright 2019 Intel Corporation
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * Authors:
+ *   Mark Janes <mark.a.janes@intel.com>
+ **************************************************************************/
+
+#include "glframe_call_class.hpp"
+
+#include <string.h>
+
+using glretrace::CallClass;
+using glretrace::SignatureTable;
+
+namespace {
+
+bool
+starts_with(const char *name, const char *prefix) {
+  return strncmp(name, prefix, strlen(prefix)) == 0;
+}
+
+// Calls are classified on the retrace thread and on the threads of
+// the threaded parser, each with signatures of its own parser.  A
+// table for each thread needs no locking.
+thread_local SignatureTable<uint32_t> call_classes;
+
+}  // namespace
+
+uint32_t
+CallClass::get(const trace::Call &call) {
+  const uint32_t *flags = call_classes.find(call.sig);
+  if (flags)
+    return *flags;
+  return call_classes.insert(call.sig, classify(call));
+}
+
+uint32_t
+CallClass::classify(const trace::Call &call) {
+  const char *name = call.sig->name;
+  uint32_t flags = NONE;
+  if ((strcmp("glDispatchCompute", name) == 0) ||
+      (strcmp("glDispatchComputeIndirect", name) == 0))
+    flags |= COMPUTE;
+  if (starts_with(name, "glClearBuffer") ||
+      starts_with(name, "glClearNamedFramebuffer") ||
+      (strcmp("glClear", name) == 0))
+    flags |= CLEAR;
+  if ((call.flags & trace::CALL_FLAG_RENDER) || (flags & (COMPUTE | CLEAR)))
+    flags |= RENDER;
+  // apitrace considers glFrameTerminatorGREMEDY to be a terminator,
+  // but this always follows swapbuffers when it exists.
+  if ((call.flags & trace::CALL_FLAG_END_FRAME) &&
+      !starts_with(name, "glFrameTerminatorGREMEDY"))
+    flags |= END_FRAME;
+  if (starts_with(name, "glXMakeCurrent") ||
+      starts_with(name, "glXMakeContextCurrent"))
+    flags |= CHANGES_CONTEXT;
+  if (starts_with(name, "glDebugMessageControl") ||
+      starts_with(name, "glDebugMessageCallback"))
+    flags |= DEBUG_MESSAGE;
+  if ((strcmp("glEnable", name) == 0) || (strcmp("glDisable", name) == 0))
+    flags |= TOGGLES_CAPABILITY;
+  return flags;
+}
@@ -0,0 +1,103 @@
+/**************************************************************************
+ *
+ * Copyright 2019 Intel Corporation
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * Authors:
+ *   Mark Janes <mark.a.janes@intel.com>
+ **************************************************************************/
+
+#ifndef _GLFRAME_CALL_CLASS_HPP_
+#define _GLFRAME_CALL_CLASS_HPP_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "trace_model.hpp"
+
+namespace glretrace {
+
+// Caches a value for each function signature, indexed by signature
+// id.  Entries remember their signature, so a table remains valid
+// when calls from a different parser (eg a frame pack) are presented.
+// Tables are not thread safe.
+template <class T>
+class SignatureTable {
+ public:
+  // returns NULL if the signature has not been stored
+  T *find(const trace::FunctionSig *sig) {
+    if (sig->id >= m_entries.size())
+      return NULL;
+    Entry &e = m_entries[sig->id];
+    if (e.sig != sig || e.name != sig->name)
+      return NULL;
+    return &e.value;
+  }
+  T &insert(const trace::FunctionSig *sig, const T &value) {
+    if (sig->id >= m_entries.size())
+      m_entries.resize(sig->id + 1);
+    Entry &e = m_entries[sig->id];
+    e.sig = sig;
+    e.name = sig->name;
+    e.value = value;
+    return e.value;
+  }
+  void clear() { m_entries.clear(); }
+
+ private:
+  struct Entry {
+    Entry() : sig(NULL), name(NULL), value() {}
+    const trace::FunctionSig *sig;
+    const char *name;
+    T value;
+  };
+  std::vector<Entry> m_entries;
+};
+
+// Classifies calls by signature, so that the per-call checks in the
+// retrace loops do not compare call names.  Classifications are
+// cached separately by each thread which calls get.
+class CallClass {
+ public:
+  enum Flags {
+    NONE = 0,
+    // draws, compute dispatches and clears
+    RENDER = 1 << 0,
+    COMPUTE = 1 << 1,
+    CLEAR = 1 << 2,
+    // swapbuffers, excluding glFrameTerminatorGREMEDY
+    END_FRAME = 1 << 3,
+    CHANGES_CONTEXT = 1 << 4,
+    // glDebugMessageControl and glDebugMessageCallback
+    DEBUG_MESSAGE = 1 << 5,
+    // glEnable and glDisable
+    TOGGLES_CAPABILITY = 1 << 6,
+  };
+  static uint32_t get(const trace::Call &call);
+
+ private:
+  static uint32_t classify(const trace::Call &call);
+};
+
+}  // namespace glretrace
+
+#endif  // _GLFRAME_CALL_CLASS_HPP_
@@ -31,9 +31,11 @@
 #include <GL/glext.h>
 
 #include "trace_model.hpp"
+#include "glframe_call_class.hpp"
 #include "glframe_retrace_render.hpp"
 #include "glretrace.hpp"
 
+using glretrace::CallClass;
 using glretrace::ThreadContext;
 
 extern retrace::Retracer retracer;
@@ -67,12 +69,7 @@ ThreadContext::track(trace::Call *c,
 
 bool
 ThreadContext::changesContext(const trace::Call &call) {
-  if (strncmp(call.name(), "glXMakeCurrent", strlen("glXMakeCurrent")) == 0)
-    return true;
-  if (strncmp(call.name(), "glXMakeContextCurrent",
-              strlen("glXMakeContextCurrent")) == 0)
-    return true;
-  return false;
+  return CallClass::get(call) & CallClass::CHANGES_CONTEXT;
 }
 
 bool
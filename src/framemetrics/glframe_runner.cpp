@@ -35,6 +35,7 @@
 #include <string>
 #include <vector>
 
+#include "glframe_gl_errors.hpp"
 #include "glframe_glhelper.hpp"
 #include "glframe_retrace_render.hpp"
 #include "glretrace.hpp"
@@ -47,6 +48,7 @@ using metrics::PerfMetricDescriptor;
 using metrics::PerfMetricGroup;
 using metrics::PerfMetrics;
 using glretrace::FrameRunner;
+using glretrace::GlErrors;
 using glretrace::GlFunctions;
 using glretrace::ERR;
 
@@ -176,10 +178,10 @@ void
 FrameRunner::advanceToFrame(unsigned f) {
   trace::Call *call;
   while ((call = parser->parse_call()) && m_current_frame < f) {
-    assert(!GlFunctions::GetError());
+    GlErrors::begin();
     retracer.retrace(*call);
     /* drain any errors from trace: */
-    while (GlFunctions::GetError()) {}
+    GlErrors::end(*call);
     bool save_call = false;
     const bool frame_boundary = call->flags & trace::CALL_FLAG_END_FRAME;
     if (ThreadContext::changesContext(*call)) {
@@ -235,10 +237,10 @@ FrameRunner::run(unsigned end_frame) {
         }
       }
 
-    assert(!GlFunctions::GetError());
+    GlErrors::begin();
     retracer.retrace(*call);
     /* drain any errors from trace: */
-    while (GlFunctions::GetError()) {}
+    GlErrors::end(*call);
 
     if (RetraceRender::isRender(*call) && m_interval == kPerRender) {
       ++m_current_event;
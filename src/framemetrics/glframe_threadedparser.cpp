@@ -26,10 +26,12 @@
 //  **********************************************************************/
 
 #include "glframe_threadedparser.hpp"
+#include "glframe_frame_index.hpp"
 #include "glframe_thread.hpp"
 #include "glframe_os.hpp"
 #include "glframe_retrace_render.hpp"
 
+using glretrace::FrameIndex;
 using glretrace::ThreadParser;
 using glretrace::Semaphore;
 using trace::Call;
@@ -39,7 +41,7 @@ using trace::ParseBookmark;
 namespace glretrace {
 class ThreadParser : public Thread {
  public:
-  ThreadParser(const char *filename, unsigned max_frame);
+  explicit ThreadParser(const char *filename);
   void parse_range(const ThreadedParser::ParseRange &range);
   Call *parse_call(void);
   void clear();
@@ -49,11 +51,12 @@ class ThreadParser : public Thread {
 
   ~ThreadParser();
  private:
-  const unsigned m_max_frame;
   std::vector<Call *> m_parsed_calls;
   std::vector<Call *>::iterator m_current_call;
   Parser m_parser;
   ThreadedParser::ParseRange m_range;
+  // calls before this have been read by m_parser
+  unsigned m_next_call_no;
   std::mutex m_mutex;
   Semaphore m_reader_sem, m_consumer_sem;
   bool m_running;
@@ -117,23 +120,17 @@ bool
 ThreadedParser::open(const char *filename) {
   if (!m_parser.open(filename))
     return false;
-  ParseBookmark begin, end;
-  m_parser.getBookmark(begin);
-  std::cout << "scanning for frames\n";
-  while (auto call = m_parser.scan_call()) {
-    if (RetraceRender::endsFrame(*call)) {
-      m_parser.getBookmark(end);
-      m_frames.emplace(ParseRange(begin, end));
-      if (0 == (m_frames.size() % 100))
-        std::cout << "frame: " << m_frames.size() << std::endl;
-      begin = end;
-      if (m_frames.size() > m_max_frame)
-        break;
-    }
-    delete call;
+  FrameIndex index;
+  if (!index.open(filename))
+    return false;
+  for (uint32_t f = 0; f < index.frameCount(); ++f) {
+    const FrameIndex::Frame &frame = index.frame(f);
+    m_frames.emplace(ParseRange(frame.begin, frame.end));
+    if (m_frames.size() > m_max_frame)
+      break;
   }
   for (int i = 0; i < 4; ++i) {
-    ThreadParser *p = new ThreadParser(filename, m_max_frame);
+    ThreadParser *p = new ThreadParser(filename);
     m_threads.push_back(p);
     p->Start();
     p->parse_range(m_frames.front());
@@ -160,10 +157,10 @@ ThreadedParser::getVersion(void) const { return m_parser.getVersion(); }
 const trace::Properties &
 ThreadedParser::getProperties(void) const { return m_parser.getProperties(); }
 
-ThreadParser::ThreadParser(const char *filename, unsigned max_frame)
+ThreadParser::ThreadParser(const char *filename)
     : Thread("threaded parser"),
-      m_max_frame(max_frame),
       m_range(ParseBookmark(), ParseBookmark()),
+      m_next_call_no(0),
       m_running(false) {
   m_parser.open(filename);
   m_current_call = m_parsed_calls.begin();
@@ -195,21 +192,23 @@ ThreadParser::clear() {
 void
 ThreadParser::Run() {
   m_running = true;
-  unsigned frame = 0;
-  while (auto call = m_parser.scan_call()) {
-    if (RetraceRender::endsFrame(*call)) {
-      if (frame++ > m_max_frame)
-        break;
-    }
-    delete call;
-  }
-
   while(m_running) {
     {
       m_reader_sem.wait();
       std::lock_guard<std::mutex> l(m_mutex);
       if (!m_running)
         return;
+      // apitrace writes each signature once, where it is first used,
+      // so the parser must read the calls preceding the range before
+      // seeking to its bookmark.  Frames parsed by the other threads
+      // are scanned, which is much faster than parsing them.
+      while (m_next_call_no < m_range.begin.next_call_no) {
+        Call *call = m_parser.scan_call();
+        if (!call)
+          break;
+        m_next_call_no = call->no + 1;
+        delete call;
+      }
       m_parser.setBookmark(m_range.begin);
       int call_id = m_range.begin.next_call_no;
       const int next_frame_call_id = m_range.end.next_call_no;
@@ -217,6 +216,8 @@ ThreadParser::Run() {
         ++call_id;
         m_parsed_calls.push_back(m_parser.parse_call());
       }
+      if (m_next_call_no < m_range.end.next_call_no)
+        m_next_call_no = m_range.end.next_call_no;
       m_current_call = m_parsed_calls.begin();
       m_consumer_sem.post();
     }
@@ -30,10 +30,12 @@
 #include <string>
 #include <vector>
 
+#include "glframe_frame_index.hpp"
 #include "glframe_glhelper.hpp"
 #include "glframe_loop.hpp"
 #include "glframe_utils.hpp"
 
+using glretrace::FrameIndex;
 using glretrace::FrameLoop;
 
 int main(int argc, char *argv[]) {
@@ -85,6 +87,16 @@ int main(int argc, char *argv[]) {
     printf("%s", usage);
     return -1;
   }
+  FrameIndex index;
+  if (index.open(frame_file)) {
+    for (auto f : frames) {
+      if (f > index.frameCount()) {
+        printf("ERROR: trace contains %u frames, frame %u requested.\n",
+               index.frameCount(), f);
+        return -1;
+      }
+    }
+  }
   glretrace::GlFunctions::Init();
   FrameLoop loop(frame_file, out_file, loop_count);
   for (auto f : frames) {
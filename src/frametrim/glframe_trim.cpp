@@ -0,0 +1,716 @@
+// Copyright (C) Intel Corp.  2019.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#include "glframe_trim.hpp"
+
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <string.h>
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "glframe_frame_index.hpp"
+#include "glframe_retrace_render.hpp"
+#include "glframe_thread_context.hpp"
+#include "trace_model.hpp"
+#include "trace_parser.hpp"
+#include "trace_writer.hpp"
+
+using glretrace::FrameIndex;
+using glretrace::FrameTrim;
+using glretrace::RetraceRender;
+using glretrace::ThreadContext;
+using trace::Call;
+
+namespace {
+
+bool
+starts_with(const char *name, const char *prefix) {
+  return strncmp(name, prefix, strlen(prefix)) == 0;
+}
+
+bool
+starts_with_any(const char *name, const char *const *prefixes) {
+  for (; *prefixes; ++prefixes)
+    if (starts_with(name, *prefixes))
+      return true;
+  return false;
+}
+
+// object names are traced as integers.  Enums (eg the argument to
+// glActiveTexture) are not object names.
+bool
+object_name(const trace::Value *value, unsigned *name) {
+  if (!value || dynamic_cast<const trace::Enum *>(value))
+    return false;
+  if (!dynamic_cast<const trace::UInt *>(value) &&
+      !dynamic_cast<const trace::SInt *>(value))
+    return false;
+  *name = value->toUInt();
+  return true;
+}
+
+unsigned
+texture_target(unsigned target) {
+  // cube map faces are modified through the cube map binding
+  if (target >= GL_TEXTURE_CUBE_MAP_POSITIVE_X &&
+      target <= GL_TEXTURE_CUBE_MAP_NEGATIVE_Z)
+    return GL_TEXTURE_CUBE_MAP;
+  return target;
+}
+
+const char *const texture_modifiers[] = {
+  "glTexImage", "glTexSubImage", "glTexStorage", "glTexParameter",
+  "glTexBuffer", "glCompressedTex", "glCopyTex", "glGenerateMipmap",
+  NULL };
+const char *const buffer_modifiers[] = {
+  "glBufferData", "glBufferSubData", "glBufferStorage", "glMapBuffer",
+  "glUnmapBuffer", "glFlushMappedBufferRange", "glClearBufferData",
+  "glClearBufferSubData", NULL };
+const char *const framebuffer_modifiers[] = {
+  "glFramebufferTexture", "glFramebufferRenderbuffer",
+  "glFramebufferParameter", NULL };
+const char *const renderbuffer_modifiers[] = {
+  "glRenderbufferStorage", NULL };
+const char *const vertex_array_modifiers[] = {
+  "glEnableVertexAttribArray", "glDisableVertexAttribArray",
+  "glVertexAttribDivisor", "glVertexAttribBinding", "glVertexAttribFormat",
+  "glVertexAttribIFormat", "glVertexAttribLFormat", "glBindVertexBuffer",
+  "glVertexBindingDivisor", NULL };
+const char *const prefix_skips[] = {
+  "glBeginQuery", "glEndQuery", "glQueryCounter", "glGenQueries",
+  "glDeleteQueries", "glBeginConditionalRender", "glEndConditionalRender",
+  NULL };
+
+}  // namespace
+
+FrameTrim::FrameTrim() : m_current_thread(0),
+                         m_current(&m_contexts[0]),
+                         m_frame_end(0),
+                         m_has_frame_end(false) {
+  const char *gen[] = {
+    "glGenTextures", "glGenBuffers", "glGenBuffersARB", "glGenFramebuffers",
+    "glGenFramebuffersEXT", "glGenRenderbuffers", "glGenRenderbuffersEXT",
+    "glGenVertexArrays", "glGenSamplers", "glCreateTextures",
+    "glCreateBuffers", "glCreateFramebuffers", "glCreateRenderbuffers",
+    "glCreateVertexArrays", "glCreateSamplers" };
+  for (auto name : gen)
+    m_handlers[name] = &FrameTrim::trackGen;
+
+  const char *create[] = {
+    "glCreateProgram", "glCreateProgramObjectARB", "glCreateShader",
+    "glCreateShaderObjectARB", "glCreateShaderProgramv" };
+  for (auto name : create)
+    m_handlers[name] = &FrameTrim::trackCreate;
+
+  const char *del[] = {
+    "glDeleteTextures", "glDeleteBuffers", "glDeleteBuffersARB",
+    "glDeleteFramebuffers", "glDeleteFramebuffersEXT",
+    "glDeleteRenderbuffers", "glDeleteRenderbuffersEXT",
+    "glDeleteVertexArrays", "glDeleteSamplers", "glDeleteProgram",
+    "glDeleteShader" };
+  for (auto name : del)
+    m_handlers[name] = &FrameTrim::trackDelete;
+
+  const char *bind[] = {
+    "glActiveTexture", "glActiveTextureARB", "glBindTexture",
+    "glBindBuffer", "glBindBufferARB", "glBindBufferBase",
+    "glBindBufferRange", "glBindFramebuffer", "glBindFramebufferEXT",
+    "glBindRenderbuffer", "glBindRenderbufferEXT", "glBindVertexArray",
+    "glUseProgram", "glUseProgramObjectARB", "glBindSampler",
+    "glBindTextureUnit" };
+  for (auto name : bind)
+    m_handlers[name] = &FrameTrim::trackBind;
+
+  m_handlers["memcpy"] = &FrameTrim::trackMemcpy;
+}
+
+FrameTrim::~FrameTrim() {}
+
+void
+FrameTrim::trackPrefix(const Call &call) {
+  const char *name = call.sig->name;
+  if (call.thread_id != m_current_thread) {
+    m_current_thread = call.thread_id;
+    m_current = &m_contexts[m_thread_contexts[m_current_thread]];
+  }
+  if (ThreadContext::changesContext(call))
+    trackContext(call);
+  if (RetraceRender::endsFrame(call)) {
+    // only the terminator preceding the frame is retained
+    m_frame_end = call.no;
+    m_has_frame_end = true;
+    return;
+  }
+  if (starts_with_any(name, prefix_skips))
+    return;
+  if (RetraceRender::isRender(call) &&
+      !starts_with_any(name, buffer_modifiers))
+    return;
+
+  auto handler = m_handlers.find(name);
+  if (handler != m_handlers.end()) {
+    (this->*handler->second)(call);
+    return;
+  }
+  if ((starts_with(name, "glUniform") &&
+       !starts_with(name, "glUniformBlockBinding") &&
+       !starts_with(name, "glUniformSubroutines")) ||
+      starts_with(name, "glProgramUniform")) {
+    trackUniform(call);
+    return;
+  }
+  if ((starts_with(name, "glVertexAttrib") && strstr(name, "Pointer")) ||
+      starts_with_any(name, vertex_array_modifiers)) {
+    trackVertexAttrib(call);
+    return;
+  }
+  trackGeneric(call);
+}
+
+void
+FrameTrim::trackFrame(const Call &call) {
+  std::vector<ObjectKey> objects;
+  referencedObjects(call, &objects);
+  for (auto key : objects) {
+    auto live = m_live.find(key);
+    if (live != m_live.end())
+      m_referenced.insert(live->second);
+  }
+}
+
+void
+FrameTrim::requiredCalls(std::set<unsigned> *calls) const {
+  std::vector<ObjectPtr> pending(m_referenced.begin(), m_referenced.end());
+  pending.insert(pending.end(), m_global_deps.begin(), m_global_deps.end());
+
+  // objects bound at the start of the frame are referenced by it, and
+  // the last bind to each binding point of each context establishes
+  // the bound state.  The retained context switches precede the binds.
+  for (const auto &context : m_contexts) {
+    for (auto binding : context.second.bindings) {
+      const ObjectType type = binding.first.first;
+      const unsigned point = binding.first.second;
+      if (type == BUFFER && (point & 0xffff) == GL_ELEMENT_ARRAY_BUFFER &&
+          (point >> 16) != 0)
+        // element array bindings belong to the vertex array
+        continue;
+      if (binding.second.call_no)
+        calls->insert(binding.second.call_no);
+      auto live = m_live.find(ObjectKey(type, binding.second.name));
+      if (live != m_live.end())
+        pending.push_back(live->second);
+    }
+  }
+
+  std::set<ObjectPtr> visited;
+  while (!pending.empty()) {
+    ObjectPtr object = pending.back();
+    pending.pop_back();
+    if (!visited.insert(object).second)
+      continue;
+    calls->insert(object->calls.begin(), object->calls.end());
+    for (auto uniform : object->uniforms)
+      calls->insert(uniform.second);
+    pending.insert(pending.end(), object->deps.begin(), object->deps.end());
+  }
+
+  calls->insert(m_global_calls.begin(), m_global_calls.end());
+  if (m_has_frame_end)
+    calls->insert(m_frame_end);
+}
+
+void
+FrameTrim::trackContext(const Call &call) {
+  // the context is the "ctx" argument of glXMakeCurrent and
+  // glXMakeContextCurrent.  Releasing the context selects context 0.
+  uint64_t context = 0;
+  for (unsigned i = 0; i < call.sig->num_args && i < call.args.size(); ++i) {
+    if (strcmp(call.sig->arg_names[i], "ctx") == 0 && call.args[i].value)
+      context = call.args[i].value->toUIntPtr();
+  }
+  m_thread_contexts[m_current_thread] = context;
+  m_current = &m_contexts[context];
+}
+
+void
+FrameTrim::trackGen(const Call &call) {
+  ObjectType type;
+  if (!objectType(call.sig->name, &type))
+    return;
+  // generated names are the last argument of glGen* and glCreate*
+  const trace::Array *names = NULL;
+  if (!call.args.empty() && call.args.back().value)
+    names = call.args.back().value->toArray();
+  if (!names)
+    return;
+  for (auto value : names->values) {
+    unsigned name;
+    if (!object_name(value, &name))
+      continue;
+    ObjectPtr object(new Object);
+    object->calls.push_back(call.no);
+    m_live[ObjectKey(type, name)] = object;
+  }
+}
+
+void
+FrameTrim::trackCreate(const Call &call) {
+  ObjectType type;
+  unsigned name;
+  if (!objectType(call.sig->name, &type) || !object_name(call.ret, &name))
+    return;
+  ObjectPtr object(new Object);
+  object->calls.push_back(call.no);
+  m_live[ObjectKey(type, name)] = object;
+}
+
+void
+FrameTrim::trackDelete(const Call &call) {
+  // frameretrace never deletes shaders, so that they can be re-used
+  // when editing programs.
+  if (strcmp(call.sig->name, "glDeleteShader") == 0)
+    return;
+
+  ObjectType type;
+  if (!objectType(call.sig->name, &type) || call.args.empty())
+    return;
+  std::vector<unsigned> names;
+  const trace::Value *arg = call.args.back().value;
+  if (!arg)
+    return;
+  if (const trace::Array *a = arg->toArray()) {
+    for (auto value : a->values) {
+      unsigned name;
+      if (object_name(value, &name))
+        names.push_back(name);
+    }
+  } else {
+    unsigned name;
+    if (object_name(arg, &name))
+      names.push_back(name);
+  }
+
+  for (auto name : names) {
+    const ObjectKey key(type, name);
+    auto live = m_live.find(key);
+    if (live == m_live.end())
+      continue;
+    // the deletion is retained only if another object still depends
+    // on the deleted one.
+    live->second->calls.push_back(call.no);
+    m_live.erase(live);
+    // deleting a bound object reverts the binding to 0
+    for (auto &binding : m_current->bindings)
+      if (binding.first.first == type && binding.second.name == name)
+        binding.second = Binding();
+  }
+}
+
+void
+FrameTrim::trackBind(const Call &call) {
+  const char *name = call.sig->name;
+  if (starts_with(name, "glActiveTexture")) {
+    m_current->active_texture = call.args[0].value->toUInt() - GL_TEXTURE0;
+    m_global_calls.push_back(call.no);
+    return;
+  }
+
+  ObjectType type;
+  if (!objectType(name, &type))
+    return;
+
+  std::vector<BindingPoint> points;
+  unsigned object_name_arg;
+  if (type == PROGRAM || type == VERTEX_ARRAY) {
+    points.push_back(bindingPoint(type, 0));
+    object_name_arg = 0;
+  } else if (type == SAMPLER) {
+    points.push_back(bindingPoint(type, 0, call.args[0].value->toUInt()));
+    object_name_arg = 1;
+  } else if (strcmp(name, "glBindTextureUnit") == 0) {
+    points.push_back(bindingPoint(type, 0, call.args[0].value->toUInt()));
+    object_name_arg = 1;
+  } else if (starts_with(name, "glBindBufferBase") ||
+             starts_with(name, "glBindBufferRange")) {
+    const unsigned target = call.args[0].value->toUInt();
+    points.push_back(bindingPoint(type, target));
+    points.push_back(bindingPoint(type, target,
+                                  call.args[1].value->toUInt()));
+    object_name_arg = 2;
+  } else if (type == FRAMEBUFFER &&
+             call.args[0].value->toUInt() == GL_FRAMEBUFFER) {
+    points.push_back(bindingPoint(type, GL_DRAW_FRAMEBUFFER));
+    points.push_back(bindingPoint(type, GL_READ_FRAMEBUFFER));
+    object_name_arg = 1;
+  } else {
+    points.push_back(bindingPoint(type, call.args[0].value->toUInt()));
+    object_name_arg = 1;
+  }
+
+  unsigned bound = 0;
+  if (call.args.size() > object_name_arg)
+    object_name(call.args[object_name_arg].value, &bound);
+
+  ObjectPtr object;
+  if (bound) {
+    object = lookup(ObjectKey(type, bound));
+    if (!object) {
+      // compatibility profiles create objects on first bind
+      object.reset(new Object);
+      object->calls.push_back(call.no);
+      m_live[ObjectKey(type, bound)] = object;
+    }
+  }
+
+  if (type == BUFFER &&
+      call.args[0].value->toUInt() == GL_ELEMENT_ARRAY_BUFFER) {
+    // the element array binding is vertex array state
+    const unsigned vao_name =
+        m_current->bindings[bindingPoint(VERTEX_ARRAY, 0)].name;
+    ObjectPtr vao = lookup(ObjectKey(VERTEX_ARRAY, vao_name));
+    if (vao) {
+      addBinding(vao, VERTEX_ARRAY, 0);
+      vao->calls.push_back(call.no);
+      if (object)
+        vao->deps.push_back(object);
+    }
+  }
+
+  for (auto point : points) {
+    Binding &binding = m_current->bindings[point];
+    binding.name = bound;
+    binding.call_no = call.no;
+  }
+}
+
+void
+FrameTrim::trackUniform(const Call &call) {
+  ObjectPtr program;
+  int location;
+  if (starts_with(call.sig->name, "glProgramUniform")) {
+    unsigned name;
+    if (!object_name(call.args[0].value, &name))
+      return;
+    program = lookup(ObjectKey(PROGRAM, name));
+    location = call.args[1].value->toSInt();
+  } else {
+    program = lookup(ObjectKey(
+        PROGRAM, m_current->bindings[bindingPoint(PROGRAM, 0)].name));
+    if (program)
+      addBinding(program, PROGRAM, 0);
+    location = call.args[0].value->toSInt();
+  }
+  if (!program) {
+    m_global_calls.push_back(call.no);
+    return;
+  }
+  // a uniform value is replaced by subsequent updates to its location
+  program->uniforms[location] = call.no;
+}
+
+void
+FrameTrim::trackVertexAttrib(const Call &call) {
+  const unsigned vao_name =
+      m_current->bindings[bindingPoint(VERTEX_ARRAY, 0)].name;
+  ObjectPtr vao = lookup(ObjectKey(VERTEX_ARRAY, vao_name));
+  if (!vao) {
+    // default vertex array: state is retained, along with the buffers
+    // it sources from
+    m_global_calls.push_back(call.no);
+    const Binding &array_buffer =
+        m_current->bindings[bindingPoint(BUFFER, GL_ARRAY_BUFFER)];
+    if (array_buffer.call_no)
+      m_global_calls.push_back(array_buffer.call_no);
+    if (ObjectPtr buffer = lookup(ObjectKey(BUFFER, array_buffer.name)))
+      m_global_deps.push_back(buffer);
+    return;
+  }
+  addBinding(vao, VERTEX_ARRAY, 0);
+  if (strstr(call.sig->name, "Pointer"))
+    addBinding(vao, BUFFER, GL_ARRAY_BUFFER);
+  vao->calls.push_back(call.no);
+  std::vector<ObjectKey> objects;
+  referencedObjects(call, &objects);
+  for (auto key : objects)
+    if (ObjectPtr dep = lookup(key))
+      vao->deps.push_back(dep);
+}
+
+void
+FrameTrim::trackMemcpy(const Call &call) {
+  // apitrace records writes to mapped buffers as memcpy
+  if (m_mapped_buffer)
+    m_mapped_buffer->calls.push_back(call.no);
+  else
+    m_global_calls.push_back(call.no);
+}
+
+void
+FrameTrim::trackGeneric(const Call &call) {
+  const char *name = call.sig->name;
+  std::vector<ObjectKey> objects;
+  referencedObjects(call, &objects);
+
+  ObjectType target_type;
+  unsigned target;
+  const bool modifies_bound = targetBinding(call, &target_type, &target);
+  ObjectPtr owner;
+  if (modifies_bound)
+    owner = lookup(ObjectKey(
+        target_type,
+        m_current->bindings[bindingPoint(target_type, target)].name));
+  else if (!objects.empty())
+    owner = lookup(objects.front());
+
+  if (!owner) {
+    if (modifies_bound) {
+      // modifies the default framebuffer or an unknown object.  The
+      // bind which made it current must precede the call.
+      const Binding &b =
+          m_current->bindings[bindingPoint(target_type, target)];
+      if (b.call_no)
+        m_global_calls.push_back(b.call_no);
+    }
+    if (!(call.flags & trace::CALL_FLAG_NO_SIDE_EFFECTS) ||
+        !objects.empty())
+      m_global_calls.push_back(call.no);
+    for (auto key : objects)
+      if (ObjectPtr dep = lookup(key))
+        m_global_deps.push_back(dep);
+    return;
+  }
+
+  if (starts_with(name, "glBufferData") ||
+      starts_with(name, "glNamedBufferData")) {
+    // redefines the contents of the buffer.  Only the call which
+    // created the buffer is still needed.
+    owner->calls.resize(1);
+    owner->deps.clear();
+  }
+  if (modifies_bound) {
+    addBinding(owner, target_type, target);
+    if (target_type == TEXTURE)
+      // uploads source from the bound unpack buffer, if any
+      addBinding(owner, BUFFER, GL_PIXEL_UNPACK_BUFFER);
+  }
+  owner->calls.push_back(call.no);
+  for (auto key : objects)
+    if (ObjectPtr dep = lookup(key))
+      if (dep != owner)
+        owner->deps.push_back(dep);
+
+  if ((strstr(name, "MapBuffer") || strstr(name, "MapNamedBuffer")) &&
+      !strstr(name, "Unmap"))
+    m_mapped_buffer = owner;
+}
+
+bool
+FrameTrim::objectType(const char *name, ObjectType *type) {
+  // order matters: "Framebuffer" and "Renderbuffer" precede "Buffer",
+  // and glCreateShaderProgramv creates a program.
+  static const struct {
+    const char *substring;
+    ObjectType type;
+  } types[] = {
+    {"Framebuffer", FRAMEBUFFER},
+    {"Renderbuffer", RENDERBUFFER},
+    {"VertexArray", VERTEX_ARRAY},
+    {"Texture", TEXTURE},
+    {"Sampler", SAMPLER},
+    {"Buffer", BUFFER},
+    {"Program", PROGRAM},
+    {"Shader", SHADER},
+  };
+  for (auto t : types) {
+    if (strstr(name, t.substring)) {
+      *type = t.type;
+      return true;
+    }
+  }
+  return false;
+}
+
+void
+FrameTrim::referencedObjects(const Call &call,
+                             std::vector<ObjectKey> *objects) const {
+  static const std::map<std::string, ObjectType> arg_types = {
+    {"texture", TEXTURE}, {"textures", TEXTURE},
+    {"buffer", BUFFER}, {"buffers", BUFFER},
+    {"readBuffer", BUFFER}, {"writeBuffer", BUFFER},
+    {"program", PROGRAM}, {"shader", SHADER}, {"shaders", SHADER},
+    {"framebuffer", FRAMEBUFFER}, {"renderbuffer", RENDERBUFFER},
+    {"array", VERTEX_ARRAY}, {"arrays", VERTEX_ARRAY},
+    {"vaobj", VERTEX_ARRAY}, {"sampler", SAMPLER}, {"samplers", SAMPLER},
+  };
+  for (unsigned i = 0; i < call.sig->num_args && i < call.args.size(); ++i) {
+    auto arg_type = arg_types.find(call.sig->arg_names[i]);
+    if (arg_type == arg_types.end())
+      continue;
+    const trace::Value *value = call.args[i].value;
+    if (!value)
+      continue;
+    unsigned name;
+    if (const trace::Array *a = value->toArray()) {
+      for (auto element : a->values)
+        if (object_name(element, &name) && name)
+          objects->push_back(ObjectKey(arg_type->second, name));
+    } else if (object_name(value, &name) && name) {
+      objects->push_back(ObjectKey(arg_type->second, name));
+    }
+  }
+}
+
+bool
+FrameTrim::targetBinding(const Call &call, ObjectType *type,
+                         unsigned *target) const {
+  const char *name = call.sig->name;
+  if (starts_with(name, "glDrawBuffer")) {
+    *type = FRAMEBUFFER;
+    *target = GL_DRAW_FRAMEBUFFER;
+    return true;
+  }
+  if (starts_with(name, "glReadBuffer")) {
+    *type = FRAMEBUFFER;
+    *target = GL_READ_FRAMEBUFFER;
+    return true;
+  }
+
+  if (starts_with_any(name, texture_modifiers))
+    *type = TEXTURE;
+  else if (starts_with_any(name, buffer_modifiers))
+    *type = BUFFER;
+  else if (starts_with_any(name, framebuffer_modifiers))
+    *type = FRAMEBUFFER;
+  else if (starts_with_any(name, renderbuffer_modifiers))
+    *type = RENDERBUFFER;
+  else
+    return false;
+
+  for (unsigned i = 0; i < call.sig->num_args && i < call.args.size(); ++i) {
+    if (strcmp(call.sig->arg_names[i], "target") != 0)
+      continue;
+    *target = call.args[i].value->toUInt();
+    if (*type == TEXTURE)
+      *target = texture_target(*target);
+    if (*type == FRAMEBUFFER && *target == GL_FRAMEBUFFER)
+      *target = GL_DRAW_FRAMEBUFFER;
+    return true;
+  }
+  return false;
+}
+
+FrameTrim::BindingPoint
+FrameTrim::bindingPoint(ObjectType type, unsigned target, int index) const {
+  unsigned point = target;
+  if (type == TEXTURE && index < 0)
+    point |= m_current->active_texture << 16;
+  else if (index >= 0)
+    point |= (index + 1) << 16;
+  if (type == BUFFER && target == GL_ELEMENT_ARRAY_BUFFER) {
+    auto vao = m_current->bindings.find(BindingPoint(VERTEX_ARRAY, 0));
+    if (vao != m_current->bindings.end())
+      point |= vao->second.name << 16;
+  }
+  return BindingPoint(type, point);
+}
+
+FrameTrim::ObjectPtr
+FrameTrim::lookup(const ObjectKey &key) {
+  if (key.second == 0)
+    return ObjectPtr();
+  auto live = m_live.find(key);
+  if (live == m_live.end())
+    return ObjectPtr();
+  return live->second;
+}
+
+void
+FrameTrim::addBinding(const ObjectPtr &object, ObjectType type,
+                      unsigned target) {
+  const Binding &binding = m_current->bindings[bindingPoint(type, target)];
+  if (binding.call_no &&
+      (object->calls.empty() || object->calls.back() != binding.call_no))
+    object->calls.push_back(binding.call_no);
+  if (ObjectPtr bound = lookup(ObjectKey(type, binding.name)))
+    if (bound != object)
+      object->deps.push_back(bound);
+}
+
+bool
+glretrace::trim_frames(const FrameIndex &index, const std::string &trace_file,
+                       unsigned frame, unsigned frame_count,
+                       const std::string &out_file, size_t *retained_calls) {
+  const unsigned frame_begin = index.frame(frame).begin.next_call_no;
+  const unsigned frame_end =
+      index.frame(frame + frame_count - 1).end.next_call_no;
+
+  // analyze the calls preceding the frame
+  trace::Parser parser;
+  if (!parser.open(trace_file.c_str()))
+    return false;
+  FrameTrim trim;
+  while (trace::Call *call = parser.parse_call()) {
+    const unsigned call_no = call->no;
+    if (call_no < frame_begin)
+      trim.trackPrefix(*call);
+    else if (call_no < frame_end)
+      trim.trackFrame(*call);
+    delete call;
+    if (call_no + 1 >= frame_end)
+      break;
+  }
+  parser.close();
+
+  std::set<unsigned> required;
+  trim.requiredCalls(&required);
+
+  // write the required prefix calls, followed by the frame
+  if (!parser.open(trace_file.c_str()))
+    return false;
+  trace::Writer writer;
+  if (!writer.open(out_file.c_str(), parser.getVersion(),
+                   parser.getProperties())) {
+    parser.close();
+    return false;
+  }
+  while (trace::Call *call = parser.parse_call()) {
+    const unsigned call_no = call->no;
+    if (call_no >= frame_begin || required.count(call_no))
+      writer.writeCall(call);
+    delete call;
+    if (call_no + 1 >= frame_end)
+      break;
+  }
+  writer.close();
+  parser.close();
+  *retained_calls = required.size();
+  return true;
+}
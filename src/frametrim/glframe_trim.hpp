@@ -0,0 +1,165 @@
+// Copyright (C) Intel Corp.  2019.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#ifndef _GLFRAME_TRIM_HPP_
+#define _GLFRAME_TRIM_HPP_
+
+#include <stdint.h>
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace trace {
+class Call;
+}
+
+namespace glretrace {
+
+class FrameIndex;
+
+// Determines which calls preceding a frame are needed to reproduce
+// the GL objects that the frame references.
+//
+// Calls in the prefix are attributed to the GL objects they create,
+// modify or bind.  Calls which do not reference an object (enables,
+// viewports, context management) are always retained.  Draws, clears,
+// queries and frame terminators in the prefix are dropped, along with
+// calls for objects that are deleted before the frame, and buffer
+// uploads which are superseded by a later glBufferData.
+//
+// Binding points are tracked for each context, and the context
+// current on each thread.  Object names are assumed to be shared by
+// all contexts.
+class FrameTrim {
+ public:
+  FrameTrim();
+  ~FrameTrim();
+
+  // call for each call preceding the frame, in order
+  void trackPrefix(const trace::Call &call);
+  // call for each call in the frame range, in order
+  void trackFrame(const trace::Call &call);
+  // call numbers of prefix calls which must be retained
+  void requiredCalls(std::set<unsigned> *calls) const;
+
+ private:
+  enum ObjectType {
+    TEXTURE,
+    BUFFER,
+    PROGRAM,
+    SHADER,
+    FRAMEBUFFER,
+    RENDERBUFFER,
+    VERTEX_ARRAY,
+    SAMPLER,
+  };
+  typedef std::pair<ObjectType, unsigned> ObjectKey;
+  typedef std::pair<ObjectType, unsigned> BindingPoint;
+
+  struct Object {
+    // calls which define the object contents
+    std::vector<unsigned> calls;
+    // latest value for each uniform location
+    std::map<int, unsigned> uniforms;
+    // other objects referenced while defining this one
+    std::vector<std::shared_ptr<Object>> deps;
+  };
+  typedef std::shared_ptr<Object> ObjectPtr;
+
+  struct Binding {
+    Binding() : name(0), call_no(0) {}
+    unsigned name;
+    unsigned call_no;
+  };
+
+  struct ContextBindings {
+    ContextBindings() : active_texture(0) {}
+    std::map<BindingPoint, Binding> bindings;
+    unsigned active_texture;
+  };
+
+  typedef void (FrameTrim::*MemberFunType)(const trace::Call&);
+  void trackContext(const trace::Call &call);
+  void trackGen(const trace::Call &call);
+  void trackCreate(const trace::Call &call);
+  void trackDelete(const trace::Call &call);
+  void trackBind(const trace::Call &call);
+  void trackUniform(const trace::Call &call);
+  void trackVertexAttrib(const trace::Call &call);
+  void trackMemcpy(const trace::Call &call);
+  void trackGeneric(const trace::Call &call);
+
+  // objects named in the arguments of a call
+  void referencedObjects(const trace::Call &call,
+                         std::vector<ObjectKey> *objects) const;
+  // for calls which modify the object bound to a target, provides the
+  // type and target of the binding
+  bool targetBinding(const trace::Call &call, ObjectType *type,
+                     unsigned *target) const;
+  static bool objectType(const char *name, ObjectType *type);
+  BindingPoint bindingPoint(ObjectType type, unsigned target,
+                            int index = -1) const;
+  ObjectPtr lookup(const ObjectKey &key);
+  // records the bind which makes an object current for modification
+  void addBinding(const ObjectPtr &object, ObjectType type,
+                  unsigned target);
+
+  std::map<std::string, MemberFunType> m_handlers;
+  std::map<ObjectKey, ObjectPtr> m_live;
+  // bindings of each context, keyed by the traced context handle, and
+  // the context current on each thread
+  std::map<uint64_t, ContextBindings> m_contexts;
+  std::map<unsigned, uint64_t> m_thread_contexts;
+  unsigned m_current_thread;
+  ContextBindings *m_current;
+  ObjectPtr m_mapped_buffer;
+
+  // retained prefix calls that are not attributed to an object, and
+  // the objects they depend on
+  std::vector<unsigned> m_global_calls;
+  std::vector<ObjectPtr> m_global_deps;
+  // last frame terminator before the frame
+  unsigned m_frame_end;
+  bool m_has_frame_end;
+  // objects referenced by the frame range
+  std::set<ObjectPtr> m_referenced;
+};
+
+// Writes frames [frame, frame + frame_count) of trace_file to
+// out_file, preceded by the prefix calls they require.  Returns false
+// if the output cannot be written.
+bool trim_frames(const FrameIndex &index, const std::string &trace_file,
+                 unsigned frame, unsigned frame_count,
+                 const std::string &out_file, size_t *retained_calls);
+
+}  // namespace glretrace
+
+#endif  // _GLFRAME_TRIM_HPP_
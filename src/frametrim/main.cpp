@@ -0,0 +1,98 @@
+// Copyright (C) Intel Corp.  2019.  All Rights Reserved.
+
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the
+// "Software"), to deal in the Software without restriction, including
+// without limitation the rights to use, copy, modify, merge, publish,
+// distribute, sublicense, and/or sell copies of the Software, and to
+// permit persons to whom the Software is furnished to do so, subject to
+// the following conditions:
+
+// The above copyright notice and this permission notice (including the
+// next paragraph) shall be included in all copies or substantial
+// portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE COPYRIGHT OWNER(S) AND/OR ITS SUPPLIERS BE
+// LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+// OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+// WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//  **********************************************************************/
+//  * Authors:
+//  *   Mark Janes <mark.a.janes@intel.com>
+//  **********************************************************************/
+
+#include <getopt.h>
+#include <stdio.h>
+
+#include <string>
+
+#include "glframe_frame_index.hpp"
+#include "glframe_trim.hpp"
+#include "glframe_utils.hpp"
+
+using glretrace::FrameIndex;
+
+int main(int argc, char *argv[]) {
+  unsigned frame_count = 1;
+  std::string frame_file, out_file;
+  const char *usage = "USAGE: frametrim [-n {frame_count}] -o {out_file} "
+                      "-f {trace} frame\n";
+  int opt;
+  while ((opt = getopt(argc, argv, "n:f:o:h")) != -1) {
+    switch (opt) {
+      case 'n':
+        if (glretrace::strtou(optarg, &frame_count))
+          return -1;
+        continue;
+      case 'f':
+        frame_file = optarg;
+        continue;
+      case 'o':
+        out_file = optarg;
+        continue;
+      case 'h':
+      default: /* '?' */
+        printf("%s", usage);
+        return 0;
+    }
+  }
+
+  unsigned frame;
+  if (optind + 1 != argc || glretrace::strtou(argv[optind], &frame)) {
+    printf("ERROR: target frame not specified.\n");
+    printf("%s", usage);
+    return -1;
+  }
+  if (out_file.empty()) {
+    printf("ERROR: output file not specified.\n");
+    printf("%s", usage);
+    return -1;
+  }
+  FrameIndex index;
+  if (!index.open(frame_file)) {
+    printf("ERROR: frame file not found: %s\n", frame_file.c_str());
+    printf("%s", usage);
+    return -1;
+  }
+  if (frame_count == 0 || frame + frame_count > index.frameCount()) {
+    printf("ERROR: trace contains %u frames.\n", index.frameCount());
+    return -1;
+  }
+
+  size_t retained;
+  if (!glretrace::trim_frames(index, frame_file, frame, frame_count,
+                              out_file, &retained)) {
+    printf("ERROR: could not write: %s\n", out_file.c_str());
+    return -1;
+  }
+
+  printf("retained %zu of %u calls preceding frame %u\n",
+         retained, index.frame(frame).begin.next_call_no, frame);
+  printf("trimmed trace: %s, frame %u\n", out_file.c_str(),
+         frame > 0 ? 1 : 0);
+  return 0;
+}
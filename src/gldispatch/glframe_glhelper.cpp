@@ -170,6 +170,8 @@ static void *pGetQueryiv = NULL;
 static void *pGetQueryObjectiv = NULL;
 static void *pGetQueryObjectui64v = NULL;
 static void *pQueryCounter = NULL;
+static void *pDebugMessageCallback = NULL;
+static void *pDebugMessageControl = NULL;
 }  // namespace
 
 static void * _GetProcAddress(const char *name) {
@@ -468,6 +470,8 @@ GlFunctions::Init(void *lookup_fn) {
   assert(pGetQueryObjectui64v);
   pQueryCounter = _GetProcAddress("glQueryCounter");
   assert(pQueryCounter);
+  pDebugMessageCallback = _GetProcAddress("glDebugMessageCallback");
+  pDebugMessageControl = _GetProcAddress("glDebugMessageControl");
 }
 
 GLuint
@@ -1431,3 +1435,25 @@ GlFunctions::QueryCounter(GLuint id, GLenum target) {
   typedef void (*QUERYCOUNTER)(GLuint id, GLenum target);
   return ((QUERYCOUNTER)pQueryCounter)(id, target);
 }
+
+bool
+GlFunctions::DebugMessageCallback(GLDEBUGPROC callback,
+                                  const void *userParam) {
+  if (!pDebugMessageCallback || !pDebugMessageControl)
+    return false;
+  typedef void (*DEBUGMESSAGECALLBACK)(GLDEBUGPROC callback,
+                                       const void *userParam);
+  ((DEBUGMESSAGECALLBACK)pDebugMessageCallback)(callback, userParam);
+  return true;
+}
+
+void
+GlFunctions::DebugMessageControl(GLenum source, GLenum type,
+                                 GLenum severity, GLsizei count,
+                                 const GLuint *ids, GLboolean enabled) {
+  typedef void (*DEBUGMESSAGECONTROL)(GLenum source, GLenum type,
+                                      GLenum severity, GLsizei count,
+                                      const GLuint *ids, GLboolean enabled);
+  ((DEBUGMESSAGECONTROL)pDebugMessageControl)(source, type, severity,
+                                              count, ids, enabled);
+}
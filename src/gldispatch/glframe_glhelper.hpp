@@ -243,6 +243,12 @@ class GlFunctions {
   static void GetQueryObjectiv(GLuint id, GLenum pname, GLint *params);
   static void GetQueryObjectui64v(GLuint id, GLenum pname, GLuint64 *params);
   static void QueryCounter(GLuint id, GLenum target);
+  // returns false if the entry point is not available
+  static bool DebugMessageCallback(GLDEBUGPROC callback,
+                                   const void *userParam);
+  static void DebugMessageControl(GLenum source, GLenum type,
+                                  GLenum severity, GLsizei count,
+                                  const GLuint *ids, GLboolean enabled);
 
  private:
   GlFunctions();
@@ -43,6 +43,12 @@ CancellationPolicy::isCancelled(SelectionId selectionCount,
   return false;
 }
 
+bool
+CancellationPolicy::isCancelled(ExperimentId experimentCount) const {
+  std::lock_guard<std::mutex> l(m_protect);
+  return experimentCount < m_current_exp;
+}
+
 void
 CancellationPolicy::cancel(SelectionId selectionCount,
                            ExperimentId experimentCount) {
@@ -39,6 +39,8 @@ class CancellationPolicy : NoCopy, NoAssign {
  public:
   bool isCancelled(SelectionId selectionCount,
                    ExperimentId experimentCount) const;
+  // for requests which span the frame, rather than a selection
+  bool isCancelled(ExperimentId experimentCount) const;
   void cancel(SelectionId selectionCount,
               ExperimentId experimentCount);
 
@@ -0,0 +1,195 @@
+/**************************************************************************
+ *
+ * Copyright 2019 Intel Corporation
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * Authors:
+ *   Mark Janes <mark.a.janes@intel.com>
+ **************************************************************************/
+
+#include "glframe_checkpoint.hpp"
+
+#include <stdio.h>
+
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "glframe_os.hpp"
+#include "glframe_retrace_render.hpp"
+
+using glretrace::CheckpointParser;
+using glretrace::FrameCheckpoint;
+using glretrace::RetraceRender;
+using glretrace::application_cache_directory;
+
+namespace {
+
+// the original call numbers of a checkpoint
+std::string
+call_numbers_path(const std::string &checkpoint_path) {
+  return checkpoint_path + ".callnos";
+}
+
+}  // namespace
+
+FrameCheckpoint::FrameCheckpoint(const std::vector<unsigned char> &md5,
+                                 uint32_t frame_number,
+                                 uint32_t frame_count,
+                                 bool skip_draws)
+    : m_frame_number(frame_number),
+      m_frame_count(frame_count),
+      m_recording(false) {
+  std::stringstream path_s;
+  path_s << application_cache_directory() << std::hex << std::setfill('0');
+  for (auto byte : md5)
+    path_s << std::setw(2) << static_cast<unsigned int>(byte);
+  path_s << std::dec << "." << frame_number << "." << frame_count
+         << (skip_draws ? ".skip_draws" : "") << ".checkpoint.trace";
+  m_path = path_s.str();
+  m_tmp_path = m_path + ".tmp";
+}
+
+FrameCheckpoint::~FrameCheckpoint() {
+  if (!m_recording)
+    return;
+  // abandoned before the frame was reached
+  m_writer.close();
+  remove(m_tmp_path.c_str());
+}
+
+bool
+FrameCheckpoint::exists() const {
+  // checkpoints which were stored without call numbers are replaced
+  for (auto path : { m_path, call_numbers_path(m_path) }) {
+    FILE *fh = fopen(path.c_str(), "rb");
+    if (!fh)
+      return false;
+    fclose(fh);
+  }
+  return true;
+}
+
+bool
+FrameCheckpoint::begin(const trace::AbstractParser &source) {
+  m_call_numbers.clear();
+  m_recording = m_writer.open(m_tmp_path.c_str(),
+                              source.getVersion(),
+                              source.getProperties());
+  return m_recording;
+}
+
+void
+FrameCheckpoint::write(trace::Call *call) {
+  if (!m_recording)
+    return;
+  m_writer.writeCall(call);
+  m_call_numbers.push_back(call->no);
+}
+
+void
+FrameCheckpoint::commit(trace::AbstractParser *source,
+                        const trace::ParseBookmark &frame_start) {
+  if (!m_recording)
+    return;
+  trace::ParseBookmark resume;
+  source->getBookmark(resume);
+  source->setBookmark(frame_start);
+  uint32_t frames = m_frame_count;
+  while (trace::Call *call = source->parse_call()) {
+    m_writer.writeCall(call);
+    m_call_numbers.push_back(call->no);
+    const bool frame_boundary = RetraceRender::endsFrame(*call);
+    delete call;
+    if (frame_boundary && --frames == 0)
+      break;
+  }
+  source->setBookmark(resume);
+  m_writer.close();
+  m_recording = false;
+  // the call numbers are in place before the checkpoint is visible
+  const std::string numbers_path = call_numbers_path(m_path);
+  if (!storeCallNumbers(numbers_path) ||
+      (rename(m_tmp_path.c_str(), m_path.c_str()) != 0)) {
+    remove(m_tmp_path.c_str());
+    remove(numbers_path.c_str());
+  }
+}
+
+bool
+FrameCheckpoint::storeCallNumbers(const std::string &path) const {
+  const std::string tmp_path = call_numbers_path(m_tmp_path);
+  FILE *fh = fopen(tmp_path.c_str(), "wb");
+  if (!fh)
+    return false;
+  const size_t count = m_call_numbers.size();
+  bool success = (fwrite(m_call_numbers.data(), sizeof(uint32_t), count,
+                         fh) == count);
+  success = (fclose(fh) == 0) && success;
+  if (success && (rename(tmp_path.c_str(), path.c_str()) == 0))
+    return true;
+  remove(tmp_path.c_str());
+  return false;
+}
+
+CheckpointParser::CheckpointParser(trace::AbstractParser *source)
+    : m_source(source) {}
+
+bool
+CheckpointParser::open(const char *filename) {
+  m_call_numbers.clear();
+  if (!m_source->open(filename))
+    return false;
+  FILE *fh = fopen(call_numbers_path(filename).c_str(), "rb");
+  if (!fh)
+    // calls are reported with their numbers in the checkpoint
+    return true;
+  uint32_t call_no;
+  while (fread(&call_no, sizeof(call_no), 1, fh) == 1)
+    m_call_numbers.push_back(call_no);
+  fclose(fh);
+  return true;
+}
+
+void
+CheckpointParser::close(void) {
+  m_source->close();
+  m_call_numbers.clear();
+}
+
+trace::Call *
+CheckpointParser::parse_call(void) {
+  trace::Call *call = m_source->parse_call();
+  if (call && (call->no < m_call_numbers.size()))
+    call->no = m_call_numbers[call->no];
+  return call;
+}
+
+void
+CheckpointParser::getBookmark(trace::ParseBookmark &bookmark) {
+  m_source->getBookmark(bookmark);
+}
+
+void
+CheckpointParser::setBookmark(const trace::ParseBookmark &bookmark) {
+  m_source->setBookmark(bookmark);
+}
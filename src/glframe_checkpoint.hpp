@@ -0,0 +1,114 @@
+/**************************************************************************
+ *
+ * Copyright 2019 Intel Corporation
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * Authors:
+ *   Mark Janes <mark.a.janes@intel.com>
+ **************************************************************************/
+
+#ifndef _GLFRAME_CHECKPOINT_HPP_
+#define _GLFRAME_CHECKPOINT_HPP_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "glframe_traits.hpp"
+#include "trace_parser.hpp"
+#include "trace_writer.hpp"
+
+namespace glretrace {
+
+// A reduced trace which reproduces the GL state at the start of a
+// frame, followed by the calls of the frames under analysis.  It
+// contains only the calls that were retraced on the way to the frame,
+// so that a subsequent open of the same trace and frame does not
+// have to parse or replay the rest of the original trace.
+//
+// Checkpoints are stored in application_cache_directory(), keyed by
+// the md5sum of the trace, the frame range, and whether draws were
+// skipped while generating them.  trace::Writer numbers the calls of
+// the checkpoint consecutively, so the original number of each call
+// is stored alongside it, and restored by CheckpointParser.
+class FrameCheckpoint : NoCopy, NoAssign, NoMove {
+ public:
+  FrameCheckpoint(const std::vector<unsigned char> &md5,
+                  uint32_t frame_number,
+                  uint32_t frame_count,
+                  bool skip_draws);
+  ~FrameCheckpoint();
+
+  bool exists() const;
+  const std::string &path() const { return m_path; }
+  // the first analyzed frame, within the checkpoint trace
+  uint32_t frameNumber() const { return m_frame_number > 0 ? 1 : 0; }
+
+  // starts recording a checkpoint from the parsed trace
+  bool begin(const trace::AbstractParser &source);
+  // records a call which contributes state at the start of the
+  // frame.  Of the frame terminators in the prefix, only the last
+  // should be recorded.
+  void write(trace::Call *call);
+  // copies the analyzed frames, and stores the checkpoint
+  void commit(trace::AbstractParser *source,
+              const trace::ParseBookmark &frame_start);
+
+ private:
+  bool storeCallNumbers(const std::string &path) const;
+
+  const uint32_t m_frame_number, m_frame_count;
+  std::string m_path, m_tmp_path;
+  trace::Writer m_writer;
+  bool m_recording;
+  // original call number of each recorded call
+  std::vector<uint32_t> m_call_numbers;
+};
+
+// Parses a checkpoint with the source parser, reporting each call with
+// its number in the original trace.
+class CheckpointParser : public trace::AbstractParser,
+                         NoCopy, NoAssign, NoMove {
+ public:
+  explicit CheckpointParser(trace::AbstractParser *source);
+  trace::AbstractParser *source() const { return m_source; }
+
+  bool open(const char *filename);
+  void close(void);
+  trace::Call *parse_call(void);
+  void getBookmark(trace::ParseBookmark &bookmark);
+  void setBookmark(const trace::ParseBookmark &bookmark);
+  unsigned long long getVersion(void) const {
+    return m_source->getVersion();
+  }
+  const trace::Properties &getProperties(void) const {
+    return m_source->getProperties();
+  }
+
+ private:
+  trace::AbstractParser *m_source;
+  std::vector<uint32_t> m_call_numbers;
+};
+
+}  // namespace glretrace
+
+#endif  // _GLFRAME_CHECKPOINT_HPP_
@@ -23,27 +23,54 @@
 #ifndef GLFRAME_FILTER_H_
 #define GLFRAME_FILTER_H_
 
+#include <string.h>
+
 #include <set>
 #include <string>
 
+#include "glframe_call_class.hpp"
 #include "retrace.hpp"
 
 namespace glretrace {
 
 class RetraceFilter {
  public:
-  RetraceFilter(retrace::Retracer *r) : m_retracer(r) {}
+  RetraceFilter(retrace::Retracer *r) : m_retracer(r), m_state_only(false) {}
   void Disable(const std::string &call) {
     m_disabled.emplace(call);
+    m_disabled_sigs.clear();
   }
+  // Queries which only read bound state do not need the frame to be
+  // rendered.  In state only mode, draws, dispatches and clears are
+  // skipped.
+  void setStateOnly(bool state_only) { m_state_only = state_only; }
   void retrace(trace::Call &call) {
-    if (m_disabled.find(call.sig->name) != m_disabled.end())
+    const bool *disabled = m_disabled_sigs.find(call.sig);
+    if (!disabled)
+      disabled = &m_disabled_sigs.insert(
+          call.sig, m_disabled.find(call.sig->name) != m_disabled.end());
+    if (*disabled)
+      return;
+    if (m_state_only && drawsPixels(call))
       return;
     m_retracer->retrace(call);
   }
  private:
+  bool drawsPixels(const trace::Call &call) {
+    const bool *draws = m_draw_sigs.find(call.sig);
+    if (!draws)
+      // glEnd terminates the glBegin block, which was retraced
+      draws = &m_draw_sigs.insert(
+          call.sig, (CallClass::get(call) & CallClass::RENDER) &&
+          (strcmp(call.sig->name, "glEnd") != 0));
+    return *draws;
+  }
+
   std::set<std::string> m_disabled;
+  SignatureTable<bool> m_disabled_sigs;
+  SignatureTable<bool> m_draw_sigs;
   retrace::Retracer *m_retracer;
+  bool m_state_only;
 };
 
 }
@@ -0,0 +1,230 @@
+/**************************************************************************
+ *
+ * Copyright 2019 Intel Corporation
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * Authors:
+ *   Mark Janes <mark.a.janes@intel.com>
+ **************************************************************************/
+
+#include "glframe_frame_index.hpp"
+
+#include <stdio.h>
+
+#include <functional>
+#include <sstream>
+#include <string>
+
+#include "glframe_os.hpp"
+#include "glframe_retrace_render.hpp"
+
+using glretrace::FrameIndex;
+using glretrace::RetraceRender;
+using glretrace::application_cache_directory;
+using glretrace::glretrace_pid;
+using glretrace::glretrace_stat;
+
+namespace {
+
+// "FIDX", followed by the format version
+const uint32_t kIndexMagic = 0x58444946;
+const uint32_t kIndexVersion = 2;
+
+template <class T>
+bool
+read_value(FILE *fh, T *val) {
+  return fread(val, sizeof(T), 1, fh) == 1;
+}
+
+template <class T>
+bool
+write_value(FILE *fh, const T &val) {
+  return fwrite(&val, sizeof(T), 1, fh) == 1;
+}
+
+bool
+read_bookmark(FILE *fh, trace::ParseBookmark *bookmark) {
+  uint64_t chunk;
+  uint32_t offset, call_no;
+  if (!read_value(fh, &chunk) ||
+      !read_value(fh, &offset) ||
+      !read_value(fh, &call_no))
+    return false;
+  bookmark->offset.chunk = chunk;
+  bookmark->offset.offsetInChunk = offset;
+  bookmark->next_call_no = call_no;
+  return true;
+}
+
+bool
+write_bookmark(FILE *fh, const trace::ParseBookmark &bookmark) {
+  return (write_value(fh, static_cast<uint64_t>(bookmark.offset.chunk)) &&
+          write_value(fh,
+                      static_cast<uint32_t>(bookmark.offset.offsetInChunk)) &&
+          write_value(fh, static_cast<uint32_t>(bookmark.next_call_no)));
+}
+
+}  // namespace
+
+FrameIndex::FrameIndex() : m_trace_size(0), m_trace_mtime(0) {}
+
+bool
+FrameIndex::open(const std::string &trace_path) {
+  if (openStored(trace_path))
+    return true;
+  if (m_index_path.empty() || !scan())
+    return false;
+  store();
+  return true;
+}
+
+bool
+FrameIndex::openStored(const std::string &trace_path) {
+  m_frames.clear();
+  m_index_path.clear();
+  m_trace_path = trace_path;
+  if (!glretrace_stat(trace_path, &m_trace_size, &m_trace_mtime))
+    return false;
+
+  // the index is named by the hash of the full path, as traces in
+  // different directories may share a name.  The path, size and
+  // mtime are verified when the index is loaded.
+  std::string basename = trace_path;
+  const size_t sep = basename.find_last_of("/\\");
+  if (sep != std::string::npos)
+    basename = basename.substr(sep + 1);
+  std::stringstream index_path;
+  index_path << application_cache_directory() << basename << "."
+             << std::hex << std::hash<std::string>()(trace_path)
+             << ".frameindex";
+  m_index_path = index_path.str();
+  return load();
+}
+
+uint32_t
+FrameIndex::renderCount(uint32_t first_frame, uint32_t frame_count) const {
+  uint32_t count = 0;
+  for (uint32_t f = first_frame;
+       f < first_frame + frame_count && f < m_frames.size(); ++f)
+    count += m_frames[f].render_count;
+  return count;
+}
+
+bool
+FrameIndex::load() {
+  FILE *fh = fopen(m_index_path.c_str(), "rb");
+  if (!fh)
+    return false;
+  uint32_t magic, version, path_size, frame_count;
+  uint64_t trace_size;
+  int64_t trace_mtime;
+  bool valid = (read_value(fh, &magic) && magic == kIndexMagic &&
+                read_value(fh, &version) && version == kIndexVersion &&
+                read_value(fh, &trace_size) && trace_size == m_trace_size &&
+                read_value(fh, &trace_mtime) && trace_mtime == m_trace_mtime &&
+                read_value(fh, &path_size) &&
+                path_size == m_trace_path.size());
+  if (valid) {
+    std::string trace_path(path_size, '\0');
+    valid = ((fread(&trace_path[0], 1, path_size, fh) == path_size) &&
+             (trace_path == m_trace_path));
+  }
+  // each frame holds at least one call, which occupies at least one
+  // byte of the trace.  A larger count is a corrupt index.
+  valid = (valid && read_value(fh, &frame_count) &&
+           (frame_count <= m_trace_size));
+  if (valid) {
+    m_frames.resize(frame_count);
+    for (auto &f : m_frames) {
+      if (!read_bookmark(fh, &f.begin) ||
+          !read_bookmark(fh, &f.end) ||
+          !read_value(fh, &f.call_count) ||
+          !read_value(fh, &f.render_count)) {
+        valid = false;
+        break;
+      }
+    }
+  }
+  fclose(fh);
+  if (!valid)
+    m_frames.clear();
+  return valid;
+}
+
+bool
+FrameIndex::scan() {
+  trace::Parser p;
+  if (!p.open(m_trace_path.c_str()))
+    return false;
+  Frame current;
+  current.call_count = 0;
+  current.render_count = 0;
+  p.getBookmark(current.begin);
+  while (trace::Call *call = p.scan_call()) {
+    ++current.call_count;
+    if (RetraceRender::isRender(*call))
+      ++current.render_count;
+    const bool frame_boundary = RetraceRender::endsFrame(*call);
+    delete call;
+    if (!frame_boundary)
+      continue;
+    p.getBookmark(current.end);
+    m_frames.push_back(current);
+    current.begin = current.end;
+    current.call_count = 0;
+    current.render_count = 0;
+  }
+  p.close();
+  return true;
+}
+
+void
+FrameIndex::store() const {
+  // write to a temporary file, so that a concurrent reader never
+  // observes a partial index.  The file is unique to the process, as
+  // several processes may index the same trace.
+  std::stringstream tmp_s;
+  tmp_s << m_index_path << "." << glretrace_pid();
+  const std::string tmp_path = tmp_s.str();
+  FILE *fh = fopen(tmp_path.c_str(), "wb");
+  if (!fh)
+    return;
+  const uint32_t path_size = m_trace_path.size();
+  bool success = (write_value(fh, kIndexMagic) &&
+                  write_value(fh, kIndexVersion) &&
+                  write_value(fh, m_trace_size) &&
+                  write_value(fh, m_trace_mtime) &&
+                  write_value(fh, path_size) &&
+                  (fwrite(m_trace_path.data(), 1, path_size, fh) ==
+                   path_size) &&
+                  write_value(fh, static_cast<uint32_t>(m_frames.size())));
+  for (auto &f : m_frames) {
+    if (!success)
+      break;
+    success = (write_bookmark(fh, f.begin) &&
+               write_bookmark(fh, f.end) &&
+               write_value(fh, f.call_count) &&
+               write_value(fh, f.render_count));
+  }
+  fclose(fh);
+  if (!success || rename(tmp_path.c_str(), m_index_path.c_str()) != 0)
+    remove(tmp_path.c_str());
+}
@@ -0,0 +1,88 @@
+/**************************************************************************
+ *
+ * Copyright 2019 Intel Corporation
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * Authors:
+ *   Mark Janes <mark.a.janes@intel.com>
+ **************************************************************************/
+
+#ifndef _GLFRAME_FRAME_INDEX_HPP_
+#define _GLFRAME_FRAME_INDEX_HPP_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "glframe_traits.hpp"
+#include "trace_parser.hpp"
+
+namespace glretrace {
+
+// Records the location of each frame in a trace file, so that tools
+// can seek directly to a frame instead of scanning from the first
+// call.  The index is generated once per trace, and persisted in
+// application_cache_directory() alongside uploaded traces.  A stored
+// index is discarded if the path, size or modification time of the
+// trace changes.
+class FrameIndex : NoCopy, NoAssign, NoMove {
+ public:
+  struct Frame {
+    trace::ParseBookmark begin;  // first call in the frame
+    trace::ParseBookmark end;    // first call after the frame terminator
+    uint32_t call_count;
+    uint32_t render_count;
+  };
+
+  FrameIndex();
+
+  // loads the index for the trace, scanning the trace and storing a
+  // new index if none is available.  Returns false if the trace
+  // cannot be read.
+  bool open(const std::string &trace_path);
+  // loads a stored index for the trace, without scanning.  Returns
+  // false if no index has been stored.
+  bool openStored(const std::string &trace_path);
+
+  // number of complete frames in the trace.  Calls following the
+  // last frame terminator are not indexed.
+  uint32_t frameCount() const { return m_frames.size(); }
+  const Frame &frame(uint32_t frame_number) const {
+    return m_frames[frame_number];
+  }
+  // total renders in frames [first_frame, first_frame + frame_count)
+  uint32_t renderCount(uint32_t first_frame, uint32_t frame_count) const;
+
+ private:
+  bool load();
+  bool scan();
+  void store() const;
+
+  std::string m_trace_path, m_index_path;
+  uint64_t m_trace_size;
+  int64_t m_trace_mtime;
+  std::vector<Frame> m_frames;
+};
+
+}  // namespace glretrace
+
+#endif  // _GLFRAME_FRAME_INDEX_HPP_
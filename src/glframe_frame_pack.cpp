@@ -0,0 +1,583 @@
+/**************************************************************************
+ *
+ * Copyright 2019 Intel Corporation
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * Authors:
+ *   Mark Janes <mark.a.janes@intel.com>
+ **************************************************************************/
+
+#include "glframe_frame_pack.hpp"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "trace_model.hpp"
+
+using glretrace::FramePackParser;
+using glretrace::FramePackWriter;
+using trace::Call;
+using trace::Value;
+
+namespace {
+
+// "FPCK", followed by the format version
+const uint32_t kPackMagic = 0x4b435046;
+const uint32_t kPackVersion = 2;
+
+enum ValueTag {
+  TAG_NULL,
+  TAG_BOOL,
+  TAG_SINT,
+  TAG_UINT,
+  TAG_FLOAT,
+  TAG_DOUBLE,
+  TAG_STRING,
+  TAG_WSTRING,
+  TAG_ENUM,
+  TAG_BITMASK,
+  TAG_STRUCT,
+  TAG_ARRAY,
+  TAG_BLOB,
+  TAG_POINTER,
+  TAG_REPR
+};
+
+template <class T>
+void
+append_pod(std::vector<char> *buf, const T &v) {
+  const char *bytes = reinterpret_cast<const char *>(&v);
+  buf->insert(buf->end(), bytes, bytes + sizeof(T));
+}
+
+void
+append_string(std::vector<char> *buf, const char *s) {
+  const uint32_t len = s ? strlen(s) : 0;
+  append_pod(buf, len);
+  if (len)
+    buf->insert(buf->end(), s, s + len);
+  buf->push_back('\0');
+}
+
+}  // namespace
+
+FramePackWriter::FramePackWriter() {}
+
+template <class T>
+void
+FramePackWriter::writePod(const T &v) {
+  append_pod(&m_calls, v);
+}
+
+void
+FramePackWriter::writeString(const char *s) {
+  append_string(&m_calls, s);
+}
+
+void
+FramePackWriter::write(const Call &call) {
+  m_call_offsets.push_back(m_calls.size());
+  m_functions[call.sig->id] = call.sig;
+  writePod(static_cast<uint32_t>(call.no));
+  writePod(static_cast<uint32_t>(call.sig->id));
+  writePod(static_cast<uint32_t>(call.thread_id));
+  writePod(static_cast<uint32_t>(call.flags));
+  writePod(static_cast<uint32_t>(call.args.size()));
+  for (auto &arg : call.args)
+    writeValue(arg.value);
+  writeValue(call.ret);
+}
+
+void
+FramePackWriter::writeValue(const Value *value) {
+  // derived types precede their base: Enum is a SInt, Bitmask and
+  // Pointer are UInts.
+  if (!value || dynamic_cast<const trace::Null *>(value)) {
+    writePod<uint8_t>(TAG_NULL);
+  } else if (auto v = dynamic_cast<const trace::Bool *>(value)) {
+    writePod<uint8_t>(TAG_BOOL);
+    writePod<uint8_t>(v->value);
+  } else if (auto v = dynamic_cast<const trace::Enum *>(value)) {
+    writePod<uint8_t>(TAG_ENUM);
+    m_enums[v->sig->id] = v->sig;
+    writePod(static_cast<uint32_t>(v->sig->id));
+    writePod(static_cast<int64_t>(v->value));
+  } else if (auto v = dynamic_cast<const trace::SInt *>(value)) {
+    writePod<uint8_t>(TAG_SINT);
+    writePod(static_cast<int64_t>(v->value));
+  } else if (auto v = dynamic_cast<const trace::Bitmask *>(value)) {
+    writePod<uint8_t>(TAG_BITMASK);
+    m_bitmasks[v->sig->id] = v->sig;
+    writePod(static_cast<uint32_t>(v->sig->id));
+    writePod(static_cast<uint64_t>(v->value));
+  } else if (auto v = dynamic_cast<const trace::Pointer *>(value)) {
+    writePod<uint8_t>(TAG_POINTER);
+    writePod(static_cast<uint64_t>(v->value));
+  } else if (auto v = dynamic_cast<const trace::UInt *>(value)) {
+    writePod<uint8_t>(TAG_UINT);
+    writePod(static_cast<uint64_t>(v->value));
+  } else if (auto v = dynamic_cast<const trace::Float *>(value)) {
+    writePod<uint8_t>(TAG_FLOAT);
+    writePod(v->value);
+  } else if (auto v = dynamic_cast<const trace::Double *>(value)) {
+    writePod<uint8_t>(TAG_DOUBLE);
+    writePod(v->value);
+  } else if (auto v = dynamic_cast<const trace::String *>(value)) {
+    writePod<uint8_t>(TAG_STRING);
+    writeString(v->value);
+  } else if (auto v = dynamic_cast<const trace::WString *>(value)) {
+    writePod<uint8_t>(TAG_WSTRING);
+    const uint32_t len = wcslen(v->value);
+    writePod(len);
+    for (uint32_t i = 0; i < len; ++i)
+      writePod(v->value[i]);
+  } else if (auto v = dynamic_cast<const trace::Struct *>(value)) {
+    writePod<uint8_t>(TAG_STRUCT);
+    m_structs[v->sig->id] = v->sig;
+    writePod(static_cast<uint32_t>(v->sig->id));
+    for (auto member : v->members)
+      writeValue(member);
+  } else if (auto v = dynamic_cast<const trace::Array *>(value)) {
+    writePod<uint8_t>(TAG_ARRAY);
+    writePod(static_cast<uint32_t>(v->values.size()));
+    for (auto element : v->values)
+      writeValue(element);
+  } else if (auto v = dynamic_cast<const trace::Blob *>(value)) {
+    writePod<uint8_t>(TAG_BLOB);
+    std::string data(v->buf, v->size);
+    auto existing = m_blob_index.find(data);
+    uint32_t index;
+    if (existing != m_blob_index.end()) {
+      index = existing->second;
+    } else {
+      index = m_blobs.size();
+      m_blob_index[data] = index;
+      m_blobs.push_back(data);
+    }
+    writePod(index);
+  } else if (auto v = dynamic_cast<const trace::Repr *>(value)) {
+    writePod<uint8_t>(TAG_REPR);
+    writeValue(v->humanValue);
+    writeValue(v->machineValue);
+  } else {
+    assert(false);
+    writePod<uint8_t>(TAG_NULL);
+  }
+}
+
+bool
+FramePackWriter::commit(const std::string &path,
+                        unsigned long long trace_version,
+                        const trace::Properties &properties) const {
+  std::vector<char> header;
+  append_pod(&header, kPackMagic);
+  append_pod(&header, kPackVersion);
+  append_pod(&header, static_cast<uint64_t>(trace_version));
+
+  append_pod(&header, static_cast<uint32_t>(properties.size()));
+  for (auto &p : properties) {
+    append_string(&header, p.first.c_str());
+    append_string(&header, p.second.c_str());
+  }
+
+  append_pod(&header, static_cast<uint32_t>(m_functions.size()));
+  for (auto &f : m_functions) {
+    append_pod(&header, static_cast<uint32_t>(f.second->id));
+    append_string(&header, f.second->name);
+    append_pod(&header, static_cast<uint32_t>(f.second->num_args));
+    for (unsigned i = 0; i < f.second->num_args; ++i)
+      append_string(&header, f.second->arg_names[i]);
+  }
+
+  append_pod(&header, static_cast<uint32_t>(m_enums.size()));
+  for (auto &e : m_enums) {
+    append_pod(&header, static_cast<uint32_t>(e.second->id));
+    append_pod(&header, static_cast<uint32_t>(e.second->num_values));
+    for (unsigned i = 0; i < e.second->num_values; ++i) {
+      append_string(&header, e.second->values[i].name);
+      append_pod(&header, static_cast<int64_t>(e.second->values[i].value));
+    }
+  }
+
+  append_pod(&header, static_cast<uint32_t>(m_bitmasks.size()));
+  for (auto &b : m_bitmasks) {
+    append_pod(&header, static_cast<uint32_t>(b.second->id));
+    append_pod(&header, static_cast<uint32_t>(b.second->num_flags));
+    for (unsigned i = 0; i < b.second->num_flags; ++i) {
+      append_string(&header, b.second->flags[i].name);
+      append_pod(&header, static_cast<uint64_t>(b.second->flags[i].value));
+    }
+  }
+
+  append_pod(&header, static_cast<uint32_t>(m_structs.size()));
+  for (auto &s : m_structs) {
+    append_pod(&header, static_cast<uint32_t>(s.second->id));
+    append_string(&header, s.second->name);
+    append_pod(&header, static_cast<uint32_t>(s.second->num_members));
+    for (unsigned i = 0; i < s.second->num_members; ++i)
+      append_string(&header, s.second->member_names[i]);
+  }
+
+  append_pod(&header, static_cast<uint32_t>(m_blobs.size()));
+  for (auto &blob : m_blobs) {
+    append_pod(&header, static_cast<uint64_t>(blob.size()));
+    header.insert(header.end(), blob.begin(), blob.end());
+  }
+
+  append_pod(&header, static_cast<uint32_t>(m_call_offsets.size()));
+  for (auto offset : m_call_offsets)
+    append_pod(&header, offset);
+
+  // write to a temporary file, so that a concurrent reader never
+  // observes a partial pack
+  const std::string tmp_path = path + ".tmp";
+  FILE *fh = fopen(tmp_path.c_str(), "wb");
+  if (!fh)
+    return false;
+  bool success =
+      ((fwrite(header.data(), 1, header.size(), fh) == header.size()) &&
+       (fwrite(m_calls.data(), 1, m_calls.size(), fh) == m_calls.size()));
+  fclose(fh);
+  if (success)
+    success = (rename(tmp_path.c_str(), path.c_str()) == 0);
+  if (!success)
+    remove(tmp_path.c_str());
+  return success;
+}
+
+namespace glretrace {
+
+// bounds-checked sequential reads from the pack
+class FramePackParser::Reader {
+ public:
+  Reader(const char *begin, const char *end)
+      : m_pos(begin), m_end(end), m_valid(true) {}
+  template <class T> T read() {
+    T v = T();
+    if (m_pos + sizeof(T) > m_end) {
+      m_valid = false;
+      return v;
+    }
+    memcpy(&v, m_pos, sizeof(T));
+    m_pos += sizeof(T);
+    return v;
+  }
+  // returns a pointer to the null-terminated string in the pack
+  const char *readString() {
+    const uint32_t len = read<uint32_t>();
+    if (!m_valid || m_pos + len + 1 > m_end) {
+      m_valid = false;
+      return "";
+    }
+    const char *s = m_pos;
+    m_pos += len + 1;
+    return s;
+  }
+  const char *skip(size_t bytes) {
+    if (m_pos + bytes > m_end) {
+      m_valid = false;
+      return m_end;
+    }
+    const char *p = m_pos;
+    m_pos += bytes;
+    return p;
+  }
+  const char *pos() const { return m_pos; }
+  bool valid() const { return m_valid && m_pos <= m_end; }
+
+ private:
+  const char *m_pos, *m_end;
+  bool m_valid;
+};
+
+}  // namespace glretrace
+
+FramePackParser::FramePackParser() : m_version(0),
+                                     m_calls_start(0),
+                                     m_next_call(0) {}
+
+FramePackParser::~FramePackParser() {
+  close();
+}
+
+bool
+FramePackParser::open(const char *filename) {
+  close();
+  FILE *fh = fopen(filename, "rb");
+  if (!fh)
+    return false;
+  fseek(fh, 0, SEEK_END);
+  const long size = ftell(fh);
+  fseek(fh, 0, SEEK_SET);
+  if (size > 0) {
+    m_data.resize(size);
+    if (fread(m_data.data(), 1, size, fh) != static_cast<size_t>(size))
+      m_data.clear();
+  }
+  fclose(fh);
+  if (m_data.empty())
+    return false;
+
+  const char *base = m_data.data();
+  Reader r(base, base + m_data.size());
+  if (r.read<uint32_t>() != kPackMagic ||
+      r.read<uint32_t>() != kPackVersion) {
+    close();
+    return false;
+  }
+  m_version = r.read<uint64_t>();
+
+  const uint32_t property_count = r.read<uint32_t>();
+  for (uint32_t i = 0; i < property_count && r.valid(); ++i) {
+    const std::string key = r.readString();
+    m_properties[key] = r.readString();
+  }
+
+  const uint32_t function_count = r.read<uint32_t>();
+  for (uint32_t i = 0; i < function_count && r.valid(); ++i) {
+    trace::FunctionSig *sig = new trace::FunctionSig();
+    sig->id = r.read<uint32_t>();
+    sig->name = r.readString();
+    sig->num_args = r.read<uint32_t>();
+    const char **arg_names = new const char *[sig->num_args];
+    for (unsigned a = 0; a < sig->num_args; ++a)
+      arg_names[a] = r.readString();
+    sig->arg_names = arg_names;
+    m_functions[sig->id] = sig;
+  }
+
+  const uint32_t enum_count = r.read<uint32_t>();
+  for (uint32_t i = 0; i < enum_count && r.valid(); ++i) {
+    trace::EnumSig *sig = new trace::EnumSig();
+    sig->id = r.read<uint32_t>();
+    sig->num_values = r.read<uint32_t>();
+    trace::EnumValue *values = new trace::EnumValue[sig->num_values];
+    for (unsigned v = 0; v < sig->num_values; ++v) {
+      values[v].name = r.readString();
+      values[v].value = r.read<int64_t>();
+    }
+    sig->values = values;
+    m_enums[sig->id] = sig;
+  }
+
+  const uint32_t bitmask_count = r.read<uint32_t>();
+  for (uint32_t i = 0; i < bitmask_count && r.valid(); ++i) {
+    trace::BitmaskSig *sig = new trace::BitmaskSig();
+    sig->id = r.read<uint32_t>();
+    sig->num_flags = r.read<uint32_t>();
+    trace::BitmaskFlag *flags = new trace::BitmaskFlag[sig->num_flags];
+    for (unsigned f = 0; f < sig->num_flags; ++f) {
+      flags[f].name = r.readString();
+      flags[f].value = r.read<uint64_t>();
+    }
+    sig->flags = flags;
+    m_bitmasks[sig->id] = sig;
+  }
+
+  const uint32_t struct_count = r.read<uint32_t>();
+  for (uint32_t i = 0; i < struct_count && r.valid(); ++i) {
+    trace::StructSig *sig = new trace::StructSig();
+    sig->id = r.read<uint32_t>();
+    sig->name = r.readString();
+    sig->num_members = r.read<uint32_t>();
+    const char **member_names = new const char *[sig->num_members];
+    for (unsigned m = 0; m < sig->num_members; ++m)
+      member_names[m] = r.readString();
+    sig->member_names = member_names;
+    m_structs[sig->id] = sig;
+  }
+
+  const uint32_t blob_count = r.read<uint32_t>();
+  for (uint32_t i = 0; i < blob_count && r.valid(); ++i) {
+    const uint64_t blob_size = r.read<uint64_t>();
+    m_blob_sizes.push_back(blob_size);
+    m_blobs.push_back(r.skip(blob_size));
+  }
+
+  const uint32_t call_count = r.read<uint32_t>();
+  for (uint32_t i = 0; i < call_count && r.valid(); ++i)
+    m_call_offsets.push_back(r.read<uint64_t>());
+  m_calls_start = r.pos() - base;
+
+  if (!r.valid()) {
+    close();
+    return false;
+  }
+  return true;
+}
+
+void
+FramePackParser::close(void) {
+  for (auto &f : m_functions) {
+    delete [] f.second->arg_names;
+    delete f.second;
+  }
+  m_functions.clear();
+  for (auto &e : m_enums) {
+    delete [] e.second->values;
+    delete e.second;
+  }
+  m_enums.clear();
+  for (auto &b : m_bitmasks) {
+    delete [] b.second->flags;
+    delete b.second;
+  }
+  m_bitmasks.clear();
+  for (auto &s : m_structs) {
+    delete [] s.second->member_names;
+    delete s.second;
+  }
+  m_structs.clear();
+  m_blobs.clear();
+  m_blob_sizes.clear();
+  m_call_offsets.clear();
+  m_properties.clear();
+  m_data.clear();
+  m_next_call = 0;
+}
+
+Call *
+FramePackParser::parse_call(void) {
+  if (m_next_call >= m_call_offsets.size())
+    return NULL;
+  const char *base = m_data.data();
+  Reader r(base + m_calls_start + m_call_offsets[m_next_call],
+           base + m_data.size());
+  ++m_next_call;
+
+  const uint32_t call_no = r.read<uint32_t>();
+  auto sig = m_functions.find(r.read<uint32_t>());
+  if (sig == m_functions.end())
+    return NULL;
+  const uint32_t thread_id = r.read<uint32_t>();
+  const trace::CallFlags flags =
+      static_cast<trace::CallFlags>(r.read<uint32_t>());
+  Call *call = new Call(sig->second, flags, thread_id);
+  call->no = call_no;
+  const uint32_t arg_count = r.read<uint32_t>();
+  call->args.resize(arg_count);
+  for (uint32_t i = 0; i < arg_count; ++i)
+    call->args[i].value = readValue(&r);
+  call->ret = readValue(&r);
+  if (!r.valid()) {
+    delete call;
+    return NULL;
+  }
+  return call;
+}
+
+Value *
+FramePackParser::readValue(Reader *r) {
+  switch (r->read<uint8_t>()) {
+    case TAG_NULL:
+      return NULL;
+    case TAG_BOOL:
+      return new trace::Bool(r->read<uint8_t>() != 0);
+    case TAG_SINT:
+      return new trace::SInt(r->read<int64_t>());
+    case TAG_UINT:
+      return new trace::UInt(r->read<uint64_t>());
+    case TAG_FLOAT:
+      return new trace::Float(r->read<float>());
+    case TAG_DOUBLE:
+      return new trace::Double(r->read<double>());
+    case TAG_STRING: {
+      // trace::String owns its value
+      const char *s = r->readString();
+      char *copy = new char[strlen(s) + 1];
+      strcpy(copy, s);  // NOLINT
+      return new trace::String(copy);
+    }
+    case TAG_WSTRING: {
+      const uint32_t len = r->read<uint32_t>();
+      wchar_t *copy = new wchar_t[len + 1];
+      for (uint32_t i = 0; i < len; ++i)
+        copy[i] = r->read<wchar_t>();
+      copy[len] = 0;
+      return new trace::WString(copy);
+    }
+    case TAG_ENUM: {
+      auto sig = m_enums.find(r->read<uint32_t>());
+      const int64_t value = r->read<int64_t>();
+      if (sig == m_enums.end())
+        return new trace::SInt(value);
+      return new trace::Enum(sig->second, value);
+    }
+    case TAG_BITMASK: {
+      auto sig = m_bitmasks.find(r->read<uint32_t>());
+      const uint64_t value = r->read<uint64_t>();
+      if (sig == m_bitmasks.end())
+        return new trace::UInt(value);
+      return new trace::Bitmask(sig->second, value);
+    }
+    case TAG_STRUCT: {
+      auto sig = m_structs.find(r->read<uint32_t>());
+      if (sig == m_structs.end())
+        return NULL;
+      trace::Struct *s = new trace::Struct(sig->second);
+      for (unsigned i = 0; i < sig->second->num_members; ++i)
+        s->members[i] = readValue(r);
+      return s;
+    }
+    case TAG_ARRAY: {
+      const uint32_t len = r->read<uint32_t>();
+      trace::Array *a = new trace::Array(len);
+      for (uint32_t i = 0; i < len; ++i)
+        a->values[i] = readValue(r);
+      return a;
+    }
+    case TAG_BLOB: {
+      const uint32_t index = r->read<uint32_t>();
+      if (index >= m_blobs.size())
+        return NULL;
+      // the retracer may keep the buffer of a blob after the call is
+      // deleted, or the pack is closed, so each blob owns a copy.
+      trace::Blob *b = new trace::Blob(m_blob_sizes[index]);
+      memcpy(b->buf, m_blobs[index], m_blob_sizes[index]);
+      return b;
+    }
+    case TAG_POINTER:
+      return new trace::Pointer(r->read<uint64_t>());
+    case TAG_REPR: {
+      Value *human = readValue(r);
+      Value *machine = readValue(r);
+      return new trace::Repr(human, machine);
+    }
+  }
+  return NULL;
+}
+
+void
+FramePackParser::getBookmark(trace::ParseBookmark &bookmark) {
+  bookmark.offset.chunk = m_next_call;
+  bookmark.offset.offsetInChunk = 0;
+  bookmark.next_call_no = 0;
+}
+
+void
+FramePackParser::setBookmark(const trace::ParseBookmark &bookmark) {
+  m_next_call = bookmark.offset.chunk;
+}
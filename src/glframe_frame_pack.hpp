@@ -0,0 +1,113 @@
+/**************************************************************************
+ *
+ * Copyright 2019 Intel Corporation
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * Authors:
+ *   Mark Janes <mark.a.janes@intel.com>
+ **************************************************************************/
+
+#ifndef _GLFRAME_FRAME_PACK_HPP_
+#define _GLFRAME_FRAME_PACK_HPP_
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "glframe_traits.hpp"
+#include "trace_parser.hpp"
+
+namespace glretrace {
+
+// A frame pack holds the parsed calls of a frame range in a compact,
+// position-independent file.  Signatures are stored once, and
+// identical blobs (eg repeated buffer uploads) are stored once and
+// shared by every call that references them.
+//
+// FramePackWriter serializes calls as they are provided.
+// FramePackParser serves the stored calls through the
+// trace::AbstractParser interface, so that RetraceContext can build
+// its renders from a pack without invoking the apitrace parser or
+// decompressor.
+class FramePackWriter : NoCopy, NoAssign, NoMove {
+ public:
+  FramePackWriter();
+  void write(const trace::Call &call);
+  // writes the pack to path.  Returns false on failure.
+  bool commit(const std::string &path,
+              unsigned long long trace_version,
+              const trace::Properties &properties) const;
+
+ private:
+  void writeValue(const trace::Value *value);
+  void writeString(const char *s);
+  template <class T> void writePod(const T &v);
+
+  std::vector<char> m_calls;
+  std::vector<uint64_t> m_call_offsets;
+  std::map<unsigned, const trace::FunctionSig *> m_functions;
+  std::map<unsigned, const trace::EnumSig *> m_enums;
+  std::map<unsigned, const trace::BitmaskSig *> m_bitmasks;
+  std::map<unsigned, const trace::StructSig *> m_structs;
+  std::map<std::string, uint32_t> m_blob_index;
+  std::vector<std::string> m_blobs;
+};
+
+class FramePackParser : public trace::AbstractParser,
+                        NoCopy, NoAssign, NoMove {
+ public:
+  FramePackParser();
+  ~FramePackParser();
+
+  bool open(const char *filename);
+  void close(void);
+  trace::Call *parse_call(void);
+  // bookmarks hold the index of the next call in the pack
+  void getBookmark(trace::ParseBookmark &bookmark);
+  void setBookmark(const trace::ParseBookmark &bookmark);
+  unsigned long long getVersion(void) const { return m_version; }
+  const trace::Properties &getProperties(void) const {
+    return m_properties;
+  }
+
+ private:
+  class Reader;
+  trace::Value *readValue(Reader *r);
+
+  std::vector<char> m_data;
+  unsigned long long m_version;
+  trace::Properties m_properties;
+  std::map<unsigned, trace::FunctionSig *> m_functions;
+  std::map<unsigned, trace::EnumSig *> m_enums;
+  std::map<unsigned, trace::BitmaskSig *> m_bitmasks;
+  std::map<unsigned, trace::StructSig *> m_structs;
+  std::vector<const char *> m_blobs;
+  std::vector<uint64_t> m_blob_sizes;
+  std::vector<uint64_t> m_call_offsets;
+  uint64_t m_calls_start;
+  size_t m_next_call;
+};
+
+}  // namespace glretrace
+
+#endif  // _GLFRAME_FRAME_PACK_HPP_
@@ -0,0 +1,140 @@
+/**************************************************************************
+ *
+ * Copyright 2019 Intel Corporation
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * Authors:
+ *   Mark Janes <mark.a.janes@intel.com>
+ **************************************************************************/
+
+#include "glframe_gl_errors.hpp"
+
+#include <GL/glext.h>
+
+#include <atomic>
+#include <map>
+#include <string>
+
+#include "glframe_call_class.hpp"
+#include "glframe_glhelper.hpp"
+#include "glretrace.hpp"
+
+using glretrace::CallClass;
+using glretrace::GlErrors;
+using glretrace::GlFunctions;
+
+namespace {
+
+// incremented by the debug callback.  Synchronous output invokes it
+// on the retrace thread, but the trace may disable that.
+std::atomic<unsigned> reported_errors(0);
+unsigned errors_at_begin = 0;
+
+glretrace::Context *current_context = NULL;
+bool current_has_callback = false;
+
+// KHR_debug support for each context.  A context pointer may be
+// reused after the context is destroyed, so a stale entry is possible.
+// That is harmless: install_callback() fails on a context that lacks
+// KHR_debug, and a context that has it falls back to glGetError.
+std::map<glretrace::Context *, bool> khr_debug;
+
+bool
+has_khr_debug(glretrace::Context *context) {
+  auto i = khr_debug.find(context);
+  if (i != khr_debug.end())
+    return i->second;
+  std::string extensions;
+  GlFunctions::GetGlExtensions(&extensions);
+  const bool supported =
+      (extensions.find("GL_KHR_debug") != std::string::npos);
+  khr_debug[context] = supported;
+  return supported;
+}
+
+void GLAPIENTRY
+on_debug_message(GLenum, GLenum type, GLuint, GLenum, GLsizei,
+                 const GLchar *, const void *) {
+  if (type == GL_DEBUG_TYPE_ERROR)
+    ++reported_errors;
+}
+
+// installs the debug callback on the current context, reporting only
+// errors.  Output is synchronous, so that an error is counted before
+// the call that generated it returns.  Returns false if the context
+// does not support KHR_debug, in which case glGetError must be used.
+bool
+install_callback() {
+  if (!has_khr_debug(current_context))
+    return false;
+  while (GlFunctions::GetError() != GL_NO_ERROR) {}
+  if (!GlFunctions::DebugMessageCallback(on_debug_message, NULL))
+    return false;
+  GlFunctions::DebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE,
+                                   0, NULL, GL_FALSE);
+  GlFunctions::DebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_ERROR,
+                                   GL_DONT_CARE, 0, NULL, GL_TRUE);
+  GlFunctions::Enable(GL_DEBUG_OUTPUT);
+  GlFunctions::Enable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+  return GlFunctions::GetError() == GL_NO_ERROR;
+}
+
+// true if the call may disable, filter or defer the debug messages
+// which report errors
+bool
+changes_debug_output(const trace::Call &call) {
+  const uint32_t flags = CallClass::get(call);
+  if (flags & CallClass::DEBUG_MESSAGE)
+    return true;
+  if (!(flags & CallClass::TOGGLES_CAPABILITY))
+    return false;
+  const unsigned cap = call.args[0].value->toUInt();
+  return ((cap == GL_DEBUG_OUTPUT) || (cap == GL_DEBUG_OUTPUT_SYNCHRONOUS));
+}
+
+}  // namespace
+
+void
+GlErrors::begin() {
+  glretrace::Context *context = glretrace::getCurrentContext();
+  if (context != current_context) {
+    // contexts are not remembered, as a context pointer may be reused
+    // after the context is destroyed.  Instead, the callback is
+    // installed after each context switch.
+    current_context = context;
+    current_has_callback = (context != NULL) && install_callback();
+  }
+  errors_at_begin = reported_errors;
+}
+
+GLenum
+GlErrors::end(const trace::Call &call) {
+  GLenum err = GL_NO_ERROR;
+  if (!current_has_callback || (reported_errors != errors_at_begin)) {
+    err = GlFunctions::GetError();
+    if (err != GL_NO_ERROR)
+      while (GlFunctions::GetError() != GL_NO_ERROR) {}
+  }
+  if (current_has_callback && changes_debug_output(call))
+    // falls back to glGetError if the callback cannot be installed
+    current_has_callback = install_callback();
+  return err;
+}
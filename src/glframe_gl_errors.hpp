@@ -0,0 +1,59 @@
+/**************************************************************************
+ *
+ * Copyright 2019 Intel Corporation
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * Authors:
+ *   Mark Janes <mark.a.janes@intel.com>
+ **************************************************************************/
+
+#ifndef _GLFRAME_GL_ERRORS_HPP_
+#define _GLFRAME_GL_ERRORS_HPP_
+
+#include <GL/gl.h>
+
+namespace trace {
+class Call;
+}
+
+namespace glretrace {
+
+// Collects the GL errors generated by retraced calls.  When the
+// current context supports KHR_debug, errors are reported
+// synchronously through a debug message callback, and glGetError is
+// only called to identify an error that the callback reported.  Other
+// contexts fall back to calling glGetError after every call.  The
+// callback is installed again if the trace changes the debug output.
+class GlErrors {
+ public:
+  // call before retracing each call
+  static void begin();
+  // returns the first error generated by the call since begin(), or
+  // GL_NO_ERROR.  Remaining errors are drained.
+  static GLenum end(const trace::Call &call);
+
+ private:
+  GlErrors();
+};
+
+}  // namespace glretrace
+
+#endif  // _GLFRAME_GL_ERRORS_HPP_
@@ -61,19 +61,23 @@ Logger::Create() {
 
 void
 Logger::Begin() {
+  m_instance->m_started = true;
   m_instance->Start();
 }
 
 void
 Logger::Destroy() {
-  m_instance->Stop();
-  m_instance->Join();
+  if (m_instance->m_started) {
+    m_instance->Stop();
+    m_instance->Join();
+  }
   delete m_instance;
   m_instance = NULL;
 }
 
 Logger::Logger(const std::string &out_path) : Thread("logger"),
                                               m_severity(WARN),
+                                              m_started(false),
                                               m_running(true),
                                               m_stderr(false) {
   std::stringstream ss;
@@ -127,11 +131,16 @@ Logger::Log(Severity s, const std::string &file, int line,
      << file << " " << line
      << " (" << format_severity(s) << "): "
      << message << "\n";
-  ScopedLock sl(m_instance->m_protect);
-  m_instance->m_q.push(ss.str());
-  m_instance->m_sem.post();
-  if (m_instance->m_stderr)
-    std::cerr << ss.str();
+  {
+    ScopedLock sl(m_instance->m_protect);
+    m_instance->m_q.push(ss.str());
+    if (m_instance->m_started)
+      m_instance->m_sem.post();
+    if (m_instance->m_stderr)
+      std::cerr << ss.str();
+  }
+  if (!m_instance->m_started)
+    Flush();
 }
 
 void
@@ -140,6 +149,11 @@ Logger::SetSeverity(Severity s) {
   m_instance->m_severity = s;
 }
 
+bool
+Logger::Enabled(Severity s) {
+  return m_instance && (s >= m_instance->m_severity);
+}
+
 void
 Logger::Flush() {
   assert(m_instance);
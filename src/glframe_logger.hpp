@@ -50,6 +50,8 @@ enum Severity {
 class Logger : public Thread {
  public:
   static void Create();
+  // starts the logging thread.  Until then, messages are written as
+  // they are logged, as in a process which forks workers.
   static void Begin();
   static void Destroy();
   static void Log(Severity s, const std::string &file, int line,
@@ -57,6 +59,9 @@ class Logger : public Thread {
   static void GetLog(std::string *out);
   static void Flush();
   static void SetSeverity(Severity s);
+  // true if messages of the severity are logged.  Callers avoid
+  // formatting messages that would be discarded.
+  static bool Enabled(Severity s);
   static void EnableStderr();
   void Run();
 
@@ -71,6 +76,7 @@ class Logger : public Thread {
   Semaphore m_sem;
   FILE *m_fh, *m_read_fh;
   int m_severity;
+  bool m_started;
   bool m_running;
   bool m_stderr;
 };
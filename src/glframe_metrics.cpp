@@ -27,20 +27,37 @@
 
 #include "glframe_metrics.hpp"
 
+#include <stdlib.h>
 #include <string.h>
+
 #include <string>
 
 #include "glframe_metrics_intel.hpp"
 #include "glframe_metrics_amd.hpp"
+#include "glframe_metrics_pipeline.hpp"
+#include "glframe_metrics_timer.hpp"
 #include "glframe_glhelper.hpp"
 #include "glframe_metrics_amd_gpa.hpp"
 
 using glretrace::PerfMetrics;
+using glretrace::PerfMetricsPipeline;
+using glretrace::PerfMetricsTimer;
 using glretrace::OnFrameRetrace;
 
 PerfMetrics *PerfMetrics::Create(OnFrameRetrace *callback) {
   std::string extensions;
 
+  // FRAMERETRACE_METRICS=timer selects gpu timer queries, and
+  // FRAMERETRACE_METRICS=pipeline selects pipeline statistics with gpu
+  // time, even when vendor metrics are available.
+  const char *backend = getenv("FRAMERETRACE_METRICS");
+  if (backend && (strcmp(backend, "timer") == 0) &&
+      PerfMetricsTimer::Supported())
+    return new PerfMetricsTimer(callback);
+  if (backend && (strcmp(backend, "pipeline") == 0) &&
+      PerfMetricsPipeline::Supported())
+    return new PerfMetricsPipeline(callback, PerfMetricsTimer::Supported());
+
   const GLubyte *renderer = GlFunctions::GetString(GL_RENDERER);
   if (strstr((const char*)renderer, "AMD") != NULL)
       return new glretrace::PerfMetricsAMDGPA(callback);
@@ -50,6 +67,11 @@ PerfMetrics *PerfMetrics::Create(OnFrameRetrace *callback) {
     return new PerfMetricsIntel(callback);
   if (extensions.find("GL_AMD_performance_monitor") != std::string::npos)
     return new PerfMetricsAMD(callback);
+  // both query backends are collected in a single pass
+  if (PerfMetricsPipeline::Supported())
+    return new PerfMetricsPipeline(callback, PerfMetricsTimer::Supported());
+  if (PerfMetricsTimer::Supported())
+    return new PerfMetricsTimer(callback);
 
   return new glretrace::DummyMetrics();
 }
@@ -57,6 +57,24 @@ class PerfMetrics {
   // with the id
   virtual void selectMetric(MetricId metric) = 0;
 
+  // Plans the collection of metrics in as few passes as possible,
+  // returning the number of passes.  An empty list schedules every
+  // metric.  Implementations which cannot combine metrics make a pass
+  // for each metric, or for each group.
+  virtual int schedule(const std::vector<MetricId> &metrics) {
+    m_scheduled = metrics;
+    return m_scheduled.empty() ? groupCount() : m_scheduled.size();
+  }
+
+  // Subsequent begin/end will collect data for every metric scheduled
+  // in the pass
+  virtual void selectPass(int pass) {
+    if (m_scheduled.empty())
+      selectGroup(pass);
+    else
+      selectMetric(m_scheduled[pass]);
+  }
+
   // Begin collection for selected metrics.  When reported, the
   // counter values will be associated with the specified render.
   virtual void begin(RenderId render) = 0;
@@ -72,6 +90,9 @@ class PerfMetrics {
   // Call before changing to another context
   virtual void endContext() = 0;
   virtual void beginContext() = 0;
+
+ protected:
+  std::vector<MetricId> m_scheduled;
 };
 
 class DummyMetrics : public PerfMetrics {
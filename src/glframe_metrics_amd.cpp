@@ -30,7 +30,9 @@
 #include <GL/gl.h>
 #include <GL/glext.h>
 
+#include <deque>
 #include <string>
+#include <utility>
 #include <vector>
 #include <map>
 
@@ -96,11 +98,15 @@ class PerfMetricGroup : public NoCopy, NoAssign {
   void metrics(std::vector<MetricDescription> *m) const;
   void begin(RenderId render);
   void end(RenderId render);
-  void publish(MetricId metric, PerfMetricsAMD::MetricMap *m);
+  void publish(PerfMetricsAMD::MetricMap *m);
   void selectMetric(MetricId metric);
 
  private:
+  typedef std::pair<RenderId, GLuint> ExtantMonitor;
   void selectMetric(MetricId metric, bool enabled);
+  bool read(const ExtantMonitor &monitor, bool wait);
+  void poll();
+
   std::string m_group_name;
   const int m_group_id, m_offset;
   std::vector<unsigned char> m_data_buf;
@@ -108,11 +114,17 @@ class PerfMetricGroup : public NoCopy, NoAssign {
 
   std::map<MetricId, PerfMetric *> m_metrics;
 
-  // represent monitors that have not produced results
-  std::map<RenderId, int> m_extant_monitors;
+  // represent monitors that have not produced results, in the order
+  // they were submitted
+  std::deque<ExtantMonitor> m_extant_monitors;
 
-  // represent monitors that can be reused
+  // represent monitors that can be reused.  Monitors are kept for the
+  // lifetime of the group, so the pool grows to the number of renders
+  // in the frame.
   std::vector<unsigned int> m_free_monitors;
+
+  // results which were read before publish
+  PerfMetricsAMD::MetricMap m_results;
 };
 
 }  // namespace
@@ -299,6 +311,8 @@ PerfMetricGroup::selectMetric(MetricId metric, bool enabled) {
 
 void
 PerfMetricGroup::begin(RenderId render) {
+  poll();
+
   if (m_free_monitors.empty()) {
     assert(!GL::GetError());
     m_free_monitors.resize(m_extant_monitors.empty() ?
@@ -310,68 +324,86 @@ PerfMetricGroup::begin(RenderId render) {
   }
   assert(!m_free_monitors.empty());
   GlFunctions::BeginPerfMonitorAMD(m_free_monitors.back());
-  m_extant_monitors[render] = m_free_monitors.back();
+  m_extant_monitors.push_back(ExtantMonitor(render, m_free_monitors.back()));
   m_free_monitors.pop_back();
 }
 
-void
-PerfMetricGroup::publish(MetricId metric,
-                         PerfMetricsAMD::MetricMap *out_metrics) {
-  for (auto extant_monitor : m_extant_monitors) {
-    GLuint ready_for_read = 0, data_size = 0;
-    GLsizei bytes_written = 0;
-    while (!ready_for_read) {
-      GlFunctions::GetPerfMonitorCounterDataAMD(
-          extant_monitor.second, GL_PERFMON_RESULT_AVAILABLE_AMD,
-          sizeof(GLuint), &ready_for_read, &bytes_written);
-      assert(bytes_written == sizeof(GLuint));
-      assert(!GL::GetError());
-      if (!ready_for_read)
-        GlFunctions::Finish();
-    }
-    assert(ready_for_read);
-    GlFunctions::GetPerfMonitorCounterDataAMD(extant_monitor.second,
-                                              GL_PERFMON_RESULT_SIZE_AMD,
-                                              sizeof(GLuint), &data_size,
-                                              &bytes_written);
-    assert(!GL::GetError());
-    assert(bytes_written == sizeof(GLuint));
-    std::vector<unsigned char> buf(data_size);
+bool
+PerfMetricGroup::read(const ExtantMonitor &monitor, bool wait) {
+  GLuint ready_for_read = 0, data_size = 0;
+  GLsizei bytes_written = 0;
+  while (!ready_for_read) {
     GlFunctions::GetPerfMonitorCounterDataAMD(
-            extant_monitor.second, GL_PERFMON_RESULT_AMD, data_size,
-            reinterpret_cast<unsigned int *>(buf.data()), &bytes_written);
-    const unsigned char *buf_ptr = buf.data();
-    const unsigned char *buf_end = buf_ptr + bytes_written;
-    while (buf_ptr < buf_end) {
-      const GLuint *group = reinterpret_cast<const GLuint *>(buf_ptr);
-      const GLuint *counter = group + 1;
-      buf_ptr += 2*sizeof(GLuint);
-      assert((int)(*group) == m_group_id);
-      if (metric != ALL_METRICS_IN_GROUP)
-        assert(metric.counter() == *counter);
-      MetricId parsed_metric(*group, *counter);
-      assert(m_metrics.find(parsed_metric) != m_metrics.end());
-
-      float value = 0.0;
-      int bytes_read = 0;
-      m_metrics[parsed_metric]->getMetric(buf_ptr, &value, &bytes_read);
-      (*out_metrics)[parsed_metric][extant_monitor.first] = value;
-      buf_ptr += bytes_read;
-    }
-    m_free_monitors.push_back(extant_monitor.second);
+        monitor.second, GL_PERFMON_RESULT_AVAILABLE_AMD,
+        sizeof(GLuint), &ready_for_read, &bytes_written);
+    assert(bytes_written == sizeof(GLuint));
+    assert(!GL::GetError());
+    if (ready_for_read)
+      break;
+    if (!wait)
+      return false;
+    GlFunctions::Finish();
+  }
+  GlFunctions::GetPerfMonitorCounterDataAMD(monitor.second,
+                                            GL_PERFMON_RESULT_SIZE_AMD,
+                                            sizeof(GLuint), &data_size,
+                                            &bytes_written);
+  assert(!GL::GetError());
+  assert(bytes_written == sizeof(GLuint));
+  m_data_buf.resize(data_size);
+  GlFunctions::GetPerfMonitorCounterDataAMD(
+          monitor.second, GL_PERFMON_RESULT_AMD, data_size,
+          reinterpret_cast<unsigned int *>(m_data_buf.data()),
+          &bytes_written);
+  const unsigned char *buf_ptr = m_data_buf.data();
+  const unsigned char *buf_end = buf_ptr + bytes_written;
+  while (buf_ptr < buf_end) {
+    const GLuint *group = reinterpret_cast<const GLuint *>(buf_ptr);
+    const GLuint *counter = group + 1;
+    buf_ptr += 2*sizeof(GLuint);
+    assert((int)(*group) == m_group_id);
+    if (m_metric != ALL_METRICS_IN_GROUP)
+      assert(m_metric.counter() == *counter);
+    MetricId parsed_metric(*group, *counter);
+    assert(m_metrics.find(parsed_metric) != m_metrics.end());
+
+    float value = 0.0;
+    int bytes_read = 0;
+    m_metrics[parsed_metric]->getMetric(buf_ptr, &value, &bytes_read);
+    m_results[parsed_metric][monitor.first] = value;
+    buf_ptr += bytes_read;
+  }
+  m_free_monitors.push_back(monitor.second);
+  return true;
+}
+
+void
+PerfMetricGroup::poll() {
+  // monitors complete in the order they were submitted
+  while (!m_extant_monitors.empty()) {
+    if (!read(m_extant_monitors.front(), false))
+      break;
+    m_extant_monitors.pop_front();
   }
+}
+
+void
+PerfMetricGroup::publish(PerfMetricsAMD::MetricMap *out_metrics) {
+  for (auto extant_monitor : m_extant_monitors)
+    read(extant_monitor, true);
   m_extant_monitors.clear();
-  GlFunctions::DeletePerfMonitorsAMD(m_free_monitors.size(),
-                                     m_free_monitors.data());
-  m_free_monitors.clear();
+  for (auto &parsed_metric : m_results)
+    for (auto &datapoint : parsed_metric.second)
+      (*out_metrics)[parsed_metric.first][datapoint.first] = datapoint.second;
+  m_results.clear();
 }
 
 void
 PerfMetricGroup::end(RenderId render) {
-  auto i = m_extant_monitors.find(render);
-  if (i == m_extant_monitors.end())
+  if (m_extant_monitors.empty() ||
+      m_extant_monitors.back().first != render)
     return;
-  GlFunctions::EndPerfMonitorAMD(i->second);
+  GlFunctions::EndPerfMonitorAMD(m_extant_monitors.back().second);
 }
 
 
@@ -448,7 +480,7 @@ PerfMetricsContextAMD::selectMetric(MetricId metric) {
 
 void
 PerfMetricsContextAMD::publish(PerfMetricsAMD::MetricMap *metrics)  {
-  current_group->publish(current_metric, metrics);
+  current_group->publish(metrics);
 }
 
 void
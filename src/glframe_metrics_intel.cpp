@@ -30,7 +30,11 @@
 #include <GL/gl.h>
 #include <GL/glext.h>
 
+#include <algorithm>
+#include <deque>
+#include <set>
 #include <string>
+#include <utility>
 #include <vector>
 #include <map>
 
@@ -87,23 +91,38 @@ class PerfMetricGroup : public NoCopy, NoAssign {
   ~PerfMetricGroup();
   const std::string &name() const { return m_query_name; }
   void metrics(std::vector<MetricDescription> *m) const;
+  // maps counters of the group to the ids they are reported under.
+  // An empty selection reports every counter.
+  typedef std::map<MetricId, MetricId> Selection;
+  void select(const Selection &metrics);
   void begin(RenderId render);
   void end(RenderId render);
-  void publish(MetricId metric, PerfMetricsIntel::MetricMap *m);
+  void publish(PerfMetricsIntel::MetricMap *m);
 
  private:
+  typedef std::pair<RenderId, GLuint> ExtantQuery;
+  bool read(const ExtantQuery &query, GLuint flags);
+  void poll();
+
   std::string m_query_name;
   const int m_query_id;
   unsigned int m_data_size;
   std::vector<unsigned char> m_data_buf;
+  Selection m_selected;
 
   std::map<MetricId, PerfMetric *> m_metrics;
 
-  // represent queries that have not produced results
-  std::map<RenderId, int> m_extant_query_handles;
+  // represent queries that have not produced results, in the order
+  // they were submitted
+  std::deque<ExtantQuery> m_extant_query_handles;
 
-  // represent query handles that can be reused
+  // represent query handles that can be reused.  Handles are kept
+  // for the lifetime of the group, so the pool grows to the number of
+  // renders in the frame.
   std::vector<unsigned int> m_free_query_handles;
+
+  // results which were read before publish
+  PerfMetricsIntel::MetricMap m_results;
 };
 
 }  // namespace
@@ -115,6 +134,8 @@ class PerfMetricsContextInterface {
   virtual int groupCount() const = 0;
   virtual void selectMetric(MetricId metric) = 0;
   virtual void selectGroup(int index) = 0;
+  virtual int schedule(const std::vector<MetricId> &metrics) = 0;
+  virtual void selectPass(int pass) = 0;
   virtual void begin(RenderId render) = 0;
   virtual void end() = 0;
   virtual void publish(PerfMetricsIntel::MetricMap *metrics) = 0;
@@ -127,6 +148,8 @@ class NoMetrics : public PerfMetricsContextInterface {
   int groupCount() const { return 0; }
   void selectMetric(MetricId metric) {}
   void selectGroup(int index) {}
+  int schedule(const std::vector<MetricId> &metrics) { return 0; }
+  void selectPass(int pass) {}
   void begin(RenderId render) {}
   void end() {}
   void publish(PerfMetricsIntel::MetricMap *metrics) {}
@@ -141,6 +164,8 @@ class PerfMetricsContext : public PerfMetricsContextInterface,
   int groupCount() const;
   void selectMetric(MetricId metric);
   void selectGroup(int index);
+  int schedule(const std::vector<MetricId> &metrics);
+  void selectPass(int pass);
   void begin(RenderId render);
   void end();
   void publish(PerfMetricsIntel::MetricMap *metrics);
@@ -148,6 +173,16 @@ class PerfMetricsContext : public PerfMetricsContextInterface,
   std::vector<PerfMetricGroup *> groups;
   // indicates offset in groups of PerfMetricGroup reporting MetricId
   std::map<MetricId, int> metric_map;
+  // names of the metrics in the published list, and their ids
+  std::map<MetricId, std::string> metric_names;
+  std::map<std::string, MetricId> published_ids;
+  // for each group, the ids of its counters by name
+  std::vector<std::map<std::string, MetricId>> group_metrics;
+  struct Pass {
+    int group;
+    PerfMetricGroup::Selection metrics;
+  };
+  std::vector<Pass> passes;
   // indicates the group that will handle subsequent begin/end calls
   PerfMetricGroup *current_group;
   MetricId current_metric;
@@ -156,6 +191,8 @@ class PerfMetricsContext : public PerfMetricsContextInterface,
 
 }  // namespace glretrace
 
+static const MetricId ALL_METRICS_IN_GROUP = MetricId(~ID_PREFIX_MASK);
+
 PerfMetricsContext::PerfMetricsContext(OnFrameRetrace *cb)
     : current_group(NULL) {
   GLuint query_id;
@@ -204,12 +241,16 @@ PerfMetricsContext::PerfMetricsContext(OnFrameRetrace *cb)
     }
 
     groups.push_back(g);
+    group_metrics.resize(groups.size());
     metrics.clear();
     g->metrics(&metrics);
     for (auto &d : metrics) {
+      group_metrics.back()[d.name] = d.id;
       if (known_metrics.find(d.name) == known_metrics.end()) {
         known_metrics[d.name] = d;
         metric_map[d.id] = group_index;
+        metric_names[d.id] = d.name;
+        published_ids[d.name] = d.id;
       }
     }
     ++group_index;
@@ -233,7 +274,8 @@ PerfMetricsContext::~PerfMetricsContext() {
   groups.clear();
 }
 
-PerfMetricGroup::PerfMetricGroup(int query_id) : m_query_id(query_id) {
+PerfMetricGroup::PerfMetricGroup(int query_id)
+    : m_query_id(query_id) {
   static GLint max_name_len = 0;
   if (max_name_len == 0)
     GlFunctions::GetIntegerv(GL_PERFQUERY_QUERY_NAME_LENGTH_MAX_INTEL,
@@ -274,8 +316,16 @@ PerfMetricGroup::metrics(std::vector<MetricDescription> *m) const {
   }
 }
 
+void
+PerfMetricGroup::select(const Selection &metrics) {
+  assert(m_extant_query_handles.empty());
+  m_selected = metrics;
+}
+
 void
 PerfMetricGroup::begin(RenderId render) {
+  poll();
+
   if (m_free_query_handles.empty()) {
     GLuint query_handle;
     GlFunctions::CreatePerfQueryINTEL(m_query_id, &query_handle);
@@ -300,47 +350,63 @@ PerfMetricGroup::begin(RenderId render) {
     GRLOG(glretrace::WARN, "failed to begin metrics query");
     glretrace_delay(200);
   }
-  m_extant_query_handles[render] = query_handle;
+  m_extant_query_handles.push_back(ExtantQuery(render, query_handle));
 }
 
-static const MetricId ALL_METRICS_IN_GROUP = MetricId(~ID_PREFIX_MASK);
+bool
+PerfMetricGroup::read(const ExtantQuery &query, GLuint flags) {
+  memset(m_data_buf.data(), 0, m_data_buf.size());
+  GLuint bytes_written = 0;
+  GlFunctions::GetPerfQueryDataINTEL(query.second, flags,
+                                     m_data_size, m_data_buf.data(),
+                                     &bytes_written);
+  if (bytes_written == 0)
+    // result is not available
+    return false;
+  assert(bytes_written == m_data_size);
+
+  if (m_selected.empty()) {
+    for (auto desired_metric : m_metrics) {
+      MetricId met_id = desired_metric.first;
+      m_results[met_id][query.first] =
+          desired_metric.second->getMetric(m_data_buf);
+    }
+  } else {
+    for (auto desired_metric : m_selected)
+      m_results[desired_metric.second][query.first] =
+          m_metrics[desired_metric.first]->getMetric(m_data_buf);
+  }
+  m_free_query_handles.push_back(query.second);
+  return true;
+}
 
 void
-PerfMetricGroup::publish(MetricId metric,
-                         PerfMetricsIntel::MetricMap *out_metrics) {
-  const bool publish_all = (metric == ALL_METRICS_IN_GROUP);
-  for (auto extant_query : m_extant_query_handles) {
-    memset(m_data_buf.data(), 0, m_data_buf.size());
-    GLuint bytes_written;
-    GlFunctions::GetPerfQueryDataINTEL(extant_query.second,
-                                       GL_PERFQUERY_WAIT_INTEL,
-                                       m_data_size, m_data_buf.data(),
-                                       &bytes_written);
-    assert(bytes_written == m_data_size);
-
-    if (publish_all) {
-      for (auto desired_metric : m_metrics) {
-        MetricId met_id = desired_metric.first;
-        (*out_metrics)[met_id][extant_query.first] =
-            desired_metric.second->getMetric(m_data_buf);
-      }
-    } else {
-        (*out_metrics)[metric][extant_query.first] =
-            m_metrics[metric]->getMetric(m_data_buf);
-    }
-    m_free_query_handles.push_back(extant_query.second);
+PerfMetricGroup::poll() {
+  // queries complete in the order they were submitted
+  while (!m_extant_query_handles.empty()) {
+    if (!read(m_extant_query_handles.front(),
+              GL_PERFQUERY_DONOT_FLUSH_INTEL))
+      break;
+    m_extant_query_handles.pop_front();
   }
+}
+
+void
+PerfMetricGroup::publish(PerfMetricsIntel::MetricMap *out_metrics) {
+  for (auto extant_query : m_extant_query_handles)
+    read(extant_query, GL_PERFQUERY_WAIT_INTEL);
   m_extant_query_handles.clear();
-  for (auto free_query : m_free_query_handles) {
-    GlFunctions::DeletePerfQueryINTEL(free_query);
-  }
-  m_free_query_handles.clear();
+  for (auto &metric : m_results)
+    for (auto &datapoint : metric.second)
+      (*out_metrics)[metric.first][datapoint.first] = datapoint.second;
+  m_results.clear();
 }
 
 void
 PerfMetricGroup::end(RenderId render) {
-  if (m_extant_query_handles.find(render) != m_extant_query_handles.end())
-    GlFunctions::EndPerfQueryINTEL(m_extant_query_handles[render]);
+  if (!m_extant_query_handles.empty() &&
+      m_extant_query_handles.back().first == render)
+    GlFunctions::EndPerfQueryINTEL(m_extant_query_handles.back().second);
 }
 
 
@@ -427,11 +493,14 @@ PerfMetricsContext::selectMetric(MetricId metric) {
   assert(metric_map.find(metric) != metric_map.end());
   current_metric = metric;
   current_group = groups[metric_map[metric]];
+  PerfMetricGroup::Selection selection;
+  selection[metric] = metric;
+  current_group->select(selection);
 }
 
 void
 PerfMetricsContext::publish(PerfMetricsIntel::MetricMap *metrics)  {
-  current_group->publish(current_metric, metrics);
+  current_group->publish(metrics);
 }
 
 void
@@ -456,10 +525,70 @@ PerfMetricsContext::selectGroup(int index) {
     return;
   current_group = groups[index];
   current_metric = ALL_METRICS_IN_GROUP;
+  current_group->select(PerfMetricGroup::Selection());
+}
+
+int
+PerfMetricsContext::schedule(const std::vector<MetricId> &metrics) {
+  passes.clear();
+  // Metrics are requested by name, and may be collected from any
+  // group which reports a counter with the same name.
+  std::set<std::string> remaining;
+  if (metrics.empty()) {
+    for (auto &i : published_ids)
+      remaining.insert(i.first);
+  }
+  for (auto m : metrics) {
+    auto name = metric_names.find(m);
+    if (name != metric_names.end())
+      remaining.insert(name->second);
+  }
+
+  // Each group requires a separate pass.  Greedily choose the group
+  // that reports the most outstanding metrics.
+  while (!remaining.empty()) {
+    int best = -1;
+    size_t best_count = 0;
+    for (size_t g = 0; g < group_metrics.size(); ++g) {
+      size_t count = 0;
+      for (auto &name : remaining)
+        count += group_metrics[g].count(name);
+      if (count > best_count) {
+        best = g;
+        best_count = count;
+      }
+    }
+    assert(best >= 0);
+    if (best < 0)
+      break;
+    Pass pass;
+    pass.group = best;
+    for (auto name = remaining.begin(); name != remaining.end(); ) {
+      auto counter = group_metrics[best].find(*name);
+      if (counter == group_metrics[best].end()) {
+        ++name;
+        continue;
+      }
+      // report under the id of the published metric list
+      pass.metrics[counter->second] = published_ids[*name];
+      name = remaining.erase(name);
+    }
+    passes.push_back(pass);
+  }
+  return passes.size();
+}
+
+void
+PerfMetricsContext::selectPass(int pass) {
+  if (pass >= static_cast<int>(passes.size()))
+    return;
+  current_group = groups[passes[pass].group];
+  current_metric = ALL_METRICS_IN_GROUP;
+  current_group->select(passes[pass].metrics);
 }
 
 PerfMetricsIntel::PerfMetricsIntel(OnFrameRetrace *cb)
-    : m_current_group(0) {
+    : m_current_group(0), m_current_pass(-1) {
   Context *c = getCurrentContext();
   m_current_context = new PerfMetricsContext(cb);
   if (!m_current_context->groupCount()) {
@@ -486,6 +615,7 @@ void
 PerfMetricsIntel::selectMetric(MetricId metric) {
   m_data.clear();
   m_current_metric = metric;
+  m_current_pass = -1;
   for (auto i : m_contexts)
     i.second->selectMetric(metric);
 }
@@ -494,10 +624,29 @@ void
 PerfMetricsIntel::selectGroup(int index) {
   m_current_group = index;
   m_current_metric = ALL_METRICS_IN_GROUP;
+  m_current_pass = -1;
   for (auto i : m_contexts)
     i.second->selectGroup(index);
 }
 
+int
+PerfMetricsIntel::schedule(const std::vector<MetricId> &metrics) {
+  m_data.clear();
+  m_scheduled = metrics;
+  m_current_pass = -1;
+  int pass_count = 0;
+  for (auto i : m_contexts)
+    pass_count = std::max(pass_count, i.second->schedule(metrics));
+  return pass_count;
+}
+
+void
+PerfMetricsIntel::selectPass(int pass) {
+  m_current_pass = pass;
+  for (auto i : m_contexts)
+    i.second->selectPass(pass);
+}
+
 void
 PerfMetricsIntel::begin(RenderId render) {
   if (!m_current_context) {
@@ -545,6 +694,12 @@ PerfMetricsIntel::beginContext() {
       m_current_context = new NoMetrics();
     }
     m_contexts[c] = m_current_context;
+    if (m_current_pass >= 0)
+      m_current_context->schedule(m_scheduled);
+  }
+  if (m_current_pass >= 0) {
+    m_current_context->selectPass(m_current_pass);
+    return;
   }
   m_current_context->selectGroup(m_current_group);
   if (m_current_metric() &&
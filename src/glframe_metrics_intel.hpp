@@ -47,6 +47,8 @@ class PerfMetricsIntel : public PerfMetrics, NoCopy, NoAssign {
   int groupCount() const;
   void selectMetric(MetricId metric);
   void selectGroup(int index);
+  int schedule(const std::vector<MetricId> &metrics);
+  void selectPass(int pass);
   void begin(RenderId render);
   void end();
   void publish(ExperimentId experimentCount,
@@ -61,6 +63,7 @@ class PerfMetricsIntel : public PerfMetrics, NoCopy, NoAssign {
   MetricMap m_data;
   int m_current_group;
   MetricId m_current_metric;
+  int m_current_pass;
 };
 
 }  // namespace glretrace
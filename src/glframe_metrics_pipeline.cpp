@@ -0,0 +1,94 @@
+/**************************************************************************
+ *
+ * Copyright 2019 Intel Corporation
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * Authors:
+ *   Mark Janes <mark.a.janes@intel.com>
+ **************************************************************************/
+
+#include "glframe_metrics_pipeline.hpp"
+
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "glframe_glhelper.hpp"
+
+using glretrace::GlFunctions;
+using glretrace::MetricId;
+using glretrace::OnFrameRetrace;
+using glretrace::PerfMetricsPipeline;
+using glretrace::PerfMetricsTimer;
+using glretrace::RenderQuery;
+
+namespace {
+
+// Each counter has its own target, so every counter is active at the
+// same time.  The metric group follows the 0xfff of the timer.
+const RenderQuery kCounters[] = {
+  { MetricId(0xffe, 1), GL_VERTICES_SUBMITTED_ARB, 1.0,
+    "Vertices Submitted",
+    "Vertices submitted to the primitive assembler" },
+  { MetricId(0xffe, 2), GL_PRIMITIVES_SUBMITTED_ARB, 1.0,
+    "Primitives Submitted",
+    "Primitives submitted to the primitive assembler" },
+  { MetricId(0xffe, 3), GL_VERTEX_SHADER_INVOCATIONS_ARB, 1.0,
+    "Vertex Shader Invocations",
+    "Number of times the vertex shader was invoked" },
+  { MetricId(0xffe, 4), GL_FRAGMENT_SHADER_INVOCATIONS_ARB, 1.0,
+    "Fragment Shader Invocations",
+    "Number of times the fragment shader was invoked" },
+  { MetricId(0xffe, 5), GL_COMPUTE_SHADER_INVOCATIONS_ARB, 1.0,
+    "Compute Shader Invocations",
+    "Number of times the compute shader was invoked" },
+  { MetricId(0xffe, 6), GL_CLIPPING_INPUT_PRIMITIVES_ARB, 1.0,
+    "Clipping Input Primitives",
+    "Primitives which reached the clipping stage" },
+  { MetricId(0xffe, 7), GL_CLIPPING_OUTPUT_PRIMITIVES_ARB, 1.0,
+    "Clipping Output Primitives",
+    "Primitives which passed the clipping stage" },
+};
+
+std::vector<RenderQuery>
+counters(bool gpu_time) {
+  std::vector<RenderQuery> queries;
+  if (gpu_time)
+    queries.push_back(PerfMetricsTimer::kGpuTime);
+  queries.insert(queries.end(), std::begin(kCounters), std::end(kCounters));
+  return queries;
+}
+
+}  // namespace
+
+PerfMetricsPipeline::PerfMetricsPipeline(OnFrameRetrace *cb, bool gpu_time)
+    : PerfMetricsQueries(counters(gpu_time), cb) {}
+
+bool
+PerfMetricsPipeline::Supported() {
+  std::string extensions;
+  GlFunctions::GetGlExtensions(&extensions);
+  return (extensions.find("GL_ARB_pipeline_statistics_query") !=
+          std::string::npos);
+}
@@ -0,0 +1,307 @@
+/**************************************************************************
+ *
+ * Copyright 2019 Intel Corporation
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * Authors:
+ *   Mark Janes <mark.a.janes@intel.com>
+ **************************************************************************/
+
+#include "glframe_metrics_timer.hpp"
+
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "glframe_glhelper.hpp"
+#include "glretrace.hpp"
+
+using glretrace::ExperimentId;
+using glretrace::GlFunctions;
+using glretrace::MetricId;
+using glretrace::MetricSeries;
+using glretrace::NoAssign;
+using glretrace::NoCopy;
+using glretrace::OnFrameRetrace;
+using glretrace::PerfMetricsQueries;
+using glretrace::PerfMetricsTimer;
+using glretrace::RenderId;
+using glretrace::RenderQueries;
+using glretrace::RenderQuery;
+using glretrace::SelectionId;
+
+namespace glretrace {
+
+// Queries bracketing each render, for a single context.  Query
+// objects are pooled and reused across passes, and the results of
+// completed renders are read while subsequent renders execute.
+class RenderQueries : NoCopy, NoAssign {
+ public:
+  explicit RenderQueries(const std::vector<RenderQuery> &queries);
+  ~RenderQueries();
+  void begin(RenderId render);
+  void end();
+  void publish(PerfMetricsQueries::MetricMap *out);
+
+ private:
+  struct Extant {
+    RenderId render;
+    // query objects for each RenderQuery, in order
+    std::vector<GLuint> objects;
+  };
+  bool read(const Extant &e, bool wait);
+  void poll();
+
+  const std::vector<RenderQuery> &m_queries;
+  size_t m_objects_per_render;
+  // queries that have not produced results, in submission order
+  std::deque<Extant> m_extant;
+  std::vector<GLuint> m_free;
+  PerfMetricsQueries::MetricMap m_results;
+  bool m_active;
+};
+
+}  // namespace glretrace
+
+RenderQueries::RenderQueries(const std::vector<RenderQuery> &queries)
+    : m_queries(queries), m_objects_per_render(0), m_active(false) {
+  for (const auto &q : m_queries)
+    m_objects_per_render += (q.target == GL_TIMESTAMP) ? 2 : 1;
+}
+
+RenderQueries::~RenderQueries() {
+  for (const auto &e : m_extant)
+    m_free.insert(m_free.end(), e.objects.begin(), e.objects.end());
+  if (!m_free.empty())
+    GlFunctions::DeleteQueries(m_free.size(), m_free.data());
+}
+
+void
+RenderQueries::begin(RenderId render) {
+  poll();
+
+  if (m_free.size() < m_objects_per_render) {
+    // grow the pool with the number of renders in the frame
+    const size_t count = m_objects_per_render * (m_extant.empty() ?
+                                                 8 : m_extant.size());
+    const size_t offset = m_free.size();
+    m_free.resize(offset + count);
+    GlFunctions::GenQueries(count, m_free.data() + offset);
+  }
+  Extant e;
+  e.render = render;
+  e.objects.assign(m_free.end() - m_objects_per_render, m_free.end());
+  m_free.resize(m_free.size() - m_objects_per_render);
+
+  auto object = e.objects.begin();
+  for (const auto &q : m_queries) {
+    if (q.target == GL_TIMESTAMP) {
+      GlFunctions::QueryCounter(*object, GL_TIMESTAMP);
+      object += 2;
+    } else {
+      GlFunctions::BeginQuery(q.target, *object++);
+    }
+  }
+  m_extant.push_back(e);
+  m_active = true;
+}
+
+void
+RenderQueries::end() {
+  if (!m_active)
+    return;
+  auto object = m_extant.back().objects.begin();
+  for (const auto &q : m_queries) {
+    if (q.target == GL_TIMESTAMP) {
+      GlFunctions::QueryCounter(*(object + 1), GL_TIMESTAMP);
+      object += 2;
+    } else {
+      GlFunctions::EndQuery(q.target);
+      ++object;
+    }
+  }
+  m_active = false;
+}
+
+bool
+RenderQueries::read(const Extant &e, bool wait) {
+  if (!wait) {
+    for (auto object : e.objects) {
+      GLint available = 0;
+      GlFunctions::GetQueryObjectiv(object, GL_QUERY_RESULT_AVAILABLE,
+                                    &available);
+      if (!available)
+        return false;
+    }
+  }
+  auto object = e.objects.begin();
+  for (const auto &q : m_queries) {
+    GLuint64 value = 0;
+    GlFunctions::GetQueryObjectui64v(*object++, GL_QUERY_RESULT, &value);
+    if (q.target == GL_TIMESTAMP) {
+      GLuint64 end_value = 0;
+      GlFunctions::GetQueryObjectui64v(*object++, GL_QUERY_RESULT,
+                                       &end_value);
+      value = (end_value > value) ? end_value - value : 0;
+    }
+    m_results[q.metric][e.render] = static_cast<float>(value) * q.scale;
+  }
+  m_free.insert(m_free.end(), e.objects.begin(), e.objects.end());
+  return true;
+}
+
+void
+RenderQueries::poll() {
+  // the active render has not produced results
+  while (!m_extant.empty() && !(m_active && m_extant.size() == 1)) {
+    if (!read(m_extant.front(), false))
+      break;
+    m_extant.pop_front();
+  }
+}
+
+void
+RenderQueries::publish(PerfMetricsQueries::MetricMap *out) {
+  end();
+  for (const auto &e : m_extant)
+    read(e, true);
+  m_extant.clear();
+  for (auto &metric : m_results)
+    for (auto &datapoint : metric.second)
+      (*out)[metric.first][datapoint.first] = datapoint.second;
+  m_results.clear();
+}
+
+PerfMetricsQueries::PerfMetricsQueries(
+    const std::vector<RenderQuery> &queries, OnFrameRetrace *cb)
+    : m_queries(queries), m_current_context(NULL) {
+  m_contexts[getCurrentContext()] = new RenderQueries(m_queries);
+  if (!cb)
+    return;
+  std::vector<MetricId> ids;
+  std::vector<std::string> names;
+  std::vector<std::string> descriptions;
+  for (const auto &q : m_queries) {
+    ids.push_back(q.metric);
+    names.push_back(q.name);
+    descriptions.push_back(q.description);
+  }
+  cb->onMetricList(ids, names, descriptions);
+}
+
+PerfMetricsQueries::~PerfMetricsQueries() {
+  for (auto i : m_contexts)
+    delete i.second;
+  m_contexts.clear();
+}
+
+void
+PerfMetricsQueries::selectMetric(MetricId metric) {
+  m_data.clear();
+  m_selected.clear();
+  m_selected.insert(metric);
+}
+
+void
+PerfMetricsQueries::selectGroup(int index) {
+  m_selected.clear();
+}
+
+int
+PerfMetricsQueries::schedule(const std::vector<MetricId> &metrics) {
+  m_data.clear();
+  m_selected = std::set<MetricId>(metrics.begin(), metrics.end());
+  return 1;
+}
+
+void
+PerfMetricsQueries::begin(RenderId render) {
+  if (!m_current_context)
+    beginContext();
+  m_current_context->begin(render);
+}
+
+void
+PerfMetricsQueries::end() {
+  if (m_current_context)
+    m_current_context->end();
+}
+
+void
+PerfMetricsQueries::publish(ExperimentId experimentCount,
+                            SelectionId selectionCount,
+                            OnFrameRetrace *callback) {
+  if (m_current_context)
+    m_current_context->publish(&m_data);
+
+  for (auto i : m_data) {
+    if (!m_selected.empty() &&
+        (m_selected.find(i.first) == m_selected.end()))
+      continue;
+    MetricSeries s;
+    s.metric = i.first;
+    s.data.resize(i.second.rbegin()->first.index() + 1);
+    for (auto datapoint : i.second)
+      s.data[datapoint.first.index()] = datapoint.second;
+    callback->onMetrics(s, experimentCount, selectionCount);
+  }
+  m_data.clear();
+}
+
+void
+PerfMetricsQueries::beginContext() {
+  Context *c = getCurrentContext();
+  auto entry = m_contexts.find(c);
+  if (entry != m_contexts.end()) {
+    m_current_context = entry->second;
+    return;
+  }
+  m_current_context = new RenderQueries(m_queries);
+  m_contexts[c] = m_current_context;
+}
+
+void
+PerfMetricsQueries::endContext() {
+  // query results must be read in the context that made them
+  if (m_current_context)
+    m_current_context->publish(&m_data);
+  m_current_context = NULL;
+}
+
+// metric groups of the vendor extensions are numbered from 0.
+// Timestamps are used rather than GL_TIME_ELAPSED, which cannot be
+// nested within elapsed time queries made by the traced application.
+const RenderQuery PerfMetricsTimer::kGpuTime = {
+  MetricId(0xfff, 1), GL_TIMESTAMP, 0.001, "GPU Time",
+  "Time elapsed on the gpu for the render, in microseconds" };
+
+PerfMetricsTimer::PerfMetricsTimer(OnFrameRetrace *cb)
+    : PerfMetricsQueries(std::vector<RenderQuery>(1, kGpuTime), cb) {}
+
+bool
+PerfMetricsTimer::Supported() {
+  std::string extensions;
+  GlFunctions::GetGlExtensions(&extensions);
+  return extensions.find("GL_ARB_timer_query") != std::string::npos;
+}
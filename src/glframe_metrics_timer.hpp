@@ -0,0 +1,100 @@
+/**************************************************************************
+ *
+ * Copyright 2019 Intel Corporation
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * Authors:
+ *   Mark Janes <mark.a.janes@intel.com>
+ **************************************************************************/
+
+#ifndef _GLFRAME_METRICS_TIMER_HPP_
+#define _GLFRAME_METRICS_TIMER_HPP_
+
+#include <stdint.h>
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include "glframe_metrics.hpp"
+#include "glframe_traits.hpp"
+
+namespace glretrace {
+
+class RenderQueries;
+struct Context;
+
+// A GL query which brackets each render, and the metric it reports.
+struct RenderQuery {
+  MetricId metric;
+  // GL_TIMESTAMP brackets the render with a pair of counters, and
+  // reports the time between them.  Other targets are begun and
+  // ended around the render.
+  uint32_t target;
+  // converts the query result to the unit of the metric
+  float scale;
+  const char *name;
+  const char *description;
+};
+
+// Collects metrics from GL queries.  Every query is made in a single
+// pass.
+class PerfMetricsQueries : public PerfMetrics, NoCopy, NoAssign {
+ public:
+  PerfMetricsQueries(const std::vector<RenderQuery> &queries,
+                     OnFrameRetrace *cb);
+  ~PerfMetricsQueries();
+  int groupCount() const { return 1; }
+  void selectMetric(MetricId metric);
+  void selectGroup(int index);
+  int schedule(const std::vector<MetricId> &metrics);
+  void selectPass(int pass) {}
+  void begin(RenderId render);
+  void end();
+  void publish(ExperimentId experimentCount,
+               SelectionId selectionCount,
+               OnFrameRetrace *callback);
+  void endContext();
+  void beginContext();
+  typedef std::map<MetricId, std::map<RenderId, float>> MetricMap;
+
+ private:
+  const std::vector<RenderQuery> m_queries;
+  RenderQueries *m_current_context;
+  std::map<Context*, RenderQueries*> m_contexts;
+  MetricMap m_data;
+  // metrics to publish.  Empty publishes every metric.
+  std::set<MetricId> m_selected;
+};
+
+// Reports the gpu time of each render with GL_ARB_timer_query.  This
+// is available on most drivers, including software renderers, when
+// the vendor performance extensions are not.
+class PerfMetricsTimer : public PerfMetricsQueries {
+ public:
+  explicit PerfMetricsTimer(OnFrameRetrace *cb);
+  static bool Supported();
+  static const RenderQuery kGpuTime;
+};
+
+}  // namespace glretrace
+
+#endif  // _GLFRAME_METRICS_TIMER_HPP_
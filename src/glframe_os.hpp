@@ -28,6 +28,8 @@
 #ifndef _GLFRAME_OS_H_
 #define _GLFRAME_OS_H_
 
+#include <stdint.h>
+#include <stdio.h>
 #include <time.h>
 
 #include <mutex>
@@ -69,6 +71,23 @@ std::string application_cache_directory();
 
 int glretrace_rand(unsigned int *seedp);
 void glretrace_delay(unsigned int ms);
+int glretrace_pid();
+
+// file offsets are 64 bit, for traces larger than 4GB
+int glretrace_fseek(FILE *fh, int64_t offset, int whence);
+int64_t glretrace_ftell(FILE *fh);
+// The modification time is in the finest units the system provides,
+// and is only compared with other results of glretrace_stat.  false if
+// the file does not exist.
+bool glretrace_stat(const std::string &path, uint64_t *size,
+                    int64_t *mtime);
+
+// Forks a worker process, which is bound to one of the processors
+// available to the caller, chosen round-robin by index.  The heap of
+// the worker is limited to memory_limit_mb (0 for no limit).  Returns
+// 0 in the worker, the pid of the worker in the caller, and -1 on
+// failure or where workers are not supported.
+int fork_worker(unsigned int index, unsigned int memory_limit_mb);
 
 }  // namespace glretrace
 
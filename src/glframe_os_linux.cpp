@@ -26,9 +26,11 @@
 //  **********************************************************************/
 
 #include <pwd.h>
+#include <sched.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/resource.h>
 #include <sys/time.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -68,6 +70,68 @@ glretrace_delay(unsigned int ms) {
   usleep(1000 * ms);
 }
 
+int
+glretrace_pid() {
+  return getpid();
+}
+
+int
+glretrace_fseek(FILE *fh, int64_t offset, int whence) {
+  return fseeko(fh, offset, whence);
+}
+
+int64_t
+glretrace_ftell(FILE *fh) {
+  return ftello(fh);
+}
+
+bool
+glretrace_stat(const std::string &path, uint64_t *size, int64_t *mtime) {
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0)
+    return false;
+  *size = st.st_size;
+  *mtime = (static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 +
+            st.st_mtim.tv_nsec);
+  return true;
+}
+
+int
+fork_worker(unsigned int index, unsigned int memory_limit_mb) {
+  // workers exit when their session ends, and are not waited on
+  signal(SIGCHLD, SIG_IGN);
+  cpu_set_t available;
+  CPU_ZERO(&available);
+  const bool affinity =
+      (sched_getaffinity(0, sizeof(available), &available) == 0);
+
+  const pid_t pid = fork();
+  if (pid != 0)
+    return pid;
+
+  if (affinity && CPU_COUNT(&available) > 0) {
+    unsigned int skip = index % CPU_COUNT(&available);
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (!CPU_ISSET(cpu, &available))
+        continue;
+      if (skip--)
+        continue;
+      cpu_set_t worker;
+      CPU_ZERO(&worker);
+      CPU_SET(cpu, &worker);
+      sched_setaffinity(0, sizeof(worker), &worker);
+      break;
+    }
+  }
+  if (memory_limit_mb) {
+    struct rlimit limit;
+    limit.rlim_cur = static_cast<rlim_t>(memory_limit_mb) << 20;
+    limit.rlim_max = limit.rlim_cur;
+    setrlimit(RLIMIT_DATA, &limit);
+  }
+  return 0;
+}
+
 std::string application_cache_directory() {
   const char *homedir = "/tmp";
 
@@ -26,6 +26,8 @@
 //  **********************************************************************/
 
 #include <windows.h>
+#include <sys/stat.h>
+#include <sys/types.h>
 #include <time.h>
 #include <stdlib.h>
 #include <sstream>
@@ -77,6 +79,37 @@ glretrace_delay(unsigned int ms) {
   Sleep(ms);
 }
 
+int
+glretrace_pid() {
+  return GetCurrentProcessId();
+}
+
+int
+glretrace_fseek(FILE *fh, int64_t offset, int whence) {
+  return _fseeki64(fh, offset, whence);
+}
+
+int64_t
+glretrace_ftell(FILE *fh) {
+  return _ftelli64(fh);
+}
+
+bool
+glretrace_stat(const std::string &path, uint64_t *size, int64_t *mtime) {
+  struct _stat64 st;
+  if (_stat64(path.c_str(), &st) != 0)
+    return false;
+  *size = st.st_size;
+  *mtime = st.st_mtime;
+  return true;
+}
+
+int
+fork_worker(unsigned int index, unsigned int memory_limit_mb) {
+  // windows has no fork.  Each server process serves one session.
+  return -1;
+}
+
     std::string application_cache_directory() {
 	const char *app_dir = getenv("APPDATA");
 	const std::string cache_dir = std::string(app_dir) + "\\frameretrace";
@@ -0,0 +1,85 @@
+/**************************************************************************
+ *
+ * Copyright 2019 Intel Corporation
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * Authors:
+ *   Mark Janes <mark.a.janes@intel.com>
+ **************************************************************************/
+
+#include "glframe_render_target_cache.hpp"
+
+#include <iterator>
+#include <vector>
+
+using glretrace::RenderId;
+using glretrace::RenderOptions;
+using glretrace::RenderTargetCache;
+
+RenderTargetCache::RenderTargetCache(size_t budget_bytes)
+    : m_budget(budget_bytes), m_bytes(0) {}
+
+const std::vector<RenderTargetCache::Image> *
+RenderTargetCache::find(RenderId render, RenderOptions options) {
+  auto entry = m_entries.find(Key(render.index(), options));
+  if (entry == m_entries.end())
+    return NULL;
+  m_lru.splice(m_lru.end(), m_lru, entry->second);
+  return &entry->second->images;
+}
+
+void
+RenderTargetCache::insert(RenderId render, RenderOptions options,
+                          std::vector<Image> *images) {
+  const Key key(render.index(), options);
+  remove(key);
+  size_t bytes = 0;
+  for (const auto &image : *images)
+    bytes += image.png.size();
+  if (bytes > m_budget)
+    return;
+  m_lru.push_back(Entry());
+  Entry &entry = m_lru.back();
+  entry.key = key;
+  entry.bytes = bytes;
+  entry.images.swap(*images);
+  m_entries[key] = std::prev(m_lru.end());
+  m_bytes += bytes;
+  while (m_bytes > m_budget)
+    remove(m_lru.front().key);
+}
+
+void
+RenderTargetCache::clear() {
+  m_entries.clear();
+  m_lru.clear();
+  m_bytes = 0;
+}
+
+void
+RenderTargetCache::remove(const Key &key) {
+  auto entry = m_entries.find(key);
+  if (entry == m_entries.end())
+    return;
+  m_bytes -= entry->second->bytes;
+  m_lru.erase(entry->second);
+  m_entries.erase(entry);
+}
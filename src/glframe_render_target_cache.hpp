@@ -0,0 +1,84 @@
+/**************************************************************************
+ *
+ * Copyright 2019 Intel Corporation
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * Authors:
+ *   Mark Janes <mark.a.janes@intel.com>
+ **************************************************************************/
+
+#ifndef _GLFRAME_RENDER_TARGET_CACHE_HPP_
+#define _GLFRAME_RENDER_TARGET_CACHE_HPP_
+
+#include <list>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "glframe_retrace_interface.hpp"
+#include "glframe_traits.hpp"
+
+namespace glretrace {
+
+// Holds the render target images captured by previous retraces of
+// the frame.  With NORMAL_RENDER, the images reported for a render
+// depend only on the render and the render options, so they can be
+// served without replaying the frame until an experiment changes the
+// frame.  Images are captured at the end of each render target
+// region as the frame is retraced, so that stepping through the
+// renders of a region does not require a retrace.
+//
+// The least recently used images are released when the cache
+// exceeds its budget.
+class RenderTargetCache : NoCopy, NoAssign, NoMove {
+ public:
+  struct Image {
+    std::string label;
+    std::vector<unsigned char> png;
+  };
+
+  explicit RenderTargetCache(size_t budget_bytes);
+  // returns NULL if the images are not cached
+  const std::vector<Image> *find(RenderId render, RenderOptions options);
+  void insert(RenderId render, RenderOptions options,
+              std::vector<Image> *images);
+  // called when an experiment changes the frame
+  void clear();
+
+ private:
+  typedef std::pair<int, int> Key;
+  struct Entry {
+    Key key;
+    size_t bytes;
+    std::vector<Image> images;
+  };
+  void remove(const Key &key);
+
+  const size_t m_budget;
+  size_t m_bytes;
+  std::list<Entry> m_lru;
+  std::map<Key, std::list<Entry>::iterator> m_entries;
+};
+
+}  // namespace glretrace
+
+#endif  // _GLFRAME_RENDER_TARGET_CACHE_HPP_
@@ -32,16 +32,28 @@
 #include <fcntl.h>
 #include <stdio.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iomanip>
+#include <map>
 #include <sstream>
 #include <string>
 #include <vector>
 
 #include "glframe_batch.hpp"
+#include "glframe_checkpoint.hpp"
+#include "glframe_frame_index.hpp"
+#include "glframe_frame_pack.hpp"
+#include "glframe_gl_errors.hpp"
 #include "glframe_glhelper.hpp"
 #include "glframe_gpu_speed.hpp"
 #include "glframe_logger.hpp"
 #include "glframe_metrics.hpp"
+#include "glframe_os.hpp"
 #include "glframe_perf_enabled.hpp"
+#include "glframe_render_target_cache.hpp"
 #include "glframe_retrace_context.hpp"
 #include "glframe_retrace_render.hpp"
 #include "glframe_state_enums.hpp"
@@ -53,10 +65,16 @@
 #include "trace_dump.hpp"
 
 using glretrace::ExperimentId;
+using glretrace::FastForwardMode;
+using glretrace::FrameCheckpoint;
+using glretrace::FrameIndex;
+using glretrace::FramePackWriter;
 using glretrace::FrameRetrace;
 using glretrace::FrameState;
+using glretrace::GlErrors;
 using glretrace::GlFunctions;
 using glretrace::MesaBatch;
+using glretrace::MetricAggregation;
 using glretrace::MetricId;
 using glretrace::MetricSeries;
 using glretrace::NoRedirect;
@@ -65,13 +83,26 @@ using glretrace::OutputPoller;
 using glretrace::RenderId;
 using glretrace::RenderOptions;
 using glretrace::RenderSelection;
+using glretrace::RenderTargetCache;
 using glretrace::RenderTargetType;
 using glretrace::SelectionId;
 using glretrace::ShaderAssembly;
 using glretrace::StateKey;
 using glretrace::StateTrack;
 using glretrace::StdErrRedirect;
+using glretrace::API_VIEW;
+using glretrace::BATCH_VIEW;
+using glretrace::SHADER_ASSEMBLY_VIEW;
+using glretrace::STATE_VIEW;
+using glretrace::TEXTURE_VIEW;
+using glretrace::UNIFORM_VIEW;
 using glretrace::WARN;
+using glretrace::METRIC_AVERAGE;
+using glretrace::METRIC_MAX;
+using glretrace::METRIC_MIN;
+using glretrace::METRIC_PER_RENDER;
+using glretrace::METRIC_SUM;
+using glretrace::application_cache_directory;
 using image::Image;
 using retrace::parser;
 using trace::Call;
@@ -88,10 +119,27 @@ static StdErrRedirect assemblyOutput;
 static MesaBatch batchControl;
 #endif
 
-FrameRetrace::FrameRetrace()
+// memory for the images of previous render target retraces
+static const size_t kRenderTargetCacheBytes = 256 * 1024 * 1024;
+
+// metrics warm-up replays the frame until consecutive frame times
+// differ by less than the tolerance
+static const int kMaxWarmUpReplays = 10;
+static const double kWarmUpTolerance = 0.02;
+
+// samples further than this many (scaled) median absolute deviations
+// from the median are rejected as outliers
+static const float kOutlierDeviations = 3.0;
+
+FrameRetrace::FrameRetrace(FastForwardMode fast_forward, bool checkpoint)
     : m_tracker(&assemblyOutput),
       m_metrics(NULL),
-      m_retracer(NULL) {
+      m_retracer(NULL),
+      m_rt_cache(new RenderTargetCache(kRenderTargetCacheBytes)),
+      m_fast_forward(fast_forward),
+      m_checkpoint(checkpoint),
+      m_repetitions(1),
+      m_checkpoint_parser(parser) {
 }
 
 FrameRetrace::~FrameRetrace() {
@@ -101,7 +149,10 @@ FrameRetrace::~FrameRetrace() {
     delete c;
   if (m_retracer)
     delete m_retracer;
+  delete m_rt_cache;
   parser->close();
+  if (parser == &m_checkpoint_parser)
+    parser = m_checkpoint_parser.source();
   retrace::cleanUp();
 }
 
@@ -160,9 +211,275 @@ gen_2x2_texture() {
   return tex2x2;
 }
 
+namespace {
+
+// Calls which have no influence on the GL object state at the start
+// of the target frame.  These are skipped when fast-forwarding.
+bool
+classify_fast_forward(const trace::Call &call) {
+  if (call.flags & (trace::CALL_FLAG_NO_SIDE_EFFECTS |
+                    trace::CALL_FLAG_END_FRAME))
+    return true;
+  if (glretrace::RetraceRender::isRender(call))
+    return true;
+  static const char *skip_prefixes[] = {"glBeginQuery",
+                                        "glEndQuery",
+                                        "glQueryCounter",
+                                        "glBeginConditionalRender",
+                                        "glEndConditionalRender"};
+  for (auto prefix : skip_prefixes)
+    if (strncmp(call.sig->name, prefix, strlen(prefix)) == 0)
+      return true;
+  return ((strcmp(call.sig->name, "glFinish") == 0) ||
+          (strcmp(call.sig->name, "glFlush") == 0));
+}
+
+bool
+skip_during_fast_forward(const trace::Call &call) {
+  // the table is not thread safe, and parser threads have their own
+  // signatures
+  thread_local glretrace::SignatureTable<bool> skipped;
+  const bool *skip = skipped.find(call.sig);
+  if (skip)
+    return *skip;
+  return skipped.insert(call.sig, classify_fast_forward(call));
+}
+
+// Captures render target images, to compare fast-forward and full
+// replays of a frame.
+class RenderTargetChecksum : public OnFrameRetrace {
+ public:
+  RenderTargetChecksum() : checksum(0) {}
+  void onFileOpening(bool, bool, uint32_t) {}
+  void onGLError(uint32_t, const std::string &, const std::string &) {}
+  void onShaderAssembly(RenderId, SelectionId, ExperimentId,
+                        const ShaderAssembly &, const ShaderAssembly &,
+                        const ShaderAssembly &, const ShaderAssembly &,
+                        const ShaderAssembly &, const ShaderAssembly &) {}
+  void onRenderTarget(SelectionId, ExperimentId,
+                      const std::string &label,
+                      const uvec &pngImageData) {
+    const std::string png(pngImageData.begin(), pngImageData.end());
+    checksum ^= std::hash<std::string>()(label + png);
+  }
+  void onMetricList(const std::vector<MetricId> &,
+                    const std::vector<std::string> &,
+                    const std::vector<std::string> &) {}
+  void onMetrics(const MetricSeries &, ExperimentId, SelectionId) {}
+  void onShaderCompile(RenderId, ExperimentId, bool, const std::string &) {}
+  void onApi(SelectionId, RenderId, const std::vector<std::string> &,
+             const std::vector<uint32_t> &,
+             const std::vector<std::string> &) {}
+  void onError(glretrace::ErrorSeverity, const std::string &) {}
+  void onBatch(SelectionId, ExperimentId, RenderId, const std::string &) {}
+  void onUniform(SelectionId, ExperimentId, RenderId, const std::string &,
+                 glretrace::UniformType, glretrace::UniformDimension,
+                 const std::vector<unsigned char> &) {}
+  void onState(SelectionId, ExperimentId, RenderId, StateKey,
+               const std::vector<std::string> &) {}
+  void onTextureData(ExperimentId, const std::string &,
+                     const std::vector<unsigned char> &) {}
+  void onTexture(SelectionId, ExperimentId, RenderId, glretrace::TextureKey,
+                 const std::vector<glretrace::TextureData> &) {}
+  size_t checksum;
+};
+
+float
+median(std::vector<float> *values) {
+  auto middle = values->begin() + values->size() / 2;
+  std::nth_element(values->begin(), middle, values->end());
+  if (values->size() % 2)
+    return *middle;
+  const float upper = *middle;
+  const float lower = *std::max_element(values->begin(), middle);
+  return (lower + upper) / 2;
+}
+
+// Reduces a series to a single value over the sequences of the
+// selection.  Metrics are collected for each sequence as a whole, so
+// the value of a sequence is the sum of its entries.
+void
+aggregate(const RenderSelection &selection,
+          MetricAggregation aggregation,
+          MetricSeries *s) {
+  std::vector<float> values, variances;
+  uint32_t samples = 0;
+  for (auto sequence : selection.series) {
+    float value = 0, variance = 0;
+    for (uint32_t r = sequence.begin.index();
+         (r < sequence.end.index()) && (r < s->data.size()); ++r) {
+      value += s->data[r];
+      if (s->samples.empty())
+        continue;
+      variance += s->variance[r];
+      samples = std::max(samples, s->samples[r]);
+    }
+    values.push_back(value);
+    variances.push_back(variance);
+  }
+  if (values.empty())
+    values.push_back(0.0);
+  if (variances.empty())
+    variances.push_back(0.0);
+
+  size_t chosen = 0;
+  float value = 0, variance = 0;
+  switch (aggregation) {
+    case METRIC_SUM:
+    case METRIC_AVERAGE:
+      for (size_t i = 0; i < values.size(); ++i) {
+        value += values[i];
+        variance += variances[i];
+      }
+      if (aggregation == METRIC_AVERAGE) {
+        value /= values.size();
+        variance /= (values.size() * values.size());
+      }
+      break;
+    case METRIC_MIN:
+      chosen = std::min_element(values.begin(), values.end()) -
+               values.begin();
+      value = values[chosen];
+      variance = variances[chosen];
+      break;
+    case METRIC_MAX:
+      chosen = std::max_element(values.begin(), values.end()) -
+               values.begin();
+      value = values[chosen];
+      variance = variances[chosen];
+      break;
+    case METRIC_PER_RENDER:
+      return;
+  }
+  s->data.assign(1, value);
+  if (samples > 1) {
+    s->variance.assign(1, variance);
+    s->samples.assign(1, samples);
+  }
+}
+
+// Collects the metrics published by repeated replays of the frame,
+// and reports the median and variance of the samples for each render.
+class MetricSamples : public OnFrameRetrace {
+ public:
+  MetricSamples() : m_experiment(0), m_selection(0),
+                    m_aggregation(METRIC_PER_RENDER) {}
+  // reduces the reported series over the sequences of the selection
+  MetricSamples(const RenderSelection &selection,
+                MetricAggregation aggregation)
+      : m_experiment(0), m_selection(0),
+        m_render_selection(selection),
+        m_aggregation(aggregation) {}
+  void onFileOpening(bool, bool, uint32_t) {}
+  void onGLError(uint32_t, const std::string &, const std::string &) {}
+  void onShaderAssembly(RenderId, SelectionId, ExperimentId,
+                        const ShaderAssembly &, const ShaderAssembly &,
+                        const ShaderAssembly &, const ShaderAssembly &,
+                        const ShaderAssembly &, const ShaderAssembly &) {}
+  void onRenderTarget(SelectionId, ExperimentId, const std::string &,
+                      const uvec &) {}
+  void onMetricList(const std::vector<MetricId> &,
+                    const std::vector<std::string> &,
+                    const std::vector<std::string> &) {}
+  void onMetrics(const MetricSeries &metricData,
+                 ExperimentId experimentCount,
+                 SelectionId selectionCount) {
+    m_experiment = experimentCount;
+    m_selection = selectionCount;
+    auto &renders = m_samples[metricData.metric];
+    if (renders.size() < metricData.data.size())
+      renders.resize(metricData.data.size());
+    for (size_t i = 0; i < metricData.data.size(); ++i)
+      renders[i].push_back(metricData.data[i]);
+  }
+  void onShaderCompile(RenderId, ExperimentId, bool, const std::string &) {}
+  void onApi(SelectionId, RenderId, const std::vector<std::string> &,
+             const std::vector<uint32_t> &,
+             const std::vector<std::string> &) {}
+  void onError(glretrace::ErrorSeverity, const std::string &) {}
+  void onBatch(SelectionId, ExperimentId, RenderId, const std::string &) {}
+  void onUniform(SelectionId, ExperimentId, RenderId, const std::string &,
+                 glretrace::UniformType, glretrace::UniformDimension,
+                 const std::vector<unsigned char> &) {}
+  void onState(SelectionId, ExperimentId, RenderId, StateKey,
+               const std::vector<std::string> &) {}
+  void onTextureData(ExperimentId, const std::string &,
+                     const std::vector<unsigned char> &) {}
+  void onTexture(SelectionId, ExperimentId, RenderId, glretrace::TextureKey,
+                 const std::vector<glretrace::TextureData> &) {}
+
+  void publish(OnFrameRetrace *callback) const {
+    for (const auto &metric : m_samples) {
+      MetricSeries s;
+      s.metric = metric.first;
+      for (auto samples : metric.second) {
+        if (samples.empty()) {
+          // a render which this pass did not measure
+          s.data.push_back(0.0);
+          s.variance.push_back(0.0);
+          s.samples.push_back(0);
+          continue;
+        }
+        reject_outliers(&samples);
+        s.data.push_back(median(&samples));
+        float mean = 0;
+        for (auto v : samples)
+          mean += v;
+        mean /= samples.size();
+        float variance = 0;
+        for (auto v : samples)
+          variance += (v - mean) * (v - mean);
+        if (samples.size() > 1)
+          variance /= (samples.size() - 1);
+        s.variance.push_back(variance);
+        s.samples.push_back(samples.size());
+      }
+      bool repeated = false;
+      for (auto count : s.samples)
+        if (count > 1)
+          repeated = true;
+      if (!repeated) {
+        s.variance.clear();
+        s.samples.clear();
+      }
+      aggregate(m_render_selection, m_aggregation, &s);
+      callback->onMetrics(s, m_experiment, m_selection);
+    }
+  }
+
+ private:
+  static void reject_outliers(std::vector<float> *samples) {
+    if (samples->size() < 3)
+      return;
+    std::vector<float> values(*samples);
+    const float center = median(&values);
+    std::vector<float> deviations;
+    for (auto v : *samples)
+      deviations.push_back(fabs(v - center));
+    // scaled to estimate the standard deviation of normal samples
+    const float mad = 1.4826 * median(&deviations);
+    if (mad == 0.0)
+      return;
+    std::vector<float> kept;
+    for (auto v : *samples)
+      if (fabs(v - center) <= kOutlierDeviations * mad)
+        kept.push_back(v);
+    samples->swap(kept);
+  }
+
+  // samples for each render of each metric
+  std::map<MetricId, std::vector<std::vector<float>>> m_samples;
+  ExperimentId m_experiment;
+  SelectionId m_selection;
+  RenderSelection m_render_selection;
+  const MetricAggregation m_aggregation;
+};
+
+}  // namespace
+
 void
 FrameRetrace::openFile(const std::string &filename,
-                       const std::vector<unsigned char> &,
+                       const std::vector<unsigned char> &md5,
                        uint64_t,
                        uint32_t framenumber,
                        uint32_t framecount,
@@ -192,38 +509,122 @@ FrameRetrace::openFile(const std::string &filename,
   m_retracer->Disable("glGetQueryObjectui64v");
   m_retracer->Disable("glQueryCounter");
 
+  // an out of range frame is reported without replaying the trace, if
+  // the trace has already been indexed.  The index is not generated
+  // here, as scanning the trace would delay every first open.
+  FrameIndex index;
+  if (index.openStored(filename) && index.frameCount() < framenumber) {
+    std::stringstream msg;
+    msg << "Trace contains " << index.frameCount() <<
+        " frames.  Please choose an earlier frame for analysis.";
+    callback->onError(RETRACE_FATAL, msg.str());
+    return;
+  }
+
+  // In validation mode, the first open of a frame performs a full
+  // replay, recording the final render target.  Subsequent opens skip
+  // draws, and are compared with the recorded render target.  Without
+  // an md5, the reference cannot be identified, and every open is a
+  // full replay.
+  bool skip_draws = (m_fast_forward == SKIP_DRAWS);
+  std::string reference_path;
+  size_t reference_checksum = 0;
+  if ((m_fast_forward == VALIDATE_SKIP_DRAWS) && !md5.empty()) {
+    std::stringstream reference_s;
+    reference_s << application_cache_directory() << std::hex
+                << std::setfill('0');
+    for (auto byte : md5)
+      reference_s << std::setw(2) << static_cast<unsigned int>(byte);
+    reference_s << std::dec << "." << framenumber << "." << framecount
+                << ".checksum";
+    reference_path = reference_s.str();
+    if (FILE *fh = fopen(reference_path.c_str(), "rb")) {
+      skip_draws = (fread(&reference_checksum, sizeof(reference_checksum),
+                          1, fh) == 1);
+      fclose(fh);
+    }
+  }
+
+  // the parsed calls of the frame are cached in a pack, which is
+  // cheaper to load than parsing and decompressing the trace.
+  std::string pack_path;
+  bool use_pack = false;
+  if (!md5.empty()) {
+    std::stringstream pack_s;
+    pack_s << application_cache_directory() << std::hex
+           << std::setfill('0');
+    for (auto byte : md5)
+      pack_s << std::setw(2) << static_cast<unsigned int>(byte);
+    pack_s << std::dec << "." << framenumber << "." << framecount
+           << ".framepack";
+    pack_path = pack_s.str();
+    use_pack = m_frame_pack.open(pack_path.c_str());
+  }
+  const uint32_t requested_framecount = framecount;
+
+  // a stored checkpoint replaces the original trace.  Otherwise, the
+  // calls retraced on the way to the frame are recorded to a new one.
+  FrameCheckpoint checkpoint(md5, framenumber, framecount, skip_draws);
+  std::string trace_path = filename;
+  bool record_checkpoint = m_checkpoint && !md5.empty();
+  // frames of the trace which precede the first frame of trace_path
+  uint32_t base_frame = 0;
+  if (record_checkpoint && checkpoint.exists()) {
+    trace_path = checkpoint.path();
+    base_frame = framenumber - checkpoint.frameNumber();
+    record_checkpoint = false;
+    // calls are reported with their numbers in the original trace
+    parser = &m_checkpoint_parser;
+  }
+
   retrace::setUp();
-  parser->open(filename.c_str());
+  parser->open(trace_path.c_str());
+  if (record_checkpoint)
+    record_checkpoint = checkpoint.begin(*parser);
 
   // play up to the requested frame
   trace::Call *call;
-  unsigned int current_frame = 0;
+  unsigned int current_frame = base_frame;
+  const bool log_calls = glretrace::Logger::Enabled(glretrace::DEBUG);
   while ((call = parser->parse_call()) && current_frame < framenumber) {
-    std::stringstream call_stream;
-    trace::dump(*call, call_stream,
-                trace::DUMP_FLAG_NO_COLOR);
-    GRLOGF(glretrace::DEBUG, "CALL: %s", call_stream.str().c_str());
+    if (log_calls) {
+      std::stringstream call_stream;
+      trace::dump(*call, call_stream,
+                  trace::DUMP_FLAG_NO_COLOR);
+      GRLOGF(glretrace::DEBUG, "CALL: %s", call_stream.str().c_str());
+    }
 
     bool owned_by_thread_tracker = false;
     m_thread_context.track(call, &owned_by_thread_tracker);
     // we re-use shaders for shader editing features, even if the
     // source program has deleted them.  To support this, we never
     // delete shaders.
+    const bool frame_boundary = RetraceRender::endsFrame(*call);
     if (strcmp(call->sig->name, "glDeleteShader") != 0) {
-      m_retracer->retrace(*call);
-      GLenum err = GlFunctions::GetError();
-      if (err != GL_NO_ERROR) {
-        // indicate to user that a GL error occured as the trace was
-        // being replayed.  Do not display multi-line gl commands
-        std::string firstline;
-        std::getline(call_stream, firstline);
-        callback->onGLError(current_frame,
-                            glretrace::state_enum_to_name(err),
-                            firstline);
+      if (!skip_draws || !skip_during_fast_forward(*call)) {
+        if (record_checkpoint && !frame_boundary)
+          checkpoint.write(call);
+        GlErrors::begin();
+        m_retracer->retrace(*call);
+        GLenum err = GlErrors::end(*call);
+        if (err != GL_NO_ERROR) {
+          // indicate to user that a GL error occured as the trace was
+          // being replayed.  Do not display multi-line gl commands
+          std::stringstream call_stream;
+          trace::dump(*call, call_stream,
+                      trace::DUMP_FLAG_NO_COLOR);
+          std::string firstline;
+          std::getline(call_stream, firstline);
+          callback->onGLError(current_frame,
+                              glretrace::state_enum_to_name(err),
+                              firstline);
+        }
       }
       m_tracker.track(*call);
     }
-    const bool frame_boundary = RetraceRender::endsFrame(*call);
+    if (frame_boundary && record_checkpoint &&
+        current_frame + 1 == framenumber)
+      checkpoint.write(call);
     if (!owned_by_thread_tracker)
       delete call;
     if (frame_boundary) {
@@ -263,7 +664,10 @@ FrameRetrace::openFile(const std::string &filename,
   GLuint tex2x2 = gen_2x2_texture();
 
   while (true) {
-    auto c = new RetraceContext(current_render, tex2x2, parser,
+    trace::AbstractParser *frame_parser = parser;
+    if (use_pack)
+      frame_parser = &m_frame_pack;
+    auto c = new RetraceContext(current_render, tex2x2, frame_parser,
                                 m_retracer, &m_tracker, m_cancelPolicy);
     // initialize metrics collector with context
     m_metrics->beginContext();
@@ -276,9 +680,58 @@ FrameRetrace::openFile(const std::string &filename,
       break;
   }
 
+  if (record_checkpoint)
+    checkpoint.commit(parser, frame_start.start);
+
+  if (!use_pack && !pack_path.empty()) {
+    FramePackWriter pack;
+    trace::ParseBookmark resume;
+    parser->getBookmark(resume);
+    parser->setBookmark(frame_start.start);
+    uint32_t frames = 0;
+    while (frames < requested_framecount &&
+           (call = parser->parse_call())) {
+      pack.write(*call);
+      if (RetraceRender::endsFrame(*call))
+        ++frames;
+      delete call;
+    }
+    parser->setBookmark(resume);
+    if (frames == requested_framecount)
+      pack.commit(pack_path, parser->getVersion(), parser->getProperties());
+  }
+
+  if (!reference_path.empty()) {
+    const size_t checksum = frameChecksum();
+    if (!skip_draws) {
+      if (FILE *fh = fopen(reference_path.c_str(), "wb")) {
+        fwrite(&checksum, sizeof(checksum), 1, fh);
+        fclose(fh);
+      }
+    } else if (checksum != reference_checksum) {
+      std::stringstream msg;
+      msg << "Frame " << framenumber << " differs from a full replay when "
+          "draws are skipped.  Reopen the frame with full replay.";
+      callback->onError(RETRACE_WARN, msg.str());
+    }
+  }
+
   callback->onFileOpening(false, true, current_frame);
 }
 
+size_t
+FrameRetrace::frameChecksum() const {
+  RenderTargetChecksum images;
+  if (getRenderCount() == 0)
+    return images.checksum;
+  RenderSelection last;
+  last.id = SelectionId(0);
+  last.push_back(getRenderCount() - 1);
+  retraceRenderTarget(ExperimentId(0), last, glretrace::NORMAL_RENDER,
+                      glretrace::STOP_AT_RENDER, &images);
+  return images.checksum;
+}
+
 int
 FrameRetrace::getRenderCount() const {
   int count = 0;
@@ -294,11 +747,29 @@ FrameRetrace::retraceRenderTarget(ExperimentId experimentCount,
                                   RenderTargetType type,
                                   RenderOptions options,
                                   OnFrameRetrace *callback) const {
+  if (callback && (type == glretrace::NORMAL_RENDER)) {
+    const RenderId last_render(selection.series.back().end() - 1);
+    RenderId image_render;
+    RenderOptions image_options;
+    for (auto i : m_contexts) {
+      if (!i->imageRender(last_render, options, &image_render,
+                          &image_options))
+        continue;
+      const auto images = m_rt_cache->find(image_render, image_options);
+      if (!images)
+        break;
+      for (const auto &image : *images)
+        callback->onRenderTarget(selection.id, experimentCount,
+                                 image.label, image.png);
+      return;
+    }
+  }
+
   // reset to beginning of frame
   parser->setBookmark(frame_start.start);
   for (auto i : m_contexts)
     i->retraceRenderTarget(experimentCount, selection, type, options,
-                           m_tracker, callback);
+                           m_tracker, m_rt_cache, callback);
 }
 
 void
@@ -315,53 +786,55 @@ FrameRetrace::retraceShaderAssembly(const RenderSelection &selection,
 
 FrameState::FrameState(const std::string &filename,
                        int framenumber, int framecount) : render_count(0) {
-  trace::Parser *p = reinterpret_cast<trace::Parser*>(parser);
-  p->open(filename.c_str());
-  trace::Call *call;
-  int current_frame = 0;
-  while ((call = p->scan_call()) && current_frame < framenumber) {
-    if (RetraceRender::endsFrame(*call)) {
-      ++current_frame;
-      if (current_frame == framenumber) {
-        delete call;
-        break;
-      }
-    }
-    delete call;
-  }
+  FrameIndex index;
+  if (!index.open(filename))
+    return;
+  render_count = index.renderCount(framenumber, framecount);
+}
 
-  while ((call = p->scan_call())) {
-    if (RetraceRender::isRender(*call)) {
-      ++render_count;
-    }
+bool
+FrameRetrace::isCancelled(const RenderSelection *selection,
+                          ExperimentId experimentCount) const {
+  if (selection)
+    return m_cancelPolicy.isCancelled(selection->id, experimentCount);
+  return m_cancelPolicy.isCancelled(experimentCount);
+}
 
-    if (RetraceRender::endsFrame(*call)) {
-      --framecount;
-      if (framecount == 0) {
-        delete call;
-        break;
-      }
-    }
-    delete call;
+bool
+FrameRetrace::warmUp(const RenderSelection *selection,
+                     ExperimentId experimentCount) const {
+  // retrace the frame until its duration settles, ensuring that the
+  // gpu is not throttled and has finished raising its clocks
+  double previous = 0;
+  for (int i = 0; i < kMaxWarmUpReplays; ++i) {
+    if (isCancelled(selection, experimentCount))
+      return false;
+    const auto begin = std::chrono::steady_clock::now();
+    parser->setBookmark(frame_start.start);
+    for (auto c : m_contexts)
+      c->retraceMetrics(NULL, m_tracker);
+    GlFunctions::Finish();
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - begin;
+    if ((i > 0) &&
+        (fabs(elapsed.count() - previous) < kWarmUpTolerance * previous))
+      break;
+    previous = elapsed.count();
   }
+  return !isCancelled(selection, experimentCount);
 }
 
 void
 FrameRetrace::retraceMetrics(const std::vector<MetricId> &ids,
                              ExperimentId experimentCount,
                              OnFrameRetrace *callback) const {
-  // retrace the frame once to warm up the gpu, ensuring that the gpu
-  // is not throttled
-  parser->setBookmark(frame_start.start);
-
-  for (auto i : m_contexts)
-    i->retraceMetrics(NULL, m_tracker);
+  if (!warmUp(NULL, experimentCount))
+    return;
 
   const int render_count = getRenderCount();
+  const MetricId nullMetric(0);
+  std::vector<MetricId> metrics;
   for (const auto &id : ids) {
-    // reset to beginning of frame
-    parser->setBookmark(frame_start.start);
-    const MetricId nullMetric(0);
     if (id == nullMetric) {
       // no metrics selected
       MetricSeries metricData;
@@ -374,42 +847,68 @@ FrameRetrace::retraceMetrics(const std::vector<MetricId> &ids,
                           SelectionId(0));
       continue;
     }
-    m_metrics->selectMetric(id);
-    for (auto i : m_contexts)
-      i->retraceMetrics(m_metrics, m_tracker);
-    m_metrics->publish(experimentCount,
-                       SelectionId(0),  // this use case is not based
-                                        // on render selection
-                       callback);
+    metrics.push_back(id);
   }
+  if (metrics.empty())
+    return;
+
+  // collect all of the metrics that can share a pass
+  MetricSamples samples;
+  const int pass_count = m_metrics->schedule(metrics);
+  for (uint32_t repetition = 0; repetition < m_repetitions; ++repetition) {
+    if (isCancelled(NULL, experimentCount))
+      return;
+    for (int pass = 0; pass < pass_count; ++pass) {
+      // reset to beginning of frame
+      parser->setBookmark(frame_start.start);
+      m_metrics->selectPass(pass);
+      for (auto i : m_contexts)
+        i->retraceMetrics(m_metrics, m_tracker);
+      m_metrics->publish(experimentCount,
+                         SelectionId(0),  // this use case is not based
+                                          // on render selection
+                         &samples);
+    }
+  }
+  samples.publish(callback);
 }
 
 void
 FrameRetrace::retraceAllMetrics(const RenderSelection &selection,
                                 ExperimentId experimentCount,
+                                MetricAggregation aggregation,
                                 OnFrameRetrace *callback) const {
-  // retrace the frame once to warm up the gpu, ensuring that the gpu
-  // is not throttled
-  parser->setBookmark(frame_start.start);
-  for (auto i : m_contexts)
-    i->retraceMetrics(NULL, m_tracker);
-
-  if (m_cancelPolicy.isCancelled(selection.id, experimentCount))
+  if (!warmUp(&selection, experimentCount))
     return;
 
-  for (int i = 0; i < m_metrics->groupCount(); ++i) {
-    m_metrics->selectGroup(i);
-    parser->setBookmark(frame_start.start);
-
-    for (auto i : m_contexts)
-      i->retraceAllMetrics(selection, m_metrics, m_tracker);
-
-    if (m_cancelPolicy.isCancelled(selection.id, experimentCount))
-      break;
+  // an empty list schedules the passes for every metric
+  MetricSamples samples(selection, aggregation);
+  const int pass_count = m_metrics->schedule(std::vector<MetricId>());
+  bool cancelled = false;
+  for (uint32_t repetition = 0;
+       (repetition < m_repetitions) && !cancelled; ++repetition) {
+    for (int pass = 0; pass < pass_count; ++pass) {
+      m_metrics->selectPass(pass);
+      parser->setBookmark(frame_start.start);
+
+      for (auto i : m_contexts)
+        i->retraceAllMetrics(selection, m_metrics, m_tracker);
+
+      if (m_cancelPolicy.isCancelled(selection.id, experimentCount)) {
+        cancelled = true;
+        break;
+      }
+    }
+    m_metrics->publish(experimentCount,
+                       selection.id,
+                       &samples);
   }
-  m_metrics->publish(experimentCount,
-                     selection.id,
-                     callback);
+  samples.publish(callback);
+}
+
+void
+FrameRetrace::setMetricRepetitions(uint32_t repetitions) {
+  m_repetitions = repetitions ? repetitions : 1;
 }
 
 void
@@ -422,6 +921,7 @@ FrameRetrace::replaceShaders(RenderId renderId,
                              const std::string &geom,
                              const std::string &comp,
                              OnFrameRetrace *callback) {
+  m_rt_cache->clear();
   GRLOGF(DEBUG, "%s\n%s", vs.c_str(), fs.c_str());
   for (auto i : m_contexts)
     if (i->replaceShaders(renderId, experimentCount, &m_tracker,
@@ -432,6 +932,7 @@ FrameRetrace::replaceShaders(RenderId renderId,
 
 void
 FrameRetrace::disableDraw(const RenderSelection &selection, bool disable) {
+  m_rt_cache->clear();
   for (auto sequence : selection.series) {
     for (auto render = sequence.begin; render < sequence.end; ++render) {
       for (auto context : m_contexts)
@@ -442,6 +943,7 @@ FrameRetrace::disableDraw(const RenderSelection &selection, bool disable) {
 
 void
 FrameRetrace::simpleShader(const RenderSelection &selection, bool simple) {
+  m_rt_cache->clear();
   for (auto sequence : selection.series) {
     for (auto render = sequence.begin; render < sequence.end; ++render) {
       for (auto context : m_contexts)
@@ -488,6 +990,7 @@ FrameRetrace::setUniform(const RenderSelection &selection,
                          const std::string &name,
                          int index,
                          const std::string &data) {
+  m_rt_cache->clear();
   // reset to beginning of frame
   parser->setBookmark(frame_start.start);
   for (auto i : m_contexts)
@@ -509,6 +1012,7 @@ FrameRetrace::setState(const RenderSelection &selection,
                        const StateKey &item,
                        int offset,
                        const std::string &value) {
+  m_rt_cache->clear();
   // reset to beginning of frame
   parser->setBookmark(frame_start.start);
   for (auto i : m_contexts)
@@ -517,6 +1021,7 @@ FrameRetrace::setState(const RenderSelection &selection,
 
 void
 FrameRetrace::revertExperiments() {
+  m_rt_cache->clear();
   for (auto i : m_contexts)
     i->revertExperiments(&m_tracker);
 }
@@ -524,6 +1029,7 @@ FrameRetrace::revertExperiments() {
 void
 FrameRetrace::oneByOneScissor(const RenderSelection &selection,
                               bool scissor) {
+  m_rt_cache->clear();
   // reset to beginning of frame
   parser->setBookmark(frame_start.start);
   const StateKey enable("Fragment/Scissor", "GL_SCISSOR_TEST");
@@ -555,6 +1061,7 @@ FrameRetrace::oneByOneScissor(const RenderSelection &selection,
 void
 FrameRetrace::wireframe(const RenderSelection &selection,
                         bool wireframe) {
+  m_rt_cache->clear();
   // reset to beginning of frame
   parser->setBookmark(frame_start.start);
   const StateKey wireframe_key("Primitive/Polygon", "GL_POLYGON_MODE");
@@ -583,6 +1090,7 @@ FrameRetrace::wireframe(const RenderSelection &selection,
 void
 FrameRetrace::texture2x2(const RenderSelection &selection,
                          bool texture_2x2) {
+  m_rt_cache->clear();
   for (auto i : m_contexts)
     i->texture2x2(selection, texture_2x2);
 }
@@ -597,6 +1105,29 @@ FrameRetrace::retraceTextures(const RenderSelection &selection,
     i->retraceTextures(selection, experimentCount, m_tracker, callback);
 }
 
+void
+FrameRetrace::retraceViews(const RenderSelection &selection,
+                           ExperimentId experimentCount,
+                           uint32_t views,
+                           OnFrameRetrace *callback) {
+  if (!batchControl.batchSupported())
+    views &= ~BATCH_VIEW;
+  // Shader assembly is parsed from the driver output while tracking
+  // the frame, which would consume batch output.  Batches take a
+  // separate replay in that case.
+  uint32_t fused = views;
+  if ((views & SHADER_ASSEMBLY_VIEW) && (views & BATCH_VIEW))
+    fused &= ~BATCH_VIEW;
+
+  // reset to beginning of frame
+  parser->setBookmark(frame_start.start);
+  for (auto i : m_contexts)
+    i->retraceViews(selection, experimentCount, fused, &m_tracker,
+                    &batchControl, &assemblyOutput, callback);
+  if (fused != views)
+    retraceBatch(selection, experimentCount, callback);
+}
+
 void
 FrameRetrace::cancel(SelectionId selectionCount,
                      ExperimentId experimentCount) {
@@ -33,7 +33,9 @@
 #include <vector>
 
 #include "glframe_cancellation.hpp"
+#include "glframe_checkpoint.hpp"
 #include "glframe_filter.hpp"
+#include "glframe_frame_pack.hpp"
 #include "glframe_retrace_interface.hpp"
 #include "glframe_state.hpp"
 #include "glframe_thread_context.hpp"
@@ -56,12 +58,29 @@ struct RenderBookmark {
 };
 
 class PerfMetrics;
+class RenderTargetCache;
 class RetraceRender;
 class RetraceContext;
 
+// Selects how openFile replays the calls preceding the target frame.
+enum FastForwardMode {
+  // retrace every call
+  FULL_REPLAY,
+  // retrace only calls which build GL object state.  Draws, clears,
+  // dispatches, queries and presents are skipped.
+  SKIP_DRAWS,
+  // as SKIP_DRAWS, but compare the final render target of the frame
+  // with the result of a full replay.  The full replay is performed
+  // the first time a trace/frame is opened, and its result is cached.
+  VALIDATE_SKIP_DRAWS
+};
+
 class FrameRetrace : public IFrameRetrace {
  public:
-  FrameRetrace();
+  // checkpoint: store a reduced trace for each opened frame, and
+  // open it instead of the original trace when the frame is reopened.
+  explicit FrameRetrace(FastForwardMode fast_forward = FULL_REPLAY,
+                        bool checkpoint = false);
   ~FrameRetrace();
   void openFile(const std::string &filename,
                 const std::vector<unsigned char> &md5,
@@ -86,6 +105,7 @@ class FrameRetrace : public IFrameRetrace {
                       OnFrameRetrace *callback) const;
   void retraceAllMetrics(const RenderSelection &selection,
                          ExperimentId experimentCount,
+                         MetricAggregation aggregation,
                          OnFrameRetrace *callback) const;
   void replaceShaders(RenderId renderId,
                       ExperimentId experimentCount,
@@ -133,6 +153,11 @@ class FrameRetrace : public IFrameRetrace {
   void retraceTextures(const RenderSelection &selection,
                        ExperimentId experimentCount,
                        OnFrameRetrace *callback);
+  void retraceViews(const RenderSelection &selection,
+                    ExperimentId experimentCount,
+                    uint32_t views,
+                    OnFrameRetrace *callback);
+  void setMetricRepetitions(uint32_t repetitions);
   void revertExperiments();
   void cancel(SelectionId selectionCount,
               ExperimentId experimentCount);
@@ -147,12 +172,34 @@ class FrameRetrace : public IFrameRetrace {
   StateTrack m_tracker;
   PerfMetrics * m_metrics;
   RetraceFilter * m_retracer;
+  // images from previous render target retraces
+  RenderTargetCache * m_rt_cache;
 
   // each entry is the last render in an RT region
   std::vector<RenderId> render_target_regions;
 
   ThreadContext m_thread_context;
   CancellationPolicy m_cancelPolicy;
+  const FastForwardMode m_fast_forward;
+  const bool m_checkpoint;
+  // measured replays for each metrics request
+  uint32_t m_repetitions;
+
+  // serves the frame calls from the pack cache.  Blobs in the retraced
+  // calls reference the pack, so it lives as long as the contexts.
+  FramePackParser m_frame_pack;
+  // replaces the global parser while a stored checkpoint is retraced
+  CheckpointParser m_checkpoint_parser;
+
+  // hashes the final render target of the frame
+  size_t frameChecksum() const;
+  // unmeasured replays which precede metrics collection.  A NULL
+  // selection is a request for the whole frame.  Returns false if the
+  // request was cancelled.
+  bool warmUp(const RenderSelection *selection,
+              ExperimentId experimentCount) const;
+  bool isCancelled(const RenderSelection *selection,
+                   ExperimentId experimentCount) const;
 };
 
 } /* namespace glretrace */
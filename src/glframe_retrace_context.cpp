@@ -35,6 +35,7 @@
 #include "glframe_glhelper.hpp"
 #include "glframe_logger.hpp"
 #include "glframe_metrics.hpp"
+#include "glframe_render_target_cache.hpp"
 #include "glframe_retrace_render.hpp"
 #include "glframe_retrace_texture.hpp"
 #include "glframe_state_override.hpp"
@@ -54,6 +55,7 @@ using glretrace::PerfMetrics;
 using glretrace::RenderId;
 using glretrace::RenderOptions;
 using glretrace::RenderSelection;
+using glretrace::RenderTargetCache;
 using glretrace::RenderTargetType;
 using glretrace::RetraceContext;
 using glretrace::RetraceFilter;
@@ -63,6 +65,12 @@ using glretrace::StateKey;
 using glretrace::StateOverride;
 using glretrace::StateTrack;
 using glretrace::Textures;
+using glretrace::API_VIEW;
+using glretrace::BATCH_VIEW;
+using glretrace::SHADER_ASSEMBLY_VIEW;
+using glretrace::STATE_VIEW;
+using glretrace::TEXTURE_VIEW;
+using glretrace::UNIFORM_VIEW;
 using glretrace::WARN;
 using image::Image;
 
@@ -234,12 +242,90 @@ void clear_all() {
   glretrace::GlFunctions::GetError();
 }
 
+// reads the images of the current draw buffer
+void
+read_render_targets(RenderTargetType type,
+                    std::vector<RenderTargetCache::Image> *images) {
+  const int image_count = glstate::getDrawBufferImageCount();
+
+  // re-order the images to put depth/stencil at the bottom
+  std::vector<int> rt_indices;
+  if (type == glretrace::GEOMETRY_RENDER || type == glretrace::OVERDRAW_RENDER) {
+    rt_indices.push_back(0);
+  } else {
+    for (int rt_num = 0; rt_num < image_count; ++rt_num)
+      rt_indices.push_back(rt_num);
+    // request depth and stencil images
+    rt_indices.push_back(kDepth);
+    rt_indices.push_back(kStencil);
+  }
+
+  for (auto rt_num : rt_indices) {
+    Image *i = glstate::getDrawBufferImage(rt_num);
+    if (!i) {
+      // it is typical for some render targets to be inaccessible
+      continue;
+    }
+    // else construct the appropriate label for the image
+    std::string label;
+    switch (rt_num) {
+      case kDepth:
+        label = "depth";
+        break;
+      case kStencil:
+        label = "stencil";
+        break;
+      default: {
+        std::stringstream slabel;
+        slabel <<  "attachment " << rt_num;
+        label = slabel.str();
+        break;
+      }
+    }
+    if (type == glretrace::GEOMETRY_RENDER)
+      label = "geometry";
+    if (type == glretrace::OVERDRAW_RENDER) {
+      label = "overdraw";
+      rt_num = kOverDraw;
+    }
+
+    normalize_image(i, rt_num);
+    std::stringstream png;
+    i->writePNG(png, true);
+
+    images->push_back(RenderTargetCache::Image());
+    RenderTargetCache::Image &image = images->back();
+    image.label = label;
+    const std::string bytes = png.str();
+    image.png.assign(bytes.begin(), bytes.end());
+    delete i;
+  }
+}
+
+bool
+RetraceContext::imageRender(RenderId render, RenderOptions options,
+                            RenderId *image_render,
+                            RenderOptions *image_options) const {
+  if (m_renders.empty() ||
+      (render < m_renders.begin()->first) ||
+      (render > m_renders.rbegin()->first))
+    return false;
+  *image_render = (options & glretrace::STOP_AT_RENDER) ?
+                  render : lastRenderForRTRegion(render);
+  *image_options = options;
+  if (lastRenderForRTRegion(*image_render) == *image_render)
+    *image_options = static_cast<RenderOptions>(
+        options & ~glretrace::STOP_AT_RENDER);
+  return true;
+}
+
 void
 RetraceContext::retraceRenderTarget(ExperimentId experimentCount,
                                     const RenderSelection &selection,
                                     RenderTargetType type,
                                     RenderOptions options,
                                     const StateTrack &tracker,
+                                    RenderTargetCache *cache,
                                     OnFrameRetrace *callback) const {
   if (m_renders.empty())
     return;
@@ -256,9 +342,36 @@ RetraceContext::retraceRenderTarget(ExperimentId experimentCount,
   else if (type == GEOMETRY_RENDER)
     unselected_type = NULL_RENDER;
 
+  const RenderId last_render = lastRender(selection);
+
+  // a normal retrace of the frame produces the images that would be
+  // reported for each region, so they are cached as they are passed.
+  // Images are no longer those of a normal retrace once the reported
+  // render target has been cleared.
+  const bool cacheable = cache && (type == NORMAL_RENDER) &&
+                         !(options & glretrace::CLEAR_BEFORE_RENDER);
+  bool cleared = false;
+  RenderId reported_render;
+  RenderOptions reported_options;
+  const bool contains_last_render = imageRender(last_render, options,
+                                                &reported_render,
+                                                &reported_options);
+  auto retrace_render = [&](RenderTargetType render_type) {
+    const RenderId id = current_render->first;
+    current_render->second->retraceRenderTarget(tracker, render_type);
+    if (!cacheable || cleared ||
+        (callback && contains_last_render && id == reported_render) ||
+        (lastRenderForRTRegion(id) != id) ||
+        cache->find(id, glretrace::DEFAULT_RENDER))
+      return;
+    std::vector<RenderTargetCache::Image> images;
+    read_render_targets(type, &images);
+    cache->insert(id, glretrace::DEFAULT_RENDER, &images);
+  };
+
   // play up to the beginning of the first render
   while (current_render->first < selection.series.front().begin) {
-    current_render->second->retraceRenderTarget(tracker, unselected_type);
+    retrace_render(unselected_type);
     ++current_render;
     if (current_render == m_renders.end())
       // played through the context
@@ -273,15 +386,13 @@ RetraceContext::retraceRenderTarget(ExperimentId experimentCount,
   }
 
   // play through the selected renders
-  const RenderId last_render = lastRender(selection);
   while (current_render->first < selection.series.back().end) {
     RenderTargetType current_type = type;
     if (!isSelected(current_render->first, selection))
       // unselected renders don't get highlighting
       current_type = unselected_type;
     const bool is_last_render = (current_render->first == last_render);
-    current_render->second->retraceRenderTarget(tracker,
-                                                current_type);
+    retrace_render(current_type);
     ++current_render;
 
     if (is_last_render)
@@ -298,8 +409,7 @@ RetraceContext::retraceRenderTarget(ExperimentId experimentCount,
     RenderId last_render_in_rt_region =
         lastRenderForRTRegion(last_render);
     while (current_render->first <= last_render_in_rt_region) {
-      current_render->second->retraceRenderTarget(tracker,
-                                                  unselected_type);
+      retrace_render(unselected_type);
       ++current_render;
       if (current_render == m_renders.end())
         // played through the context
@@ -308,76 +418,26 @@ RetraceContext::retraceRenderTarget(ExperimentId experimentCount,
   }
 
   // report an image if the last selected render is in this context
-  const bool contains_last_render =
-      ((last_render >= m_renders.begin()->first) &&
-       (last_render <= m_renders.rbegin()->first));
   if (contains_last_render) {
-    const int image_count = glstate::getDrawBufferImageCount();
-
-    // re-order the images to put depth/stencil at the bottom
-    std::vector<int> rt_indices;
-    if (type == GEOMETRY_RENDER || type == OVERDRAW_RENDER) {
-      rt_indices.push_back(0);
-    } else {
-      for (int rt_num = 0; rt_num < image_count; ++rt_num)
-        rt_indices.push_back(rt_num);
-      // request depth and stencil images
-      rt_indices.push_back(kDepth);
-      rt_indices.push_back(kStencil);
-    }
-
     if (callback) {
-      for (auto rt_num : rt_indices) {
-        Image *i = glstate::getDrawBufferImage(rt_num);
-        if (!i) {
-          // it is typical for some render targets to be inaccessible
-          continue;
-        }
-        // else construct the appropriate label for the image
-        std::string label;
-        switch (rt_num) {
-          case kDepth:
-            label = "depth";
-            break;
-          case kStencil:
-            label = "stencil";
-            break;
-          default: {
-            std::stringstream slabel;
-            slabel <<  "attachment " << rt_num;
-            label = slabel.str();
-            break;
-          }
-        }
-        if (type == GEOMETRY_RENDER)
-          label = "geometry";
-        if (type == OVERDRAW_RENDER) {
-          label = "overdraw";
-          rt_num = kOverDraw;
-        }
-
-        normalize_image(i, rt_num);
-        std::stringstream png;
-        i->writePNG(png, true);
-
-        std::vector<unsigned char> d;
-        const int bytes = png.str().size();
-        d.resize(bytes);
-        memcpy(d.data(), png.str().c_str(), bytes);
-        callback->onRenderTarget(selection.id, experimentCount, label, d);
-        delete i;
-      }
+      std::vector<RenderTargetCache::Image> images;
+      read_render_targets(type, &images);
+      for (const auto &image : images)
+        callback->onRenderTarget(selection.id, experimentCount,
+                                 image.label, image.png);
+      if (cacheable)
+        cache->insert(reported_render, reported_options, &images);
 
       // after reporting the RT image, clear all attachments to
       // prevent artifacts from appearing in subsequent retraces.
       clear_all();
+      cleared = true;
     }
   }
 
   // play to the rest of the context
   while (current_render != m_renders.end()) {
-    current_render->second->retraceRenderTarget(tracker,
-                                                unselected_type);
+    retrace_render(unselected_type);
     ++current_render;
   }
   clear_all();
@@ -403,6 +463,19 @@ RetraceContext::retraceMetrics(PerfMetrics *perf,
 }
 
 
+// Skips draws for queries that only read bound state, for the
+// lifetime of the object.
+class StateOnlyReplay {
+ public:
+  StateOnlyReplay(RetraceFilter *retracer,
+                  bool state_only) : m_retracer(retracer) {
+    m_retracer->setStateOnly(state_only);
+  }
+  ~StateOnlyReplay() { m_retracer->setStateOnly(false); }
+ private:
+  RetraceFilter *m_retracer;
+};
+
 class CleanPerf {
  public:
   CleanPerf(glretrace::PerfMetrics *perf,
@@ -625,6 +698,7 @@ RetraceContext::retraceUniform(const RenderSelection &selection,
                                ExperimentId experimentCount,
                                const StateTrack &tracker,
                                OnFrameRetrace *callback) {
+  const StateOnlyReplay state_only(m_retracer, true);
   if (m_context_switch)
     m_retracer->retrace(*m_context_switch);
   for (auto r : m_renders) {
@@ -670,6 +744,7 @@ RetraceContext::retraceState(const RenderSelection &selection,
                              ExperimentId experimentCount,
                              const StateTrack &tracker,
                              OnFrameRetrace *callback) {
+  const StateOnlyReplay state_only(m_retracer, true);
   if (m_context_switch)
     m_retracer->retrace(*m_context_switch);
   for (auto r : m_renders) {
@@ -756,3 +831,93 @@ RetraceContext::retraceTextures(const RenderSelection &selection,
     }
   }
 }
+
+class ViewsHook : public RetraceRender::CallbackHook {
+ public:
+  ViewsHook(uint32_t views, Textures *t, const StateTrack *tracker,
+            SelectionId s, ExperimentId e,
+            RenderId r, OnFrameRetrace *c)
+      : m_views(views), m_textures(t), m_tracker(tracker),
+        m_s(s), m_e(e), m_r(r), m_c(c) {}
+  void onCallbackReady() const {
+    if (m_views & SHADER_ASSEMBLY_VIEW)
+      m_c->onShaderAssembly(m_r, m_s, m_e,
+                            m_tracker->currentVertexShader(),
+                            m_tracker->currentFragmentShader(),
+                            m_tracker->currentTessControlShader(),
+                            m_tracker->currentTessEvalShader(),
+                            m_tracker->currentGeomShader(),
+                            m_tracker->currentCompShader());
+    if (m_views & UNIFORM_VIEW)
+      UniformHook(m_s, m_e, m_r, m_c).onCallbackReady();
+    if (m_views & STATE_VIEW)
+      StateHook(m_s, m_e, m_r, m_c).onCallbackReady();
+    if (m_views & TEXTURE_VIEW)
+      TextureHook(m_textures, m_s, m_e, m_r, m_c).onCallbackReady();
+  }
+ private:
+  uint32_t m_views;
+  Textures *m_textures;
+  const StateTrack *m_tracker;
+  SelectionId m_s;
+  ExperimentId m_e;
+  RenderId m_r;
+  OnFrameRetrace *m_c;
+};
+
+void
+RetraceContext::retraceViews(const RenderSelection &selection,
+                             ExperimentId experimentCount,
+                             uint32_t views,
+                             StateTrack *tracker,
+                             BatchControl *control,
+                             OutputPoller *poller,
+                             OnFrameRetrace *callback) {
+  if (views & API_VIEW)
+    retraceApi(selection, callback);
+  if (!(views & ~API_VIEW))
+    // api text is generated without replaying the frame
+    return;
+
+  // shader assembly is parsed from the same driver output that
+  // reports batches, see FrameRetrace::retraceViews
+  const bool tracked = views & SHADER_ASSEMBLY_VIEW;
+  const bool batch = views & BATCH_VIEW;
+  assert(!(tracked && batch));
+
+  // shader assembly is emitted by the driver when a draw is compiled,
+  // and batches and textures are read from the rendered frame
+  const StateOnlyReplay state_only(
+      m_retracer,
+      !(views & (SHADER_ASSEMBLY_VIEW | BATCH_VIEW | TEXTURE_VIEW)));
+  if (m_context_switch)
+    m_retracer->retrace(*m_context_switch);
+  for (auto r : m_renders) {
+    const bool selected =
+        isSelected(r.first, selection) &&
+        !m_cancelPolicy.isCancelled(selection.id, experimentCount);
+    if (batch) {
+      if (selected) {
+        GlFunctions::Finish();
+        control->batchOn();
+      } else {
+        control->batchOff();
+      }
+      poller->flush();
+    }
+    const ViewsHook hook(views, m_textures, tracker,
+                         selection.id, experimentCount,
+                         r.first, callback);
+    const ViewsHook *h = selected ? &hook : NULL;
+    if (tracked)
+      r.second->retrace(tracker, h);
+    else
+      r.second->retrace(*tracker, h);
+    if (batch && selected) {
+      GlFunctions::Finish();
+      poller->pollBatch(selection.id, experimentCount, r.first, callback);
+    }
+  }
+  if (batch)
+    control->batchOff();
+}
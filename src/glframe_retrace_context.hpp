@@ -56,6 +56,7 @@ class ExperimentId;
 class MetricId;
 class OutputPoller;
 class PerfMetrics;
+class RenderTargetCache;
 class RetraceRender;
 class Textures;
 
@@ -72,7 +73,16 @@ class RetraceContext {
                            RenderTargetType type,
                            RenderOptions options,
                            const StateTrack &tracker,
+                           RenderTargetCache *cache,
                            OnFrameRetrace *callback) const;
+  // the render after which images are read, for a selection ending
+  // with the render, and the options which key the images in the
+  // RenderTargetCache.  Images read at the end of a render target
+  // region do not depend on STOP_AT_RENDER.  Returns false if the
+  // render is not in the context.
+  bool imageRender(RenderId render, RenderOptions options,
+                   RenderId *image_render,
+                   RenderOptions *image_options) const;
   void retraceMetrics(PerfMetrics *perf, const StateTrack &tracker) const;
   void retraceAllMetrics(const RenderSelection &selection,
                          PerfMetrics *perf,
@@ -127,6 +137,13 @@ class RetraceContext {
                        ExperimentId experimentCount,
                        const StateTrack &tracker,
                        OnFrameRetrace *callback);
+  void retraceViews(const RenderSelection &selection,
+                    ExperimentId experimentCount,
+                    uint32_t views,
+                    StateTrack *tracker,
+                    BatchControl *control,
+                    OutputPoller *poller,
+                    OnFrameRetrace *callback);
   void revertExperiments(StateTrack *tracker);
 
  private:
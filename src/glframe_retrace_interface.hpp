@@ -52,6 +52,27 @@ enum RenderOptions {
   CLEAR_BEFORE_RENDER = 0x2,
 };
 
+// streaming views which can be served by a single retraceViews
+// request
+enum RetraceView {
+  SHADER_ASSEMBLY_VIEW = 0x1,
+  API_VIEW = 0x2,
+  BATCH_VIEW = 0x4,
+  UNIFORM_VIEW = 0x8,
+  STATE_VIEW = 0x10,
+  TEXTURE_VIEW = 0x20,
+};
+
+// reduction of retraceAllMetrics results over the RenderSequences
+// of a selection, applied by the server
+enum MetricAggregation {
+  METRIC_PER_RENDER,  // no reduction
+  METRIC_SUM,
+  METRIC_AVERAGE,
+  METRIC_MIN,
+  METRIC_MAX
+};
+
 enum ErrorSeverity {
   RETRACE_WARN,
   RETRACE_FATAL
@@ -189,7 +210,12 @@ class ExperimentId {
 
 struct MetricSeries {
   MetricId metric;
+  // the median of the samples taken for each render
   std::vector<float> data;
+  // sample variance and count for each render, after outliers are
+  // rejected.  Empty when a single sample was taken.
+  std::vector<float> variance;
+  std::vector<uint32_t> samples;
 };
 
 struct RenderSequence {
@@ -412,8 +438,10 @@ class IFrameRetrace {
   virtual void retraceMetrics(const std::vector<MetricId> &ids,
                               ExperimentId experimentCount,
                               OnFrameRetrace *callback) const = 0;
+  // with an aggregation, each MetricSeries holds a single value
   virtual void retraceAllMetrics(const RenderSelection &selection,
                                  ExperimentId experimentCount,
+                                 MetricAggregation aggregation,
                                  OnFrameRetrace *callback) const = 0;
   virtual void replaceShaders(RenderId renderId,
                               ExperimentId experimentCount,
@@ -456,6 +484,15 @@ class IFrameRetrace {
   virtual void retraceTextures(const RenderSelection &selection,
                                ExperimentId experimentCount,
                                OnFrameRetrace *callback) = 0;
+  // serves each view in the RetraceView bitmask from a single replay
+  // of the frame, with the same callbacks as the per-view requests
+  virtual void retraceViews(const RenderSelection &selection,
+                            ExperimentId experimentCount,
+                            uint32_t views,
+                            OnFrameRetrace *callback) = 0;
+  // sets the number of measured replays for subsequent metrics
+  // requests.  The median of the samples is reported for each render.
+  virtual void setMetricRepetitions(uint32_t repetitions) = 0;
   virtual void revertExperiments() = 0;
   virtual void cancel(SelectionId selectionCount,
                       ExperimentId experimentCount) = 0;
@@ -27,11 +27,14 @@
 
 #include "glframe_retrace_render.hpp"
 
+#include <list>
 #include <map>
 #include <string>
 #include <sstream>
 #include <vector>
 
+#include "glframe_call_class.hpp"
+#include "glframe_gl_errors.hpp"
 #include "glframe_glhelper.hpp"
 #include "glframe_logger.hpp"
 #include "glframe_metrics.hpp"
@@ -44,8 +47,10 @@
 #include "glframe_state_override.hpp"
 #include "glframe_texture_override.hpp"
 
+using glretrace::CallClass;
 using glretrace::DEBUG;
 using glretrace::ExperimentId;
+using glretrace::GlErrors;
 using glretrace::GlFunctions;
 using glretrace::PerfMetrics;
 using glretrace::RetraceFilter;
@@ -69,43 +74,73 @@ static const std::string overdraw_fs =
     "  gl_FragColor = vec4(1,1,1,1);\n"
     "}";
 
-bool
-isCompute(const trace::Call &call) {
-  return ((strcmp("glDispatchCompute", call.name()) == 0) ||
-          (strcmp("glDispatchComputeIndirect",
-                  call.name()) == 0));
-}
+namespace {
 
-bool
-is_clear(const trace::Call &call) {
-  if (strncmp("glClearBuffer", call.name(),
-              strlen("glClearBuffer")) == 0)
-    return true;
-  if (strncmp("glClearNamedFramebuffer", call.name(),
-              strlen("glClearNamedFramebuffer")) == 0)
-    return true;
-  if (strcmp("glClear", call.name()) == 0)
-    return true;
-  return false;
-}
+// Holds the API text generated for the most recently requested
+// renders.  The text of the least recently used render is released
+// when the cache exceeds its budget.
+class ApiTextCache {
+ public:
+  ApiTextCache() : m_bytes(0) {}
+  // returns NULL if the text for the render is not cached
+  const std::vector<std::string> *find(const RetraceRender *render) {
+    auto entry = m_entries.find(render);
+    if (entry == m_entries.end())
+      return NULL;
+    m_lru.splice(m_lru.end(), m_lru, entry->second);
+    return &entry->second->text;
+  }
+  const std::vector<std::string> &insert(const RetraceRender *render,
+                                         std::vector<std::string> *text) {
+    remove(render);
+    size_t bytes = 0;
+    for (const auto &line : *text)
+      bytes += line.size();
+    m_lru.push_back(Entry());
+    auto inserted = std::prev(m_lru.end());
+    inserted->render = render;
+    inserted->bytes = bytes;
+    inserted->text.swap(*text);
+    m_entries[render] = inserted;
+    m_bytes += bytes;
+    // the requested render is kept, even if it exceeds the budget
+    while (m_bytes > kBudget && m_lru.begin() != inserted)
+      remove(m_lru.front().render);
+    return inserted->text;
+  }
+  void remove(const RetraceRender *render) {
+    auto entry = m_entries.find(render);
+    if (entry == m_entries.end())
+      return;
+    m_bytes -= entry->second->bytes;
+    m_lru.erase(entry->second);
+    m_entries.erase(entry);
+  }
+
+ private:
+  static const size_t kBudget = 64 * 1024 * 1024;
+  struct Entry {
+    const RetraceRender *render;
+    size_t bytes;
+    std::vector<std::string> text;
+  };
+  std::list<Entry> m_lru;
+  std::map<const RetraceRender *, std::list<Entry>::iterator> m_entries;
+  size_t m_bytes;
+};
+
+ApiTextCache api_text_cache;
+
+}  // namespace
 
 bool
 RetraceRender::isRender(const trace::Call &call) {
-  return ((call.flags & trace::CALL_FLAG_RENDER) || isCompute(call)
-          || is_clear(call));
+  return CallClass::get(call) & CallClass::RENDER;
 }
 
 bool
 RetraceRender::endsFrame(const trace::Call &c) {
-  if (c.flags & trace::CALL_FLAG_END_FRAME) {
-    // apitrace considers glFrameTerminatorGREMEDY to be a terminator,
-    // but this always follows swapbuffers when it exists.
-    if (strncmp("glFrameTerminatorGREMEDY", c.sig->name,
-                strlen("glFrameTerminatorGREMEDY")) == 0)
-      return false;
-    return true;
-  }
-  return false;
+  return CallClass::get(c) & CallClass::END_FRAME;
 }
 
 int
@@ -167,7 +202,9 @@ RetraceRender::RetraceRender(unsigned int tex2x2,
                              trace::AbstractParser *parser,
                              RetraceFilter *retracer,
                              StateTrack *tracker)
-    : m_retracer(retracer),
+    : m_parser(parser),
+      m_retracer(retracer),
+      m_last_call(NULL),
       m_rt_program(-1),
       m_overdraw_program(-1),
       m_retrace_program(-1),
@@ -182,20 +219,19 @@ RetraceRender::RetraceRender(unsigned int tex2x2,
       m_overdraw_rt_override(new StateOverride()),
       m_texture_override(new TextureOverride(tex2x2)) {
   trace::Call *call = NULL;
-  std::stringstream call_stream;
   bool compute = false;
   trace::ParseBookmark call_start;
   while ((call = parser->parse_call())) {
     tracker->flush();
     if (0) // flip this to get full error info
       retrace::debug = 1;
+    GlErrors::begin();
     m_retracer->retrace(*call);
-    const GLenum err = GlFunctions::GetError();
-    GL_CHECK_STR(call->sig->name);
+    const GLenum err = GlErrors::end(*call);
     tracker->track(*call);
     m_end_of_frame = endsFrame(*call);
     const bool render = isRender(*call);
-    compute = isCompute(*call);
+    compute = CallClass::get(*call) & CallClass::COMPUTE;
     if (ThreadContext::changesContext(*call)) {
       if (ThreadContext::nullContext(*call, retracer)) {
         delete call;
@@ -203,20 +239,15 @@ RetraceRender::RetraceRender(unsigned int tex2x2,
       }
       // else
       m_changes_context = true;
-      if (m_api_calls.size() > 0) {
+      if (!m_calls.empty()) {
         // this ought to be in the next context
         m_parser->setBookmark(call_start);
         delete call;
         break;
       }
     }
-    trace::dump(*call, call_stream,
-                trace::DUMP_FLAG_NO_COLOR);
-    m_api_calls.push_back(call_stream.str());
-    call_stream.str("");
-
     if (err != GL_NO_ERROR) {
-      m_error_indices.push_back(m_api_calls.size() - 1);
+      m_error_indices.push_back(m_calls.size());
       m_errors.push_back(glretrace::state_enum_to_name(err));
     }
 
@@ -310,6 +341,7 @@ RetraceRender::RetraceRender(unsigned int tex2x2,
 }
 
 RetraceRender::~RetraceRender() {
+  api_text_cache.remove(this);
   delete m_uniform_override;
   delete m_state_override;
   delete m_highlight_rt_override;
@@ -369,7 +401,8 @@ RetraceRender::retraceRenderTarget(const StateTrack &tracker,
 
 
 void
-RetraceRender::retrace(StateTrack *tracker) const {
+RetraceRender::retrace(StateTrack *tracker,
+                       const CallbackHook *hook) const {
   // check that the parser is in correct state
   tracker->flush();
 
@@ -394,11 +427,24 @@ RetraceRender::retrace(StateTrack *tracker) const {
     }
   }
 
+  if (hook) {
+    m_uniform_override->overrideUniforms();
+    m_state_override->overrideState();
+    m_texture_override->overrideTexture();
+  }
+
   // retrace the final render
   if (!m_disabled)
     m_retracer->retrace(*m_last_call);
   if (tracker)
     tracker->track(*m_last_call);
+
+  if (hook) {
+    hook->onCallbackReady();
+    m_state_override->restoreState();
+    m_uniform_override->restoreUniforms();
+    m_texture_override->restoreTexture();
+  }
   StateTrack::useProgramGL(m_original_program);
 }
 
@@ -481,7 +527,22 @@ void
 RetraceRender::onApi(SelectionId selId,
                      RenderId renderId,
                      OnFrameRetrace *callback) {
-  callback->onApi(selId, renderId, m_api_calls, m_error_indices, m_errors);
+  const std::vector<std::string> *api_calls = api_text_cache.find(this);
+  if (!api_calls) {
+    std::vector<std::string> text;
+    std::stringstream call_stream;
+    auto dump_call = [&](trace::Call *call) {
+      trace::dump(*call, call_stream, trace::DUMP_FLAG_NO_COLOR);
+      text.push_back(call_stream.str());
+      call_stream.str("");
+    };
+    for (auto call : m_calls)
+      dump_call(call);
+    if (m_last_call)
+      dump_call(m_last_call);
+    api_calls = &api_text_cache.insert(this, &text);
+  }
+  callback->onApi(selId, renderId, *api_calls, m_error_indices, m_errors);
 }
 
 void
@@ -66,7 +66,10 @@ class RetraceRender {
 
   void retraceRenderTarget(const StateTrack &tracker,
                            RenderTargetType type) const;
-  void retrace(StateTrack *tracker) const;
+  // tracks program state through the render.  With a hook, the
+  // render also applies its experiments as the const variant does.
+  void retrace(StateTrack *tracker,
+               const CallbackHook *hook = NULL) const;
   void retrace(const StateTrack &tracker,
                const CallbackHook *hook = NULL) const;
   bool endsFrame() const { return m_end_of_frame; }
@@ -113,7 +116,7 @@ class RetraceRender {
     m_modified_geom, m_modified_comp;
   int m_rt_program, m_overdraw_program, m_retrace_program, m_original_program;
   bool m_end_of_frame, m_highlight_rt, m_changes_context;
-  std::vector<std::string> m_api_calls;
+  // API text for the calls is generated when requested, see onApi
   std::vector<unsigned> m_error_indices;
   std::vector<std::string> m_errors;
   bool m_disabled, m_simple_shader;
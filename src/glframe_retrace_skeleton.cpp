@@ -30,20 +30,31 @@
 #include <google/protobuf/io/zero_copy_stream_impl_lite.h>
 #include <google/protobuf/io/coded_stream.h>
 
+#include <condition_variable>
+#include <deque>
+#include <iomanip>
+#include <mutex>
 #include <string>
 #include <sstream>
+#include <utility>
 #include <vector>
 
+#include "crc32c/crc32c.h"
+#include "glframe_logger.hpp"
 #include "glframe_os.hpp"
 #include "glframe_retrace_interface.hpp"
 #include "glframe_retrace.hpp"
+#include "glframe_shared_ring.hpp"
 #include "glframe_socket.hpp"
 #include "playback.pb.h" // NOLINT
 
 using ApiTrace::CancellationEvent;
+using ApiTrace::MetricsRequest;
+using ApiTrace::RenderTargetRequest;
 using ApiTrace::RetraceRequest;
 using ApiTrace::RetraceResponse;
 using glretrace::ErrorSeverity;
+using glretrace::CancellationPolicy;
 using glretrace::ExperimentId;
 using glretrace::FrameRetrace;
 using glretrace::FrameRetraceSkeleton;
@@ -53,8 +64,11 @@ using glretrace::MetricSeries;
 using glretrace::RenderId;
 using glretrace::RenderOptions;
 using glretrace::RenderTargetType;
+using glretrace::RequestBacklog;
+using glretrace::Semaphore;
 using glretrace::SelectionId;
 using glretrace::ShaderAssembly;
+using glretrace::SharedRing;
 using glretrace::Socket;
 using glretrace::StateKey;
 using glretrace::TextureData;
@@ -63,18 +77,19 @@ using glretrace::Thread;
 using glretrace::UniformDimension;
 using glretrace::UniformType;
 using glretrace::application_cache_directory;
+using glretrace::glretrace_fseek;
+using glretrace::glretrace_ftell;
+using glretrace::glretrace_pid;
 using google::protobuf::io::ArrayInputStream;
-using google::protobuf::io::ArrayOutputStream;
 using google::protobuf::io::CodedInputStream;
-using google::protobuf::io::CodedOutputStream;
 
 
 namespace glretrace {
 class CancellationThread : public Thread {
  public:
-  explicit CancellationThread(Socket *s, IFrameRetrace *f)
+  CancellationThread(Socket *s, IFrameRetrace *f, CancellationPolicy *p)
       : Thread("cancellation thread"),
-        m_socket(s), m_retrace(f) { Start(); }
+        m_socket(s), m_retrace(f), m_policy(p) { Start(); }
   virtual void Run() {
     std::vector<unsigned char> buf;
     while (true) {
@@ -91,18 +106,215 @@ class CancellationThread : public Thread {
       CodedInputStream::Limit msg_limit = coded_in.PushLimit(buf_size);
       e.ParseFromCodedStream(&coded_in);
       coded_in.PopLimit(msg_limit);
-      m_retrace->cancel(SelectionId(e.selection_count()),
-                        ExperimentId(e.experiment_count()));
+      if (e.has_session())
+        // identifies the client to a multi-session server
+        continue;
+      const SelectionId sel(e.selection_count());
+      const ExperimentId exp(e.experiment_count());
+      m_policy->cancel(sel, exp);
+      m_retrace->cancel(sel, exp);
     }
   }
 
  private:
   Socket *m_socket;
   IFrameRetrace *m_retrace;
+  CancellationPolicy *m_policy;
+};
+
+// the selection and experiment which a read of the frame was made
+// for.  false for requests which change the state of the server.
+bool
+readIds(const RetraceRequest &r, uint32_t *sel, uint32_t *exp) {
+  *sel = 0;
+  *exp = 0;
+  switch (r.requesttype()) {
+    case ApiTrace::RENDER_TARGET_REQUEST:
+      *sel = r.rendertarget().render_selection().selection_count();
+      *exp = r.rendertarget().experiment_count();
+      return true;
+    case ApiTrace::SHADER_ASSEMBLY_REQUEST:
+      *sel = r.shaderassembly().render_selection().selection_count();
+      *exp = r.shaderassembly().experiment_count();
+      return true;
+    case ApiTrace::METRICS_REQUEST:
+      // bar graph metrics span the frame, regardless of selection
+      *exp = r.metrics().experiment_count();
+      return true;
+    case ApiTrace::ALL_METRICS_REQUEST:
+      *sel = r.allmetrics().selection().selection_count();
+      *exp = r.allmetrics().experiment_count();
+      return true;
+    case ApiTrace::API_REQUEST:
+      *sel = r.api().selection().selection_count();
+      return true;
+    case ApiTrace::BATCH_REQUEST:
+      *sel = r.batch().selection().selection_count();
+      *exp = r.batch().experiment_count();
+      return true;
+    case ApiTrace::UNIFORM_REQUEST:
+      *sel = r.uniform().selection().selection_count();
+      *exp = r.uniform().experiment_count();
+      return true;
+    case ApiTrace::STATE_REQUEST:
+      *sel = r.state().selection().selection_count();
+      *exp = r.state().experiment_count();
+      return true;
+    case ApiTrace::TEXTURE_REQUEST:
+      *sel = r.texture().selection().selection_count();
+      *exp = r.texture().experiment_count();
+      return true;
+    case ApiTrace::VIEWS_REQUEST:
+      *sel = r.views().selection().selection_count();
+      *exp = r.views().experiment_count();
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool
+sameSeries(const ApiTrace::RenderSelection &a,
+           const ApiTrace::RenderSelection &b) {
+  if (a.render_series_size() != b.render_series_size())
+    return false;
+  for (int i = 0; i < a.render_series_size(); ++i)
+    if ((a.render_series(i).begin() != b.render_series(i).begin()) ||
+        (a.render_series(i).end() != b.render_series(i).end()))
+      return false;
+  return true;
+}
+
+// true if the responses to newer are a superset of the responses to
+// older, for reads of the same type.
+bool
+answers(const RetraceRequest &older, const RetraceRequest &newer) {
+  switch (older.requesttype()) {
+    case ApiTrace::METRICS_REQUEST: {
+      const MetricsRequest &o = older.metrics(), &n = newer.metrics();
+      if (o.metric_ids_size() != n.metric_ids_size())
+        return false;
+      for (int i = 0; i < o.metric_ids_size(); ++i)
+        if (o.metric_ids(i) != n.metric_ids(i))
+          return false;
+      return true;
+    }
+    case ApiTrace::ALL_METRICS_REQUEST:
+      return (older.allmetrics().aggregation() ==
+              newer.allmetrics().aggregation());
+    case ApiTrace::VIEWS_REQUEST: {
+      const uint32_t views = older.views().views();
+      return (newer.views().views() & views) == views;
+    }
+    case ApiTrace::RENDER_TARGET_REQUEST: {
+      // the ui requests each type of render target for a selection
+      const RenderTargetRequest &o = older.rendertarget(),
+                                &n = newer.rendertarget();
+      return (o.type() == n.type()) && (o.options() == n.options());
+    }
+    case ApiTrace::TEXTURE_REQUEST:
+      return sameSeries(older.texture().selection(),
+                        newer.texture().selection());
+    default:
+      return true;
+  }
+}
+
+// Reads requests from the socket ahead of their execution, so the
+// skeleton can skip requests which were superseded while it replayed
+// the frame for an earlier request.
+class RequestBacklog : public Thread {
+ public:
+  explicit RequestBacklog(Socket *s) : Thread("request backlog"),
+                                       m_socket(s),
+                                       m_closed(false) {}
+  virtual void Run() {
+    std::vector<unsigned char> buf;
+    while (true) {
+      // leading 4 bytes is the message length
+      uint32_t msg_len;
+      if (!m_socket->Read(&msg_len))
+        break;
+      buf.resize(msg_len);
+      if (!m_socket->ReadVec(&buf))
+        break;
+
+      const size_t buf_size = buf.size();
+      ArrayInputStream array_in(buf.data(), buf_size);
+      CodedInputStream coded_in(&array_in);
+      RetraceRequest request;
+      CodedInputStream::Limit msg_limit = coded_in.PushLimit(buf_size);
+      request.ParseFromCodedStream(&coded_in);
+      coded_in.PopLimit(msg_limit);
+      const bool open_file =
+          (request.requesttype() == ApiTrace::OPEN_FILE_REQUEST);
+      {
+        std::lock_guard<std::mutex> l(m_protect);
+        m_requests.push_back(std::move(request));
+        m_cv.notify_all();
+      }
+      if (open_file)
+        // the trace file may be uploaded through the socket.  It is
+        // read by the skeleton while the request executes.
+        m_resume.wait();
+    }
+    std::lock_guard<std::mutex> l(m_protect);
+    m_closed = true;
+    m_cv.notify_all();
+  }
+  // blocks until a request is read.  false after the socket closes.
+  bool pop(RetraceRequest *request) {
+    std::unique_lock<std::mutex> l(m_protect);
+    m_cv.wait(l, [this] { return m_closed || !m_requests.empty(); });
+    if (m_requests.empty())
+      return false;
+    request->Swap(&m_requests.front());
+    m_requests.pop_front();
+    return true;
+  }
+  // true if a subsequent read of the same type has the same or a
+  // more recent selection and experiment
+  bool superseded(const RetraceRequest &request) const {
+    uint32_t sel, exp;
+    if (!readIds(request, &sel, &exp))
+      return false;
+    std::lock_guard<std::mutex> l(m_protect);
+    for (const auto &newer : m_requests) {
+      if (newer.requesttype() != request.requesttype())
+        continue;
+      uint32_t newer_sel, newer_exp;
+      readIds(newer, &newer_sel, &newer_exp);
+      // Selection 0 reads span the frame, as for the frame column of
+      // the metrics table.  Only another frame-wide read supersedes
+      // them.
+      if (SelectionId(sel).count() == 0 &&
+          SelectionId(newer_sel).count() != 0)
+        continue;
+      if (newer_sel >= sel && newer_exp >= exp &&
+          answers(request, newer))
+        return true;
+    }
+    return false;
+  }
+  // called when the open file request has completed its upload
+  void resume() { m_resume.post(); }
+
+ private:
+  Socket *m_socket;
+  std::deque<RetraceRequest> m_requests;
+  mutable std::mutex m_protect;
+  std::condition_variable m_cv;
+  Semaphore m_resume;
+  bool m_closed;
 };
 
 }  // end namespace glretrace
 
+// Shared memory for the images sent to a local client.  Pages are
+// only allocated as the ring is written.  Images which do not fit are
+// sent through the socket.
+static const size_t kSharedRingSize = 256 << 20;
+
 FrameRetraceSkeleton::FrameRetraceSkeleton(Socket *retrace_sock,
                                            Socket *cancellation_socket,
                                            IFrameRetrace *frameretrace)
@@ -110,31 +322,32 @@ FrameRetraceSkeleton::FrameRetraceSkeleton(Socket *retrace_sock,
       m_force_upload(false),
       m_socket(retrace_sock),
       m_frame(frameretrace),
+      m_cancel(NULL),
       m_fatal_error(false),
-      m_multi_metrics_response(new RetraceResponse) {
+      m_multi_metrics_response(new RetraceResponse),
+      m_image_response(new RetraceResponse),
+      m_request_id(0),
+      m_open_file_pending(false),
+      m_ring(NULL) {
   if (!m_frame)
     m_frame = new FrameRetrace();
   if (cancellation_socket)
-    m_cancel = new CancellationThread(cancellation_socket, m_frame);
+    m_cancel = new CancellationThread(cancellation_socket, m_frame,
+                                      &m_cancelled);
 }
 
 void
 writeResponse(Socket *s,
               const RetraceResponse &response,
               std::vector<unsigned char> *buf) {
-  const uint32_t write_size = response.ByteSize();
-  if (!s->Write(write_size)) {
-    return;
-  }
+  s->WriteMessage(response, buf);
+}
 
-  buf->clear();
-  buf->resize(write_size);
-  ArrayOutputStream array_out(buf->data(), write_size);
-  CodedOutputStream coded_out(&array_out);
-  response.SerializeToCodedStream(&coded_out);
-  if (!s->WriteVec(*buf)) {
-    return;
-  }
+void
+FrameRetraceSkeleton::respond(RetraceResponse *response) {
+  if (m_request_id)
+    response->set_request_id(m_request_id);
+  writeResponse(m_socket, *response, &m_buf);
 }
 
 void
@@ -172,43 +385,157 @@ void set_shader_assembly(const ShaderAssembly &assembly,
   response->set_code_sinking(assembly.codeSinking);
 }
 
+// empty messages signal the last response of a streaming request
+void
+set_render_target_end(RetraceResponse *proto_response) {
+  auto rt_resp = proto_response->mutable_rendertarget();
+  rt_resp->set_selection_count(-1);
+  rt_resp->set_experiment_count(-1);
+  rt_resp->set_label("");
+  rt_resp->set_image("");
+}
+
+void
+set_shader_assembly_end(RetraceResponse *proto_response) {
+  auto resp = proto_response->mutable_shaderassembly();
+  resp->set_render_id(-1);
+  resp->set_selection_id(-1);
+  resp->set_experiment_count(-1);
+  ShaderAssembly s;
+  set_shader_assembly(s, resp->mutable_vertex());
+  set_shader_assembly(s, resp->mutable_fragment());
+  set_shader_assembly(s, resp->mutable_tess_control());
+  set_shader_assembly(s, resp->mutable_tess_eval());
+  set_shader_assembly(s, resp->mutable_geom());
+  set_shader_assembly(s, resp->mutable_comp());
+}
+
+void
+set_api_end(RetraceResponse *proto_response) {
+  auto resp = proto_response->mutable_api();
+  resp->set_render_id(-1);
+  resp->set_selection_count(-1);
+}
+
+void
+set_batch_end(RetraceResponse *proto_response) {
+  auto resp = proto_response->mutable_batch();
+  resp->set_render_id(-1);
+  resp->set_selection_count(-1);
+  resp->set_experiment_count(-1);
+  resp->set_batch("");
+}
+
+void
+set_uniform_end(RetraceResponse *proto_response) {
+  auto resp = proto_response->mutable_uniform();
+  resp->set_render_id(-1);
+  resp->set_selection_count(-1);
+  resp->set_experiment_count(-1);
+  resp->set_name("");
+  resp->set_uniform_type(ApiTrace::FLOAT_UNIFORM);
+  resp->set_uniform_dimension(ApiTrace::D_1x1);
+  resp->set_data("");
+}
+
+void
+set_state_end(RetraceResponse *proto_response) {
+  auto resp = proto_response->mutable_state();
+  resp->set_selection_count(-1);
+  resp->set_render_id(-1);
+  resp->set_experiment_count(-1);
+  resp->add_value("");
+  auto r_item = resp->mutable_item();
+  r_item->set_path("");
+  r_item->set_name("");
+}
+
+void
+set_texture_end(RetraceResponse *proto_response) {
+  auto resp = proto_response->mutable_texture();
+  resp->set_selection_count(-1);
+  resp->set_experiment_count(-1);
+  resp->set_render_id(-1);
+  auto bind = resp->mutable_binding();
+  bind->set_unit(-1);
+  bind->set_target(-1);
+  bind->set_offset(-1);
+}
+
+typedef void (*EndFn)(RetraceResponse *);
+// the responses which terminate each view of a views request
+const std::pair<uint32_t, EndFn> kViewEnds[] = {
+  { glretrace::SHADER_ASSEMBLY_VIEW, set_shader_assembly_end },
+  { glretrace::API_VIEW, set_api_end },
+  { glretrace::BATCH_VIEW, set_batch_end },
+  { glretrace::UNIFORM_VIEW, set_uniform_end },
+  { glretrace::STATE_VIEW, set_state_end },
+  { glretrace::TEXTURE_VIEW, set_texture_end } };
+
 void
 FrameRetraceSkeleton::Run() {
-  while (true) {
-    // leading 4 bytes is the message length
-    uint32_t msg_len;
-    if (!m_socket->Read(&msg_len)) {
-      return;
-    }
-    m_buf.resize(msg_len);
-    if (!m_socket->ReadVec(&m_buf)) {
-      return;
-    }
+  RequestBacklog backlog(m_socket);
+  backlog.Start();
+  RetraceRequest request;
+  while (backlog.pop(&request)) {
+    if (request.requesttype() == ApiTrace::OPEN_FILE_REQUEST)
+      // the upload is read below, unless a fatal error was hit.
+      // Either way, the backlog resumes reading once it completes.
+      m_open_file_pending = true;
 
-    if (m_fatal_error)
+    if (m_fatal_error) {
       // after fatal error is encountered, do not process subsequent
       // requests.
+      resumeBacklog(&backlog);
       continue;
+    }
 
-    const size_t buf_size = m_buf.size();
-    ArrayInputStream array_in(m_buf.data(), buf_size);
-    CodedInputStream coded_in(&array_in);
-    RetraceRequest request;
-    CodedInputStream::Limit msg_limit = coded_in.PushLimit(buf_size);
-    request.ParseFromCodedStream(&coded_in);
-    coded_in.PopLimit(msg_limit);
+    // responses are tagged with the id of the request, so the stub
+    // can route them while it has several requests outstanding
+    m_request_id = request.request_id();
+    if (isStale(request) || backlog.superseded(request)) {
+      // a more recent request replaces this one, and there is no
+      // need to replay the frame for it.
+      respondSkipped(request);
+      continue;
+    }
     switch (request.requesttype()) {
+      case ApiTrace::PROTOCOL_VERSION_REQUEST:
+        {
+          RetraceResponse proto_response;
+          proto_response.mutable_protocol_version()->set_version(
+              ApiTrace::PROTOCOL_VERSION);
+          // only local clients request shared memory
+          if (request.protocol_version().shared_memory() && !m_ring)
+            m_ring = SharedRing::Create(kSharedRingSize);
+          if (m_ring)
+            proto_response.mutable_protocol_version()->set_shared_memory(
+                true);
+          respond(&proto_response);
+          if (m_ring && !m_socket->SendFd(m_ring->fd()))
+            m_fatal_error = true;
+          break;
+        }
       case ApiTrace::OPEN_FILE_REQUEST:
         {
           auto of = request.fileopen();
           std::string file_path = of.filename();
-          const std::vector<unsigned char> vsum(of.md5sum().begin(),
-                                                of.md5sum().end());
+          // current clients identify the trace with trace_hash, and
+          // older clients with its md5
+          const std::string &key = (of.has_tracehash() ? of.tracehash() :
+                                    of.md5sum());
+          const std::vector<unsigned char> vsum(key.begin(), key.end());
           std::stringstream cache_file_s;
           cache_file_s << application_cache_directory();
-          cache_file_s << std::hex;
-          for (auto byte : vsum)
-            cache_file_s << static_cast<unsigned int>(byte);
+          if (of.has_tracehash()) {
+            cache_file_s << "tree_" << std::hex << std::setfill('0');
+            for (auto byte : vsum)
+              cache_file_s << std::setw(2) << static_cast<unsigned int>(byte);
+          } else {
+            cache_file_s << std::hex;
+            for (auto byte : vsum)
+              cache_file_s << static_cast<unsigned int>(byte);
+          }
           cache_file_s << ".trace";
 
           FILE * fh = fopen(of.filename().c_str(), "rb");
@@ -219,27 +546,19 @@ FrameRetraceSkeleton::Run() {
           if (!fh || m_force_upload) {
             // request file data
             file_path = cache_file_s.str();
-            onFileOpening(true, false, 0);
-
             if (fh)
               fclose(fh);
-            fh = fopen(file_path.c_str(), "wb");
-
-            uint32_t bytes_received = 0;
-            std::vector<unsigned char> buf;
-            while (true) {
-              uint32_t bytes;
-              m_socket->Read(&bytes);
-              buf.resize(bytes);
-              m_socket->ReadVec(&buf);
-              bytes_received += bytes;
-              const uint32_t w_bytes = fwrite(buf.data(), 1, bytes, fh);
-              assert(w_bytes == bytes);
-              if (bytes_received == of.filesize())
-                break;
+            fh = NULL;
+            if (!receiveUpload(file_path, of.filesize())) {
+              // the client disconnected, or was sent an error
+              m_fatal_error = true;
+              resumeBacklog(&backlog);
+              continue;
             }
           }
-          fclose(fh);
+          if (fh)
+            fclose(fh);
+          resumeBacklog(&backlog);
 
           m_frame->openFile(file_path, vsum, of.filesize(),
                             of.framenumber(), of.framecount(), this);
@@ -258,13 +577,8 @@ FrameRetraceSkeleton::Run() {
                                        this);
           // send empty message to signal the last response
           RetraceResponse proto_response;
-          auto rt_resp = proto_response.mutable_rendertarget();
-          rt_resp->set_selection_count(-1);
-          rt_resp->set_experiment_count(-1);
-          rt_resp->set_label("");
-          rt_resp->set_image("");
-          ShaderAssembly s;
-          writeResponse(m_socket, proto_response, &m_buf);
+          set_render_target_end(&proto_response);
+          respond(&proto_response);
           break;
         }
       case ApiTrace::METRICS_REQUEST:
@@ -279,7 +593,7 @@ FrameRetraceSkeleton::Run() {
                                   ExperimentId(met.experiment_count()),
                                   this);
           // callbacks have accumulated in m_multi_metrics_response
-          writeResponse(m_socket, *m_multi_metrics_response, &m_buf);
+          respond(m_multi_metrics_response);
           m_multi_metrics_response->Clear();
           break;
         }
@@ -299,11 +613,13 @@ FrameRetraceSkeleton::Run() {
           metrics_response->set_selection_count(
               met.selection().selection_count());
 
-          m_frame->retraceAllMetrics(selection,
-                                     ExperimentId(met.experiment_count()),
-                                     this);
+          m_frame->retraceAllMetrics(
+              selection,
+              ExperimentId(met.experiment_count()),
+              static_cast<glretrace::MetricAggregation>(met.aggregation()),
+              this);
           // callbacks have accumulated in m_multi_metrics_response
-          writeResponse(m_socket, *m_multi_metrics_response, &m_buf);
+          respond(m_multi_metrics_response);
           m_multi_metrics_response->Clear();
           break;
         }
@@ -319,18 +635,8 @@ FrameRetraceSkeleton::Run() {
                                          this);
           // send empty message to signal the last response
           RetraceResponse proto_response;
-          auto shader_resp = proto_response.mutable_shaderassembly();
-          shader_resp->set_render_id(-1);
-          shader_resp->set_selection_id(-1);
-          shader_resp->set_experiment_count(-1);
-          ShaderAssembly s;
-          set_shader_assembly(s, shader_resp->mutable_vertex());
-          set_shader_assembly(s, shader_resp->mutable_fragment());
-          set_shader_assembly(s, shader_resp->mutable_tess_control());
-          set_shader_assembly(s, shader_resp->mutable_tess_eval());
-          set_shader_assembly(s, shader_resp->mutable_geom());
-          set_shader_assembly(s, shader_resp->mutable_comp());
-          writeResponse(m_socket, proto_response, &m_buf);
+          set_shader_assembly_end(&proto_response);
+          respond(&proto_response);
           break;
         }
       case ApiTrace::REPLACE_SHADERS_REQUEST:
@@ -358,10 +664,8 @@ FrameRetraceSkeleton::Run() {
                               this);
           // send empty message to signal the last response
           RetraceResponse proto_response;
-          auto shader_resp = proto_response.mutable_api();
-          shader_resp->set_render_id(-1);
-          shader_resp->set_selection_count(-1);
-          writeResponse(m_socket, proto_response, &m_buf);
+          set_api_end(&proto_response);
+          respond(&proto_response);
           break;
         }
       case ApiTrace::BATCH_REQUEST:
@@ -375,12 +679,8 @@ FrameRetraceSkeleton::Run() {
                                 this);
           // send empty message to signal the last response
           RetraceResponse proto_response;
-          auto batch_resp = proto_response.mutable_batch();
-          batch_resp->set_render_id(-1);
-          batch_resp->set_selection_count(-1);
-          batch_resp->set_experiment_count(-1);
-          batch_resp->set_batch("");
-          writeResponse(m_socket, proto_response, &m_buf);
+          set_batch_end(&proto_response);
+          respond(&proto_response);
           break;
         }
       case ApiTrace::DISABLE_REQUEST:
@@ -439,15 +739,8 @@ FrameRetraceSkeleton::Run() {
                                   this);
           // send empty message to signal the last response
           RetraceResponse proto_response;
-          auto uniform_resp = proto_response.mutable_uniform();
-          uniform_resp->set_render_id(-1);
-          uniform_resp->set_selection_count(-1);
-          uniform_resp->set_experiment_count(-1);
-          uniform_resp->set_name("");
-          uniform_resp->set_uniform_type(ApiTrace::FLOAT_UNIFORM);
-          uniform_resp->set_uniform_dimension(ApiTrace::D_1x1);
-          uniform_resp->set_data("");
-          writeResponse(m_socket, proto_response, &m_buf);
+          set_uniform_end(&proto_response);
+          respond(&proto_response);
           break;
         }
       case ApiTrace::SET_UNIFORM_REQUEST:
@@ -477,15 +770,8 @@ FrameRetraceSkeleton::Run() {
                                 this);
           // send empty message to signal the last response
           RetraceResponse proto_response;
-          auto state_resp = proto_response.mutable_state();
-          state_resp->set_selection_count(-1);
-          state_resp->set_render_id(-1);
-          state_resp->set_experiment_count(-1);
-          state_resp->add_value("");
-          auto r_item = state_resp->mutable_item();
-          r_item->set_path("");
-          r_item->set_name("");
-          writeResponse(m_socket, proto_response, &m_buf);
+          set_state_end(&proto_response);
+          respond(&proto_response);
           break;
         }
       case ApiTrace::SET_STATE_REQUEST:
@@ -506,6 +792,13 @@ FrameRetraceSkeleton::Run() {
           m_frame->revertExperiments();
           break;
         }
+      case ApiTrace::METRIC_REPETITIONS_REQUEST:
+        {
+          assert(request.has_metric_repetitions());
+          m_frame->setMetricRepetitions(
+              request.metric_repetitions().repetitions());
+          break;
+        }
       case ApiTrace::TEXTURE_REQUEST:
         {
           assert(request.has_texture());
@@ -517,19 +810,109 @@ FrameRetraceSkeleton::Run() {
                                    this);
           // send empty message to signal the last response
           RetraceResponse proto_response;
-          auto resp = proto_response.mutable_texture();
-          resp->set_selection_count(-1);
-          resp->set_experiment_count(-1);
-          resp->set_render_id(-1);
-          auto bind = resp->mutable_binding();
-          bind->set_unit(-1);
-          bind->set_target(-1);
-          bind->set_offset(-1);
-          writeResponse(m_socket, proto_response, &m_buf);
+          set_texture_end(&proto_response);
+          respond(&proto_response);
           break;
         }
+      case ApiTrace::VIEWS_REQUEST:
+        {
+          assert(request.has_views());
+          auto views = request.views();
+          RenderSelection selection;
+          makeRenderSelection(views.selection(), &selection);
+          m_frame->retraceViews(selection,
+                                ExperimentId(views.experiment_count()),
+                                views.views(),
+                                this);
+          // terminate each requested view as the single-view
+          // requests do, so the stub can track them independently
+          respondViewsEnd(views.views());
+          break;
+        }
+    }
+  }
+  resumeBacklog(&backlog);
+  backlog.Join();
+}
+
+void
+FrameRetraceSkeleton::resumeBacklog(RequestBacklog *backlog) {
+  if (!m_open_file_pending)
+    return;
+  m_open_file_pending = false;
+  backlog->resume();
+}
+
+bool
+FrameRetraceSkeleton::isStale(const RetraceRequest &request) const {
+  uint32_t sel, exp;
+  if (!readIds(request, &sel, &exp))
+    return false;
+  // requests without a selection are not cancelled by a new one
+  const SelectionId selection = (SelectionId(sel).count() ?
+                                 SelectionId(sel) :
+                                 SelectionId(SelectionId::INVALID_SELECTION));
+  return m_cancelled.isCancelled(selection, ExperimentId(exp));
+}
+
+void
+FrameRetraceSkeleton::respondViewsEnd(uint32_t views) {
+  for (const auto &end : kViewEnds) {
+    if (!(views & end.first))
+      continue;
+    RetraceResponse proto_response;
+    end.second(&proto_response);
+    respond(&proto_response);
+  }
+}
+
+void
+FrameRetraceSkeleton::respondSkipped(const RetraceRequest &request) {
+  // the stub completes the request on its last response
+  RetraceResponse proto_response;
+  switch (request.requesttype()) {
+    case ApiTrace::RENDER_TARGET_REQUEST:
+      set_render_target_end(&proto_response);
+      break;
+    case ApiTrace::SHADER_ASSEMBLY_REQUEST:
+      set_shader_assembly_end(&proto_response);
+      break;
+    case ApiTrace::METRICS_REQUEST: {
+      auto metrics = proto_response.mutable_metricsdata();
+      metrics->set_experiment_count(request.metrics().experiment_count());
+      metrics->set_selection_count(0);
+      break;
+    }
+    case ApiTrace::ALL_METRICS_REQUEST: {
+      auto &met = request.allmetrics();
+      auto metrics = proto_response.mutable_metricsdata();
+      metrics->set_experiment_count(met.experiment_count());
+      metrics->set_selection_count(met.selection().selection_count());
+      break;
     }
+    case ApiTrace::API_REQUEST:
+      set_api_end(&proto_response);
+      break;
+    case ApiTrace::BATCH_REQUEST:
+      set_batch_end(&proto_response);
+      break;
+    case ApiTrace::UNIFORM_REQUEST:
+      set_uniform_end(&proto_response);
+      break;
+    case ApiTrace::STATE_REQUEST:
+      set_state_end(&proto_response);
+      break;
+    case ApiTrace::TEXTURE_REQUEST:
+      set_texture_end(&proto_response);
+      break;
+    case ApiTrace::VIEWS_REQUEST:
+      respondViewsEnd(request.views().views());
+      return;
+    default:
+      assert(false);
+      return;
   }
+  respond(&proto_response);
 }
 
 void
@@ -543,7 +926,7 @@ FrameRetraceSkeleton::onGLError(uint32_t frame_count,
   status->set_frame_count(frame_count);
   status->set_err(err);
   status->set_call(call_str);
-  writeResponse(m_socket, proto_response, &m_buf);
+  respond(&proto_response);
 }
 
 void
@@ -555,7 +938,101 @@ FrameRetraceSkeleton::onFileOpening(bool needUpload,
   status->set_needs_upload(needUpload);
   status->set_finished(finished);
   status->set_frame_count(frame_count);
-  writeResponse(m_socket, proto_response, &m_buf);
+  respond(&proto_response);
+}
+
+bool
+FrameRetraceSkeleton::receiveUpload(const std::string &file_path,
+                                    uint64_t file_size) {
+  // Sessions of a multi-session server share the cache.  The upload
+  // is moved into place when it is complete, so other sessions never
+  // open a partial trace.  An interrupted upload is left at
+  // resume_path, and the session which claims it resumes the upload.
+  const std::string resume_path = file_path + ".part";
+  std::stringstream upload_path_s;
+  upload_path_s << file_path << "." << glretrace_pid() << ".part";
+  const std::string upload_path = upload_path_s.str();
+
+  // the partial upload only holds verified chunks
+  FILE *fh = NULL;
+  if (rename(resume_path.c_str(), upload_path.c_str()) == 0)
+    fh = fopen(upload_path.c_str(), "ab");
+  uint64_t verified = 0;
+  if (fh) {
+    glretrace_fseek(fh, 0, SEEK_END);
+    verified = glretrace_ftell(fh);
+    if (verified > file_size) {
+      fclose(fh);
+      fh = NULL;
+    }
+  }
+  if (!fh) {
+    fh = fopen(upload_path.c_str(), "wb");
+    verified = 0;
+  }
+  if (!fh) {
+    remove(upload_path.c_str());
+    onError(RETRACE_FATAL, "Could not write trace to " + upload_path);
+    return false;
+  }
+
+  std::vector<unsigned char> buf;
+  bool write_failed = false;
+  while ((verified < file_size) && !write_failed) {
+    RetraceResponse proto_response;
+    auto status = proto_response.mutable_filestatus();
+    status->set_needs_upload(true);
+    status->set_finished(false);
+    status->set_frame_count(0);
+    status->set_resume_offset(verified);
+    respond(&proto_response);
+
+    // the client sends the rest of the file.  After a chunk fails its
+    // checksum, the following chunks are discarded, and requested
+    // again.
+    uint64_t received = verified;
+    bool corrupt = false;
+    while (received < file_size) {
+      uint32_t crc, bytes;
+      if (!m_socket->Read(&crc) || !m_socket->Read(&bytes)) {
+        fclose(fh);
+        // a later session resumes the upload
+        rename(upload_path.c_str(), resume_path.c_str());
+        return false;
+      }
+      buf.resize(bytes);
+      if (!m_socket->ReadVec(&buf)) {
+        fclose(fh);
+        rename(upload_path.c_str(), resume_path.c_str());
+        return false;
+      }
+      received += bytes;
+      if (corrupt || write_failed)
+        continue;
+      if (crc32c::Crc32c(buf.data(), bytes) != crc) {
+        GRLOGF(glretrace::WARN, "upload chunk at %llu failed checksum",
+               static_cast<unsigned long long>(verified));
+        corrupt = true;
+        continue;
+      }
+      // the rest of the upload is read, so that the error response
+      // follows it on the socket
+      if (fwrite(buf.data(), 1, bytes, fh) != bytes) {
+        write_failed = true;
+        continue;
+      }
+      verified += bytes;
+    }
+  }
+  if ((fclose(fh) != 0) || write_failed) {
+    remove(upload_path.c_str());
+    onError(RETRACE_FATAL, "Could not write trace to " + upload_path);
+    return false;
+  }
+  if (rename(upload_path.c_str(), file_path.c_str()) != 0)
+    // another session cached the trace first
+    remove(upload_path.c_str());
+  return true;
 }
 
 void
@@ -586,7 +1063,7 @@ FrameRetraceSkeleton::onShaderAssembly(
   set_shader_assembly(geom, geom_response);
   auto comp_response = shader->mutable_comp();
   set_shader_assembly(comp, comp_response);
-  writeResponse(m_socket, proto_response, &m_buf);
+  respond(&proto_response);
 }
 
 typedef std::vector<unsigned char> Buffer;
@@ -596,14 +1073,20 @@ FrameRetraceSkeleton::onRenderTarget(SelectionId selectionCount,
                                      ExperimentId experimentCount,
                                      const std::string &label,
                                      const uvec & pngImageData) {
-  RetraceResponse proto_response;
-  auto rt_response = proto_response.mutable_rendertarget();
+  m_image_response->Clear();
+  auto rt_response = m_image_response->mutable_rendertarget();
   rt_response->set_selection_count(selectionCount());
   rt_response->set_experiment_count(experimentCount());
   rt_response->set_label(label);
-  std::string *image = rt_response->mutable_image();
-  image->assign((const char *)pngImageData.data(), pngImageData.size());
-  writeResponse(m_socket, proto_response, &m_buf);
+  ApiTrace::SharedPayload shared;
+  if (writeShared(pngImageData, &shared)) {
+    rt_response->set_image("");
+    *rt_response->mutable_shared_image() = shared;
+  } else {
+    std::string *image = rt_response->mutable_image();
+    image->assign((const char *)pngImageData.data(), pngImageData.size());
+  }
+  respond(m_image_response);
 }
 
 void
@@ -617,7 +1100,7 @@ FrameRetraceSkeleton::onShaderCompile(RenderId renderId,
   shader->set_experiment_count(experimentCount());
   shader->set_status(status);
   shader->set_message(errorString);
-  writeResponse(m_socket, proto_response, &m_buf);
+  respond(&proto_response);
 }
 
 void
@@ -632,7 +1115,7 @@ FrameRetraceSkeleton::onMetricList(const std::vector<MetricId> &ids,
     metrics_response->add_metric_names(i);
   for (auto i : desc)
     metrics_response->add_metric_descriptions(i);
-  writeResponse(m_socket, proto_response, &m_buf);
+  respond(&proto_response);
 }
 
 void
@@ -647,6 +1130,10 @@ FrameRetraceSkeleton::onMetrics(const MetricSeries &metricData,
   for (auto d : metricData.data) {
     s->add_data(d);
   }
+  for (auto v : metricData.variance)
+    s->add_variance(v);
+  for (auto c : metricData.samples)
+    s->add_samples(c);
 }
 
 void
@@ -668,7 +1155,7 @@ FrameRetraceSkeleton::onApi(SelectionId selectionCount,
     e->set_index(error_indices[i]);
     e->set_err(errors[i]);
   }
-  writeResponse(m_socket, proto_response, &m_buf);
+  respond(&proto_response);
 }
 
 void
@@ -677,7 +1164,7 @@ FrameRetraceSkeleton::onError(ErrorSeverity s, const std::string &message) {
   auto error = proto_response.mutable_error();
   error->set_severity(s);
   error->set_message(message);
-  writeResponse(m_socket, proto_response, &m_buf);
+  respond(&proto_response);
   if (s == RETRACE_FATAL)
     m_fatal_error = true;
 }
@@ -693,7 +1180,7 @@ FrameRetraceSkeleton::onBatch(SelectionId selectionCount,
   response->set_selection_count(selectionCount());
   response->set_experiment_count(experimentCount.count());
   response->set_batch(batch);
-  writeResponse(m_socket, proto_response, &m_buf);
+  respond(&proto_response);
 }
 
 void
@@ -766,7 +1253,7 @@ FrameRetraceSkeleton::onUniform(SelectionId selectionCount,
       break;
   }
   response->set_data(data.data(), data.size());
-  writeResponse(m_socket, proto_response, &m_buf);
+  respond(&proto_response);
 }
 
 void
@@ -785,7 +1272,7 @@ FrameRetraceSkeleton::onState(SelectionId selectionCount,
   r_item->set_name(item.name);
   for (auto i : value)
     response->add_value(i);
-  writeResponse(m_socket, proto_response, &m_buf);
+  respond(&proto_response);
 }
 
 void
@@ -813,7 +1300,7 @@ FrameRetraceSkeleton::onTexture(SelectionId selectionCount,
     rimage->set_type(image.type);
     rimage->set_md5sum(image.md5sum);
   }
-  writeResponse(m_socket, proto_response, &m_buf);
+  respond(&proto_response);
 }
 
 
@@ -821,10 +1308,29 @@ void
 FrameRetraceSkeleton::onTextureData(ExperimentId experimentCount,
                                     const std::string &md5sum,
                                     const std::vector<unsigned char> &image) {
-  RetraceResponse proto_response;
-  auto resp = proto_response.mutable_texturedata();
+  m_image_response->Clear();
+  auto resp = m_image_response->mutable_texturedata();
   resp->set_experiment_count(experimentCount());
   resp->set_md5sum(md5sum);
-  resp->set_image_data(image.data(), image.size());
-  writeResponse(m_socket, proto_response, &m_buf);
+  ApiTrace::SharedPayload shared;
+  if (writeShared(image, &shared)) {
+    resp->set_image_data("");
+    *resp->mutable_shared_image_data() = shared;
+  } else {
+    resp->set_image_data(image.data(), image.size());
+  }
+  respond(m_image_response);
+}
+
+bool
+FrameRetraceSkeleton::writeShared(const std::vector<unsigned char> &data,
+                                  ApiTrace::SharedPayload *payload) {
+  uint64_t offset;
+  if (!m_ring || !m_ring->Write(data.data(), data.size(), &offset))
+    // the client has not released enough space, so the data is sent
+    // through the socket
+    return false;
+  payload->set_offset(offset);
+  payload->set_size(data.size());
+  return true;
 }
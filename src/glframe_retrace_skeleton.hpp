@@ -31,17 +31,22 @@
 #include <string>
 #include <vector>
 
+#include "glframe_cancellation.hpp"
 #include "glframe_thread.hpp"
 #include "glframe_retrace.hpp"
 
 namespace ApiTrace {
+class RetraceRequest;
 class RetraceResponse;
+class SharedPayload;
 }  // namespace ApiTrace
 
 namespace glretrace {
 class Socket;
 class FrameRetrace;
 class CancellationThread;
+class RequestBacklog;
+class SharedRing;
 
 // handles retrace requests coming in through a socket, executes them,
 // and formats responses back through the socket
@@ -135,6 +140,37 @@ class FrameRetraceSkeleton : public Thread,
   // calling stub will call onMetrics several times on the host
   // system.
   ApiTrace::RetraceResponse *m_multi_metrics_response;
+
+  // reused for the responses which carry images, as clearing the
+  // message keeps the storage of its fields
+  ApiTrace::RetraceResponse *m_image_response;
+
+  // id of the request being executed, which tags its responses
+  uint32_t m_request_id;
+  void respond(ApiTrace::RetraceResponse *response);
+
+  // Requests are read ahead of their execution.  Reads of the frame
+  // which were superseded by a subsequent request or cancelled by a
+  // newer selection or experiment are answered without a replay.
+  CancellationPolicy m_cancelled;
+  bool isStale(const ApiTrace::RetraceRequest &request) const;
+  void respondSkipped(const ApiTrace::RetraceRequest &request);
+  void respondViewsEnd(uint32_t views);
+
+  // the backlog stops reading while a trace file may be uploaded
+  bool m_open_file_pending;
+  void resumeBacklog(RequestBacklog *backlog);
+
+  // Receives the trace in checksummed chunks, resuming an upload
+  // which was interrupted.  false if the client disconnected, or if
+  // the trace could not be written, which is reported to the client.
+  bool receiveUpload(const std::string &file_path, uint64_t file_size);
+
+  // Images for a client on the same host are copied into shared
+  // memory, and only their location is sent through the socket.
+  SharedRing *m_ring;
+  bool writeShared(const std::vector<unsigned char> &data,
+                   ApiTrace::SharedPayload *payload);
 };
 
 }  // namespace glretrace
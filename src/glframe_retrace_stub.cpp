@@ -30,17 +30,23 @@
 #include <google/protobuf/io/zero_copy_stream_impl_lite.h>
 #include <google/protobuf/io/coded_stream.h>
 
+#include <condition_variable>
 #include <deque>
+#include <map>
+#include <random>
 #include <string>
+#include <utility>
 #include <vector>
 
+#include "crc32c/crc32c.h"
 #include "glframe_logger.hpp"
 #include "glframe_os.hpp"
 #include "glframe_retrace.hpp"
+#include "glframe_shared_ring.hpp"
 #include "glframe_socket.hpp"
 #include "glframe_thread.hpp"
+#include "glframe_trace_hash.hpp"
 #include "playback.pb.h" // NOLINT
-#include "md5.h"  // NOLINT
 
 using ApiTrace::RetraceRequest;
 using ApiTrace::RetraceResponse;
@@ -50,6 +56,7 @@ using glretrace::ErrorSeverity;
 using glretrace::ExperimentId;
 using glretrace::SelectionId;
 using glretrace::FrameRetraceStub;
+using glretrace::MetricAggregation;
 using glretrace::MetricId;
 using glretrace::MetricSeries;
 using glretrace::OnFrameRetrace;
@@ -62,47 +69,47 @@ using glretrace::ScopedLock;
 using glretrace::Semaphore;
 using glretrace::Severity;
 using glretrace::ShaderAssembly;
+using glretrace::SharedRing;
 using glretrace::Socket;
 using glretrace::StateKey;
 using glretrace::Thread;
 using glretrace::WARN;
+using glretrace::glretrace_fseek;
+using glretrace::trace_hash;
 using google::protobuf::io::ArrayInputStream;
-using google::protobuf::io::ArrayOutputStream;
 using google::protobuf::io::CodedInputStream;
-using google::protobuf::io::CodedOutputStream;
 using glretrace::UniformType;
 
 namespace {
 
+// Requests are written by the stub thread, while responses are read
+// by the response thread.
 class RetraceSocket {
  public:
-  explicit RetraceSocket(const char *host, int port) : m_sock(host, port) {}
-  bool request(const RetraceRequest &req) {
-    // write message
-    const uint32_t write_size = req.ByteSizeLong();
-    if (!m_sock.Write(write_size)) {
-      return false;
-    }
-    m_buf.clear();
-    m_buf.resize(write_size);
-    ArrayOutputStream array_out(m_buf.data(), write_size);
-    CodedOutputStream coded_out(&array_out);
-    req.SerializeToCodedStream(&coded_out);
-    if (!m_sock.WriteVec(m_buf)) {
-      return false;
-    }
-    return true;
+  explicit RetraceSocket(Socket *sock) : m_sock(sock),
+                                         m_ring(NULL),
+                                         m_request_id(0) {}
+  ~RetraceSocket() {
+    delete m_ring;
+    delete m_sock;
+  }
+  // tags subsequent requests, so their responses can be routed
+  void setRequestId(uint32_t id) { m_request_id = id; }
+  bool request(RetraceRequest *req) {
+    if (m_request_id)
+      req->set_request_id(m_request_id);
+    return m_sock->WriteMessage(*req, &m_write_buf);
   }
   bool response(RetraceResponse *resp) {
     // read response
     uint32_t read_size;
-    if (!m_sock.Read(&read_size)) {
+    if (!m_sock->Read(&read_size)) {
       return false;
     }
-    m_buf.clear();
-    m_buf.resize(read_size);
-    m_sock.ReadVec(&m_buf);
-    ArrayInputStream array_in(m_buf.data(), read_size);
+    // the buffer is reused, and only grows for larger responses
+    m_read_buf.resize(read_size);
+    m_sock->ReadVec(&m_read_buf);
+    ArrayInputStream array_in(m_read_buf.data(), read_size);
     CodedInputStream coded_in(&array_in);
 
     // 64MB, from coded_stream.h.  Textures are bigger than this
@@ -111,32 +118,96 @@ class RetraceSocket {
     CodedInputStream::Limit msg_limit = coded_in.PushLimit(read_size);
     resp->ParseFromCodedStream(&coded_in);
     coded_in.PopLimit(msg_limit);
+    if (m_ring)
+      readShared(resp);
     return true;
   }
 
-  bool retrace(const RetraceRequest &req, RetraceResponse *resp) {
-    if (!request(req))
+  // writes a chunk of an uploaded file, behind its checksum
+  bool writeChunk(uint32_t crc, const std::vector<unsigned char> &buf) {
+    return (m_sock->Write(crc) &&
+            m_sock->WriteFrame(buf.data(), buf.size()));
+  }
+
+  // receives the shared memory ring, which the server passes after
+  // the handshake response
+  bool receiveRing() {
+    const int fd = m_sock->ReceiveFd();
+    if (fd == -1)
       return false;
-    return response(resp);
+    m_ring = SharedRing::Map(fd);
+    return (m_ring != NULL);
   }
 
-  void write(const std::vector<unsigned char> &buf) {
-    const uint32_t write_size = buf.size();
-    if (!m_sock.Write(write_size)) {
-      return;
+ private:
+  // copies images out of the ring, so the server can reuse the space
+  void readShared(RetraceResponse *resp) {
+    if (resp->has_rendertarget() &&
+        resp->rendertarget().has_shared_image()) {
+      auto rt = resp->mutable_rendertarget();
+      readShared(rt->shared_image(), rt->mutable_image());
+      rt->clear_shared_image();
     }
-    m_sock.WriteVec(buf);
+    if (resp->has_texturedata() &&
+        resp->texturedata().has_shared_image_data()) {
+      auto texture = resp->mutable_texturedata();
+      readShared(texture->shared_image_data(),
+                 texture->mutable_image_data());
+      texture->clear_shared_image_data();
+    }
+  }
+  void readShared(const ApiTrace::SharedPayload &payload,
+                  std::string *data) {
+    data->assign(reinterpret_cast<const char *>(
+        m_ring->Data(payload.offset())), payload.size());
+    // payloads are read in the order they were written
+    m_ring->Release(payload.offset() + payload.size());
   }
 
- private:
-  Socket m_sock;
-  std::vector<unsigned char> m_buf;
+  Socket *m_sock;
+  SharedRing *m_ring;
+  std::vector<unsigned char> m_write_buf, m_read_buf;
+  uint32_t m_request_id;
 };
+
 // command objects for enqueueing the asynchronous request
 class IRetraceRequest {
  public:
-  virtual void retrace(RetraceSocket *s) = 0;
   virtual ~IRetraceRequest() {}
+  // false if a more recent selection or experiment was made while
+  // the request was enqueued, so it need not be sent
+  virtual bool current() const { return true; }
+  // completes the request on the retrace thread, before it is sent.
+  // Returns an error message if the request cannot be sent.
+  virtual std::string prepare() { return ""; }
+  // writes the request to the server.  false if the server died.
+  virtual bool send(RetraceSocket *s) = 0;
+  // requests without responses are complete once they are sent
+  virtual bool hasResponse() const { return false; }
+  // false after the last response was handled
+  virtual bool onResponse(const RetraceResponse &response) { return false; }
+  // false if the error completes the request
+  virtual bool onErrorResponse(const RetraceResponse &response) {
+    Severity s = (response.error().severity() == RETRACE_FATAL ?
+                  ERR : WARN);
+    GRLOG(s, response.error().message().c_str());
+    return true;
+  }
+  // no other request is sent while this request is in flight
+  virtual bool exclusive() const { return false; }
+  // the request will not be answered
+  virtual void onError(const std::string &message) {}
+  // requests which only read the frame may be sent ahead of requests
+  // enqueued before them.  Requests which change the state of the
+  // server are sent in order.
+  virtual bool reorderable() const { return false; }
+  // views displaying the response, which determine the priority of
+  // reorderable requests.  0 for data which spans the frame.
+  virtual uint32_t views() const { return 0; }
+  // true if the other request would be answered identically
+  virtual bool duplicates(const IRetraceRequest &other) const {
+    return false;
+  }
 };
 
 void makeRenderSelection(const RenderSelection &selection,
@@ -149,7 +220,55 @@ void makeRenderSelection(const RenderSelection &selection,
     }
 }
 
-class RetraceRenderTargetRequest : public IRetraceRequest {
+void makeMetricSeries(const ApiTrace::MetricSeries &proto_series,
+                      MetricSeries *series) {
+  series->metric = MetricId(proto_series.metric_id());
+  series->data.assign(proto_series.data().begin(),
+                      proto_series.data().end());
+  series->variance.assign(proto_series.variance().begin(),
+                          proto_series.variance().end());
+  series->samples.assign(proto_series.samples().begin(),
+                         proto_series.samples().end());
+}
+
+// requests which are answered by one or more responses.  Streams of
+// responses end with an empty response.
+class StreamingRequest : public IRetraceRequest {
+ public:
+  explicit StreamingRequest(OnFrameRetrace *cb) : m_callback(cb) {}
+  virtual bool send(RetraceSocket *s) {
+    return s->request(&m_proto_msg);
+  }
+  virtual bool hasResponse() const { return true; }
+  virtual bool onResponse(const RetraceResponse &response) = 0;
+  virtual void onError(const std::string &message) {
+    m_callback->onError(RETRACE_FATAL, message);
+  }
+  virtual bool duplicates(const IRetraceRequest &other) const {
+    auto s = dynamic_cast<const StreamingRequest *>(&other);
+    if (!s || s->m_callback != m_callback)
+      return false;
+    return (s->m_proto_msg.SerializeAsString() ==
+            m_proto_msg.SerializeAsString());
+  }
+
+ protected:
+  RetraceRequest m_proto_msg;
+  OnFrameRetrace *m_callback;
+};
+
+// sends a request which has no response
+class OneWayRequest : public IRetraceRequest {
+ public:
+  virtual bool send(RetraceSocket *s) {
+    return s->request(&m_proto_msg);
+  }
+
+ protected:
+  RetraceRequest m_proto_msg;
+};
+
+class RetraceRenderTargetRequest : public StreamingRequest {
  public:
   RetraceRenderTargetRequest(SelectionId *current_selection,
                              ExperimentId *current_experiment,
@@ -159,10 +278,11 @@ class RetraceRenderTargetRequest : public IRetraceRequest {
                              RenderTargetType type,
                              RenderOptions options,
                              OnFrameRetrace *callback)
-      : m_sel_count(current_selection),
+      : StreamingRequest(callback),
+        m_sel_count(current_selection),
         m_exp_count(current_experiment),
         m_protect(protect),
-        m_callback(callback) {
+        m_success(false) {
     // make the proto msg
     auto rtRequest = m_proto_msg.mutable_rendertarget();
     rtRequest->set_experiment_count(experimentCount());
@@ -172,99 +292,71 @@ class RetraceRenderTargetRequest : public IRetraceRequest {
     m_proto_msg.set_requesttype(ApiTrace::RENDER_TARGET_REQUEST);
   }
 
-  virtual void retrace(RetraceSocket *s) {
-    {
-      // do not request retrace if the selection/experiment have expired
-      std::lock_guard<std::mutex> l(*m_protect);
-      const auto &sel = m_proto_msg.rendertarget().render_selection();
-      const SelectionId id(sel.selection_count());
-      if (*m_sel_count != id)
-        // more recent selection was made while this was enqueued
-        return;
-
-      const ExperimentId exp(m_proto_msg.rendertarget().experiment_count());
-      assert(exp <= *m_exp_count);
-      if (*m_exp_count != exp)
-        // more recent experiment was enabled while this was enqueued
-        return;
-    }
-    if (!s->request(m_proto_msg)) {
-      m_callback->onError(RETRACE_FATAL, "FrameRetrace server died.");
-      return;
-    }
-    bool success = false;
-    while (true) {
-      RetraceResponse response;
-      if (!s->response(&response)) {
-        m_callback->onError(RETRACE_FATAL, "FrameRetrace server died");
-        return;
-      }
-      if (response.has_error()) {
-        Severity s = (response.error().severity() == RETRACE_FATAL ?
-                      ERR : WARN);
-        GRLOG(s, response.error().message().c_str());
-        continue;
-      }
-      assert(response.has_rendertarget());
-      auto rt = response.rendertarget();
-      if (rt.selection_count() == (unsigned int)-1) {
-        OnFrameRetrace::uvec v;
-        if (!success &&
-            m_proto_msg.rendertarget().type() == ApiTrace::NORMAL_RENDER) {
-          // error case: send an empty image so the UI can display a
-          // default image.
-          m_callback->onRenderTarget(*m_sel_count,
-                                     *m_exp_count,
-                                     "no attachment",
-                                     v);
-        }
-        // last response.  Send an empty message triggering UI update.
-        m_callback->onRenderTarget(SelectionId(0),
-                                   ExperimentId(0),
-                                   "",
-                                   v);
-        return;
-      }
+  virtual bool reorderable() const { return true; }
+  virtual uint32_t views() const {
+    return FrameRetraceStub::RENDER_TARGET_VIEW;
+  }
+  virtual bool current() const {
+    // do not request retrace if the selection/experiment have expired
+    std::lock_guard<std::mutex> l(*m_protect);
+    const auto &sel = m_proto_msg.rendertarget().render_selection();
+    const SelectionId id(sel.selection_count());
+    if (*m_sel_count != id)
+      // more recent selection was made while this was enqueued
+      return false;
 
-      {
-        // do not display retraced images if the selection/experiment
-        // have expired
-        std::lock_guard<std::mutex> l(*m_protect);
-        const auto &sel = m_proto_msg.rendertarget().render_selection();
-        const SelectionId id(sel.selection_count());
-        if (*m_sel_count != id) {
-          // more recent selection was made while this was enqueued
-          success = true;
-          continue;
-        }
+    const ExperimentId exp(m_proto_msg.rendertarget().experiment_count());
+    assert(exp <= *m_exp_count);
+    if (*m_exp_count != exp)
+      // more recent experiment was enabled while this was enqueued
+      return false;
+    return true;
+  }
 
-        const ExperimentId exp(m_proto_msg.rendertarget().experiment_count());
-        assert(exp <= *m_exp_count);
-        if (*m_exp_count != exp) {
-          // more recent experiment was enabled while this was enqueued
-          success = true;
-          continue;
-        }
+  virtual bool onResponse(const RetraceResponse &response) {
+    assert(response.has_rendertarget());
+    auto rt = response.rendertarget();
+    if (rt.selection_count() == (unsigned int)-1) {
+      OnFrameRetrace::uvec v;
+      if (!m_success &&
+          m_proto_msg.rendertarget().type() == ApiTrace::NORMAL_RENDER) {
+        // error case: send an empty image so the UI can display a
+        // default image.
+        m_callback->onRenderTarget(*m_sel_count,
+                                   *m_exp_count,
+                                   "no attachment",
+                                   v);
       }
-
-      assert(rt.has_image());
-      success = true;
-      auto imageStr = rt.image();
-      std::vector<unsigned char> image(imageStr.size());
-      memcpy(image.data(), imageStr.c_str(), imageStr.size());
-      m_callback->onRenderTarget(*m_sel_count,
-                                 *m_exp_count,
-                                 rt.label(),
-                                 image);
+      // last response.  Send an empty message triggering UI update.
+      m_callback->onRenderTarget(SelectionId(0),
+                                 ExperimentId(0),
+                                 "",
+                                 v);
+      return false;
     }
+
+    // do not display retraced images if the selection/experiment
+    // have expired
+    m_success = true;
+    if (!current())
+      return true;
+
+    assert(rt.has_image());
+    auto imageStr = rt.image();
+    std::vector<unsigned char> image(imageStr.size());
+    memcpy(image.data(), imageStr.c_str(), imageStr.size());
+    m_callback->onRenderTarget(*m_sel_count,
+                               *m_exp_count,
+                               rt.label(),
+                               image);
+    return true;
   }
 
  private:
   const SelectionId * const m_sel_count;
   const ExperimentId * const m_exp_count;
   std::mutex *m_protect;
-  RetraceRequest m_proto_msg;
-  OnFrameRetrace *m_callback;
+  bool m_success;
 };
 
 void set_shader_assembly(const ApiTrace::ShaderAssembly &response,
@@ -289,103 +381,155 @@ void set_shader_assembly(const ApiTrace::ShaderAssembly &response,
   assembly->codeSinking = response.code_sinking();
 }
 
-class RetraceShaderAssemblyRequest : public IRetraceRequest {
+class RetraceShaderAssemblyRequest : public StreamingRequest {
  public:
   RetraceShaderAssemblyRequest(SelectionId *current_selection,
                                ExperimentId *current_experimentCount,
                                std::mutex *protect,
                                const RenderSelection &selection,
                                OnFrameRetrace *cb)
-      : m_sel_count(current_selection),
+      : StreamingRequest(cb),
+        m_sel_count(current_selection),
         m_exp_count(current_experimentCount),
-        m_protect(protect),
-        m_callback(cb) {
+        m_protect(protect) {
     auto shaderRequest = m_proto_msg.mutable_shaderassembly();
     makeRenderSelection(selection, shaderRequest->mutable_render_selection());
     shaderRequest->set_experiment_count(current_experimentCount->count());
     m_proto_msg.set_requesttype(ApiTrace::SHADER_ASSEMBLY_REQUEST);
   }
-  virtual void retrace(RetraceSocket *s) {
+  virtual bool reorderable() const { return true; }
+  virtual uint32_t views() const { return glretrace::SHADER_ASSEMBLY_VIEW; }
+  virtual bool current() const {
     {
       std::lock_guard<std::mutex> l(*m_protect);
       const auto &sa = m_proto_msg.shaderassembly();
       const auto &s = sa.render_selection();
       if (*m_sel_count != SelectionId(s.selection_count()))
         // more recent selection was made while this was enqueued
-        return;
+        return false;
       const ExperimentId exp(sa.experiment_count());
       assert(exp <= *m_exp_count);
       if (*m_exp_count != exp)
         // more recent experiment was made while this was enqueued
-        return;
+        return false;
     }
-    RetraceResponse response;
-    // sends single request, read multiple responses
-    if (!s->request(m_proto_msg)) {
-      m_callback->onError(RETRACE_FATAL, "FrameRetrace server died.");
-      return;
+    return true;
+  }
+
+  virtual bool onResponse(const RetraceResponse &response) {
+    assert(response.has_shaderassembly());
+    auto shader = response.shaderassembly();
+    if (shader.render_id() == (unsigned int)-1) {
+      // all responses sent.  Send a final empty shader assembly
+      // event, which notifies UI to update.
+      ShaderAssembly sa;
+      m_callback->onShaderAssembly(
+          RenderId(0),
+          SelectionId(0),
+          ExperimentId(0),
+          sa, sa, sa, sa, sa, sa);
+      return false;
+    }
+    const auto &shader_assembly = m_proto_msg.shaderassembly();
+    const auto &selection = shader_assembly.render_selection();
+    const SelectionId sel(selection.selection_count());
+    const ExperimentId exp(shader_assembly.experiment_count());
+    {
+      std::lock_guard<std::mutex> l(*m_protect);
+      if (*m_sel_count != sel)
+        // more recent selection was made while retrace was being
+        // executed.
+        return true;
+      assert(exp <= *m_exp_count);
+      if (*m_exp_count != exp)
+        // more recent selection was made while retrace was being
+        // executed.
+        return true;
     }
+    std::vector<ShaderAssembly> assemblies(6);
+    set_shader_assembly(shader.vertex(), &(assemblies[0]));
+    set_shader_assembly(shader.fragment(), &(assemblies[1]));
+    set_shader_assembly(shader.tess_control(), &(assemblies[2]));
+    set_shader_assembly(shader.tess_eval(), &(assemblies[3]));
+    set_shader_assembly(shader.geom(), &(assemblies[4]));
+    set_shader_assembly(shader.comp(), &(assemblies[5]));
+    m_callback->onShaderAssembly(
+        RenderId(shader.render_id()),
+        sel,
+        exp,
+        assemblies[0], assemblies[1], assemblies[2], assemblies[3],
+        assemblies[4], assemblies[5]);
+    return true;
+  }
 
+ private:
+  SelectionId *m_sel_count;
+  ExperimentId *m_exp_count;
+  std::mutex *m_protect;
+};
+
+// Reads and checksums the chunks of an upload on a separate thread,
+// so reading the file overlaps writing the previous chunks to the
+// socket.
+class UploadReader : public Thread {
+ public:
+  struct Chunk {
+    uint32_t crc;
+    std::vector<unsigned char> data;
+  };
+
+  explicit UploadReader(FILE *fh) : Thread("retrace_stub_upload"),
+                                    m_fh(fh) {}
+  virtual void Run() {
     while (true) {
-      response.Clear();
-      if (!s->response(&response)) {
-        m_callback->onError(RETRACE_FATAL, "FrameRetrace server died");
-        return;
-      }
-      assert(response.has_shaderassembly());
-      auto shader = response.shaderassembly();
-      if (shader.render_id() == (unsigned int)-1) {
-        // all responses sent.  Send a final empty shader assembly
-        // event, which notifies UI to update.
-        ShaderAssembly sa;
-        m_callback->onShaderAssembly(
-            RenderId(0),
-            SelectionId(0),
-            ExperimentId(0),
-            sa, sa, sa, sa, sa, sa);
-        break;
+      Chunk chunk;
+      {
+        // reuse the storage of a chunk which was already sent
+        std::lock_guard<std::mutex> l(m_protect);
+        if (!m_free.empty()) {
+          chunk.data.swap(m_free.back());
+          m_free.pop_back();
+        }
       }
-      const auto &shader_assembly = m_proto_msg.shaderassembly();
-      const auto &selection = shader_assembly.render_selection();
-      const SelectionId sel(selection.selection_count());
-      const ExperimentId exp(shader_assembly.experiment_count());
+      chunk.data.resize(kChunkSize);
+      const size_t bytes = fread(chunk.data.data(), 1, kChunkSize, m_fh);
+      chunk.data.resize(bytes);
+      chunk.crc = crc32c::Crc32c(chunk.data.data(), bytes);
       {
-        std::lock_guard<std::mutex> l(*m_protect);
-        if (*m_sel_count != sel)
-          // more recent selection was made while retrace was being
-          // executed.
-          continue;
-        assert(exp <= *m_exp_count);
-        if (*m_exp_count != exp)
-          // more recent selection was made while retrace was being
-          // executed.
-          continue;
+        std::unique_lock<std::mutex> l(m_protect);
+        m_cv.wait(l, [this] { return m_chunks.size() < kReadAhead; });
+        m_chunks.push_back(std::move(chunk));
       }
-      std::vector<ShaderAssembly> assemblies(6);
-      set_shader_assembly(shader.vertex(), &(assemblies[0]));
-      set_shader_assembly(shader.fragment(), &(assemblies[1]));
-      set_shader_assembly(shader.tess_control(), &(assemblies[2]));
-      set_shader_assembly(shader.tess_eval(), &(assemblies[3]));
-      set_shader_assembly(shader.geom(), &(assemblies[4]));
-      set_shader_assembly(shader.comp(), &(assemblies[5]));
-      m_callback->onShaderAssembly(
-          RenderId(shader.render_id()),
-          sel,
-          exp,
-          assemblies[0], assemblies[1], assemblies[2], assemblies[3],
-          assemblies[4], assemblies[5]);
+      m_cv.notify_all();
+      // an empty chunk marks the end of the file
+      if (bytes == 0)
+        return;
     }
   }
+  // false at the end of the file
+  bool pop(Chunk *chunk) {
+    std::unique_lock<std::mutex> l(m_protect);
+    m_cv.wait(l, [this] { return !m_chunks.empty(); });
+    m_free.push_back(std::move(chunk->data));
+    *chunk = std::move(m_chunks.front());
+    m_chunks.pop_front();
+    l.unlock();
+    m_cv.notify_all();
+    return !chunk->data.empty();
+  }
 
  private:
-  SelectionId *m_sel_count;
-  ExperimentId *m_exp_count;
-  std::mutex *m_protect;
-  RetraceRequest m_proto_msg;
-  OnFrameRetrace *m_callback;
+  static const size_t kChunkSize = 4 * 1024 * 1024;
+  static const size_t kReadAhead = 4;
+
+  FILE *m_fh;
+  std::deque<Chunk> m_chunks;
+  std::vector<std::vector<unsigned char>> m_free;
+  std::mutex m_protect;
+  std::condition_variable m_cv;
 };
 
-class RetraceOpenFileRequest: public IRetraceRequest {
+class RetraceOpenFileRequest: public StreamingRequest {
  public:
   RetraceOpenFileRequest(const std::string &fn,
                          const std::vector<unsigned char> &md5,
@@ -394,219 +538,205 @@ class RetraceOpenFileRequest: public IRetraceRequest {
                          uint32_t count,
                          OnFrameRetrace *cb,
                          FrameRetraceStub *stub)
-      : m_filename(fn), m_callback(cb), m_stub(stub) {
+      : StreamingRequest(cb), m_filename(fn), m_stub(stub), m_sock(NULL) {
     m_proto_msg.set_requesttype(ApiTrace::OPEN_FILE_REQUEST);
     auto file_open = m_proto_msg.mutable_fileopen();
     file_open->set_filename(fn);
     file_open->set_filesize(fileSize);
     file_open->set_framenumber(frame);
     file_open->set_framecount(count);
-    // ignore md5 argument.  it will be calculated on the retrace thread.
+    // ignore md5 argument.  The trace is hashed on the retrace thread.
   }
-  virtual void retrace(RetraceSocket *s) {
-    // calculate md5 sum off-thread.  It takes a long time and will block the UI
-    {
-      struct MD5Context md5c;
-      _MD5Init(&md5c);
-      std::vector<unsigned char> buf(1024 * 1024);
-      auto file_open = m_proto_msg.mutable_fileopen();
-      FILE * fh = fopen(file_open->filename().c_str(), "r");
-      assert(fh);
-      size_t total_bytes = 0;
-      while (true) {
-        const size_t bytes = fread(buf.data(), 1, 1024 * 1024, fh);
-        total_bytes += bytes;
-        _MD5Update(&md5c, buf.data(), bytes);
-        if (feof(fh))
-          break;
-        assert(!ferror(fh));
-      }
-      std::vector<unsigned char> md5(16);
-      _MD5Final(md5.data(), &md5c);
-      file_open->set_md5sum(md5.data(), md5.size());
-      file_open->set_filesize(total_bytes);
-    }
-
-    if (!s->request(m_proto_msg)) {
-      m_callback->onError(RETRACE_FATAL, "FrameRetrace server died.");
-      return;
-    }
-    while (true) {
-      RetraceResponse response;
-      if (!s->response(&response)) {
-        m_callback->onError(RETRACE_FATAL, "FrameRetrace server died");
-        return;
+  // file data is uploaded on the socket, between the responses
+  virtual bool exclusive() const { return true; }
+  virtual std::string prepare() {
+    // hash the trace off-thread.  It takes a long time and will block
+    // the UI
+    auto file_open = m_proto_msg.mutable_fileopen();
+    std::vector<unsigned char> hash;
+    uint64_t total_bytes = 0;
+    if (!trace_hash(file_open->filename(), &hash, &total_bytes))
+      return "Could not read trace file: " + file_open->filename();
+    file_open->set_md5sum("");
+    file_open->set_tracehash(hash.data(), hash.size());
+    file_open->set_filesize(total_bytes);
+    return "";
+  }
+  virtual bool send(RetraceSocket *s) {
+    m_sock = s;
+    return s->request(&m_proto_msg);
+  }
+  virtual bool onResponse(const RetraceResponse &response) {
+    if (response.has_filestatus()) {
+      auto status = response.filestatus();
+      if (status.needs_upload()) {
+        m_callback->onFileOpening(true, false, 0);
+        // send data, from the chunks which the server has verified
+        upload(status.resume_offset());
+        return true;
       }
-      if (response.has_filestatus()) {
-        auto status = response.filestatus();
-        if (status.needs_upload()) {
-          m_callback->onFileOpening(true, false, 0);
-          // send data
-          auto file_open = m_proto_msg.fileopen();
-          FILE * fh = fopen(file_open.filename().c_str(), "rb");
-          assert(fh);
-          std::vector<unsigned char> buf(1024 * 1024);
-          while (true) {
-            const size_t bytes = fread(buf.data(), 1, 1024 * 1024, fh);
-            buf.resize(bytes);
-            s->write(buf);
-            if (feof(fh))
-              break;
-            assert(!ferror(fh));
-          }
-          continue;
-        }
-        if (m_callback) {
-          if (status.has_err()) {
-            m_callback->onGLError(status.frame_count(),
-                                  status.err(),
-                                  status.call());
-          }
-          else {
-            m_callback->onFileOpening(status.needs_upload(),
-                                    status.finished(),
-                                    status.frame_count());
-          }
+      if (m_callback) {
+        if (status.has_err()) {
+          m_callback->onGLError(status.frame_count(),
+                                status.err(),
+                                status.call());
         }
-        if (status.finished())
-          break;
-      } else if (response.has_error()) {
-        m_callback->onError(ErrorSeverity(response.error().severity()),
-                            response.error().message());
-        if (response.error().severity() == RETRACE_FATAL) {
-          // typically this means that the frame number is invalid.
-          // Future request/response pairs should not be written or
-          // read by the stub, because they will crash or hang.
-          m_stub->Stop();
-          return;
+        else {
+          m_callback->onFileOpening(status.needs_upload(),
+                                  status.finished(),
+                                  status.frame_count());
         }
-      } else if (response.has_metricslist()) {
-        std::vector<MetricId> ids;
-        std::vector<std::string> names;
-        std::vector<std::string> descriptions;
-        auto metrics_list = response.metricslist();
-        ids.reserve(metrics_list.metric_ids_size());
-        for (int i = 0; i < metrics_list.metric_ids_size(); ++i )
-          ids.push_back(MetricId(metrics_list.metric_ids(i)));
-        names.reserve(metrics_list.metric_names_size());
-        for (int i = 0; i < metrics_list.metric_names_size(); ++i )
-          names.push_back(metrics_list.metric_names(i));
-        descriptions.reserve(metrics_list.metric_names_size());
-        for (int i = 0; i < metrics_list.metric_descriptions_size(); ++i )
-          descriptions.push_back(metrics_list.metric_descriptions(i));
-
-        m_callback->onMetricList(ids, names, descriptions);
       }
+      return !status.finished();
+    } else if (response.has_metricslist()) {
+      std::vector<MetricId> ids;
+      std::vector<std::string> names;
+      std::vector<std::string> descriptions;
+      auto metrics_list = response.metricslist();
+      ids.reserve(metrics_list.metric_ids_size());
+      for (int i = 0; i < metrics_list.metric_ids_size(); ++i )
+        ids.push_back(MetricId(metrics_list.metric_ids(i)));
+      names.reserve(metrics_list.metric_names_size());
+      for (int i = 0; i < metrics_list.metric_names_size(); ++i )
+        names.push_back(metrics_list.metric_names(i));
+      descriptions.reserve(metrics_list.metric_names_size());
+      for (int i = 0; i < metrics_list.metric_descriptions_size(); ++i )
+        descriptions.push_back(metrics_list.metric_descriptions(i));
+
+      m_callback->onMetricList(ids, names, descriptions);
+    }
+    return true;
+  }
+  virtual bool onErrorResponse(const RetraceResponse &response) {
+    m_callback->onError(ErrorSeverity(response.error().severity()),
+                        response.error().message());
+    if (response.error().severity() == RETRACE_FATAL) {
+      // typically this means that the frame number is invalid.
+      // Future request/response pairs should not be written or
+      // read by the stub, because they will crash or hang.
+      m_stub->Stop();
+      return false;
     }
+    return true;
   }
 
  private:
+  void upload(uint64_t offset) {
+    auto file_open = m_proto_msg.fileopen();
+    FILE * fh = fopen(file_open.filename().c_str(), "rb");
+    assert(fh);
+    glretrace_fseek(fh, offset, SEEK_SET);
+    UploadReader reader(fh);
+    reader.Start();
+    UploadReader::Chunk chunk;
+    bool connected = true;
+    while (reader.pop(&chunk)) {
+      // after a failed write, the reader is drained so it can exit
+      if (connected)
+        connected = m_sock->writeChunk(chunk.crc, chunk.data);
+    }
+    reader.Join();
+    fclose(fh);
+  }
+
   std::string m_filename;
-  RetraceRequest m_proto_msg;
-  OnFrameRetrace *m_callback;
   // needed to allow the command object to stop processing messages
   // from the stub's queue
   FrameRetraceStub *m_stub;
+  RetraceSocket *m_sock;
 };
 
-class RetraceMetricsRequest : public IRetraceRequest {
+class RetraceMetricsRequest : public StreamingRequest {
  public:
   RetraceMetricsRequest(const std::vector<MetricId> &ids,
                         ExperimentId *current_exp_count,
                         std::mutex *protect,
                         OnFrameRetrace *cb)
-      : m_exp_count(current_exp_count),
-        m_protect(protect),
-        m_callback(cb) {
+      : StreamingRequest(cb),
+        m_exp_count(current_exp_count),
+        m_protect(protect) {
     auto metricsRequest = m_proto_msg.mutable_metrics();
     for (MetricId i : ids)
       metricsRequest->add_metric_ids(i());
     metricsRequest->set_experiment_count((*current_exp_count)());
     m_proto_msg.set_requesttype(ApiTrace::METRICS_REQUEST);
   }
-  virtual void retrace(RetraceSocket *s) {
-    {
-      std::lock_guard<std::mutex> l(*m_protect);
-      const auto &mr = m_proto_msg.metrics();
-      const ExperimentId exp(mr.experiment_count());
-      assert(exp <= *m_exp_count);
-      if (*m_exp_count != exp)
-        // more recent experiment was enabled while this was enqueued
-        return;
-    }
-
-    RetraceResponse response;
-    s->retrace(m_proto_msg, &response);
+  virtual bool reorderable() const { return true; }
+  virtual bool current() const {
+    std::lock_guard<std::mutex> l(*m_protect);
+    const auto &mr = m_proto_msg.metrics();
+    const ExperimentId exp(mr.experiment_count());
+    assert(exp <= *m_exp_count);
+    // false if a more recent experiment was enabled while this was
+    // enqueued
+    return (*m_exp_count == exp);
+  }
+  virtual bool onResponse(const RetraceResponse &response) {
     assert(response.has_metricsdata());
     auto metrics_response = response.metricsdata();
 
     const ExperimentId eid(metrics_response.experiment_count());
     for (auto &metric_data : metrics_response.metric_data()) {
       MetricSeries met;
-      met.metric = MetricId(metric_data.metric_id());
-      auto &data_float_vec = metric_data.data();
-      met.data.reserve(data_float_vec.size());
-      for (auto d : data_float_vec)
-        met.data.push_back(d);
+      makeMetricSeries(metric_data, &met);
 
       m_callback->onMetrics(met, eid, SelectionId(0));
     }
+    return false;
   }
 
  private:
-  RetraceRequest m_proto_msg;
   ExperimentId *m_exp_count;
   std::mutex *m_protect;
-  OnFrameRetrace *m_callback;
 };
 
-class RetraceAllMetricsRequest : public IRetraceRequest {
+class RetraceAllMetricsRequest : public StreamingRequest {
  public:
   RetraceAllMetricsRequest(SelectionId *current_selection,
                            std::mutex *protect,
                            const RenderSelection &selection,
                            ExperimentId *current_exp,
+                           MetricAggregation aggregation,
                            OnFrameRetrace *cb)
-      : m_sel_count(current_selection),
+      : StreamingRequest(cb),
+        m_sel_count(current_selection),
         m_exp_count(current_exp),
-        m_protect(protect),
-        m_callback(cb) {
+        m_protect(protect) {
     auto metricsRequest = m_proto_msg.mutable_allmetrics();
     metricsRequest->set_experiment_count((*current_exp)());
+    metricsRequest->set_aggregation(
+        static_cast<ApiTrace::MetricAggregation>(aggregation));
     auto selectionRequest = metricsRequest->mutable_selection();
     makeRenderSelection(selection, selectionRequest);
     m_proto_msg.set_requesttype(ApiTrace::ALL_METRICS_REQUEST);
   }
-  virtual void retrace(RetraceSocket *s) {
-    {
-      const int query_sel_count =
-          m_proto_msg.allmetrics().selection().selection_count();
-      const SelectionId query_id(query_sel_count);
-      const int query_exp_count =
-          m_proto_msg.allmetrics().experiment_count();
-      const ExperimentId exp_id(query_exp_count);
-      std::lock_guard<std::mutex> l(*m_protect);
-      if ((*m_sel_count != query_id) &&
-          (query_id != SelectionId(0)))
-        // more recent selection was made while this was enqueued
-        return;
-      if ((*m_exp_count > exp_id) &&
-          (exp_id != ExperimentId(0)))
-        // more recent selection was made while this was enqueued
-        return;
-    }
-
-    RetraceResponse response;
-    if (!s->retrace(m_proto_msg, &response)) {
-      m_callback->onError(RETRACE_FATAL, "FrameRetrace server died.");
-      return;
-    }
-
-    if (response.has_error()) {
-      m_callback->onError(ErrorSeverity(response.error().severity()),
-                          response.error().message());
-      return;
-    }
+  virtual bool reorderable() const { return true; }
+  virtual uint32_t views() const { return FrameRetraceStub::METRICS_VIEW; }
+  virtual bool current() const {
+    const int query_sel_count =
+        m_proto_msg.allmetrics().selection().selection_count();
+    const SelectionId query_id(query_sel_count);
+    const int query_exp_count =
+        m_proto_msg.allmetrics().experiment_count();
+    const ExperimentId exp_id(query_exp_count);
+    std::lock_guard<std::mutex> l(*m_protect);
+    if ((*m_sel_count != query_id) &&
+        (query_id != SelectionId(0)))
+      // more recent selection was made while this was enqueued
+      return false;
+    if ((*m_exp_count > exp_id) &&
+        (exp_id != ExperimentId(0)))
+      // more recent selection was made while this was enqueued
+      return false;
+    return true;
+  }
+  virtual bool onErrorResponse(const RetraceResponse &response) {
+    // the metrics response follows
+    m_callback->onError(ErrorSeverity(response.error().severity()),
+                        response.error().message());
+    return true;
+  }
+  virtual bool onResponse(const RetraceResponse &response) {
     assert(response.has_metricsdata());
     auto metrics_response = response.metricsdata();
 
@@ -614,25 +744,20 @@ class RetraceAllMetricsRequest : public IRetraceRequest {
     const SelectionId sid(metrics_response.selection_count());
     for (auto &metric_data : metrics_response.metric_data()) {
       MetricSeries met;
-      met.metric = MetricId(metric_data.metric_id());
-      auto &data_float_vec = metric_data.data();
-      met.data.reserve(data_float_vec.size());
-      for (auto d : data_float_vec)
-        met.data.push_back(d);
+      makeMetricSeries(metric_data, &met);
 
       m_callback->onMetrics(met, eid, sid);
     }
+    return false;
   }
 
  private:
   const SelectionId * const m_sel_count;
   const ExperimentId * const m_exp_count;
   std::mutex *m_protect;
-  RetraceRequest m_proto_msg;
-  OnFrameRetrace *m_callback;
 };
 
-class ReplaceShadersRequest : public IRetraceRequest {
+class ReplaceShadersRequest : public StreamingRequest {
  public:
   ReplaceShadersRequest(RenderId renderId,
                         ExperimentId experimentCount,
@@ -643,7 +768,7 @@ class ReplaceShadersRequest : public IRetraceRequest {
                         const std::string &geom,
                         const std::string &comp,
                         OnFrameRetrace *cb)
-      : m_callback(cb) {
+      : StreamingRequest(cb) {
     auto shaderRequest = m_proto_msg.mutable_shaders();
     shaderRequest->set_render_id(renderId());
     shaderRequest->set_experiment_count(experimentCount());
@@ -655,9 +780,7 @@ class ReplaceShadersRequest : public IRetraceRequest {
     shaderRequest->set_comp(comp);
     m_proto_msg.set_requesttype(ApiTrace::REPLACE_SHADERS_REQUEST);
   }
-  virtual void retrace(RetraceSocket *s) {
-    RetraceResponse response;
-    s->retrace(m_proto_msg, &response);
+  virtual bool onResponse(const RetraceResponse &response) {
     assert(response.has_shadersdata());
     auto shaders_response = response.shadersdata();
 
@@ -665,14 +788,11 @@ class ReplaceShadersRequest : public IRetraceRequest {
     const RenderId rid(shaders_response.render_id());
     m_callback->onShaderCompile(rid, eid, shaders_response.status(),
                                 shaders_response.message());
+    return false;
   }
-
- private:
-  RetraceRequest m_proto_msg;
-  OnFrameRetrace *m_callback;
 };
 
-class DisableDrawRequest : public IRetraceRequest {
+class DisableDrawRequest : public OneWayRequest {
  public:
   DisableDrawRequest(const RenderSelection &selection,
                      bool disable) {
@@ -682,14 +802,9 @@ class DisableDrawRequest : public IRetraceRequest {
     disableRequest->set_disable(disable);
     m_proto_msg.set_requesttype(ApiTrace::DISABLE_REQUEST);
   }
-  virtual void retrace(RetraceSocket *s) {
-    s->request(m_proto_msg);
-  }
- private:
-  RetraceRequest m_proto_msg;
 };
 
-class SimpleShaderRequest : public IRetraceRequest {
+class SimpleShaderRequest : public OneWayRequest {
  public:
   SimpleShaderRequest(const RenderSelection &selection,
                       bool simple_shader) {
@@ -699,14 +814,9 @@ class SimpleShaderRequest : public IRetraceRequest {
     simpleRequest->set_simple_shader(simple_shader);
     m_proto_msg.set_requesttype(ApiTrace::SIMPLE_SHADER_REQUEST);
   }
-  virtual void retrace(RetraceSocket *s) {
-    s->request(m_proto_msg);
-  }
- private:
-  RetraceRequest m_proto_msg;
 };
 
-class OneByOneScissorRequest : public IRetraceRequest {
+class OneByOneScissorRequest : public OneWayRequest {
  public:
   OneByOneScissorRequest(const RenderSelection &selection,
                          bool scissor) {
@@ -716,14 +826,9 @@ class OneByOneScissorRequest : public IRetraceRequest {
     request->set_scissor(scissor);
     m_proto_msg.set_requesttype(ApiTrace::SCISSOR_REQUEST);
   }
-  virtual void retrace(RetraceSocket *s) {
-    s->request(m_proto_msg);
-  }
- private:
-  RetraceRequest m_proto_msg;
 };
 
-class WireframeRequest : public IRetraceRequest {
+class WireframeRequest : public OneWayRequest {
  public:
   WireframeRequest(const RenderSelection &selection,
                          bool wireframe) {
@@ -733,14 +838,9 @@ class WireframeRequest : public IRetraceRequest {
     request->set_wireframe(wireframe);
     m_proto_msg.set_requesttype(ApiTrace::WIREFRAME_REQUEST);
   }
-  virtual void retrace(RetraceSocket *s) {
-    s->request(m_proto_msg);
-  }
- private:
-  RetraceRequest m_proto_msg;
 };
 
-class Texture2x2Request : public IRetraceRequest {
+class Texture2x2Request : public OneWayRequest {
  public:
   Texture2x2Request(const RenderSelection &selection,
                     bool texture_2x2) {
@@ -750,100 +850,87 @@ class Texture2x2Request : public IRetraceRequest {
     request->set_texture_2x2(texture_2x2);
     m_proto_msg.set_requesttype(ApiTrace::TEXTURE_2X2_REQUEST);
   }
-  virtual void retrace(RetraceSocket *s) {
-    s->request(m_proto_msg);
-  }
- private:
-  RetraceRequest m_proto_msg;
 };
 
-class ApiRequest : public IRetraceRequest {
+class ApiRequest : public StreamingRequest {
  public:
   ApiRequest(SelectionId *current_selection,
              std::mutex *protect,
              const RenderSelection &selection,
              OnFrameRetrace *cb)
-      : m_sel_count(current_selection),
-        m_protect(protect),
-        m_callback(cb) {
+      : StreamingRequest(cb),
+        m_sel_count(current_selection),
+        m_protect(protect) {
     auto apiRequest = m_proto_msg.mutable_api();
     auto selectionRequest = apiRequest->mutable_selection();
     makeRenderSelection(selection, selectionRequest);
     m_proto_msg.set_requesttype(ApiTrace::API_REQUEST);
   }
-  virtual void retrace(RetraceSocket *s) {
+  virtual bool reorderable() const { return true; }
+  virtual uint32_t views() const { return glretrace::API_VIEW; }
+  virtual bool current() const {
     {
       std::lock_guard<std::mutex> l(*m_protect);
       const auto &sel = m_proto_msg.api().selection();
       const SelectionId id(sel.selection_count());
       if (*m_sel_count != id)
         // more recent selection was made while this was enqueued
-        return;
-    }
-    RetraceResponse response;
-    // sends single request, read multiple responses
-    if (!s->request(m_proto_msg)) {
-      m_callback->onError(RETRACE_FATAL, "FrameRetrace server died.");
-      return;
+        return false;
     }
-    while (true) {
-      response.Clear();
-      if (!s->response(&response)) {
-        m_callback->onError(RETRACE_FATAL, "FrameRetrace server died");
-        return;
-      }
-      assert(response.has_api());
-      const auto &api_response = response.api();
-      if (api_response.render_id() == (unsigned int)-1)
-        // all responses sent
-        break;
+    return true;
+  }
 
-      const auto selection = api_response.selection_count();
-      {
-        std::lock_guard<std::mutex> l(*m_protect);
-        if (*m_sel_count != SelectionId(selection))
-          // more recent selection was made while retrace was being
-          // executed.
-          continue;
-      }
+  virtual bool onResponse(const RetraceResponse &response) {
+    assert(response.has_api());
+    const auto &api_response = response.api();
+    if (api_response.render_id() == (unsigned int)-1)
+      // all responses sent
+      return false;
 
-      const RenderId rid(api_response.render_id());
-      std::vector<std::string> apis;
-      auto &api_str_vec = api_response.apis();
-      apis.reserve(api_str_vec.size());
-      for (auto a : api_str_vec)
-        apis.push_back(a);
-
-      auto &api_err = api_response.errors();
-      std::vector<uint32_t> error_indices;
-      std::vector<std::string> errors;
-      for (auto e : api_err) {
-        errors.push_back(e.err());
-        error_indices.push_back(e.index());
-      }
-      m_callback->onApi(SelectionId(selection),
-                        rid, apis, error_indices, errors);
+    const auto selection = api_response.selection_count();
+    {
+      std::lock_guard<std::mutex> l(*m_protect);
+      if (*m_sel_count != SelectionId(selection))
+        // more recent selection was made while retrace was being
+        // executed.
+        return true;
+    }
+
+    const RenderId rid(api_response.render_id());
+    std::vector<std::string> apis;
+    auto &api_str_vec = api_response.apis();
+    apis.reserve(api_str_vec.size());
+    for (auto a : api_str_vec)
+      apis.push_back(a);
+
+    auto &api_err = api_response.errors();
+    std::vector<uint32_t> error_indices;
+    std::vector<std::string> errors;
+    for (auto e : api_err) {
+      errors.push_back(e.err());
+      error_indices.push_back(e.index());
     }
+    m_callback->onApi(SelectionId(selection),
+                      rid, apis, error_indices, errors);
+    return true;
   }
 
  private:
   const SelectionId * const m_sel_count;
   std::mutex *m_protect;
-  RetraceRequest m_proto_msg;
-  OnFrameRetrace *m_callback;
 };
 
-class BatchRequest : public IRetraceRequest {
+class BatchRequest : public StreamingRequest {
  public:
   BatchRequest(SelectionId *current_selection,
                ExperimentId *current_experiment,
                std::mutex *protect,
                const RenderSelection &selection,
                OnFrameRetrace *cb)
-      : m_sel_count(current_selection),
+      : StreamingRequest(cb),
+        m_sel_count(current_selection),
         m_exp_count(current_experiment),
-        m_protect(protect),
-        m_callback(cb) {
+        m_protect(protect) {
     auto batchRequest = m_proto_msg.mutable_batch();
     auto selectionRequest = batchRequest->mutable_selection();
     makeRenderSelection(selection, selectionRequest);
@@ -851,7 +938,9 @@ class BatchRequest : public IRetraceRequest {
     m_proto_msg.set_requesttype(ApiTrace::BATCH_REQUEST);
   }
 
-  virtual void retrace(RetraceSocket *s) {
+  virtual bool reorderable() const { return true; }
+  virtual uint32_t views() const { return glretrace::BATCH_VIEW; }
+  virtual bool current() const {
     {
       std::lock_guard<std::mutex> l(*m_protect);
       const auto &batch = m_proto_msg.batch();
@@ -859,71 +948,61 @@ class BatchRequest : public IRetraceRequest {
       const SelectionId id(sel.selection_count());
       if (*m_sel_count != id)
         // more recent selection was made while this was enqueued
-        return;
+        return false;
       const ExperimentId exp(batch.experiment_count());
       assert(exp <= *m_exp_count);
       if (*m_exp_count != exp)
         // more recent experiment was made while this was enqueued
-        return;
+        return false;
     }
-    RetraceResponse response;
-    // sends single request, read multiple responses
-    if (!s->request(m_proto_msg)) {
-      m_callback->onError(RETRACE_FATAL, "FrameRetrace server died.");
-      return;
-    }
-    while (true) {
-      response.Clear();
-      if (!s->response(&response)) {
-        m_callback->onError(RETRACE_FATAL, "FrameRetrace server died");
-        return;
-      }
-      assert(response.has_batch());
-      const auto &batch_response = response.batch();
-      if (batch_response.render_id() == (unsigned int)-1)
-        // all responses sent
-        break;
+    return true;
+  }
 
-      const auto selection = batch_response.selection_count();
-      const ExperimentId exp_count(batch_response.experiment_count());
-      {
-        std::lock_guard<std::mutex> l(*m_protect);
-        if (*m_sel_count != SelectionId(selection))
-          // more recent selection was made while retrace was being
-          // executed.
-          continue;
-        assert(exp_count <= *m_exp_count);
-        if (*m_exp_count != exp_count)
-          // more recent experiment was made while this was enqueued
-          continue;
-      }
+  virtual bool onResponse(const RetraceResponse &response) {
+    assert(response.has_batch());
+    const auto &batch_response = response.batch();
+    if (batch_response.render_id() == (unsigned int)-1)
+      // all responses sent
+      return false;
 
-      const RenderId rid(batch_response.render_id());
-      m_callback->onBatch(SelectionId(selection),
-                          exp_count,
-                          rid, batch_response.batch());
+    const auto selection = batch_response.selection_count();
+    const ExperimentId exp_count(batch_response.experiment_count());
+    {
+      std::lock_guard<std::mutex> l(*m_protect);
+      if (*m_sel_count != SelectionId(selection))
+        // more recent selection was made while retrace was being
+        // executed.
+        return true;
+      assert(exp_count <= *m_exp_count);
+      if (*m_exp_count != exp_count)
+        // more recent experiment was made while this was enqueued
+        return true;
     }
+
+    const RenderId rid(batch_response.render_id());
+    m_callback->onBatch(SelectionId(selection),
+                        exp_count,
+                        rid, batch_response.batch());
+    return true;
   }
 
  private:
   const SelectionId * const m_sel_count;
   const ExperimentId * const m_exp_count;
   std::mutex *m_protect;
-  RetraceRequest m_proto_msg;
-  OnFrameRetrace *m_callback;
 };
 
-class UniformRequest : public IRetraceRequest {
+class UniformRequest : public StreamingRequest {
  public:
   UniformRequest(SelectionId *current_selection,
                  ExperimentId *current_experiment,
                  std::mutex *protect,
                  const RenderSelection &selection,
                  OnFrameRetrace *cb)
-      : m_sel_count(current_selection),
+      : StreamingRequest(cb),
+        m_sel_count(current_selection),
         m_exp_count(current_experiment),
-        m_protect(protect),
-        m_callback(cb) {
+        m_protect(protect) {
     m_proto_msg.set_requesttype(ApiTrace::UNIFORM_REQUEST);
     auto request = m_proto_msg.mutable_uniform();
     auto selectionRequest = request->mutable_selection();
@@ -932,7 +1011,9 @@ class UniformRequest : public IRetraceRequest {
   }
 
 
-  virtual void retrace(RetraceSocket *s) {
+  virtual bool reorderable() const { return true; }
+  virtual uint32_t views() const { return glretrace::UNIFORM_VIEW; }
+  virtual bool current() const {
     {
       std::lock_guard<std::mutex> l(*m_protect);
       const auto &uniform = m_proto_msg.uniform();
@@ -940,130 +1021,120 @@ class UniformRequest : public IRetraceRequest {
       const SelectionId id(sel.selection_count());
       if (*m_sel_count != id)
         // more recent selection was made while this was enqueued
-        return;
+        return false;
       const ExperimentId exp(uniform.experiment_count());
       assert(exp <= *m_exp_count);
       if (*m_exp_count != exp)
         // more recent experiment was made while this was enqueued
-        return;
+        return false;
     }
-    // sends single request, read multiple responses
-    if (!s->request(m_proto_msg)) {
-      m_callback->onError(RETRACE_FATAL, "FrameRetrace server died.");
-      return;
+    return true;
+  }
+
+  virtual bool onResponse(const RetraceResponse &response) {
+    assert(response.has_uniform());
+    const auto &uniform = response.uniform();
+    if (uniform.render_id() == (unsigned int)-1) {
+      // all responses sent.  Send a bogus uniform to inform the
+      // model that uniforms are complete
+      m_callback->onUniform(SelectionId(SelectionId::INVALID_SELECTION),
+                            ExperimentId(ExperimentId::INVALID_EXPERIMENT-1),
+                            RenderId(RenderId::INVALID_RENDER),
+                            "", glretrace::kFloatUniform,
+                            glretrace::k1x1, std::vector<unsigned char>());
+      return false;
     }
-    RetraceResponse response;
-    while (true) {
-      response.Clear();
-      if (!s->response(&response)) {
-        m_callback->onError(RETRACE_FATAL, "FrameRetrace server died");
-        return;
-      }
-      assert(response.has_uniform());
-      const auto &uniform = response.uniform();
-      if (uniform.render_id() == (unsigned int)-1) {
-        // all responses sent.  Send a bogus uniform to inform the
-        // model that uniforms are complete
-        m_callback->onUniform(SelectionId(SelectionId::INVALID_SELECTION),
-                              ExperimentId(ExperimentId::INVALID_EXPERIMENT-1),
-                              RenderId(RenderId::INVALID_RENDER),
-                              "", glretrace::kFloatUniform,
-                              glretrace::k1x1, std::vector<unsigned char>());
-        break;
-      }
 
-      const auto selection = SelectionId(uniform.selection_count());
-      const ExperimentId exp_count(uniform.experiment_count());
-      {
-        std::lock_guard<std::mutex> l(*m_protect);
-        if (*m_sel_count != selection)
-          // more recent selection was made while retrace was being
-          // executed.
-          continue;
-        assert(exp_count <= *m_exp_count);
-        if (*m_exp_count != exp_count)
-          // more recent experiment was made while this was enqueued
-          continue;
-      }
-      UniformType t;
-      switch (uniform.uniform_type()) {
-        case ApiTrace::FLOAT_UNIFORM:
-          t = glretrace::kFloatUniform;
-          break;
-        case ApiTrace::INT_UNIFORM:
-          t = glretrace::kIntUniform;
-          break;
-        case ApiTrace::UINT_UNIFORM:
-          t = glretrace::kUIntUniform;
-          break;
-        case ApiTrace::BOOL_UNIFORM:
-          t = glretrace::kBoolUniform;
-          break;
-      }
-      glretrace::UniformDimension d;
-      switch (uniform.uniform_dimension()) {
-        case ApiTrace::D_1x1:
-          d = glretrace::k1x1;
-          break;
-        case ApiTrace::D_2x1:
-          d = glretrace::k2x1;
-          break;
-        case ApiTrace::D_3x1:
-          d = glretrace::k3x1;
-          break;
-        case ApiTrace::D_4x1:
-          d = glretrace::k4x1;
-          break;
-        case ApiTrace::D_2x2:
-          d = glretrace::k2x2;
-          break;
-        case ApiTrace::D_3x2:
-          d = glretrace::k3x2;
-          break;
-        case ApiTrace::D_4x2:
-          d = glretrace::k4x2;
-          break;
-        case ApiTrace::D_2x3:
-          d = glretrace::k2x3;
-          break;
-        case ApiTrace::D_3x3:
-          d = glretrace::k3x3;
-          break;
-        case ApiTrace::D_4x3:
-          d = glretrace::k4x3;
-          break;
-        case ApiTrace::D_2x4:
-          d = glretrace::k2x4;
-          break;
-        case ApiTrace::D_3x4:
-          d = glretrace::k3x4;
-          break;
-        case ApiTrace::D_4x4:
-          d = glretrace::k4x4;
-          break;
-      }
-      const RenderId rid(uniform.render_id());
-      const auto &payload = uniform.data();
-      std::vector<unsigned char> data(payload.size());
-      memcpy(data.data(), payload.c_str(), payload.size());
-      m_callback->onUniform(selection,
-                            exp_count,
-                            rid,
-                            uniform.name(),
-                            t, d,
-                            data);
+    const auto selection = SelectionId(uniform.selection_count());
+    const ExperimentId exp_count(uniform.experiment_count());
+    {
+      std::lock_guard<std::mutex> l(*m_protect);
+      if (*m_sel_count != selection)
+        // more recent selection was made while retrace was being
+        // executed.
+        return true;
+      assert(exp_count <= *m_exp_count);
+      if (*m_exp_count != exp_count)
+        // more recent experiment was made while this was enqueued
+        return true;
+    }
+    UniformType t;
+    switch (uniform.uniform_type()) {
+      case ApiTrace::FLOAT_UNIFORM:
+        t = glretrace::kFloatUniform;
+        break;
+      case ApiTrace::INT_UNIFORM:
+        t = glretrace::kIntUniform;
+        break;
+      case ApiTrace::UINT_UNIFORM:
+        t = glretrace::kUIntUniform;
+        break;
+      case ApiTrace::BOOL_UNIFORM:
+        t = glretrace::kBoolUniform;
+        break;
     }
+    glretrace::UniformDimension d;
+    switch (uniform.uniform_dimension()) {
+      case ApiTrace::D_1x1:
+        d = glretrace::k1x1;
+        break;
+      case ApiTrace::D_2x1:
+        d = glretrace::k2x1;
+        break;
+      case ApiTrace::D_3x1:
+        d = glretrace::k3x1;
+        break;
+      case ApiTrace::D_4x1:
+        d = glretrace::k4x1;
+        break;
+      case ApiTrace::D_2x2:
+        d = glretrace::k2x2;
+        break;
+      case ApiTrace::D_3x2:
+        d = glretrace::k3x2;
+        break;
+      case ApiTrace::D_4x2:
+        d = glretrace::k4x2;
+        break;
+      case ApiTrace::D_2x3:
+        d = glretrace::k2x3;
+        break;
+      case ApiTrace::D_3x3:
+        d = glretrace::k3x3;
+        break;
+      case ApiTrace::D_4x3:
+        d = glretrace::k4x3;
+        break;
+      case ApiTrace::D_2x4:
+        d = glretrace::k2x4;
+        break;
+      case ApiTrace::D_3x4:
+        d = glretrace::k3x4;
+        break;
+      case ApiTrace::D_4x4:
+        d = glretrace::k4x4;
+        break;
+    }
+    const RenderId rid(uniform.render_id());
+    const auto &payload = uniform.data();
+    std::vector<unsigned char> data(payload.size());
+    memcpy(data.data(), payload.c_str(), payload.size());
+    m_callback->onUniform(selection,
+                          exp_count,
+                          rid,
+                          uniform.name(),
+                          t, d,
+                          data);
+    return true;
   }
 
  private:
   const SelectionId * const m_sel_count;
   const ExperimentId * const m_exp_count;
   std::mutex *m_protect;
-  RetraceRequest m_proto_msg;
-  OnFrameRetrace *m_callback;
 };
 
-class SetUniformRequest : public IRetraceRequest {
+class SetUniformRequest : public OneWayRequest {
  public:
   SetUniformRequest(const RenderSelection &selection,
                     const std::string &name,
@@ -1077,103 +1148,87 @@ class SetUniformRequest : public IRetraceRequest {
     request->set_index(index);
     request->set_data(data);
   }
-
-
-  virtual void retrace(RetraceSocket *s) {
-    s->request(m_proto_msg);
-  }
-
- private:
-  RetraceRequest m_proto_msg;
 };
 
-class StateRequest : public IRetraceRequest {
+class StateRequest : public StreamingRequest {
  public:
   StateRequest(SelectionId *current_selection,
                ExperimentId *current_experiment,
                std::mutex *protect,
                const RenderSelection &selection,
                OnFrameRetrace *cb)
-      : m_sel_count(current_selection),
+      : StreamingRequest(cb),
+        m_sel_count(current_selection),
         m_exp_count(current_experiment),
-        m_protect(protect),
-        m_callback(cb) {
+        m_protect(protect) {
     auto stateRequest = m_proto_msg.mutable_state();
     auto selectionRequest = stateRequest->mutable_selection();
     makeRenderSelection(selection, selectionRequest);
     stateRequest->set_experiment_count((*current_experiment)());
     m_proto_msg.set_requesttype(ApiTrace::STATE_REQUEST);
   }
-  virtual void retrace(RetraceSocket *s) {
+  virtual bool reorderable() const { return true; }
+  virtual uint32_t views() const { return glretrace::STATE_VIEW; }
+  virtual bool current() const {
     {
       std::lock_guard<std::mutex> l(*m_protect);
       const auto &sel = m_proto_msg.state().selection();
       const SelectionId id(sel.selection_count());
       if (*m_sel_count != id)
         // more recent selection was made while this was enqueued
-        return;
+        return false;
       const ExperimentId eid(m_proto_msg.state().experiment_count());
       if (*m_exp_count != eid)
         // more recent experiment was made while this was enqueued
-        return;
+        return false;
     }
-    RetraceResponse response;
-    // sends single request, read multiple responses
-    if (!s->request(m_proto_msg)) {
-      m_callback->onError(RETRACE_FATAL, "FrameRetrace server died.");
-      return;
+    return true;
+  }
+
+  virtual bool onResponse(const RetraceResponse &response) {
+    assert(response.has_state());
+    const auto &state_response = response.state();
+    if (state_response.render_id() == (unsigned int)-1) {
+      // all responses sent.  Send a bogus state to inform the
+      // model that uniforms are complete
+      m_callback->onState(SelectionId(SelectionId::INVALID_SELECTION),
+                          ExperimentId(ExperimentId::INVALID_EXPERIMENT-1),
+                          RenderId(RenderId::INVALID_RENDER),
+                          glretrace::StateKey(), std::vector<std::string>());
+      return false;
     }
-    while (true) {
-      response.Clear();
-      if (!s->response(&response)) {
-        m_callback->onError(RETRACE_FATAL, "FrameRetrace server died");
-        return;
-      }
-      assert(response.has_state());
-      const auto &state_response = response.state();
-      if (state_response.render_id() == (unsigned int)-1) {
-        // all responses sent.  Send a bogus state to inform the
-        // model that uniforms are complete
-        m_callback->onState(SelectionId(SelectionId::INVALID_SELECTION),
-                            ExperimentId(ExperimentId::INVALID_EXPERIMENT-1),
-                            RenderId(RenderId::INVALID_RENDER),
-                            glretrace::StateKey(), std::vector<std::string>());
-        break;
-      }
 
-      const auto selection = SelectionId(state_response.selection_count());
-      {
-        std::lock_guard<std::mutex> l(*m_protect);
-        if (*m_sel_count != selection)
-          // more recent selection was made while retrace was being
-          // executed.
-          continue;
-      }
-      const auto experiment = ExperimentId(state_response.experiment_count());
-      {
-        std::lock_guard<std::mutex> l(*m_protect);
-        if (*m_exp_count != experiment)
-          // more recent selection was made while retrace was being
-          // executed.
-          continue;
-      }
-      const RenderId rid(state_response.render_id());
-      auto &item = state_response.item();
-      glretrace::StateKey k(item.path(), item.name());
-      std::vector<std::string> value;
-      for (auto v : state_response.value())
-        value.push_back(v);
-      m_callback->onState(selection, experiment, rid,
-                          k, value);
+    const auto selection = SelectionId(state_response.selection_count());
+    {
+      std::lock_guard<std::mutex> l(*m_protect);
+      if (*m_sel_count != selection)
+        // more recent selection was made while retrace was being
+        // executed.
+        return true;
+    }
+    const auto experiment = ExperimentId(state_response.experiment_count());
+    {
+      std::lock_guard<std::mutex> l(*m_protect);
+      if (*m_exp_count != experiment)
+        // more recent selection was made while retrace was being
+        // executed.
+        return true;
     }
+    const RenderId rid(state_response.render_id());
+    auto &item = state_response.item();
+    glretrace::StateKey k(item.path(), item.name());
+    std::vector<std::string> value;
+    for (auto v : state_response.value())
+      value.push_back(v);
+    m_callback->onState(selection, experiment, rid,
+                        k, value);
+    return true;
   }
 
  private:
   const SelectionId * const m_sel_count;
   const ExperimentId * const m_exp_count;
   std::mutex *m_protect;
-  RetraceRequest m_proto_msg;
-  OnFrameRetrace *m_callback;
 };
 
 class SetStateRequest : public IRetraceRequest {
@@ -1186,7 +1241,7 @@ class SetStateRequest : public IRetraceRequest {
         m_item(item),
         m_offset(offset),
         m_value(value) {}
-  void retrace(RetraceSocket *sock) {
+  bool send(RetraceSocket *sock) {
     RetraceRequest msg;
     msg.set_requesttype(ApiTrace::SET_STATE_REQUEST);
     auto req = msg.mutable_set_state();
@@ -1197,7 +1252,7 @@ class SetStateRequest : public IRetraceRequest {
     makeRenderSelection(m_selection, selection);
     req->set_offset(m_offset);
     req->set_value(m_value);
-    sock->request(msg);
+    return sock->request(&msg);
   }
 
  private:
@@ -1210,171 +1265,480 @@ class SetStateRequest : public IRetraceRequest {
 class RevertExperimentsRequest : public IRetraceRequest {
  public:
   RevertExperimentsRequest() {}
-  void retrace(RetraceSocket *sock) {
+  bool send(RetraceSocket *sock) {
     RetraceRequest msg;
     msg.set_requesttype(ApiTrace::REVERT_EXPERIMENTS_REQUEST);
-    sock->request(msg);
+    return sock->request(&msg);
   }
  private:
 };
 
-class TextureRequest : public IRetraceRequest {
+class MetricRepetitionsRequest : public OneWayRequest {
+ public:
+  explicit MetricRepetitionsRequest(uint32_t repetitions) {
+    auto request = m_proto_msg.mutable_metric_repetitions();
+    request->set_repetitions(repetitions);
+    m_proto_msg.set_requesttype(ApiTrace::METRIC_REPETITIONS_REQUEST);
+  }
+};
+
+class TextureRequest : public StreamingRequest {
  public:
   TextureRequest(SelectionId *current_selection,
                  ExperimentId *current_experiment,
                  std::mutex *protect,
                  const RenderSelection &selection,
                  OnFrameRetrace *cb)
-      : m_sel_count(current_selection),
+      : StreamingRequest(cb),
+        m_sel_count(current_selection),
         m_exp_count(current_experiment),
-        m_protect(protect),
-        m_callback(cb) {
+        m_protect(protect) {
     m_proto_msg.set_requesttype(ApiTrace::TEXTURE_REQUEST);
     auto request = m_proto_msg.mutable_texture();
     auto selectionRequest = request->mutable_selection();
     makeRenderSelection(selection, selectionRequest);
     request->set_experiment_count(current_experiment->count());
   }
-  virtual void retrace(RetraceSocket *s) {
+  virtual bool reorderable() const { return true; }
+  virtual uint32_t views() const { return glretrace::TEXTURE_VIEW; }
+  virtual bool current() const {
     {
       std::lock_guard<std::mutex> l(*m_protect);
       const auto &sel = m_proto_msg.texture().selection();
       const SelectionId id(sel.selection_count());
       if (*m_sel_count != id)
         // more recent selection was made while this was enqueued
-        return;
+        return false;
       const ExperimentId eid(m_proto_msg.texture().experiment_count());
       if (*m_exp_count != eid)
         // more recent experiment was made while this was enqueued
-        return;
+        return false;
     }
-    RetraceResponse response;
-    // sends single request, read multiple responses
-    if (!s->request(m_proto_msg)) {
-      m_callback->onError(RETRACE_FATAL, "FrameRetrace server died.");
-      return;
+    return true;
+  }
+
+  virtual bool onResponse(const RetraceResponse &response) {
+    if (response.has_texturedata()) {
+      const auto &texture = response.texturedata();
+      const auto &data = texture.image_data();
+      std::vector<unsigned char> image_data(data.size());
+      memcpy(image_data.data(), data.c_str(), data.size());
+      m_callback->onTextureData(ExperimentId(texture.experiment_count()),
+                                texture.md5sum(), image_data);
+      return true;
+    }
+    assert(response.has_texture());
+    const auto &texture_response = response.texture();
+    if (texture_response.render_id() == (unsigned int)-1) {
+      // all responses sent.  Send a bogus state to inform the
+      // model that textures are complete
+      m_callback->onTexture(SelectionId(SelectionId::INVALID_SELECTION),
+                            ExperimentId(ExperimentId::INVALID_EXPERIMENT-1),
+                            RenderId(RenderId::INVALID_RENDER),
+                            glretrace::TextureKey(),
+                            std::vector<glretrace::TextureData>());
+      return false;
     }
-    while (true) {
-      response.Clear();
-      if (!s->response(&response)) {
-        m_callback->onError(RETRACE_FATAL, "FrameRetrace server died");
-        return;
-      }
-      if (response.has_texturedata()) {
-        const auto &texture = response.texturedata();
-        const auto &data = texture.image_data();
-        std::vector<unsigned char> image_data(data.size());
-        memcpy(image_data.data(), data.c_str(), data.size());
-        m_callback->onTextureData(ExperimentId(texture.experiment_count()),
-                                  texture.md5sum(), image_data);
-        continue;
-      }
-      assert(response.has_texture());
-      const auto &texture_response = response.texture();
-      if (texture_response.render_id() == (unsigned int)-1) {
-        // all responses sent.  Send a bogus state to inform the
-        // model that textures are complete
-        m_callback->onTexture(SelectionId(SelectionId::INVALID_SELECTION),
-                              ExperimentId(ExperimentId::INVALID_EXPERIMENT-1),
-                              RenderId(RenderId::INVALID_RENDER),
-                              glretrace::TextureKey(),
-                              std::vector<glretrace::TextureData>());
-        break;
-      }
 
-      const auto selection = SelectionId(texture_response.selection_count());
-      {
-        std::lock_guard<std::mutex> l(*m_protect);
-        if (*m_sel_count != selection)
-          // more recent selection was made while retrace was being
-          // executed.
-          continue;
-      }
-      const auto experiment = ExperimentId(texture_response.experiment_count());
-      {
-        std::lock_guard<std::mutex> l(*m_protect);
-        if (*m_exp_count != experiment)
-          // more recent selection was made while retrace was being
-          // executed.
-          continue;
-      }
-      const RenderId rid(texture_response.render_id());
-      auto &binding = texture_response.binding();
-      glretrace::TextureKey k(binding.unit(),
-                              binding.target(),
-                              binding.offset());
-      std::vector<glretrace::TextureData> images;
-      for (auto image : texture_response.images()) {
-        images.push_back(glretrace::TextureData(image.level(),
-                                                image.internal_format(),
-                                                image.width(),
-                                                image.height(),
-                                                image.format(),
-                                                image.type(),
-                                                image.md5sum()));
-      }
-      m_callback->onTexture(selection, experiment, rid,
-                            k, images);
+    const auto selection = SelectionId(texture_response.selection_count());
+    {
+      std::lock_guard<std::mutex> l(*m_protect);
+      if (*m_sel_count != selection)
+        // more recent selection was made while retrace was being
+        // executed.
+        return true;
+    }
+    const auto experiment = ExperimentId(texture_response.experiment_count());
+    {
+      std::lock_guard<std::mutex> l(*m_protect);
+      if (*m_exp_count != experiment)
+        // more recent selection was made while retrace was being
+        // executed.
+        return true;
+    }
+    const RenderId rid(texture_response.render_id());
+    auto &binding = texture_response.binding();
+    glretrace::TextureKey k(binding.unit(),
+                            binding.target(),
+                            binding.offset());
+    std::vector<glretrace::TextureData> images;
+    for (auto image : texture_response.images()) {
+      images.push_back(glretrace::TextureData(image.level(),
+                                              image.internal_format(),
+                                              image.width(),
+                                              image.height(),
+                                              image.format(),
+                                              image.type(),
+                                              image.md5sum()));
     }
+    m_callback->onTexture(selection, experiment, rid,
+                          k, images);
+    return true;
   }
 
  private:
   const SelectionId * const m_sel_count;
   const ExperimentId * const m_exp_count;
   std::mutex *m_protect;
-  RetraceRequest m_proto_msg;
-  OnFrameRetrace *m_callback;
+};
+
+// serves several views of a selection with a single request.  The
+// server sends the responses of each view terminated as for the
+// single-view request, which are dispatched to the view's request.
+class ViewsRequest : public StreamingRequest {
+ public:
+  ViewsRequest(SelectionId *current_selection,
+               ExperimentId *current_experiment,
+               std::mutex *protect,
+               const RenderSelection &selection,
+               uint32_t views,
+               OnFrameRetrace *cb)
+      : StreamingRequest(cb) {
+    m_proto_msg.set_requesttype(ApiTrace::VIEWS_REQUEST);
+    auto request = m_proto_msg.mutable_views();
+    makeRenderSelection(selection, request->mutable_selection());
+    request->set_experiment_count(current_experiment->count());
+    request->set_views(views);
+    if (views & glretrace::SHADER_ASSEMBLY_VIEW)
+      m_views[glretrace::SHADER_ASSEMBLY_VIEW] =
+          new RetraceShaderAssemblyRequest(current_selection,
+                                           current_experiment,
+                                           protect, selection, cb);
+    if (views & glretrace::API_VIEW)
+      m_views[glretrace::API_VIEW] =
+          new ApiRequest(current_selection, protect, selection, cb);
+    if (views & glretrace::BATCH_VIEW)
+      m_views[glretrace::BATCH_VIEW] =
+          new BatchRequest(current_selection, current_experiment,
+                           protect, selection, cb);
+    if (views & glretrace::UNIFORM_VIEW)
+      m_views[glretrace::UNIFORM_VIEW] =
+          new UniformRequest(current_selection, current_experiment,
+                             protect, selection, cb);
+    if (views & glretrace::STATE_VIEW)
+      m_views[glretrace::STATE_VIEW] =
+          new StateRequest(current_selection, current_experiment,
+                           protect, selection, cb);
+    if (views & glretrace::TEXTURE_VIEW)
+      m_views[glretrace::TEXTURE_VIEW] =
+          new TextureRequest(current_selection, current_experiment,
+                             protect, selection, cb);
+    m_pending = m_views.size();
+  }
+  ~ViewsRequest() {
+    for (auto v : m_views)
+      delete v.second;
+  }
+  virtual bool reorderable() const { return true; }
+  virtual uint32_t views() const { return m_proto_msg.views().views(); }
+  virtual bool current() const {
+    for (auto v : m_views)
+      if (v.second->current())
+        return true;
+    return false;
+  }
+  virtual bool onResponse(const RetraceResponse &response) {
+    uint32_t view = 0;
+    if (response.has_shaderassembly())
+      view = glretrace::SHADER_ASSEMBLY_VIEW;
+    else if (response.has_api())
+      view = glretrace::API_VIEW;
+    else if (response.has_batch())
+      view = glretrace::BATCH_VIEW;
+    else if (response.has_uniform())
+      view = glretrace::UNIFORM_VIEW;
+    else if (response.has_state())
+      view = glretrace::STATE_VIEW;
+    else if (response.has_texture() || response.has_texturedata())
+      view = glretrace::TEXTURE_VIEW;
+    auto v = m_views.find(view);
+    assert(v != m_views.end());
+    if (v == m_views.end())
+      return true;
+    if (!v->second->onResponse(response))
+      // this view is complete
+      --m_pending;
+    return m_pending > 0;
+  }
+
+ private:
+  std::map<uint32_t, StreamingRequest *> m_views;
+  size_t m_pending;
 };
 
 class NullRequest : public IRetraceRequest {
  public:
   // to pump the thread, and force it to stop
-  virtual void retrace(RetraceSocket *sock) {}
+  virtual bool send(RetraceSocket *sock) { return true; }
 };
 
 class FlushRequest : public IRetraceRequest {
  public:
   explicit FlushRequest(Semaphore *sem) : m_sem(sem) {}
   // to block until the queue executes all outstanding requests
-  virtual void retrace(RetraceSocket *sock) {
+  virtual bool exclusive() const { return true; }
+  virtual bool send(RetraceSocket *sock) {
+    m_sem->post();
+    return true;
+  }
+  virtual void onError(const std::string &message) {
     m_sem->post();
   }
  private:
   Semaphore *m_sem;
 };
 
-class BufferQueue {
+// order in which reorderable requests are sent to the server
+enum RequestPriority {
+  VISIBLE_PRIORITY,     // displayed in the current tab
+  SELECTION_PRIORITY,   // refreshes a hidden tab
+  BACKGROUND_PRIORITY   // refreshes data which spans the frame
+};
+
+// Requests waiting to be sent.  Reads of the frame are sent in
+// priority order, but never ahead of an earlier request which changes
+// the state of the server.  Reads made stale by a more recent
+// selection or experiment, and reads duplicating a queued request,
+// are dropped before they reach the socket.
+class RequestQueue {
  public:
+  RequestQueue() : m_visible(0) {}
   void push(IRetraceRequest *r) {
-    m_mut.lock();
+    std::lock_guard<std::mutex> l(m_mut);
+    prune();
+    if (r->reorderable()) {
+      for (auto i = m_requests.rbegin(); i != m_requests.rend(); ++i) {
+        if (!(*i)->reorderable())
+          // r may not be merged across a change in server state
+          break;
+        if ((*i)->duplicates(*r)) {
+          delete r;
+          return;
+        }
+      }
+    }
     m_requests.push_back(r);
-    m_mut.unlock();
-    m_sem.post();
+    m_cv.notify_all();
   }
 
+  // blocks until a request is enqueued
   IRetraceRequest *pop() {
-    m_sem.wait();
-    m_mut.lock();
-    IRetraceRequest *r = m_requests.front();
-    m_requests.pop_front();
-    m_mut.unlock();
+    std::unique_lock<std::mutex> l(m_mut);
+    m_cv.wait(l, [this] { return !m_requests.empty(); });
+    auto next = m_requests.begin();
+    for (auto i = next; i != m_requests.end(); ++i) {
+      if (!(*i)->reorderable())
+        break;
+      if (priority(**i) < priority(**next))
+        next = i;
+    }
+    IRetraceRequest *r = *next;
+    m_requests.erase(next);
     return r;
   }
 
+  // views shown by the current tab
+  void setVisible(uint32_t views) {
+    std::lock_guard<std::mutex> l(m_mut);
+    m_visible = views;
+  }
+
  private:
+  RequestPriority priority(const IRetraceRequest &r) const {
+    const uint32_t views = r.views();
+    if (!views)
+      return BACKGROUND_PRIORITY;
+    if (views & m_visible)
+      return VISIBLE_PRIORITY;
+    return SELECTION_PRIORITY;
+  }
+
+  // drops reads which need not be sent
+  void prune() {
+    auto i = m_requests.begin();
+    while (i != m_requests.end()) {
+      if ((*i)->reorderable() && !(*i)->current()) {
+        delete *i;
+        i = m_requests.erase(i);
+        continue;
+      }
+      ++i;
+    }
+  }
+
   std::deque<IRetraceRequest *> m_requests;
-  Semaphore m_sem;
   std::mutex m_mut;
+  std::condition_variable m_cv;
+  uint32_t m_visible;
+};
+
+// Requests which were sent to the server, and have not received
+// their last response.  Responses are routed to the request with
+// the same id.
+class InFlightRequests {
+ public:
+  explicit InFlightRequests(size_t window) : m_window(window),
+                                             m_sending(0),
+                                             m_closed(false),
+                                             m_failed(false) {}
+  // Registers a request before it is sent, as its response may be
+  // read as soon as it is sent.  Blocks while the window of
+  // outstanding requests is full.  false if the server died, in
+  // which case r is deleted.
+  bool push(uint32_t id, IRetraceRequest *r) {
+    std::unique_lock<std::mutex> l(m_mut);
+    m_cv.wait(l, [this] { return m_requests.size() < m_window; });
+    if (m_failed) {
+      r->onError("FrameRetrace server died");
+      delete r;
+      return false;
+    }
+    m_requests.push_back(std::make_pair(id, r));
+    m_sending = id;
+    m_cv.notify_all();
+    return true;
+  }
+  // called after the request registered by push is sent.  A request
+  // which could not be sent is removed.
+  void sent(uint32_t id, bool success) {
+    std::lock_guard<std::mutex> l(m_mut);
+    m_sending = 0;
+    m_cv.notify_all();
+    if (success)
+      return;
+    for (auto i = m_requests.begin(); i != m_requests.end(); ++i) {
+      if (i->first != id)
+        continue;
+      i->second->onError("FrameRetrace server died.");
+      delete i->second;
+      m_requests.erase(i);
+      break;
+    }
+  }
+  // blocks until every outstanding request is complete
+  void drain() {
+    std::unique_lock<std::mutex> l(m_mut);
+    m_cv.wait(l, [this] { return m_requests.empty(); });
+  }
+  // blocks until a request is outstanding.  false after close()
+  bool wait() {
+    std::unique_lock<std::mutex> l(m_mut);
+    m_cv.wait(l, [this] { return m_closed || !m_requests.empty(); });
+    return !m_requests.empty();
+  }
+  void close() {
+    std::lock_guard<std::mutex> l(m_mut);
+    m_closed = true;
+    m_cv.notify_all();
+  }
+  void dispatch(const RetraceResponse &response) {
+    IRetraceRequest *r = NULL;
+    {
+      std::unique_lock<std::mutex> l(m_mut);
+      // the response can arrive before send returns
+      m_cv.wait(l, [this, &response] {
+          return m_sending != response.request_id(); });
+      for (auto i : m_requests)
+        if (i.first == response.request_id())
+          r = i.second;
+    }
+    if (!r) {
+      // eg. an error raised by a request which has no response
+      if (response.has_error()) {
+        Severity s = (response.error().severity() == RETRACE_FATAL ?
+                      ERR : WARN);
+        GRLOG(s, response.error().message().c_str());
+      }
+      return;
+    }
+    // only the response thread removes sent requests, so r remains
+    // valid while callbacks are made without the lock.
+    const bool pending = (response.has_error() ?
+                          r->onErrorResponse(response) :
+                          r->onResponse(response));
+    if (!pending)
+      complete(response.request_id());
+  }
+  // the server will not answer the outstanding requests
+  void fail(const std::string &message) {
+    std::unique_lock<std::mutex> l(m_mut);
+    m_cv.wait(l, [this] { return m_sending == 0; });
+    for (auto i : m_requests) {
+      i.second->onError(message);
+      delete i.second;
+    }
+    m_requests.clear();
+    m_failed = true;
+    m_cv.notify_all();
+  }
+
+ private:
+  void complete(uint32_t id) {
+    std::lock_guard<std::mutex> l(m_mut);
+    for (auto i = m_requests.begin(); i != m_requests.end(); ++i) {
+      if (i->first != id)
+        continue;
+      delete i->second;
+      m_requests.erase(i);
+      break;
+    }
+    m_cv.notify_all();
+  }
+
+  const size_t m_window;
+  std::deque<std::pair<uint32_t, IRetraceRequest *>> m_requests;
+  // the request which push registered, and which is being sent
+  uint32_t m_sending;
+  std::mutex m_mut;
+  std::condition_variable m_cv;
+  bool m_closed, m_failed;
 };
 
+// reads responses while the stub thread sends subsequent requests
+class ResponseThread : public Thread {
+ public:
+  ResponseThread(RetraceSocket *sock,
+                 InFlightRequests *in_flight)
+      : Thread("retrace_stub_responses"),
+        m_sock(sock),
+        m_in_flight(in_flight) {}
+  virtual void Run() {
+    // parsing into the same message reuses its storage, which
+    // avoids reallocating large images for each response
+    RetraceResponse response;
+    while (m_in_flight->wait()) {
+      if (!m_sock->response(&response)) {
+        m_in_flight->fail("FrameRetrace server died");
+        return;
+      }
+      m_in_flight->dispatch(response);
+    }
+  }
+
+ private:
+  RetraceSocket *m_sock;
+  InFlightRequests *m_in_flight;
+};
+
+// requests which may be outstanding at the server.  Subsequent
+// requests are sent while the server executes the earlier ones.
+const size_t kMaxRequestsInFlight = 4;
+
 }  // namespace
 
 namespace glretrace {
 
 class CancellationSocket {
  public:
-  CancellationSocket(const char *host, int port)
-      : m_sock(host, port) {}
+  CancellationSocket(Socket *sock, uint64_t session)
+      : m_sock(sock) {
+    ApiTrace::CancellationEvent e;
+    e.set_selection_count(0);
+    e.set_experiment_count(0);
+    e.set_session(session);
+    send(e);
+  }
+  ~CancellationSocket() { delete m_sock; }
   void cancel(SelectionId selectionCount,
               ExperimentId experimentCount) {
     if (m_sel == selectionCount && m_exp == experimentCount)
@@ -1384,18 +1748,15 @@ class CancellationSocket {
     ApiTrace::CancellationEvent e;
     e.set_selection_count(selectionCount.count());
     e.set_experiment_count(experimentCount.count());
-    m_buf.clear();
-    const uint32_t write_size = e.ByteSizeLong();
-    m_buf.resize(write_size);
-    ArrayOutputStream array_out(m_buf.data(), write_size);
-    CodedOutputStream coded_out(&array_out);
-    e.SerializeToCodedStream(&coded_out);
-    m_sock.Write(write_size);
-    m_sock.WriteVec(m_buf);
+    send(e);
   }
 
  private:
-  Socket m_sock;
+  void send(const ApiTrace::CancellationEvent &e) {
+    m_sock->WriteMessage(e, &m_buf);
+  }
+
+  Socket *m_sock;
   std::vector<unsigned char> m_buf;
   SelectionId m_sel;
   ExperimentId m_exp;
@@ -1403,11 +1764,19 @@ class CancellationSocket {
 
 class ThreadedRetrace : public Thread {
  public:
-  explicit ThreadedRetrace(const char *host,
-                           int port) : Thread("retrace_stub"),
-                                       m_running(true),
-                                       m_sock(host, port) {}
+  // shared_memory is requested from servers on the same host
+  ThreadedRetrace(Socket *sock,
+                  uint64_t session,
+                  bool shared_memory) : Thread("retrace_stub"),
+                                        m_running(true),
+                                        m_sock(sock),
+                                        m_in_flight(kMaxRequestsInFlight),
+                                        m_responses(&m_sock, &m_in_flight),
+                                        m_request_id(0),
+                                        m_session(session),
+                                        m_shared_memory(shared_memory) {}
   void push(IRetraceRequest *r) { m_queue.push(r); }
+  void setVisible(uint32_t views) { m_queue.setVisible(views); }
   void stop() {
     m_running = false;
     m_queue.push(new NullRequest());
@@ -1415,29 +1784,123 @@ class ThreadedRetrace : public Thread {
   }
   void drop_requests() { m_running = false; }
   virtual void Run() {
+    const std::string error = handshake();
+    if (error.empty())
+      m_responses.Start();
     while (m_running) {
       IRetraceRequest *r = m_queue.pop();
-      r->retrace(&m_sock);
-      delete r;
+      if (!error.empty()) {
+        r->onError(error);
+        delete r;
+        continue;
+      }
+      if (!r->current()) {
+        delete r;
+        continue;
+      }
+      const std::string prepare_error = r->prepare();
+      if (!prepare_error.empty()) {
+        r->onError(prepare_error);
+        delete r;
+        continue;
+      }
+      // the response thread deletes r after its last response
+      const bool exclusive = r->exclusive();
+      if (exclusive)
+        m_in_flight.drain();
+      m_sock.setRequestId(++m_request_id);
+      if (!r->hasResponse()) {
+        if (!r->send(&m_sock))
+          r->onError("FrameRetrace server died.");
+        delete r;
+        continue;
+      }
+      if (!m_in_flight.push(m_request_id, r))
+        continue;
+      const bool success = r->send(&m_sock);
+      m_in_flight.sent(m_request_id, success);
+      if (!success)
+        continue;
+      if (exclusive)
+        m_in_flight.drain();
     }
+    if (!error.empty())
+      return;
+    m_in_flight.drain();
+    m_in_flight.close();
+    m_responses.Join();
   }
+
  private:
-  BufferQueue m_queue;
+  // empty if the server speaks the same protocol as the stub
+  std::string handshake() {
+    RetraceRequest request;
+    request.set_requesttype(ApiTrace::PROTOCOL_VERSION_REQUEST);
+    request.mutable_protocol_version()->set_version(
+        ApiTrace::PROTOCOL_VERSION);
+    request.mutable_protocol_version()->set_session(m_session);
+    if (m_shared_memory)
+      request.mutable_protocol_version()->set_shared_memory(true);
+    RetraceResponse response;
+    if (!m_sock.request(&request) || !m_sock.response(&response))
+      return "FrameRetrace server died.";
+    if (!response.has_protocol_version() ||
+        (response.protocol_version().version() !=
+         ApiTrace::PROTOCOL_VERSION))
+      return "FrameRetrace server is incompatible with this client.";
+    if (response.protocol_version().shared_memory() &&
+        !m_sock.receiveRing())
+      return "FrameRetrace server failed to share memory.";
+    return "";
+  }
+
+  RequestQueue m_queue;
   bool m_running;
   RetraceSocket m_sock;
+  InFlightRequests m_in_flight;
+  ResponseThread m_responses;
+  uint32_t m_request_id;
+  const uint64_t m_session;
+  const bool m_shared_memory;
 };
 
 }  // namespace glretrace
 
 using glretrace::ThreadedRetrace;
 
+namespace {
+
+// identifies both sockets of a client to the server
+uint64_t
+session_key() {
+  std::random_device random;
+  return ((static_cast<uint64_t>(random()) << 32) | random());
+}
+
+}  // namespace
+
 void
 FrameRetraceStub::Init(const char *host, int port) {
   assert(m_thread == NULL);
   assert(m_cancellation == NULL);
-  m_thread = new ThreadedRetrace(host, port);
+  const uint64_t session = session_key();
+  m_thread = new ThreadedRetrace(new Socket(host, port), session, false);
+  m_thread->setVisible(m_visible_views);
+  m_thread->Start();
+  m_cancellation = new CancellationSocket(new Socket(host, port + 1),
+                                          session);
+}
+
+void
+FrameRetraceStub::InitLocal(const std::string &path) {
+  assert(m_thread == NULL);
+  assert(m_cancellation == NULL);
+  const uint64_t session = session_key();
+  m_thread = new ThreadedRetrace(new Socket(path), session, true);
+  m_thread->setVisible(m_visible_views);
   m_thread->Start();
-  m_cancellation = new CancellationSocket(host, port + 1);
+  m_cancellation = new CancellationSocket(new Socket(path + ".cancel"),
+                                          session);
 }
 
 void
@@ -1524,6 +1987,7 @@ FrameRetraceStub::retraceMetrics(const std::vector<MetricId> &ids,
 void
 FrameRetraceStub::retraceAllMetrics(const RenderSelection &selection,
                                     ExperimentId experimentCount,
+                                    MetricAggregation aggregation,
                                     OnFrameRetrace *callback) const {
   {
     std::lock_guard<std::mutex> l(m_mutex);
@@ -1536,6 +2000,7 @@ FrameRetraceStub::retraceAllMetrics(const RenderSelection &selection,
                                               &m_mutex,
                                               selection,
                                               &m_current_experiment,
+                                              aggregation,
                                               callback));
 }
 
@@ -1657,6 +2122,11 @@ FrameRetraceStub::setState(const RenderSelection &selection,
   m_thread->push(new SetStateRequest(selection, item, offset, value));
 }
 
+void
+FrameRetraceStub::setMetricRepetitions(uint32_t repetitions) {
+  m_thread->push(new MetricRepetitionsRequest(repetitions));
+}
+
 void
 FrameRetraceStub::revertExperiments() {
   m_thread->push(new RevertExperimentsRequest());
@@ -1696,3 +2166,29 @@ FrameRetraceStub::retraceTextures(const RenderSelection &selection,
                                     &m_mutex,
                                     selection, callback));
 }
+
+void
+FrameRetraceStub::setVisibleViews(uint32_t views) {
+  // the tab may be selected before the trace is opened
+  m_visible_views = views;
+  if (m_thread)
+    m_thread->setVisible(views);
+}
+
+void
+FrameRetraceStub::retraceViews(const RenderSelection &selection,
+                               ExperimentId experimentCount,
+                               uint32_t views,
+                               OnFrameRetrace *callback) {
+  {
+    std::lock_guard<std::mutex> l(m_mutex);
+    m_current_render_selection = selection.id;
+    assert(m_current_experiment <= experimentCount);
+    m_current_experiment = experimentCount;
+  }
+  m_cancellation->cancel(selection.id, experimentCount);
+  m_thread->push(new ViewsRequest(&m_current_render_selection,
+                                  &m_current_experiment,
+                                  &m_mutex,
+                                  selection, views, callback));
+}
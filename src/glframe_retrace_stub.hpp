@@ -40,16 +40,33 @@ class ThreadedRetrace;
 class CancellationSocket;
 
 // offloads the request to a thread which serializes request to the
-// retrace process, and blocks on the result.
+// retrace process.  Several requests may be outstanding, and their
+// responses are routed to the callbacks by request id.  Queued
+// requests are sent in priority order, and stale requests are
+// dropped before they are sent.
 class FrameRetraceStub : public IFrameRetrace {
  public:
   // call once, to set up the retrace socket, and shut it down at
   // exit
   void Init(const char *host, int port);
+  // connects to a server on the same host, through unix domain
+  // sockets at path and path.cancel.  Images are passed in shared
+  // memory rather than copied through the socket.
+  void InitLocal(const std::string &path);
   void Shutdown();
   void Stop();
   void Flush();
 
+  // views which are not retraced by retraceViews, for setVisibleViews
+  enum {
+    RENDER_TARGET_VIEW = 0x100,
+    METRICS_VIEW = 0x200
+  };
+  // Pending requests for the visible views are sent to the server
+  // ahead of requests for hidden views.  views is a mask of ViewType
+  // and the view flags above.
+  void setVisibleViews(uint32_t views);
+
   virtual void openFile(const std::string &filename,
                         const std::vector<unsigned char> &md5,
                         uint64_t fileSize,
@@ -69,6 +86,7 @@ class FrameRetraceStub : public IFrameRetrace {
                               OnFrameRetrace *callback) const;
   virtual void retraceAllMetrics(const RenderSelection &selection,
                                  ExperimentId experimentCount,
+                                 MetricAggregation aggregation,
                                  OnFrameRetrace *callback) const;
   virtual void replaceShaders(RenderId renderId,
                               ExperimentId experimentCount,
@@ -111,6 +129,11 @@ class FrameRetraceStub : public IFrameRetrace {
   virtual void retraceTextures(const RenderSelection &selection,
                                ExperimentId experimentCount,
                                OnFrameRetrace *callback);
+  virtual void retraceViews(const RenderSelection &selection,
+                            ExperimentId experimentCount,
+                            uint32_t views,
+                            OnFrameRetrace *callback);
+  virtual void setMetricRepetitions(uint32_t repetitions);
   virtual void revertExperiments();
   virtual void cancel(SelectionId selectionCount,
                       ExperimentId experimentCount) { assert(false); }
@@ -122,6 +145,7 @@ class FrameRetraceStub : public IFrameRetrace {
   mutable ExperimentId m_current_experiment;
   ThreadedRetrace *m_thread = NULL;
   CancellationSocket *m_cancellation = NULL;
+  uint32_t m_visible_views = 0;
 };
 }  // namespace glretrace
 
@@ -0,0 +1,271 @@
+/**************************************************************************
+ *
+ * Copyright 2019 Intel Corporation
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * Authors:
+ *   Mark Janes <mark.a.janes@intel.com>
+ **************************************************************************/
+
+#include "glframe_session_server.hpp"
+
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <google/protobuf/io/coded_stream.h>
+
+#include <vector>
+
+#include "glframe_logger.hpp"
+#include "glframe_os.hpp"
+#include "glframe_socket.hpp"
+#include "playback.pb.h" // NOLINT
+
+using ApiTrace::CancellationEvent;
+using ApiTrace::RetraceRequest;
+using ApiTrace::RetraceResponse;
+using glretrace::ServerSocket;
+using glretrace::SessionServer;
+using glretrace::Socket;
+using glretrace::SocketPoll;
+using glretrace::fork_worker;
+using google::protobuf::MessageLite;
+using google::protobuf::io::ArrayInputStream;
+using google::protobuf::io::CodedInputStream;
+
+namespace {
+
+// clients which may connect while the server forks a worker
+const int kSessionBacklog = 16;
+// the server wakes at this interval to expire stale connections
+const int kPollMs = 1000;
+// stubs send their session key as soon as they connect each socket
+const int kSessionKeyTimeoutMs = 10000;
+// stubs connect their cancellation socket after their retrace socket
+const int kPairingTimeoutMs = 30000;
+
+bool
+expired(std::chrono::steady_clock::time_point since, int timeout_ms) {
+  return (std::chrono::steady_clock::now() - since >
+          std::chrono::milliseconds(timeout_ms));
+}
+
+// closes a connection which remains open in another process
+void
+release(Socket *s) {
+  s->Release();
+  delete s;
+}
+
+// reads a message with a leading 4 byte length.  false if the client
+// hung up.
+bool
+readMessage(Socket *s, MessageLite *msg) {
+  uint32_t msg_len;
+  if (!s->Read(&msg_len))
+    return false;
+  std::vector<unsigned char> buf(msg_len);
+  if (!s->ReadVec(&buf))
+    return false;
+  ArrayInputStream array_in(buf.data(), msg_len);
+  CodedInputStream coded_in(&array_in);
+  return msg->ParseFromCodedStream(&coded_in);
+}
+
+// Answers the protocol handshake of a new client, which carries the
+// session key of the client.  false if the client sent no key.
+bool
+acceptRetraceSocket(Socket *s, uint64_t *session) {
+  RetraceRequest request;
+  if (!readMessage(s, &request))
+    return false;
+  if ((request.requesttype() != ApiTrace::PROTOCOL_VERSION_REQUEST) ||
+      !request.protocol_version().has_session())
+    return false;
+  *session = request.protocol_version().session();
+  RetraceResponse response;
+  response.mutable_protocol_version()->set_version(
+      ApiTrace::PROTOCOL_VERSION);
+  std::vector<unsigned char> buf;
+  return s->WriteMessage(response, &buf);
+}
+
+// the first event on a cancellation socket carries the session key
+bool
+acceptCancelSocket(Socket *s, uint64_t *session) {
+  CancellationEvent e;
+  if (!readMessage(s, &e) || !e.has_session())
+    return false;
+  *session = e.session();
+  return true;
+}
+
+}  // namespace
+
+SessionServer::SessionServer(int port, unsigned int memory_limit_mb)
+    : m_server(new ServerSocket(port, kSessionBacklog)),
+      m_cancel_server(new ServerSocket(port + 1, kSessionBacklog)),
+      m_memory_limit_mb(memory_limit_mb),
+      m_worker_count(0) {}
+
+SessionServer::~SessionServer() {
+  for (auto c : m_pending)
+    delete c.sock;
+  for (auto c : m_pending_cancel)
+    delete c.sock;
+  for (auto c : m_unpaired)
+    delete c.second.sock;
+  for (auto c : m_unpaired_cancel)
+    delete c.second.sock;
+  delete m_server;
+  delete m_cancel_server;
+}
+
+bool
+SessionServer::AcceptSession(Socket **sock, Socket **cancel_sock) {
+  while (true) {
+    for (auto retrace = m_unpaired.begin(); retrace != m_unpaired.end();
+         ++retrace) {
+      auto cancel = m_unpaired_cancel.find(retrace->first);
+      if (cancel != m_unpaired_cancel.end())
+        return startWorker(retrace, cancel, sock, cancel_sock);
+    }
+
+    SocketPoll poll;
+    const int server = poll.Add(*m_server);
+    const int cancel_server = poll.Add(*m_cancel_server);
+    for (const auto &c : m_pending)
+      poll.Add(*c.sock);
+    for (const auto &c : m_pending_cancel)
+      poll.Add(*c.sock);
+    poll.Wait(kPollMs);
+
+    // identify the connections which sent their session key
+    int index = cancel_server + 1;
+    auto identify = [&](std::vector<Connection> *pending, bool cancel) {
+      std::vector<Connection> waiting;
+      for (const auto &c : *pending) {
+        if (poll.Readable(index++)) {
+          readSessionKey(c, cancel);
+        } else if (expired(c.since, kSessionKeyTimeoutMs)) {
+          GRLOGF(glretrace::WARN, "no session key from client: %s",
+                 c.sock->Address().c_str());
+          delete c.sock;
+        } else {
+          waiting.push_back(c);
+        }
+      }
+      pending->swap(waiting);
+    };
+    identify(&m_pending, false);
+    identify(&m_pending_cancel, true);
+
+    if (poll.Readable(server))
+      m_pending.push_back(Connection{m_server->Accept(), Clock::now()});
+    if (poll.Readable(cancel_server))
+      m_pending_cancel.push_back(Connection{m_cancel_server->Accept(),
+                                            Clock::now()});
+    expire(&m_unpaired);
+    expire(&m_unpaired_cancel);
+  }
+}
+
+void
+SessionServer::readSessionKey(const Connection &c, bool cancel) {
+  // the key is readable, but a client could stall mid-message
+  c.sock->SetReadTimeout(kSessionKeyTimeoutMs);
+  uint64_t session;
+  const bool identified = (cancel ? acceptCancelSocket(c.sock, &session) :
+                           acceptRetraceSocket(c.sock, &session));
+  c.sock->SetReadTimeout(0);
+  if (!identified) {
+    GRLOGF(glretrace::WARN, "rejected client: %s",
+           c.sock->Address().c_str());
+    delete c.sock;
+    return;
+  }
+  SessionTable *table = cancel ? &m_unpaired_cancel : &m_unpaired;
+  auto previous = table->find(session);
+  if (previous != table->end())
+    // the client reconnected
+    delete previous->second.sock;
+  (*table)[session] = Connection{c.sock, Clock::now()};
+}
+
+bool
+SessionServer::startWorker(SessionTable::iterator retrace,
+                           SessionTable::iterator cancel,
+                           Socket **sock, Socket **cancel_sock) {
+  Socket *s = retrace->second.sock;
+  Socket *c = cancel->second.sock;
+  m_unpaired.erase(retrace);
+  m_unpaired_cancel.erase(cancel);
+
+  const int pid = fork_worker(m_worker_count++, m_memory_limit_mb);
+  if (pid == 0) {
+    // connections of other sessions are served by the parent
+    for (auto pending : m_pending)
+      release(pending.sock);
+    m_pending.clear();
+    for (auto pending : m_pending_cancel)
+      release(pending.sock);
+    m_pending_cancel.clear();
+    for (auto unpaired : m_unpaired)
+      release(unpaired.second.sock);
+    m_unpaired.clear();
+    for (auto unpaired : m_unpaired_cancel)
+      release(unpaired.second.sock);
+    m_unpaired_cancel.clear();
+    delete m_server;
+    m_server = NULL;
+    delete m_cancel_server;
+    m_cancel_server = NULL;
+    *sock = s;
+    *cancel_sock = c;
+    return true;
+  }
+
+  if (pid < 0) {
+    GRLOGF(glretrace::ERR, "could not fork a worker for %s",
+           s->Address().c_str());
+  } else {
+    GRLOGF(glretrace::INFO, "worker %d serves %s", pid,
+           s->Address().c_str());
+    // the connections remain open in the worker
+    s->Release();
+    c->Release();
+  }
+  delete s;
+  delete c;
+  return false;
+}
+
+void
+SessionServer::expire(SessionTable *table) {
+  for (auto c = table->begin(); c != table->end();) {
+    if (!expired(c->second.since, kPairingTimeoutMs)) {
+      ++c;
+      continue;
+    }
+    GRLOGF(glretrace::WARN, "client did not connect both sockets: %s",
+           c->second.sock->Address().c_str());
+    delete c->second.sock;
+    c = table->erase(c);
+  }
+}
@@ -0,0 +1,89 @@
+/**************************************************************************
+ *
+ * Copyright 2019 Intel Corporation
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * Authors:
+ *   Mark Janes <mark.a.janes@intel.com>
+ **************************************************************************/
+
+#ifndef _GLFRAME_SESSION_SERVER_HPP_
+#define _GLFRAME_SESSION_SERVER_HPP_
+
+#include <stdint.h>
+
+#include <chrono>  // NOLINT
+#include <map>
+#include <vector>
+
+#include "glframe_traits.hpp"
+
+namespace glretrace {
+class ServerSocket;
+class Socket;
+
+// Accepts the clients of a multi-session server.  GL and apitrace
+// state are global to the process, so each session is served by a
+// forked worker process.  Stubs identify their retrace and
+// cancellation sockets with a session key, by which the sockets of
+// concurrent clients are paired.
+class SessionServer : NoCopy, NoAssign {
+ public:
+  // memory_limit_mb limits the heap of each worker (0 for no limit)
+  SessionServer(int port, unsigned int memory_limit_mb);
+  ~SessionServer();
+
+  // Waits until a client has connected both of its sockets, and
+  // forks a worker process for the session.  Returns true in the
+  // worker, which serves the session on the returned sockets.  The
+  // server process returns false, and accepts the next session.
+  // Session keys are read from each connection as they arrive, so a
+  // slow client does not delay the sessions of others.
+  bool AcceptSession(Socket **sock, Socket **cancel_sock);
+
+ private:
+  typedef std::chrono::steady_clock Clock;
+  struct Connection {
+    Socket *sock;
+    // when the connection was accepted or identified
+    Clock::time_point since;
+  };
+  typedef std::map<uint64_t, Connection> SessionTable;
+
+  void readSessionKey(const Connection &c, bool cancel);
+  bool startWorker(SessionTable::iterator retrace,
+                   SessionTable::iterator cancel,
+                   Socket **sock, Socket **cancel_sock);
+  void expire(SessionTable *table);
+
+  ServerSocket *m_server, *m_cancel_server;
+  // connections which have not sent their session key
+  std::vector<Connection> m_pending, m_pending_cancel;
+  // identified connections of clients whose other socket has not
+  // sent its session key
+  SessionTable m_unpaired, m_unpaired_cancel;
+  const unsigned int m_memory_limit_mb;
+  unsigned int m_worker_count;
+};
+
+}  // namespace glretrace
+
+#endif  // _GLFRAME_SESSION_SERVER_HPP_
@@ -0,0 +1,155 @@
+/**************************************************************************
+ *
+ * Copyright 2019 Intel Corporation
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * Authors:
+ *   Mark Janes <mark.a.janes@intel.com>
+ **************************************************************************/
+
+#include "glframe_shared_ring.hpp"
+
+#ifndef WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include <assert.h>
+#include <string.h>
+
+#include <atomic>
+#include <new>
+
+using glretrace::SharedRing;
+
+// Offsets of payloads increase monotonically, and are reduced modulo
+// the capacity to find their position in the ring.
+struct SharedRing::Header {
+  // written by the reader, polled by the writer
+  std::atomic<uint64_t> released;
+  uint64_t capacity;
+};
+
+namespace {
+
+// payloads begin on a cache line
+const size_t kHeaderSize = 64;
+
+}  // namespace
+
+SharedRing::SharedRing(int fd, void *map, size_t map_size)
+    : m_fd(fd),
+      m_map(map),
+      m_map_size(map_size),
+      m_header(reinterpret_cast<Header *>(map)),
+      m_data(reinterpret_cast<unsigned char *>(map) + kHeaderSize),
+      m_written(0) {
+  static_assert(sizeof(Header) <= kHeaderSize, "ring header too large");
+}
+
+#ifdef WIN32
+
+SharedRing *
+SharedRing::Create(size_t capacity) {
+  return NULL;
+}
+
+SharedRing *
+SharedRing::Map(int fd) {
+  return NULL;
+}
+
+SharedRing::~SharedRing() {}
+
+#else
+
+SharedRing *
+SharedRing::Create(size_t capacity) {
+  const int fd = memfd_create("frameretrace", MFD_CLOEXEC);
+  if (fd == -1)
+    return NULL;
+  // pages are only allocated as they are written
+  const size_t map_size = kHeaderSize + capacity;
+  if (ftruncate(fd, map_size) != 0) {
+    close(fd);
+    return NULL;
+  }
+  void *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   fd, 0);
+  if (map == MAP_FAILED) {
+    close(fd);
+    return NULL;
+  }
+  Header *header = new (map) Header;
+  header->released.store(0);
+  header->capacity = capacity;
+  return new SharedRing(fd, map, map_size);
+}
+
+SharedRing *
+SharedRing::Map(int fd) {
+  Header header;
+  if (pread(fd, &header, sizeof(header), 0) != sizeof(header)) {
+    close(fd);
+    return NULL;
+  }
+  const size_t map_size = kHeaderSize + header.capacity;
+  void *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   fd, 0);
+  if (map == MAP_FAILED) {
+    close(fd);
+    return NULL;
+  }
+  return new SharedRing(fd, map, map_size);
+}
+
+SharedRing::~SharedRing() {
+  munmap(m_map, m_map_size);
+  close(m_fd);
+}
+
+#endif
+
+bool
+SharedRing::Write(const void *data, size_t size, uint64_t *offset) {
+  const uint64_t capacity = m_header->capacity;
+  uint64_t begin = m_written;
+  // payloads do not wrap around the end of the ring
+  if (begin % capacity + size > capacity)
+    begin += capacity - begin % capacity;
+  const uint64_t released =
+      m_header->released.load(std::memory_order_acquire);
+  if (begin + size - released > capacity)
+    return false;
+  memcpy(m_data + begin % capacity, data, size);
+  m_written = begin + size;
+  *offset = begin;
+  return true;
+}
+
+const unsigned char *
+SharedRing::Data(uint64_t offset) const {
+  return m_data + offset % m_header->capacity;
+}
+
+void
+SharedRing::Release(uint64_t end) {
+  m_header->released.store(end, std::memory_order_release);
+}
@@ -0,0 +1,81 @@
+/**************************************************************************
+ *
+ * Copyright 2019 Intel Corporation
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * Authors:
+ *   Mark Janes <mark.a.janes@intel.com>
+ **************************************************************************/
+
+#ifndef _GLFRAME_SHARED_RING_HPP_
+#define _GLFRAME_SHARED_RING_HPP_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "glframe_traits.hpp"
+
+namespace glretrace {
+
+// A ring of shared memory, through which a process passes large
+// payloads to a process on the same host.  The writer copies each
+// payload into the ring, and sends its offset on a socket.  The
+// reader releases payloads in the order they were written, making
+// their space available to the writer.
+class SharedRing : NoCopy, NoAssign, NoMove {
+ public:
+  // creates a ring of capacity bytes, for the writing process.  NULL
+  // where shared memory is not supported.
+  static SharedRing *Create(size_t capacity);
+  // maps a ring which was created by another process.  Takes
+  // ownership of fd.  NULL on failure.
+  static SharedRing *Map(int fd);
+  ~SharedRing();
+
+  // descriptor to pass to the reading process
+  int fd() const { return m_fd; }
+
+  // Copies a payload into contiguous space in the ring.  false if the
+  // reader has not released enough space, in which case the payload
+  // should be sent on the socket.
+  bool Write(const void *data, size_t size, uint64_t *offset);
+  // the payload written at offset
+  const unsigned char *Data(uint64_t offset) const;
+  // called by the reader when it is done with the payloads which end
+  // before end
+  void Release(uint64_t end);
+
+ private:
+  struct Header;
+  SharedRing(int fd, void *map, size_t map_size);
+
+  const int m_fd;
+  void * const m_map;
+  const size_t m_map_size;
+  Header * const m_header;
+  unsigned char * const m_data;
+  // offset following the last payload written by this process
+  uint64_t m_written;
+};
+
+}  // namespace glretrace
+
+#endif  // _GLFRAME_SHARED_RING_HPP_
@@ -31,8 +31,11 @@
 #include <winsock2.h>
 #include <ws2tcpip.h>
 #else
+#include <poll.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/un.h>
 #include <unistd.h>
 #include <netdb.h>
 #include <netinet/tcp.h>
@@ -42,10 +45,12 @@
 #include <string.h>
 
 #include <string>
+#include <vector>
 
 #include "glframe_os.hpp"
 
 using glretrace::Socket;
+using glretrace::SocketPoll;
 using glretrace::ServerSocket;
 using glretrace::glretrace_delay;
 
@@ -99,6 +104,40 @@ Socket::Write(const void * buf, int size) {
   return true;
 }
 
+bool
+Socket::WriteFrame(const void *buf, uint32_t size) {
+#ifdef WIN32
+  return Write(size) && Write(buf, size);
+#else
+  struct iovec iov[2];
+  iov[0].iov_base = &size;
+  iov[0].iov_len = sizeof(size);
+  iov[1].iov_base = const_cast<void *>(buf);
+  iov[1].iov_len = size;
+  struct iovec *cur = iov;
+  int remaining = 2;
+  while (true) {
+    ssize_t bytes_written = ::writev(m_socket_fd, cur, remaining);
+    if (bytes_written < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    // skip the buffers which were completely written
+    while (remaining &&
+           static_cast<size_t>(bytes_written) >= cur->iov_len) {
+      bytes_written -= cur->iov_len;
+      ++cur;
+      --remaining;
+    }
+    if (!remaining)
+      return true;
+    cur->iov_base = reinterpret_cast<char *>(cur->iov_base) + bytes_written;
+    cur->iov_len -= bytes_written;
+  }
+#endif
+}
+
 class AutoFreeAddrInfo {
  public:
   explicit AutoFreeAddrInfo(addrinfo *p) : m_p(p) {}
@@ -150,12 +189,117 @@ Socket::Socket(const std::string &address, int port)
   m_socket_fd = fd;
 }
 
+Socket::Socket(const std::string &path)
+    : m_address(path) {
+#ifdef WIN32
+  assert(false);
+  m_socket_fd = INVALID_SOCKET;
+#else
+  SOCKET fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  assert(fd != INVALID_SOCKET);
+
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+  // the server may not be listening yet
+  while (::connect(fd, reinterpret_cast<struct sockaddr *>(&address),
+                   sizeof(address)) == SOCKET_ERROR)
+    glretrace_delay(1);
+
+  m_socket_fd = fd;
+#endif
+}
+
 Socket::~Socket() {
+  if (m_socket_fd == INVALID_SOCKET)
+    // released
+    return;
   shutdown(m_socket_fd, SHUT_RDWR);
   closesocket(m_socket_fd);
 }
 
-ServerSocket::ServerSocket(int port) {
+void
+Socket::Release() {
+  closesocket(m_socket_fd);
+  m_socket_fd = INVALID_SOCKET;
+}
+
+void
+Socket::SetReadTimeout(int timeout_ms) {
+#ifdef WIN32
+  const DWORD timeout = timeout_ms;
+#else
+  struct timeval timeout;
+  timeout.tv_sec = timeout_ms / 1000;
+  timeout.tv_usec = (timeout_ms % 1000) * 1000;
+#endif
+  setsockopt(m_socket_fd, SOL_SOCKET, SO_RCVTIMEO,
+             reinterpret_cast<const char *>(&timeout), sizeof(timeout));
+}
+
+bool
+Socket::SendFd(int fd) {
+#ifdef WIN32
+  return false;
+#else
+  // a descriptor is passed as ancillary data, with a single byte
+  char byte = 0;
+  struct iovec iov;
+  iov.iov_base = &byte;
+  iov.iov_len = 1;
+  union {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE(sizeof(int))];
+  } control;
+  memset(&control, 0, sizeof(control));
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+  return (::sendmsg(m_socket_fd, &msg, 0) == 1);
+#endif
+}
+
+int
+Socket::ReceiveFd() {
+#ifdef WIN32
+  return -1;
+#else
+  char byte;
+  struct iovec iov;
+  iov.iov_base = &byte;
+  iov.iov_len = 1;
+  union {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE(sizeof(int))];
+  } control;
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+  if (::recvmsg(m_socket_fd, &msg, 0) != 1)
+    return -1;
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  if (!cmsg || cmsg->cmsg_level != SOL_SOCKET ||
+      cmsg->cmsg_type != SCM_RIGHTS)
+    return -1;
+  int fd;
+  memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+  return fd;
+#endif
+}
+
+ServerSocket::ServerSocket(int port, int backlog) {
   m_server_fd = socket(PF_INET, SOCK_STREAM, 0);
   assert(m_server_fd != -1);
 
@@ -181,16 +325,41 @@ ServerSocket::ServerSocket(int port) {
   assert(bind_result != SOCKET_ERROR);
   // todo raise on error
 
-  const int backlog = 1;  // single connection
   const int listen_result = listen(m_server_fd, backlog);
   assert(listen_result == 0);
   // todo raise on error
 }
 
+ServerSocket::ServerSocket(const std::string &path) : m_path(path) {
+#ifdef WIN32
+  assert(false);
+  m_server_fd = INVALID_SOCKET;
+#else
+  m_server_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  assert(m_server_fd != -1);
+
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+  // a stale socket, left by a server which did not exit cleanly
+  unlink(path.c_str());
+  const int bind_result = bind(m_server_fd,
+                               reinterpret_cast<struct sockaddr *>(&address),
+                               sizeof(address));
+  assert(bind_result != SOCKET_ERROR);
+  // todo raise on error
+
+  const int listen_result = listen(m_server_fd, 1);
+  assert(listen_result == 0);
+#endif
+}
+
 Socket *
 ServerSocket::Accept() {
   socklen_t client_addr_size = sizeof(struct sockaddr_in);
   struct sockaddr_in client_address;
+  memset(&client_address, 0, sizeof(client_address));
   SOCKET socket_fd = accept(m_server_fd, (struct sockaddr *) &client_address,
                             &client_addr_size);
 
@@ -200,11 +369,23 @@ ServerSocket::Accept() {
   // now that we have a connected server socket, we don't need to listen for
   // subsequent connections.
 
+  if (!m_path.empty())
+    // unix domain clients are on the same host
+    return new Socket(socket_fd, "localhost");
   return new Socket(socket_fd, inet_ntoa(client_address.sin_addr));
 }
 
 ServerSocket::~ServerSocket() {
   closesocket(m_server_fd);
+  Unlink();
+}
+
+void
+ServerSocket::Unlink() {
+#ifndef WIN32
+  if (!m_path.empty())
+    unlink(m_path.c_str());
+#endif
 }
 
 int
@@ -232,3 +413,40 @@ Socket::Cleanup() {
   WSACleanup();
 #endif
 }
+
+int
+SocketPoll::Add(const ServerSocket &server) {
+  m_fds.push_back(server.m_server_fd);
+  m_readable.push_back(false);
+  return m_fds.size() - 1;
+}
+
+int
+SocketPoll::Add(const Socket &sock) {
+  m_fds.push_back(sock.m_socket_fd);
+  m_readable.push_back(false);
+  return m_fds.size() - 1;
+}
+
+bool
+SocketPoll::Wait(int timeout_ms) {
+#ifdef WIN32
+  std::vector<WSAPOLLFD> fds(m_fds.size());
+#else
+  std::vector<struct pollfd> fds(m_fds.size());
+#endif
+  for (size_t i = 0; i < m_fds.size(); ++i) {
+    fds[i].fd = m_fds[i];
+    fds[i].events = POLLIN;
+    fds[i].revents = 0;
+  }
+#ifdef WIN32
+  const int ready = WSAPoll(fds.data(), fds.size(), timeout_ms);
+#else
+  const int ready = ::poll(fds.data(), fds.size(), timeout_ms);
+#endif
+  for (size_t i = 0; i < m_fds.size(); ++i)
+    m_readable[i] = ((ready > 0) &&
+                     (fds[i].revents & (POLLIN | POLLHUP | POLLERR)));
+  return ready > 0;
+}
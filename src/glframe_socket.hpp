@@ -28,6 +28,9 @@
 #ifndef OS_GFSOCKET_H_
 #define OS_GFSOCKET_H_
 
+#include <stdint.h>
+#include <string.h>
+
 #include <string>
 #include <vector>
 
@@ -42,6 +45,9 @@ class Socket : NoAssign, NoCopy, NoMove {
   // Client-side constructor: connects to server.  For server-side
   // sockets, use the ServerSocket class
   Socket(const std::string &address, int port);
+  // Client-side constructor for a unix domain socket, connecting to
+  // a server on the same host.  Not supported on windows.
+  explicit Socket(const std::string &path);
   ~Socket();
   static void Init();
   static void Cleanup();
@@ -58,11 +64,39 @@ class Socket : NoAssign, NoCopy, NoMove {
   template <typename T> bool WriteVec(const std::vector<T> &vec) {
     return Write(vec.data(), sizeof(T) * vec.size());
   }
+  // writes a leading 4 byte length and the buffer in a single call,
+  // without copying the buffer
+  bool WriteFrame(const void *buf, uint32_t size);
+  // Serializes a protobuf message behind its 4 byte length, in buf,
+  // which callers reuse across messages.  The frame is written in a
+  // single call.
+  template <typename T> bool WriteMessage(const T &msg,
+                                          std::vector<unsigned char> *buf) {
+    const uint32_t size = msg.ByteSizeLong();
+    buf->resize(sizeof(size) + size);
+    memcpy(buf->data(), &size, sizeof(size));
+    msg.SerializeWithCachedSizesToArray(buf->data() + sizeof(size));
+    return Write(buf->data(), buf->size());
+  }
 
   const std::string &Address() const { return m_address; }
 
+  // fails reads which wait longer than timeout_ms for data.  0 waits
+  // without limit.
+  void SetReadTimeout(int timeout_ms);
+
+  // closes the socket in this process, without shutting down the
+  // connection, which remains open in a forked process.
+  void Release();
+
+  // passes a file descriptor to the peer of a unix domain socket
+  bool SendFd(int fd);
+  // receives a descriptor passed with SendFd.  -1 on failure.
+  int ReceiveFd();
+
  private:
   friend class ServerSocket;
+  friend class SocketPoll;
   // this constructor only called by ServerSocket, when connection is
   // accepted.
   Socket(int fd, const std::string &address)
@@ -74,22 +108,52 @@ class Socket : NoAssign, NoCopy, NoMove {
   int m_socket_fd;
 };
 
-// ServerSocket class listens for a single connection, creating a
-// server side Socket object.  The intention is to have OS-specific
+// ServerSocket class listens for connections, creating a server side
+// Socket object for each.  The intention is to have OS-specific
 // implementations.
 class ServerSocket : NoAssign, NoCopy, NoMove {
  public:
-  // establishes a server, waits for a client to connect
-  explicit ServerSocket(int port);
+  // establishes a server, which queues up to backlog connections
+  // waiting to be accepted
+  explicit ServerSocket(int port, int backlog = 1);
+  // establishes a unix domain server, for a single client on the same
+  // host.  Not supported on windows.
+  explicit ServerSocket(const std::string &path);
   ~ServerSocket();
 
   Socket *Accept();
+  // removes the path of a unix domain server.  Connected clients are
+  // unaffected.
+  void Unlink();
 
   // if 0 is passed as port, to choose an unused ephemeral port, then the
   // chosen port can be retrieved with GetPort
   int GetPort() const;
  private:
+  friend class SocketPoll;
   int m_server_fd;
+  // unix domain sockets are removed with the server
+  const std::string m_path;
+};
+
+// Waits on several sockets at once, so that a server can serve many
+// clients without blocking on any one of them.
+class SocketPoll : NoAssign, NoCopy, NoMove {
+ public:
+  // Each returns the index of the socket, for Readable.  A server is
+  // readable when a connection can be accepted.
+  int Add(const ServerSocket &server);
+  int Add(const Socket &sock);
+
+  // waits up to timeout_ms, or without limit for -1, until data can
+  // be read from a socket.  Sockets whose client hung up are
+  // readable.  Returns false if no socket is readable.
+  bool Wait(int timeout_ms);
+  bool Readable(int index) const { return m_readable[index]; }
+
+ private:
+  std::vector<int> m_fds;
+  std::vector<bool> m_readable;
 };
 
 }  // namespace glretrace
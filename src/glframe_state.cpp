@@ -96,15 +96,18 @@ StateTrack::TrackMap::TrackMap() {
 
 bool
 StateTrack::TrackMap::track(StateTrack *tracker, const Call &call) {
-  auto resolve = lookup.find(call.sig->name);
-  if (resolve == lookup.end())
+  MemberFunType *funptr = by_signature.find(call.sig);
+  if (!funptr) {
+    auto resolve = lookup.find(call.sig->name);
+    funptr = &by_signature.insert(call.sig, resolve == lookup.end() ?
+                                  NULL : resolve->second);
+  }
+  if (!*funptr)
     return false;
-  MemberFunType funptr = resolve->second;
-  (tracker->*funptr)(call);
+  (tracker->*(*funptr))(call);
   return true;
 }
 
-// TODO(majanes): use a lookup table
 void
 StateTrack::track(const Call &call) {
   if (lookup.track(this, call)) {
@@ -34,6 +34,7 @@
 #include <string>
 #include <vector>
 
+#include "glframe_call_class.hpp"
 #include "glframe_retrace_interface.hpp"
 #include "retrace.hpp"
 
@@ -123,6 +124,9 @@ class StateTrack {
    private:
     typedef void (glretrace::StateTrack::*MemberFunType)(const trace::Call&);
     std::map <std::string, MemberFunType> lookup;
+    // resolved handler for each signature, NULL if the call is not
+    // tracked
+    SignatureTable<MemberFunType> by_signature;
   };
   static TrackMap lookup;
   class ProgramKey {
@@ -0,0 +1,258 @@
+/**************************************************************************
+ *
+ * Copyright 2019 Intel Corporation
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * Authors:
+ *   Mark Janes <mark.a.janes@intel.com>
+ **************************************************************************/
+
+#include "glframe_trace_hash.hpp"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "glframe_os.hpp"
+#include "glframe_thread.hpp"
+#include "md5.h"  // NOLINT
+
+using glretrace::Thread;
+using glretrace::application_cache_directory;
+using glretrace::glretrace_fseek;
+using glretrace::glretrace_pid;
+using glretrace::glretrace_stat;
+
+namespace {
+
+const uint64_t kChunkSize = 64 * 1024 * 1024;
+const size_t kReadSize = 1024 * 1024;
+const size_t kDigestSize = 16;
+// memoized hashes, of the most recently opened traces
+const size_t kMaxMemoEntries = 256;
+
+// hashes chunks of the trace until there are none left
+class ChunkHasher : public Thread {
+ public:
+  ChunkHasher(const std::string &path,
+              std::atomic<uint64_t> *next_chunk,
+              std::vector<unsigned char> *digests)
+      : Thread("trace_hash"),
+        m_path(path),
+        m_next_chunk(next_chunk),
+        m_digests(digests),
+        m_success(true) {}
+  virtual void Run() {
+    FILE *fh = fopen(m_path.c_str(), "rb");
+    if (!fh) {
+      m_success = false;
+      return;
+    }
+    std::vector<unsigned char> buf(kReadSize);
+    while (true) {
+      const uint64_t chunk = m_next_chunk->fetch_add(1);
+      if (chunk >= m_digests->size() / kDigestSize)
+        break;
+      if (glretrace_fseek(fh, chunk * kChunkSize, SEEK_SET) != 0) {
+        m_success = false;
+        break;
+      }
+      struct MD5Context md5c;
+      _MD5Init(&md5c);
+      uint64_t remaining = kChunkSize;
+      while (remaining) {
+        const size_t bytes = fread(buf.data(), 1,
+                                   std::min<uint64_t>(remaining, kReadSize),
+                                   fh);
+        if (bytes == 0)
+          break;
+        _MD5Update(&md5c, buf.data(), bytes);
+        remaining -= bytes;
+      }
+      if (ferror(fh))
+        m_success = false;
+      _MD5Final(m_digests->data() + chunk * kDigestSize, &md5c);
+    }
+    fclose(fh);
+  }
+  bool success() const { return m_success; }
+
+ private:
+  const std::string m_path;
+  std::atomic<uint64_t> *m_next_chunk;
+  std::vector<unsigned char> *m_digests;
+  bool m_success;
+};
+
+bool
+compute_hash(const std::string &path, uint64_t size,
+             std::vector<unsigned char> *hash) {
+  const uint64_t chunks = (size + kChunkSize - 1) / kChunkSize;
+  std::vector<unsigned char> digests(chunks * kDigestSize);
+  std::atomic<uint64_t> next_chunk(0);
+  const size_t threads = std::max<size_t>(
+      1, std::min<uint64_t>(std::thread::hardware_concurrency(), chunks));
+  std::vector<ChunkHasher *> hashers;
+  for (size_t i = 0; i < threads; ++i) {
+    hashers.push_back(new ChunkHasher(path, &next_chunk, &digests));
+    hashers.back()->Start();
+  }
+  bool success = true;
+  for (auto hasher : hashers) {
+    hasher->Join();
+    success &= hasher->success();
+    delete hasher;
+  }
+  if (!success)
+    return false;
+
+  // the md5 of the size, followed by the digests of the chunks
+  unsigned char size_bytes[sizeof(size)];
+  for (size_t i = 0; i < sizeof(size); ++i)
+    size_bytes[i] = (size >> (8 * i)) & 0xff;
+  struct MD5Context md5c;
+  _MD5Init(&md5c);
+  _MD5Update(&md5c, size_bytes, sizeof(size_bytes));
+  _MD5Update(&md5c, digests.data(), digests.size());
+  hash->resize(kDigestSize);
+  _MD5Final(hash->data(), &md5c);
+  return true;
+}
+
+// Each line of the memo holds the size, modification time, and hash
+// of a trace, followed by its path.
+struct MemoEntry {
+  uint64_t size;
+  int64_t mtime;
+  std::string hash;
+  std::string path;
+};
+
+std::string
+memo_path() {
+  return application_cache_directory() + "trace_hashes";
+}
+
+std::vector<MemoEntry>
+read_memo() {
+  std::vector<MemoEntry> entries;
+  std::ifstream memo(memo_path());
+  std::string line;
+  while (std::getline(memo, line)) {
+    std::stringstream line_s(line);
+    MemoEntry entry;
+    if (!(line_s >> entry.size >> entry.mtime >> entry.hash))
+      continue;
+    line_s.get();
+    std::getline(line_s, entry.path);
+    entries.push_back(entry);
+  }
+  return entries;
+}
+
+void
+write_memo(const std::vector<MemoEntry> &entries) {
+  // other processes read the memo while it is written
+  std::stringstream tmp_s;
+  tmp_s << memo_path() << "." << glretrace_pid();
+  const std::string tmp_path = tmp_s.str();
+  {
+    std::ofstream memo(tmp_path);
+    for (const auto &entry : entries)
+      memo << entry.size << " " << entry.mtime << " " << entry.hash
+           << " " << entry.path << "\n";
+    if (!memo)
+      return;
+  }
+  if (rename(tmp_path.c_str(), memo_path().c_str()) != 0)
+    remove(tmp_path.c_str());
+}
+
+std::string
+to_hex(const std::vector<unsigned char> &bytes) {
+  static const char digits[] = "0123456789abcdef";
+  std::string hex;
+  for (auto byte : bytes) {
+    hex += digits[byte >> 4];
+    hex += digits[byte & 0xf];
+  }
+  return hex;
+}
+
+bool
+from_hex(const std::string &hex, std::vector<unsigned char> *bytes) {
+  if (hex.size() % 2)
+    return false;
+  bytes->clear();
+  for (size_t i = 0; i < hex.size(); i += 2) {
+    unsigned int byte;
+    if (sscanf(hex.c_str() + i, "%2x", &byte) != 1)
+      return false;
+    bytes->push_back(byte);
+  }
+  return true;
+}
+
+// serializes updates of the memo within the process
+std::mutex memo_protect;
+
+}  // namespace
+
+bool
+glretrace::trace_hash(const std::string &path,
+                      std::vector<unsigned char> *hash,
+                      uint64_t *size) {
+  int64_t mtime;
+  if (!glretrace_stat(path, size, &mtime))
+    return false;
+
+  std::lock_guard<std::mutex> l(memo_protect);
+  std::vector<MemoEntry> entries = read_memo();
+  for (const auto &entry : entries) {
+    if (entry.path == path && entry.size == *size &&
+        entry.mtime == mtime && entry.hash.size() == 2 * kDigestSize &&
+        from_hex(entry.hash, hash))
+      return true;
+  }
+
+  if (!compute_hash(path, *size, hash))
+    return false;
+
+  // the most recent entry is last
+  std::vector<MemoEntry> updated;
+  for (const auto &entry : entries) {
+    if (entry.path != path)
+      updated.push_back(entry);
+  }
+  if (updated.size() >= kMaxMemoEntries)
+    updated.erase(updated.begin(),
+                  updated.end() - (kMaxMemoEntries - 1));
+  updated.push_back({*size, mtime, to_hex(*hash), path});
+  write_memo(updated);
+  return true;
+}
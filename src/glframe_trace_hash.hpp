@@ -0,0 +1,50 @@
+/**************************************************************************
+ *
+ * Copyright 2019 Intel Corporation
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * Authors:
+ *   Mark Janes <mark.a.janes@intel.com>
+ **************************************************************************/
+
+#ifndef _GLFRAME_TRACE_HASH_HPP_
+#define _GLFRAME_TRACE_HASH_HPP_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+namespace glretrace {
+
+// Identifies a trace in the cache of a retrace server.  The trace is
+// read in chunks, which are hashed with md5 in parallel, and the hash
+// is the md5 of the size of the trace and the chunk digests.  Hashes
+// are memoized by path, modification time and size, so a trace which
+// was opened before is not read again.  false if the trace cannot be
+// read.
+bool trace_hash(const std::string &path,
+                std::vector<unsigned char> *hash,
+                uint64_t *size);
+
+}  // namespace glretrace
+
+#endif  // _GLFRAME_TRACE_HASH_HPP_
@@ -30,52 +30,149 @@
 
 #include <getopt.h>
 #include <signal.h>
+#include <stdio.h>
+
+#include <string>
 
 #include "glframe_glhelper.hpp"
 #include "glframe_logger.hpp"
+#include "glframe_retrace.hpp"
 #include "glframe_retrace_skeleton.hpp"
+#include "glframe_session_server.hpp"
 #include "glframe_socket.hpp"
 #include "glretrace.hpp"
 
+using glretrace::FrameRetrace;
 using glretrace::FrameRetraceSkeleton;
 using glretrace::GlFunctions;
 using glretrace::Logger;
 using glretrace::ServerSocket;
+using glretrace::SessionServer;
 using glretrace::Socket;
 
-int parse_args(int argc, char *argv[]) {
-  int opt;
+struct ServerOptions {
+  ServerOptions() : port(24642),
+                    fast_forward(glretrace::FULL_REPLAY),
+                    checkpoint(false),
+                    multi_session(false),
+                    memory_limit_mb(0) {}
+  int port;
+  glretrace::FastForwardMode fast_forward;
+  bool checkpoint;
+  bool multi_session;
+  unsigned int memory_limit_mb;
+  // unix domain socket, for a client on the same host
+  std::string path;
+};
 
-  while ((opt = getopt(argc, argv, "p:h")) != -1) {
+void parse_args(int argc, char *argv[], ServerOptions *options) {
+  int opt;
+  while ((opt = getopt(argc, argv, "p:csvml:u:h")) != -1) {
     switch (opt) {
       case 'p':
-        return atoi(optarg);
+        options->port = atoi(optarg);
+        break;
+      case 'c':
+        options->checkpoint = true;
+        break;
+      case 's':
+        options->fast_forward = glretrace::SKIP_DRAWS;
+        break;
+      case 'v':
+        options->fast_forward = glretrace::VALIDATE_SKIP_DRAWS;
+        break;
+      case 'm':
+        options->multi_session = true;
+        break;
+      case 'l':
+        options->memory_limit_mb = atoi(optarg);
+        break;
+      case 'u':
+        options->path = optarg;
+        break;
       case 'h':
       default: /* '?' */
-        printf("USAGE: frameretrace_server [-p port]\n"
-               "\tdefault port: 24642");
+        printf("USAGE: frameretrace_server [-p port] [-c] [-s] [-v] "
+               "[-m [-l MB]] [-u path]\n"
+               "\tdefault port: 24642\n"
+               "\t-c: store checkpoints for fast reopen of frames\n"
+               "\t-s: skip draws when replaying to the target frame\n"
+               "\t-v: skip draws, validating against a full replay\n"
+               "\t-m: serve many clients, each in a worker process\n"
+               "\t-l: limit the heap of each worker, in megabytes\n"
+               "\t-u: serve a client on this host, through a unix "
+               "domain socket\n");
         break;
     }
   }
-  return 24642;
 }
 
+void
+begin_process() {
+  Logger::Create();
+  Logger::SetSeverity(glretrace::INFO);
+  Logger::Begin();
+  GlFunctions::Init();
+}
+
+void
+serve_session(Socket *sock, Socket *cancel_sock,
+              const ServerOptions &options) {
+  FrameRetraceSkeleton skel(sock, cancel_sock,
+                            new FrameRetrace(options.fast_forward,
+                                             options.checkpoint));
+  skel.Run();
+}
+
+// Serves each client in a forked worker.  Returns in the worker,
+// after its session ends.
+void
+serve_sessions(const ServerOptions &options) {
+  SessionServer server(options.port, options.memory_limit_mb);
+  Socket *sock, *cancel_sock;
+  while (!server.AcceptSession(&sock, &cancel_sock))
+    continue;
+  // replaces the supervisor's logger, with one for the session
+  Logger::Destroy();
+  begin_process();
+  GRLOGF(glretrace::WARN, "session client: %s", sock->Address().c_str());
+  serve_session(sock, cancel_sock, options);
+  Logger::Destroy();
+}
 
 int main(int argc, char *argv[]) {
   // signal(SIGHUP, SIG_IGN);
   GOOGLE_PROTOBUF_VERIFY_VERSION;
-  GlFunctions::Init();
-  Logger::Create();
-  Logger::SetSeverity(glretrace::INFO);
-  Logger::Begin();
   Socket::Init();
-  int port = parse_args(argc, argv);
+  ServerOptions options;
+  parse_args(argc, argv, &options);
   // port = 53135;
-  GRLOGF(glretrace::WARN, "server port: %d", port);
-  ServerSocket sock(port), cancel_sock(port + 1);
-  FrameRetraceSkeleton skel(sock.Accept(), cancel_sock.Accept());
-  skel.Run();
+  if (options.multi_session) {
+    // the logger thread does not survive a fork, so the supervisor
+    // does not start it.  Each worker logs for its own session.
+    Logger::Create();
+    Logger::SetSeverity(glretrace::INFO);
+    Logger::EnableStderr();
+    GRLOGF(glretrace::WARN, "server port: %d", options.port);
+    serve_sessions(options);
+  } else if (!options.path.empty()) {
+    begin_process();
+    GRLOGF(glretrace::WARN, "server path: %s", options.path.c_str());
+    ServerSocket sock(options.path), cancel_sock(options.path + ".cancel");
+    Socket *s = sock.Accept(), *c = cancel_sock.Accept();
+    // the paths are not needed after the client connects, and are not
+    // left behind if the server is killed
+    sock.Unlink();
+    cancel_sock.Unlink();
+    serve_session(s, c, options);
+    Logger::Destroy();
+  } else {
+    begin_process();
+    GRLOGF(glretrace::WARN, "server port: %d", options.port);
+    ServerSocket sock(options.port), cancel_sock(options.port + 1);
+    serve_session(sock.Accept(), cancel_sock.Accept(), options);
+    Logger::Destroy();
+  }
   Socket::Cleanup();
-  Logger::Destroy();
   return 0;
 }
@@ -27,23 +27,39 @@
 
 #include <gtest/gtest.h>
 
+#include <stdio.h>
+
 #include <map>
+#include <sstream>
 #include <vector>
 #include <string>
 
 #include "glws.hpp"
 
+#include "glframe_checkpoint.hpp"
+#include "glframe_frame_index.hpp"
+#include "glframe_frame_pack.hpp"
 #include "glframe_glhelper.hpp"
 #include "glframe_logger.hpp"
+#include "glframe_os.hpp"
+#include "glframe_render_target_cache.hpp"
 #include "glframe_retrace.hpp"
 #include "glframe_retrace_skeleton.hpp"
 #include "glframe_retrace_stub.hpp"
 #include "glframe_socket.hpp"
+#include "glframe_trim.hpp"
 #include "retrace_test.hpp"
+#include "trace_dump.hpp"
+#include "trace_parser.hpp"
 
 using glretrace::ErrorSeverity;
 using glretrace::ExperimentId;
+using glretrace::FrameCheckpoint;
+using glretrace::FrameIndex;
+using glretrace::FramePackParser;
+using glretrace::FramePackWriter;
 using glretrace::FrameRetrace;
+using glretrace::FrameState;
 using glretrace::GlFunctions;
 using glretrace::Logger;
 using glretrace::MetricId;
@@ -52,6 +68,7 @@ using glretrace::OnFrameRetrace;
 using glretrace::RenderId;
 using glretrace::RenderSelection;
 using glretrace::RenderSequence;
+using glretrace::RenderTargetCache;
 using glretrace::RenderTargetType;
 using glretrace::SelectionId;
 using glretrace::ShaderAssembly;
@@ -60,6 +77,9 @@ using glretrace::TextureData;
 using glretrace::TextureKey;
 using glretrace::UniformDimension;
 using glretrace::UniformType;
+using glretrace::application_cache_directory;
+using glretrace::glretrace_pid;
+using glretrace::trim_frames;
 
 TEST(Build, Cmake) {
 }
@@ -70,7 +90,9 @@ class NullCallback : public OnFrameRetrace {
  public:
   void onFileOpening(bool needUpload,
                      bool finished,
-                     uint32_t frame_count) {}
+                     uint32_t frame_count) {
+    opened_frame = frame_count;
+  }
   void onGLError(uint32_t frame_count,
                  const std::string &err,
                  const std::string &call_str) { assert(false); }
@@ -91,6 +113,7 @@ class NullCallback : public OnFrameRetrace {
                       const std::string &label,
                       const uvec & pngImageData) {
     ++renderTargetCount;
+    images.push_back(pngImageData);
   }
   void onShaderCompile(RenderId renderId, ExperimentId count,
                        bool status,
@@ -147,7 +170,8 @@ class NullCallback : public OnFrameRetrace {
 
   NullCallback() : renderTargetCount(0),
                    textureCallBacks(0),
-                   file_error(false) {}
+                   file_error(false),
+                   opened_frame(0) {}
 
   int renderTargetCount;
   int textureCallBacks;
@@ -158,6 +182,8 @@ class NullCallback : public OnFrameRetrace {
   bool file_error;
   TextureKey saved_binding;
   std::vector<TextureData> saved_images;
+  std::vector<uvec> images;
+  uint32_t opened_frame;
 };
 
 void
@@ -218,6 +244,28 @@ TEST_F(RetraceTest, LoadFile) {
   EXPECT_EQ(cb.renderTargetCount, 3);
 }
 
+TEST_F(RetraceTest, FrameIndex) {
+  FrameIndex scanned;
+  ASSERT_TRUE(scanned.open(test_file));
+  ASSERT_GT(scanned.frameCount(), 7u);
+  EXPECT_EQ(scanned.renderCount(7, 1), 2);  // 1 for clear, 1 for draw
+
+  // the stored index is loaded without scanning
+  FrameIndex loaded;
+  ASSERT_TRUE(loaded.openStored(test_file));
+  ASSERT_EQ(loaded.frameCount(), scanned.frameCount());
+  for (uint32_t f = 0; f < loaded.frameCount(); ++f) {
+    EXPECT_EQ(loaded.frame(f).begin.next_call_no,
+              scanned.frame(f).begin.next_call_no);
+    EXPECT_EQ(loaded.frame(f).end.next_call_no,
+              scanned.frame(f).end.next_call_no);
+    EXPECT_EQ(loaded.frame(f).call_count, scanned.frame(f).call_count);
+  }
+
+  FrameState state(test_file, 7, 1);
+  EXPECT_EQ(state.getRenderCount(), 2);
+}
+
 TEST_F(RetraceTest, ReplaceShaders) {
   NullCallback cb;
   FrameRetrace rt;
@@ -393,3 +441,253 @@ TEST_F(RetraceTest, TextureStub) {
   stub.Shutdown();
   skel.Join();
 }
+
+TEST(RenderTargetCache, FindInsertClear) {
+  RenderTargetCache cache(10);
+  EXPECT_EQ(cache.find(RenderId(1), glretrace::DEFAULT_RENDER), nullptr);
+  std::vector<RenderTargetCache::Image> images(1);
+  images[0].label = "attachment 0";
+  images[0].png.resize(4);
+  cache.insert(RenderId(1), glretrace::DEFAULT_RENDER, &images);
+  const auto found = cache.find(RenderId(1), glretrace::DEFAULT_RENDER);
+  ASSERT_NE(found, nullptr);
+  EXPECT_EQ((*found)[0].label, "attachment 0");
+  // options are part of the key
+  EXPECT_EQ(cache.find(RenderId(1), glretrace::STOP_AT_RENDER), nullptr);
+
+  // exceeding the budget releases the least recently used images
+  images.resize(1);
+  images[0].png.resize(4);
+  cache.insert(RenderId(2), glretrace::DEFAULT_RENDER, &images);
+  cache.find(RenderId(1), glretrace::DEFAULT_RENDER);
+  images.resize(1);
+  images[0].png.resize(4);
+  cache.insert(RenderId(3), glretrace::DEFAULT_RENDER, &images);
+  EXPECT_NE(cache.find(RenderId(1), glretrace::DEFAULT_RENDER), nullptr);
+  EXPECT_EQ(cache.find(RenderId(2), glretrace::DEFAULT_RENDER), nullptr);
+  EXPECT_NE(cache.find(RenderId(3), glretrace::DEFAULT_RENDER), nullptr);
+
+  cache.clear();
+  EXPECT_EQ(cache.find(RenderId(1), glretrace::DEFAULT_RENDER), nullptr);
+}
+
+TEST_F(RetraceTest, RenderTargetCache) {
+  retrace::setUp();
+  GlFunctions::Init();
+
+  NullCallback cb;
+  FrameRetrace rt;
+  get_md5(test_file, &md5, &fileSize);
+  rt.openFile(test_file, md5, fileSize, 7, 1, &cb);
+  if (cb.file_error)
+    return;
+  RenderSelection s;
+  s.id = SelectionId(0);
+  s.series.push_back(RenderSequence(RenderId(1), RenderId(2)));
+  rt.retraceRenderTarget(ExperimentId(0), s, glretrace::NORMAL_RENDER,
+                         glretrace::DEFAULT_RENDER, &cb);
+  ASSERT_GT(cb.images.size(), 0);
+  const auto frame_images = cb.images;
+
+  // an unchanged frame is served from the cache, including for
+  // STOP_AT_RENDER at the end of the render target region
+  cb.images.clear();
+  rt.retraceRenderTarget(ExperimentId(0), s, glretrace::NORMAL_RENDER,
+                         glretrace::DEFAULT_RENDER, &cb);
+  EXPECT_EQ(cb.images, frame_images);
+  cb.images.clear();
+  rt.retraceRenderTarget(ExperimentId(0), s, glretrace::NORMAL_RENDER,
+                         glretrace::STOP_AT_RENDER, &cb);
+  EXPECT_EQ(cb.images, frame_images);
+
+  // experiments invalidate the cached images
+  rt.disableDraw(s, true);
+  cb.images.clear();
+  rt.retraceRenderTarget(ExperimentId(1), s, glretrace::NORMAL_RENDER,
+                         glretrace::DEFAULT_RENDER, &cb);
+  EXPECT_NE(cb.images, frame_images);
+  rt.disableDraw(s, false);
+  cb.images.clear();
+  rt.retraceRenderTarget(ExperimentId(2), s, glretrace::NORMAL_RENDER,
+                         glretrace::DEFAULT_RENDER, &cb);
+  EXPECT_EQ(cb.images, frame_images);
+
+  // as do shader edits.  This vertex shader flips the image.
+  rt.retraceShaderAssembly(s, ExperimentId(2), &cb);
+  ASSERT_GT(cb.fs.size(), 0);
+  std::string vs("attribute vec2 coord2d;\n"
+                 "varying vec2 v_TexCoordinate;\n"
+                 "void main(void) {\n"
+                 "  gl_Position = vec4(coord2d.x, -1.0 * coord2d.y, 0, 1);\n"
+                 "  v_TexCoordinate = vec2(coord2d.x, coord2d.y);\n"
+                 "}\n");
+  rt.replaceShaders(RenderId(1), ExperimentId(3), vs, cb.fs.back(),
+                    "", "", "", "", &cb);
+  EXPECT_EQ(cb.compile_error.size(), 0);
+  cb.images.clear();
+  rt.retraceRenderTarget(ExperimentId(3), s, glretrace::NORMAL_RENDER,
+                         glretrace::DEFAULT_RENDER, &cb);
+  EXPECT_NE(cb.images, frame_images);
+}
+
+TEST_F(RetraceTest, TrimFrame) {
+  FrameIndex index;
+  ASSERT_TRUE(index.open(test_file));
+  std::stringstream trimmed_s;
+  trimmed_s << application_cache_directory() << "trim-" << glretrace_pid()
+            << ".trace";
+  const std::string trimmed = trimmed_s.str();
+  size_t retained;
+  ASSERT_TRUE(trim_frames(index, test_file, 7, 1, trimmed, &retained));
+  EXPECT_LT(retained, index.frame(7).begin.next_call_no);
+
+  // frame 7 is frame 1 of the trimmed trace, following the retained
+  // prefix and its frame terminator
+  NullCallback full_cb, trimmed_cb;
+  int full_renders, trimmed_renders;
+  {
+    FrameRetrace rt;
+    get_md5(test_file, &md5, &fileSize);
+    rt.openFile(test_file, md5, fileSize, 7, 1, &full_cb);
+    ASSERT_FALSE(full_cb.file_error);
+    full_renders = rt.getRenderCount();
+    RenderSelection s;
+    s.id = SelectionId(0);
+    s.series.push_back(RenderSequence(RenderId(0), RenderId(full_renders)));
+    rt.retraceRenderTarget(ExperimentId(0), s, glretrace::NORMAL_RENDER,
+                           glretrace::DEFAULT_RENDER, &full_cb);
+  }
+  {
+    FrameRetrace rt;
+    get_md5(trimmed, &md5, &fileSize);
+    rt.openFile(trimmed, md5, fileSize, 1, 1, &trimmed_cb);
+    ASSERT_FALSE(trimmed_cb.file_error);
+    trimmed_renders = rt.getRenderCount();
+    RenderSelection s;
+    s.id = SelectionId(0);
+    s.series.push_back(RenderSequence(RenderId(0),
+                                      RenderId(trimmed_renders)));
+    rt.retraceRenderTarget(ExperimentId(0), s, glretrace::NORMAL_RENDER,
+                           glretrace::DEFAULT_RENDER, &trimmed_cb);
+  }
+  EXPECT_EQ(trimmed_renders, full_renders);
+  ASSERT_GT(full_cb.images.size(), 0);
+  EXPECT_EQ(trimmed_cb.images, full_cb.images);
+  remove(trimmed.c_str());
+}
+
+TEST_F(RetraceTest, Checkpoint) {
+  get_md5(test_file, &md5, &fileSize);
+  FrameCheckpoint checkpoint(md5, 7, 1, false);
+  remove(checkpoint.path().c_str());
+
+  // the first open replays the trace, and records the checkpoint
+  NullCallback full_cb, checkpoint_cb;
+  int full_renders, checkpoint_renders;
+  {
+    FrameRetrace rt(glretrace::FULL_REPLAY, true);
+    rt.openFile(test_file, md5, fileSize, 7, 1, &full_cb);
+    ASSERT_FALSE(full_cb.file_error);
+    full_renders = rt.getRenderCount();
+    RenderSelection s;
+    s.id = SelectionId(0);
+    s.series.push_back(RenderSequence(RenderId(0), RenderId(full_renders)));
+    rt.retraceRenderTarget(ExperimentId(0), s, glretrace::NORMAL_RENDER,
+                           glretrace::DEFAULT_RENDER, &full_cb);
+    rt.retraceApi(s, &full_cb);
+  }
+  ASSERT_TRUE(checkpoint.exists());
+
+  // the second open replays the checkpoint, and reports frames of the
+  // original trace
+  {
+    FrameRetrace rt(glretrace::FULL_REPLAY, true);
+    rt.openFile(test_file, md5, fileSize, 7, 1, &checkpoint_cb);
+    ASSERT_FALSE(checkpoint_cb.file_error);
+    checkpoint_renders = rt.getRenderCount();
+    RenderSelection s;
+    s.id = SelectionId(0);
+    s.series.push_back(RenderSequence(RenderId(0),
+                                      RenderId(checkpoint_renders)));
+    rt.retraceRenderTarget(ExperimentId(0), s, glretrace::NORMAL_RENDER,
+                           glretrace::DEFAULT_RENDER, &checkpoint_cb);
+    rt.retraceApi(s, &checkpoint_cb);
+  }
+  EXPECT_EQ(full_cb.opened_frame, 7u);
+  EXPECT_EQ(checkpoint_cb.opened_frame, 7u);
+  EXPECT_EQ(checkpoint_renders, full_renders);
+  ASSERT_GT(full_cb.images.size(), 0);
+  EXPECT_EQ(checkpoint_cb.images, full_cb.images);
+  // the api text holds the call numbers of the original trace
+  ASSERT_GT(full_cb.calls.size(), 0);
+  EXPECT_EQ(checkpoint_cb.calls, full_cb.calls);
+  remove(checkpoint.path().c_str());
+  remove((checkpoint.path() + ".callnos").c_str());
+}
+
+// concatenates the contents of the blob arguments of the call
+std::string
+blob_contents(const trace::Call &call) {
+  std::string contents;
+  for (auto &arg : call.args) {
+    auto blob = dynamic_cast<const trace::Blob *>(arg.value);
+    if (blob)
+      contents.append(blob->buf, blob->size);
+  }
+  return contents;
+}
+
+// dumps the call, with the contents of its blobs
+std::string
+dump_call(trace::Call *call) {
+  std::stringstream call_s;
+  trace::dump(*call, call_s, trace::DUMP_FLAG_NO_COLOR);
+  return call_s.str() + blob_contents(*call);
+}
+
+TEST(FramePack, WriteRead) {
+  std::stringstream pack_s;
+  pack_s << application_cache_directory() << "pack-" << glretrace_pid()
+         << ".framepack";
+  const std::string pack_path = pack_s.str();
+
+  std::vector<std::string> expected, expected_blobs;
+  {
+    trace::Parser parser;
+    ASSERT_TRUE(parser.open(test_file));
+    FramePackWriter writer;
+    while (trace::Call *call = parser.parse_call()) {
+      writer.write(*call);
+      expected.push_back(dump_call(call));
+      expected_blobs.push_back(blob_contents(*call));
+      delete call;
+    }
+    ASSERT_TRUE(writer.commit(pack_path, parser.getVersion(),
+                              parser.getProperties()));
+  }
+  ASSERT_GT(expected.size(), 0);
+
+  FramePackParser pack;
+  ASSERT_TRUE(pack.open(pack_path.c_str()));
+  std::vector<std::string> calls;
+  while (trace::Call *call = pack.parse_call()) {
+    calls.push_back(dump_call(call));
+    delete call;
+  }
+  EXPECT_EQ(calls, expected);
+
+  // blobs own their data, and remain valid after the pack is closed
+  trace::ParseBookmark start;
+  start.offset.chunk = 0;
+  pack.setBookmark(start);
+  std::vector<trace::Call *> retained;
+  while (trace::Call *call = pack.parse_call())
+    retained.push_back(call);
+  pack.close();
+  ASSERT_EQ(retained.size(), expected_blobs.size());
+  for (size_t i = 0; i < retained.size(); ++i) {
+    EXPECT_EQ(blob_contents(*retained[i]), expected_blobs[i]);
+    delete retained[i];
+  }
+  remove(pack_path.c_str());
+}
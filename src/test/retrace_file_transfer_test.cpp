@@ -27,6 +27,12 @@
 
 #include <gtest/gtest.h>
 
+#ifndef WIN32
+#include <sys/stat.h>
+#endif
+
+#include <iomanip>
+#include <sstream>
 #include <string>
 #include <vector>
 
@@ -35,6 +41,7 @@
 #include "glframe_retrace_skeleton.hpp"
 #include "glframe_retrace_stub.hpp"
 #include "glframe_socket.hpp"
+#include "glframe_trace_hash.hpp"
 #include "retrace_test.hpp"
 
 using glretrace::ErrorSeverity;
@@ -53,6 +60,7 @@ using glretrace::RenderOptions;
 using glretrace::RenderSelection;
 using glretrace::RenderTargetType;
 using glretrace::SelectionId;
+using glretrace::Semaphore;
 using glretrace::ServerSocket;
 using glretrace::ShaderAssembly;
 using glretrace::StateKey;
@@ -61,6 +69,7 @@ using glretrace::TextureKey;
 using glretrace::TextureData;
 using glretrace::UniformDimension;
 using glretrace::UniformType;
+using glretrace::trace_hash;
 
 class FileTransfer : public IFrameRetrace {
   void openFile(const std::string &filename,
@@ -84,6 +93,7 @@ class FileTransfer : public IFrameRetrace {
                       OnFrameRetrace *callback) const {}
   virtual void retraceAllMetrics(const RenderSelection &selection,
                                  ExperimentId experimentCount,
+                                 MetricAggregation aggregation,
                                  OnFrameRetrace *callback) const {}
   void replaceShaders(RenderId renderId,
                       ExperimentId experimentCount,
@@ -126,6 +136,11 @@ class FileTransfer : public IFrameRetrace {
   void retraceTextures(const RenderSelection &selection,
                        ExperimentId experimentCount,
                        OnFrameRetrace *callback) {}
+  void retraceViews(const RenderSelection &selection,
+                    ExperimentId experimentCount,
+                    uint32_t views,
+                    OnFrameRetrace *callback) {}
+  void setMetricRepetitions(uint32_t repetitions) {}
   void revertExperiments() {}
   void cancel(SelectionId selectionCount,
               ExperimentId experimentCount) {}
@@ -133,11 +148,12 @@ class FileTransfer : public IFrameRetrace {
 
 class FileTransferCB : public OnFrameRetrace {
  public:
-  FileTransferCB() : m_needUpload(false) {}
+  FileTransferCB() : m_needUpload(false), m_opened(false) {}
   void onFileOpening(bool needUpload,
                      bool finished,
                      uint32_t frame_count) {
     m_needUpload |= needUpload;
+    m_opened = true;
   }
   void onGLError(uint32_t frame_count,
                  const std::string &err,
@@ -170,7 +186,9 @@ class FileTransferCB : public OnFrameRetrace {
              const std::vector<std::string> &api_calls,
              const std::vector<uint32_t> &error_indices,
              const std::vector<std::string> &errors) {}
-  void onError(ErrorSeverity s, const std::string &message) {}
+  void onError(ErrorSeverity s, const std::string &message) {
+    m_errors.push_back(message);
+  }
   void onBatch(SelectionId selectionCount,
                ExperimentId experimentCount,
                RenderId renderId,
@@ -195,7 +213,8 @@ class FileTransferCB : public OnFrameRetrace {
                  RenderId renderId,
                  TextureKey binding,
                  const std::vector<TextureData> &images) {}
-  bool m_needUpload;
+  bool m_needUpload, m_opened;
+  std::vector<std::string> m_errors;
 };
 
 static const char *test_file = CMAKE_CURRENT_SOURCE_DIR "/simple.trace";
@@ -217,6 +236,35 @@ bool exists(const char *f) {
   return true;
 }
 
+std::vector<unsigned char>
+read_file(const std::string &path) {
+  std::vector<unsigned char> data;
+  FILE * fh = fopen(path.c_str(), "rb");
+  if (!fh)
+    return data;
+  unsigned char buf[4096];
+  size_t bytes;
+  while ((bytes = fread(buf, 1, sizeof(buf), fh)) > 0)
+    data.insert(data.end(), buf, buf + bytes);
+  fclose(fh);
+  return data;
+}
+
+// the server caches uploaded traces by their trace_hash
+std::string
+cache_path(const std::string &trace) {
+  std::vector<unsigned char> hash;
+  uint64_t size;
+  EXPECT_TRUE(trace_hash(trace, &hash, &size));
+  std::stringstream cache_file_s;
+  cache_file_s << glretrace::application_cache_directory() << "tree_"
+               << std::hex << std::setfill('0');
+  for (auto byte : hash)
+    cache_file_s << std::setw(2) << static_cast<unsigned int>(byte);
+  cache_file_s << ".trace";
+  return cache_file_s.str();
+}
+
 TEST(FrameRetrace, MD5) {
   std::vector<unsigned char> md5, md5b;
   uint32_t fileSize, fileSizeb;
@@ -226,6 +274,17 @@ TEST(FrameRetrace, MD5) {
   EXPECT_EQ(fileSize, fileSizeb);
 }
 
+TEST(FrameRetrace, TraceHash) {
+  std::vector<unsigned char> hash, memoized;
+  uint64_t size = 0, memoized_size = 0;
+  EXPECT_TRUE(trace_hash(test_file, &hash, &size));
+  EXPECT_TRUE(trace_hash(test_file, &memoized, &memoized_size));
+  EXPECT_EQ(hash, memoized);
+  EXPECT_EQ(size, memoized_size);
+  EXPECT_EQ(size, read_file(test_file).size());
+  EXPECT_FALSE(trace_hash("/does/not/exist.trace", &hash, &size));
+}
+
 TEST(FrameRetrace, FileTransfer) {
   Socket::Init();
 
@@ -242,13 +301,7 @@ TEST(FrameRetrace, FileTransfer) {
   get_md5(test_file, &md5, &fileSize);
 
   // clear cached file
-  std::stringstream cache_file_s;
-  cache_file_s << glretrace::application_cache_directory();
-  cache_file_s << std::hex;
-  for (auto byte : md5)
-    cache_file_s << static_cast<unsigned int>(byte);
-  cache_file_s << ".trace";
-  const std::string cs = cache_file_s.str();
+  const std::string cs = cache_path(test_file);
   const char *target = cs.c_str();
   remove(target);
   EXPECT_FALSE(exists(target));
@@ -275,3 +328,239 @@ TEST(FrameRetrace, FileTransfer) {
   Socket::Cleanup();
 }
 
+
+TEST(FrameRetrace, FileTransferResume) {
+  Socket::Init();
+
+  FrameRetraceStub stub;
+  FileTransfer frameretrace;
+  ServerSocket server(0);
+  ServerSocket cancel(server.GetPort() + 1);
+  stub.Init("localhost", server.GetPort());
+  UploadSkel skel(server.Accept(), &frameretrace);
+  skel.Start();
+  std::vector<unsigned char> md5;
+  uint32_t fileSize = 0;
+
+  get_md5(test_file, &md5, &fileSize);
+
+  const std::string target = cache_path(test_file);
+  remove(target.c_str());
+
+  // leave the first half of the trace, as an interrupted upload would
+  const std::vector<unsigned char> trace = read_file(test_file);
+  const std::string partial = target + ".part";
+  FILE * fh = fopen(partial.c_str(), "wb");
+  fwrite(trace.data(), 1, trace.size() / 2, fh);
+  fclose(fh);
+
+  FileTransferCB cb;
+  stub.openFile(std::string(test_file), md5,
+                fileSize, 1, 1, &cb);
+  stub.Flush();
+  EXPECT_TRUE(cb.m_needUpload);
+  EXPECT_FALSE(exists(partial.c_str()));
+  EXPECT_EQ(read_file(target), trace);
+  stub.Shutdown();
+  skel.Join();
+  remove(target.c_str());
+
+  Socket::Cleanup();
+}
+
+TEST(FrameRetrace, FileTransferMissingTrace) {
+  Socket::Init();
+
+  FrameRetraceStub stub;
+  FileTransfer frameretrace;
+  ServerSocket server(0);
+  ServerSocket cancel(server.GetPort() + 1);
+  stub.Init("localhost", server.GetPort());
+  UploadSkel skel(server.Accept(), &frameretrace);
+  skel.Start();
+
+  // a trace which cannot be hashed is reported, and not opened
+  FileTransferCB missing;
+  stub.openFile("/does/not/exist.trace", std::vector<unsigned char>(),
+                0, 1, 1, &missing);
+  stub.Flush();
+  EXPECT_EQ(missing.m_errors.size(), 1u);
+  EXPECT_FALSE(missing.m_opened);
+
+  // the stub continues to serve requests
+  std::vector<unsigned char> md5;
+  uint32_t fileSize = 0;
+  get_md5(test_file, &md5, &fileSize);
+  FileTransferCB cb;
+  stub.openFile(std::string(test_file), md5,
+                fileSize, 1, 1, &cb);
+  stub.Flush();
+  EXPECT_TRUE(cb.m_opened);
+  EXPECT_TRUE(cb.m_errors.empty());
+  stub.Shutdown();
+  skel.Join();
+  remove(cache_path(test_file).c_str());
+
+  Socket::Cleanup();
+}
+
+#ifndef WIN32
+class UploadErrorCB : public FileTransferCB {
+ public:
+  void onError(ErrorSeverity s, const std::string &message) {
+    FileTransferCB::onError(s, message);
+    m_error.post();
+  }
+  Semaphore m_error;
+};
+
+TEST(FrameRetrace, FileTransferUnwritable) {
+  Socket::Init();
+
+  FrameRetraceStub stub;
+  FileTransfer frameretrace;
+  ServerSocket server(0);
+  ServerSocket cancel(server.GetPort() + 1);
+  stub.Init("localhost", server.GetPort());
+  UploadSkel skel(server.Accept(), &frameretrace);
+  skel.Start();
+  std::vector<unsigned char> md5;
+  uint32_t fileSize = 0;
+  get_md5(test_file, &md5, &fileSize);
+
+  // a directory in place of the partial upload cannot be opened
+  const std::string target = cache_path(test_file);
+  remove(target.c_str());
+  std::stringstream upload_s;
+  upload_s << target << "." << glretrace::glretrace_pid() << ".part";
+  const std::string upload = upload_s.str();
+  ASSERT_EQ(mkdir(upload.c_str(), 0700), 0);
+
+  // the fatal error stops the stub, so it is not flushed
+  UploadErrorCB cb;
+  stub.openFile(std::string(test_file), md5,
+                fileSize, 1, 1, &cb);
+  cb.m_error.wait();
+  stub.Shutdown();
+  skel.Join();
+  EXPECT_EQ(cb.m_errors.size(), 1u);
+  EXPECT_FALSE(cb.m_opened);
+  EXPECT_FALSE(exists(upload.c_str()));
+  EXPECT_FALSE(exists(target.c_str()));
+  rmdir(upload.c_str());
+
+  Socket::Cleanup();
+}
+#endif  // WIN32
+
+// Blocks the skeleton on an api read, so subsequent metrics reads
+// queue up behind it.
+class QueuedMetrics : public FileTransfer {
+ public:
+  void retraceApi(const RenderSelection &selection,
+                  OnFrameRetrace *callback) {
+    m_entered.post();
+    m_release.wait();
+  }
+  void retraceAllMetrics(const RenderSelection &selection,
+                         ExperimentId experimentCount,
+                         MetricAggregation aggregation,
+                         OnFrameRetrace *callback) const {
+    m_selections.push_back(selection.id.count());
+  }
+  Semaphore m_entered, m_release;
+  mutable std::vector<uint32_t> m_selections;
+};
+
+TEST(FrameRetrace, FrameMetricsNotSuperseded) {
+  Socket::Init();
+
+  FrameRetraceStub stub;
+  QueuedMetrics frameretrace;
+  ServerSocket server(0);
+  ServerSocket cancel(server.GetPort() + 1);
+  stub.Init("localhost", server.GetPort());
+  FrameRetraceSkeleton skel(server.Accept(), NULL, &frameretrace);
+  skel.Start();
+
+  FileTransferCB cb;
+  RenderSelection api_selection;
+  api_selection.id = SelectionId(1);
+  stub.retraceApi(api_selection, &cb);
+  frameretrace.m_entered.wait();
+
+  // the metrics table reads the whole frame, then the selection
+  RenderSelection frame, selection;
+  frame.id = SelectionId(0);
+  selection.id = SelectionId(2);
+  stub.retraceAllMetrics(frame, ExperimentId(1),
+                         glretrace::METRIC_PER_RENDER, &cb);
+  stub.retraceAllMetrics(selection, ExperimentId(1),
+                         glretrace::METRIC_PER_RENDER, &cb);
+  // the skeleton reads both requests ahead, while the api read blocks
+  glretrace::glretrace_delay(200);
+  frameretrace.m_release.post();
+  stub.Flush();
+
+  EXPECT_EQ(frameretrace.m_selections, std::vector<uint32_t>({0, 2}));
+  stub.Shutdown();
+  skel.Join();
+
+  Socket::Cleanup();
+}
+
+class QueuedRenderTargets : public QueuedMetrics {
+ public:
+  void retraceRenderTarget(ExperimentId experimentCount,
+                           const RenderSelection &selection,
+                           RenderTargetType type,
+                           RenderOptions options,
+                           OnFrameRetrace *callback) const {
+    m_types.push_back(type);
+  }
+  mutable std::vector<RenderTargetType> m_types;
+};
+
+TEST(FrameRetrace, RenderTargetsNotSuperseded) {
+  Socket::Init();
+
+  FrameRetraceStub stub;
+  QueuedRenderTargets frameretrace;
+  ServerSocket server(0);
+  ServerSocket cancel(server.GetPort() + 1);
+  stub.Init("localhost", server.GetPort());
+  FrameRetraceSkeleton skel(server.Accept(), NULL, &frameretrace);
+  skel.Start();
+
+  FileTransferCB cb;
+  RenderSelection selection;
+  selection.id = SelectionId(1);
+  stub.retraceApi(selection, &cb);
+  frameretrace.m_entered.wait();
+
+  // the ui requests each type of render target for a selection
+  stub.retraceRenderTarget(ExperimentId(1), selection,
+                           glretrace::NORMAL_RENDER,
+                           glretrace::DEFAULT_RENDER, &cb);
+  stub.retraceRenderTarget(ExperimentId(1), selection,
+                           glretrace::GEOMETRY_RENDER,
+                           (RenderOptions)(glretrace::CLEAR_BEFORE_RENDER |
+                                           glretrace::STOP_AT_RENDER),
+                           &cb);
+  stub.retraceRenderTarget(ExperimentId(1), selection,
+                           glretrace::OVERDRAW_RENDER,
+                           glretrace::DEFAULT_RENDER, &cb);
+  // the skeleton reads the requests ahead, while the api read blocks
+  glretrace::glretrace_delay(200);
+  frameretrace.m_release.post();
+  stub.Flush();
+
+  EXPECT_EQ(frameretrace.m_types,
+            std::vector<RenderTargetType>({glretrace::NORMAL_RENDER,
+                                           glretrace::GEOMETRY_RENDER,
+                                           glretrace::OVERDRAW_RENDER}));
+  stub.Shutdown();
+  skel.Join();
+
+  Socket::Cleanup();
+}
@@ -236,7 +236,7 @@ TEST_F(RetraceTest, AllMetricData) {
   sel.series[1].begin = RenderId(1);
   sel.series[1].end = RenderId(2);
   const ExperimentId experiment(1);
-  rt.retraceAllMetrics(sel, experiment, &cb);
+  rt.retraceAllMetrics(sel, experiment, METRIC_PER_RENDER, &cb);
   EXPECT_EQ(cb.experiment_count.count(), 1);
   EXPECT_EQ(cb.selection_count.count(), 777);
   EXPECT_GT(cb.data.size(), 1);  // one callback for each metric
@@ -247,4 +247,29 @@ TEST_F(RetraceTest, AllMetricData) {
   }
   retrace::cleanUp();
 }
+
+TEST_F(RetraceTest, AggregateMetricData) {
+  GlFunctions::Init();
+  MetricsCallback cb;
+
+  FrameRetrace rt;
+  rt.openFile(test_file, md5, fileSize, 7, 1, &cb);
+  if (!cb.ids.size()) {
+    retrace::cleanUp();
+    return;
+  }
+
+  RenderSelection sel;
+  sel.id = SelectionId(778);
+  sel.push_back(0);
+  sel.push_back(1);
+  const ExperimentId experiment(1);
+  rt.retraceAllMetrics(sel, experiment, METRIC_SUM, &cb);
+  EXPECT_EQ(cb.selection_count.count(), 778);
+  EXPECT_GT(cb.data.size(), 1);
+  // the server reduces each metric to a single value
+  for (const MetricSeries s : cb.data)
+    EXPECT_EQ(s.data.size(), 1);
+  retrace::cleanUp();
+}
 }  // namespace glretrace
@@ -26,17 +26,29 @@
  **************************************************************************/
 
 #include <gtest/gtest.h>
+#include <unistd.h>
 
+#include <sstream>
 #include <string>
 #include <vector>
 
+#include "glframe_logger.hpp"
 #include "glframe_os.hpp"
+#include "glframe_session_server.hpp"
+#include "glframe_shared_ring.hpp"
 #include "glframe_socket.hpp"
 #include "glframe_thread.hpp"
+#include "playback.pb.h" // NOLINT
 
+using glretrace::Logger;
+using glretrace::SessionServer;
+using glretrace::SharedRing;
 using glretrace::Socket;
+using glretrace::SocketPoll;
 using glretrace::ServerSocket;
 using glretrace::Thread;
+using glretrace::application_cache_directory;
+using glretrace::glretrace_pid;
 using glretrace::glretrace_rand;
 
 class TestServer : public Thread {
@@ -89,3 +101,189 @@ TEST(Thread, Socket_Read_Write) {
   Socket::Cleanup();
 }
 
+
+#ifndef WIN32
+
+// writes payloads into a shared ring, passing it to the client
+// through a unix domain socket
+class SharedRingServer : public Thread {
+ public:
+  explicit SharedRingServer(const std::string &path)
+      : Thread("gtest shared ring server"),
+        m_sock(path) {}
+  void Run() {
+    Socket *s = m_sock.Accept();
+    SharedRing *ring = SharedRing::Create(1000);
+    ASSERT_TRUE(ring != NULL);
+    EXPECT_TRUE(s->SendFd(ring->fd()));
+
+    std::vector<uint8_t> payload(600);
+    unsigned int seed = 1;
+    for (auto &byte : payload)
+      byte = glretrace_rand(&seed);
+    uint64_t offset, full_offset;
+    EXPECT_TRUE(ring->Write(payload.data(), payload.size(), &offset));
+    // the first payload has not been released
+    EXPECT_FALSE(ring->Write(payload.data(), payload.size(), &full_offset));
+    s->Write(offset);
+
+    uint8_t released;
+    s->Read(&released);
+    // the second payload does not wrap around the end of the ring
+    EXPECT_TRUE(ring->Write(payload.data(), payload.size(), &offset));
+    EXPECT_EQ(offset, 1000u);
+    s->Write(offset);
+    s->Read(&released);
+    delete ring;
+    delete s;
+  }
+
+ private:
+  ServerSocket m_sock;
+};
+
+// removes the socket path, which a failed test may leave behind
+class SocketPathTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    std::stringstream path_ss;
+    path_ss << application_cache_directory() << "test-" << glretrace_pid()
+            << ".sock";
+    m_path = path_ss.str();
+  }
+  virtual void TearDown() {
+    unlink(m_path.c_str());
+  }
+  std::string m_path;
+};
+
+TEST_F(SocketPathTest, Shared_Ring) {
+  SharedRingServer server(m_path);
+  server.Start();
+
+  Socket s(m_path);
+  SharedRing *ring = SharedRing::Map(s.ReceiveFd());
+  ASSERT_TRUE(ring != NULL);
+
+  std::vector<uint8_t> expected(600);
+  unsigned int seed = 1;
+  for (auto &byte : expected)
+    byte = glretrace_rand(&seed);
+
+  for (int i = 0; i < 2; ++i) {
+    uint64_t offset;
+    s.Read(&offset);
+    std::vector<uint8_t> payload(ring->Data(offset),
+                                 ring->Data(offset) + expected.size());
+    EXPECT_EQ(payload, expected);
+    ring->Release(offset + expected.size());
+    s.Write(static_cast<uint8_t>(1));
+  }
+  server.Join();
+  delete ring;
+}
+
+// Accepts sessions in place of the server.  Each worker echoes a
+// token from its retrace socket on its cancellation socket, so that
+// clients can check how their sockets were paired.
+class SessionSupervisor : public Thread {
+ public:
+  SessionSupervisor(SessionServer *server, int sessions)
+      : Thread("gtest session supervisor"),
+        m_server(server),
+        m_sessions(sessions) {}
+  void Run() {
+    Socket *sock, *cancel_sock;
+    for (int i = 0; i < m_sessions; ++i) {
+      if (!m_server->AcceptSession(&sock, &cancel_sock))
+        continue;
+      // worker process
+      uint64_t token = 0;
+      sock->Read(&token);
+      cancel_sock->Write(token);
+      _exit(0);
+    }
+  }
+
+ private:
+  SessionServer *m_server;
+  const int m_sessions;
+};
+
+// true if the socket has data within a few seconds
+bool
+readable(const Socket &s) {
+  SocketPoll poll;
+  poll.Add(s);
+  return poll.Wait(5000);
+}
+
+void
+send_session_key(Socket *s, uint64_t session) {
+  ApiTrace::RetraceRequest request;
+  request.set_requesttype(ApiTrace::PROTOCOL_VERSION_REQUEST);
+  request.mutable_protocol_version()->set_version(ApiTrace::PROTOCOL_VERSION);
+  request.mutable_protocol_version()->set_session(session);
+  std::vector<unsigned char> buf;
+  s->WriteMessage(request, &buf);
+}
+
+void
+send_cancel_key(Socket *s, uint64_t session) {
+  ApiTrace::CancellationEvent e;
+  e.set_selection_count(0);
+  e.set_experiment_count(0);
+  e.set_session(session);
+  std::vector<unsigned char> buf;
+  s->WriteMessage(e, &buf);
+}
+
+// reads the handshake response, and checks that the worker for the
+// session owns both sockets
+void
+check_session(Socket *s, Socket *cancel_sock, uint64_t token) {
+  ASSERT_TRUE(readable(*s));
+  uint32_t len;
+  ASSERT_TRUE(s->Read(&len));
+  std::vector<unsigned char> response(len);
+  ASSERT_TRUE(s->ReadVec(&response));
+  s->Write(token);
+  ASSERT_TRUE(readable(*cancel_sock));
+  uint64_t echoed = 0;
+  ASSERT_TRUE(cancel_sock->Read(&echoed));
+  EXPECT_EQ(echoed, token);
+}
+
+TEST(Thread, SessionPairing) {
+  // the supervisor logs without a logging thread
+  Logger::Create();
+  int port;
+  {
+    ServerSocket probe(0);
+    port = probe.GetPort();
+  }
+  SessionServer server(port, 0);
+  SessionSupervisor supervisor(&server, 2);
+  supervisor.Start();
+
+  // the first client stalls before sending its session key, while
+  // the second client connects both of its sockets
+  Socket first("localhost", port);
+  Socket second("localhost", port);
+  send_session_key(&second, 2);
+  Socket second_cancel("localhost", port + 1);
+  send_cancel_key(&second_cancel, 2);
+  check_session(&second, &second_cancel, 22);
+
+  // the first client connects its cancellation socket before it
+  // sends its retrace key
+  Socket first_cancel("localhost", port + 1);
+  send_cancel_key(&first_cancel, 1);
+  send_session_key(&first, 1);
+  check_session(&first, &first_cancel, 11);
+
+  supervisor.Join();
+  Logger::Destroy();
+}
+
+#endif  // WIN32
@@ -40,6 +40,7 @@
 
 using glretrace::ExperimentId;
 using glretrace::IFrameRetrace;
+using glretrace::METRIC_SUM;
 using glretrace::MetricId;
 using glretrace::MetricSeries;
 using glretrace::QMetricValue;
@@ -47,12 +48,13 @@ using glretrace::QMetricsModel;
 using glretrace::QSelection;
 using glretrace::SelectionId;
 
-QMetricValue::QMetricValue() : m_name(""), m_frame_value(0), m_value(0) {
+QMetricValue::QMetricValue() : m_name(""), m_frame_value(0), m_value(0),
+                               m_confidence(0) {
   assert(false);
 }
 
 QMetricValue::QMetricValue(QObject *p)
-    : m_name(""), m_frame_value(0), m_value(0) {
+    : m_name(""), m_frame_value(0), m_value(0), m_confidence(0) {
   moveToThread(p->thread());
 }
 
@@ -80,6 +82,12 @@ QMetricValue::setFrameValue(float v) {
   emit onFrameValue();
 }
 
+void
+QMetricValue::setConfidence(float c) {
+  m_confidence = c;
+  emit onConfidence();
+}
+
 QMetricsModel::QMetricsModel()
     : m_retrace(NULL), m_current_selection_count(SelectionId(0)),
       m_experiment_count(ExperimentId(0)) {
@@ -106,7 +114,7 @@ QMetricsModel::init(IFrameRetrace *r,
   // request frame and initial metrics
   s.id = m_current_selection_count;
   s.series.push_back(RenderSequence(RenderId(0), RenderId(render_count)));
-  m_retrace->retraceAllMetrics(s, m_experiment_count, this);
+  m_retrace->retraceAllMetrics(s, m_experiment_count, METRIC_SUM, this);
   emit metricTableChanged();
 }
 
@@ -133,10 +141,19 @@ QMetricsModel::onMetrics(const MetricSeries &metricData,
   float value = 0;
   for (auto v : metricData.data)
     value += v;
-  if (selectionCount == SelectionId(0))
+  if (selectionCount == SelectionId(0)) {
     m_metrics[metricData.metric]->setFrameValue(value);
-  else
-    m_metrics[metricData.metric]->setValue(value);
+    return;
+  }
+  m_metrics[metricData.metric]->setValue(value);
+
+  // variance of the sum of the per-render medians, which is empty
+  // unless the metric was sampled repeatedly
+  float variance = 0;
+  for (size_t i = 0; i < metricData.variance.size(); ++i)
+    if (metricData.samples[i])
+      variance += metricData.variance[i] / metricData.samples[i];
+  m_metrics[metricData.metric]->setConfidence(1.96 * sqrt(variance));
 }
 
 void
@@ -146,13 +163,16 @@ QMetricsModel::onSelect(SelectionId id, QList<int> selection) {
   m_current_selection_count = id;
   m_render_selection.clear();
   if (selection.empty()) {
-    for (auto m : m_metric_list)
+    for (auto m : m_metric_list) {
       m->setValue(0.0);
+      m->setConfidence(0.0);
+    }
     return;
   }
   renderSelectionFromList(m_current_selection_count, selection,
                           &m_render_selection);
-  m_retrace->retraceAllMetrics(m_render_selection, m_experiment_count, this);
+  m_retrace->retraceAllMetrics(m_render_selection, m_experiment_count,
+                               METRIC_SUM, this);
 }
 
 void
@@ -166,12 +186,12 @@ QMetricsModel::refresh() {
   RenderSelection s;
   s.id = SelectionId(0);
   s.series.push_back(RenderSequence(RenderId(0), RenderId(m_render_count)));
-  m_retrace->retraceAllMetrics(s, m_experiment_count, this);
+  m_retrace->retraceAllMetrics(s, m_experiment_count, METRIC_SUM, this);
 
   // retrace the metrics for the current selection
   if (!m_render_selection.series.empty())
     m_retrace->retraceAllMetrics(m_render_selection,
-                                 m_experiment_count, this);
+                                 m_experiment_count, METRIC_SUM, this);
 }
 
 QMetricsModel::~QMetricsModel() {
@@ -235,6 +255,14 @@ QMetricValue::value() const {
   return QLocale().toString(m_value, 'f', precision);
 }
 
+QString
+QMetricValue::confidence() const {
+  if (m_confidence == 0.0)
+    return QString();
+  return QString::fromUtf8("\u00b1 ") +
+      QLocale().toString(m_confidence, 'f', 4);
+}
+
 QString
 QMetricValue::frameValue() const {
   int precision = 4;
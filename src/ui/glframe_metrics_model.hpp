@@ -49,6 +49,7 @@ class QMetricValue : public QObject,
   Q_PROPERTY(QString description READ description NOTIFY onDescription)
   Q_PROPERTY(QString value READ value NOTIFY onValue)
   Q_PROPERTY(QString frameValue READ frameValue NOTIFY onFrameValue)
+  Q_PROPERTY(QString confidence READ confidence NOTIFY onConfidence)
 
  public:
   QMetricValue();
@@ -57,20 +58,24 @@ class QMetricValue : public QObject,
   void setDescription(const std::string &d);
   void setValue(float v);
   void setFrameValue(float v);
+  // half width of the 95% confidence interval of the selection value
+  void setConfidence(float c);
   QString name() const { return m_name; }
   QString description() const { return m_description; }
   QString value() const;
   QString frameValue() const;
+  QString confidence() const;
   float value_f() const { return m_value; }
   float frameValue_f() const { return m_frame_value; }
  signals:
   void onValue();
   void onFrameValue();
+  void onConfidence();
   void onName();
   void onDescription();
  private:
   QString m_name, m_description;
-  float m_frame_value, m_value;
+  float m_frame_value, m_value, m_confidence;
 };
 
 class QMetricsModel : public QObject, OnFrameRetrace,
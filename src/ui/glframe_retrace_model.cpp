@@ -30,6 +30,8 @@
 #include <QtConcurrentRun>
 #include <QFileInfo>
 
+#include <stdio.h>
+
 #include <sstream>
 #include <string>
 #include <vector>
@@ -49,6 +51,7 @@ using glretrace::ERR;
 using glretrace::ErrorSeverity;
 using glretrace::ExperimentId;
 using glretrace::FrameRetraceModel;
+using glretrace::FrameRetraceStub;
 using glretrace::FrameState;
 using glretrace::MetricId;
 using glretrace::MetricSeries;
@@ -68,6 +71,11 @@ using glretrace::TextureKey;
 using glretrace::UniformDimension;
 using glretrace::UniformType;
 
+// measured replays for each metrics request.  Additional repetitions
+// let the metrics table show the confidence of each value, at the
+// cost of slower metrics.
+static const uint32_t kMetricRepetitions = 1;
+
 FrameRetraceModel::FrameRetraceModel()
     : m_experiment(&m_retrace),
       m_rendertarget(new QRenderTargetModel(this)),
@@ -80,6 +88,7 @@ FrameRetraceModel::FrameRetraceModel()
       m_experiment_count(0),
       m_open_percent(0),
       m_frame_count(0),
+      m_metric_repetitions(kMetricRepetitions),
       m_max_metric(0),
       m_severity(Warning) {
   m_metrics_model.push_back(new QMetric(MetricId(0), "No metric"));
@@ -96,6 +105,11 @@ FrameRetraceModel::~FrameRetraceModel() {
     m_state = NULL;
   }
   m_retrace.Shutdown();
+  if (!m_server_path.empty()) {
+    // left behind by a server which did not exit cleanly
+    remove(m_server_path.c_str());
+    remove((m_server_path + ".cancel").c_str());
+  }
   delete m_rendertarget;
   delete m_uniforms;
   delete m_stateModel;
@@ -116,8 +130,10 @@ bool file_exists(const char *fileName) {
   return infile.good();
 }
 
+// path is the unix domain socket of a server on the same host, or
+// empty to serve on port
 void
-exec_retracer(const char *main_exe, int port) {
+exec_retracer(const char *main_exe, int port, const std::string &path) {
   // frameretrace_server should be at the same path as frameretrace
   std::string server_exe(main_exe);
 
@@ -157,12 +173,36 @@ exec_retracer(const char *main_exe, int port) {
                               "-p",
                               port_str.c_str(),
                               NULL};
-  glretrace::fork_execv(server_exe.c_str(), args);
+  const char *const local_args[] = {server_exe.c_str(),
+                                    "-u",
+                                    path.c_str(),
+                                    NULL};
+  glretrace::fork_execv(server_exe.c_str(),
+                        path.empty() ? args : local_args);
 
   // delay necessary for windows systems
   glretrace::glretrace_delay(1000);
 }
 
+// A server on the same host is reached through a unix domain socket,
+// which allows it to pass images in shared memory.  Empty where unix
+// domain sockets are not supported.
+std::string
+local_server_path() {
+#ifdef WIN32
+  return "";
+#else
+  std::stringstream path_ss;
+  path_ss << glretrace::application_cache_directory() << "server-"
+          << glretrace::glretrace_pid() << ".sock";
+  // the limit on the length of sockaddr_un::sun_path
+  static const size_t kMaxSocketPath = 107;
+  if (path_ss.str().size() > kMaxSocketPath)
+    return "";
+  return path_ss.str();
+#endif
+}
+
 bool
 FrameRetraceModel::setFrame(const QString &filename, const QString &framenumber,
                             const QString &host) {
@@ -202,21 +242,33 @@ FrameRetraceModel::setFrame(const QString &filename, const QString &framenumber,
                              m_target_frame_number,
                              framecount);
   m_state = future.result();
+  // images from a server on the same host are passed through shared
+  // memory
+  const std::string path = (host == "localhost") ? local_server_path() : "";
+  m_server_path = path;
   if (host == "localhost") {
     {
       ServerSocket sock(0);
       port = sock.GetPort();
     }
-    GRLOGF(glretrace::WARN, "using port: %d", port);
-    exec_retracer(main_exe.toStdString().c_str(), port);
+    if (path.empty()) {
+      GRLOGF(glretrace::WARN, "using port: %d", port);
+    } else {
+      GRLOGF(glretrace::WARN, "using socket: %s", path.c_str());
+    }
+    exec_retracer(main_exe.toStdString().c_str(), port, path);
   }
 
-  m_retrace.Init(host.toStdString().c_str(), port);
+  if (path.empty())
+    m_retrace.Init(host.toStdString().c_str(), port);
+  else
+    m_retrace.InitLocal(path);
 
-  // let the stub calculate the md5 off-thread.  Doing it here
+  // let the stub hash the trace off-thread.  Doing it here
   // conforms better to the interfaces, but blocks the UI.
   m_retrace.openFile(filename.toStdString(), md5, 0,
                      m_target_frame_number, framecount, this);
+  m_retrace.setMetricRepetitions(metricRepetitions());
 
   glretrace::renderSelectionFromList(m_selection_count,
                                      m_cached_selection,
@@ -315,33 +367,19 @@ FrameRetraceModel::retraceRendertarget() {
 }
 
 void
-FrameRetraceModel::retrace_shader_assemblies() {
-  if (m_cached_selection.empty())
-    return;
-
-  RenderSelection rs;
-  glretrace::renderSelectionFromList(m_selection_count,
-                                     m_cached_selection,
-                                     &rs);
-  m_retrace.retraceShaderAssembly(rs, m_experiment_count, this);
-}
-
-void
-FrameRetraceModel::retrace_api() {
-  RenderSelection sel;
-  glretrace::renderSelectionFromList(m_selection_count,
-                                     m_cached_selection,
-                                     &sel);
-  m_retrace.retraceApi(sel, this);
-}
-
-void
-FrameRetraceModel::retrace_batch() {
+FrameRetraceModel::retrace_views(uint32_t views) {
   RenderSelection sel;
   glretrace::renderSelectionFromList(m_selection_count,
                                      m_cached_selection,
                                      &sel);
-  m_retrace.retraceBatch(sel, m_experiment_count, this);
+  if (m_cached_selection.empty())
+    views &= ~glretrace::SHADER_ASSEMBLY_VIEW;
+  if (views & glretrace::UNIFORM_VIEW)
+    m_uniforms->clear();
+  if (views & glretrace::STATE_VIEW)
+    m_stateModel->clear();
+  // a single replay serves all of the views
+  m_retrace.retraceViews(sel, m_experiment_count, views, this);
 }
 
 void
@@ -505,39 +543,36 @@ FrameRetraceModel::onSelect(SelectionId id, QList<int> selection) {
   m_cached_selection = selection;
   m_selection_count = id;
 
+  // the shader, api, batch, uniform and state tabs are refreshed by
+  // a single request
+  const uint32_t views = (glretrace::SHADER_ASSEMBLY_VIEW |
+                          glretrace::API_VIEW |
+                          glretrace::BATCH_VIEW |
+                          glretrace::UNIFORM_VIEW |
+                          glretrace::STATE_VIEW);
+  const bool fused_tab = (m_current_tab == kShaders ||
+                          m_current_tab == kApiCalls ||
+                          m_current_tab == kBatch ||
+                          m_current_tab == kUniforms ||
+                          m_current_tab == kState);
+
   // refresh currently visible tab
+  if (fused_tab)
+    retrace_views(views);
   if (m_current_tab == kRenderTarget)
     retraceRendertarget();
-  if (m_current_tab == kShaders)
-    retrace_shader_assemblies();
-  if (m_current_tab == kApiCalls)
-    retrace_api();
-  if (m_current_tab == kBatch)
-    retrace_batch();
-  if (m_current_tab == kUniforms)
-    retrace_uniforms();
   if (m_current_tab == kMetrics)
     m_metrics_table.onSelect(id, selection);
-  if (m_current_tab == kState)
-    retrace_state();
   if (m_current_tab == kTextures)
     retrace_textures();
 
   // refresh other tabs
+  if (!fused_tab)
+    retrace_views(views);
   if (m_current_tab != kRenderTarget)
     retraceRendertarget();
-  if (m_current_tab != kShaders)
-    retrace_shader_assemblies();
-  if (m_current_tab != kApiCalls)
-    retrace_api();
-  if (m_current_tab != kBatch)
-    retrace_batch();
-  if (m_current_tab != kUniforms)
-    retrace_uniforms();
   if (m_current_tab != kMetrics)
     m_metrics_table.onSelect(id, selection);
-  if (m_current_tab != kState)
-    retrace_state();
   if (m_current_tab != kTextures)
     retrace_textures();
 }
@@ -555,6 +590,28 @@ FrameRetraceModel::refreshBarMetrics() {
                            this);
 }
 
+int
+FrameRetraceModel::metricRepetitions() const {
+  ScopedLock s(m_protect);
+  return m_metric_repetitions;
+}
+
+void
+FrameRetraceModel::setMetricRepetitions(int repetitions) {
+  if (repetitions < 1)
+    repetitions = 1;
+  {
+    ScopedLock s(m_protect);
+    if (m_metric_repetitions == static_cast<uint32_t>(repetitions))
+      return;
+    m_metric_repetitions = repetitions;
+  }
+  emit onMetricRepetitions();
+  // the retracer is connected when a frame is opened
+  if (m_state)
+    m_retrace.setMetricRepetitions(repetitions);
+}
+
 void
 FrameRetraceModel::refreshMetrics() {
   // "Refresh" button invoke this.
@@ -646,35 +703,34 @@ FrameRetraceModel::onExperiment(ExperimentId experiment_count) {
 
   refreshBarMetrics();
 
+  // the shader, batch, uniform and state tabs are refreshed by a
+  // single request
+  const uint32_t views = (glretrace::SHADER_ASSEMBLY_VIEW |
+                          glretrace::BATCH_VIEW |
+                          glretrace::UNIFORM_VIEW |
+                          glretrace::STATE_VIEW);
+  const bool fused_tab = (m_current_tab == kShaders ||
+                          m_current_tab == kBatch ||
+                          m_current_tab == kUniforms ||
+                          m_current_tab == kState);
+
   // refresh the currently shown tab
+  if (fused_tab)
+    retrace_views(views);
   if (m_current_tab == kRenderTarget)
     retraceRendertarget();
-  if (m_current_tab == kShaders)
-    retrace_shader_assemblies();
-  if (m_current_tab == kBatch)
-    retrace_batch();
-  if (m_current_tab == kUniforms)
-    retrace_uniforms();
   if (m_current_tab == kMetrics)
     m_metrics_table.onExperiment(experiment_count);
-  if (m_current_tab == kState)
-    retrace_state();
   if (m_current_tab == kTextures)
     retrace_textures();
 
   // refresh the rest of the tabs
+  if (!fused_tab)
+    retrace_views(views);
   if (m_current_tab != kRenderTarget)
     retraceRendertarget();
-  if (m_current_tab != kShaders)
-    retrace_shader_assemblies();
-  if (m_current_tab != kBatch)
-    retrace_batch();
-  if (m_current_tab != kUniforms)
-    retrace_uniforms();
   if (m_current_tab != kMetrics)
     m_metrics_table.onExperiment(experiment_count);
-  if (m_current_tab != kState)
-    retrace_state();
   if (m_current_tab != kTextures)
     retrace_textures();
 }
@@ -691,19 +747,41 @@ FrameRetraceModel::onUniform(SelectionId selectionCount,
                         name, type, dimension, data);
 }
 
-void
-FrameRetraceModel::retrace_uniforms() {
-  RenderSelection sel;
-  glretrace::renderSelectionFromList(m_selection_count,
-                                     m_cached_selection,
-                                     &sel);
-  m_uniforms->clear();
-  m_retrace.retraceUniform(sel, m_experiment_count, this);
-}
-
 void
 FrameRetraceModel::setTab(const int index) {
   m_current_tab = static_cast<TabIndex>(index);
+
+  // requests for the visible tab are sent to the retracer first
+  uint32_t views = 0;
+  switch (m_current_tab) {
+    case kShaders:
+      views = glretrace::SHADER_ASSEMBLY_VIEW;
+      break;
+    case kRenderTarget:
+      views = FrameRetraceStub::RENDER_TARGET_VIEW;
+      break;
+    case kApiCalls:
+      views = glretrace::API_VIEW;
+      break;
+    case kBatch:
+      views = glretrace::BATCH_VIEW;
+      break;
+    case kMetrics:
+      views = FrameRetraceStub::METRICS_VIEW;
+      break;
+    case kExperiments:
+      break;
+    case kUniforms:
+      views = glretrace::UNIFORM_VIEW;
+      break;
+    case kState:
+      views = glretrace::STATE_VIEW;
+      break;
+    case kTextures:
+      views = glretrace::TEXTURE_VIEW;
+      break;
+  }
+  m_retrace.setVisibleViews(views);
 }
 
 
@@ -717,16 +795,6 @@ FrameRetraceModel::onState(SelectionId selectionCount,
                         renderId, item, value);
 }
 
-void
-FrameRetraceModel::retrace_state() {
-  RenderSelection sel;
-  glretrace::renderSelectionFromList(m_selection_count,
-                                     m_cached_selection,
-                                     &sel);
-  m_stateModel->clear();
-  m_retrace.retraceState(sel, m_experiment_count, this);
-}
-
 void
 FrameRetraceModel::retrace_textures() {
   m_textureModel->retraceTextures(&m_retrace,
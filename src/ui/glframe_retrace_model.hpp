@@ -130,6 +130,8 @@ class FrameRetraceModel : public QObject,
   Q_PROPERTY(QString argvZero READ argvZero WRITE setArgvZero
              NOTIFY onArgvZero)
   Q_PROPERTY(glretrace::QMetricsModel* metricTab READ metricTab CONSTANT)
+  Q_PROPERTY(int metricRepetitions READ metricRepetitions
+             WRITE setMetricRepetitions NOTIFY onMetricRepetitions)
   Q_PROPERTY(QString generalError READ generalError
              NOTIFY onGeneralError)
   Q_PROPERTY(QString generalErrorDetails READ generalErrorDetails
@@ -243,6 +245,8 @@ class FrameRetraceModel : public QObject,
   QString argvZero() { return main_exe; }
   void setArgvZero(const QString &a) { main_exe = a; emit onArgvZero(); }
   QMetricsModel *metricTab() { return &m_metrics_table; }
+  int metricRepetitions() const;
+  void setMetricRepetitions(int repetitions);
   QString generalError() { return m_general_error; }
   QString generalErrorDetails() { return m_general_error_details; }
 
@@ -265,6 +269,7 @@ class FrameRetraceModel : public QObject,
   void onFrameCount();
   void onMaxMetric();
   void onArgvZero();
+  void onMetricRepetitions();
   void onGeneralError();
   void onOpenError();
 
@@ -272,11 +277,7 @@ class FrameRetraceModel : public QObject,
   // thread.  The handler generates QObjects which are passed to qml
   void updateMetricList();
  private:
-  void retrace_shader_assemblies();
-  void retrace_api();
-  void retrace_batch();
-  void retrace_uniforms();
-  void retrace_state();
+  void retrace_views(uint32_t views);
   void retrace_textures();
   void refreshBarMetrics();
 
@@ -315,8 +316,12 @@ class FrameRetraceModel : public QObject,
 
   QRenderShadersList m_shaders;
   QString main_exe;  // for path to frameretrace_server
+  // unix domain socket of a local server.  Empty for tcp servers.
+  std::string m_server_path;
 
   int m_target_frame_number, m_open_percent, m_frame_count;
+  // measured replays for each metrics request
+  uint32_t m_metric_repetitions;
 
   // thread-safe storage for member data updated from the retrace
   // socket thread.
@@ -25,6 +25,12 @@ Item {
                 width: 100
                 horizontalAlignment: Text.AlignRight
             }
+            TableViewColumn {
+                role: "confidence"
+                title: "95% Confidence"
+                width: 120
+                horizontalAlignment: Text.AlignRight
+            }
             TableViewColumn {
                 role: "frameValue"
                 title: "Frame"
@@ -61,5 +61,23 @@ Item {
                 metricsModel.refreshMetrics();
             }
         }
+        Text {
+            id: repetitionsText
+            anchors.left: refreshButton.right
+            anchors.leftMargin: 25
+            anchors.top: parent.top
+            anchors.topMargin: 5
+            text: "Repetitions:"
+        }
+        SpinBox {
+            anchors.left: repetitionsText.right
+            anchors.leftMargin: 10
+            minimumValue: 1
+            maximumValue: 20
+            value: metricsModel.metricRepetitions
+            onValueChanged: {
+                metricsModel.metricRepetitions = value;
+            }
+        }
     }
 }